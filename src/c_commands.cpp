@@ -15,6 +15,9 @@
 //     Console command.
 //
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include <unordered_map>
 
 #include "c_commands.h"
@@ -23,6 +26,9 @@
 #include "doomtype.h"
 #include "i_system.h"
 #include "m_config.h"
+#include "net_client.h"
+#include "z_stats.h"
+#include "z_zone.h"
 
 namespace theta
 {
@@ -79,6 +85,102 @@ static void CmdSet(CommandArguments args)
     }
 }
 
+static void PrintZoneStat(const char* name, const zonestat_t& stat)
+{
+    console::printf("%-24s %7d %10lu %10lu %8.1f %10.0f\n", name,
+                    stat.blocks, static_cast<unsigned long>(stat.bytes),
+                    static_cast<unsigned long>(stat.peak),
+                    stat.alloc_rate, stat.byte_rate);
+}
+
+// Command to show zone memory statistics
+static void CmdZone(CommandArguments args)
+{
+    std::string mode = args.size() > 1 ? args.at(1) : "tags";
+
+    if (mode == "tags")
+    {
+        console::printf("%-24s %7s %10s %10s %8s %10s\n", "tag", "blocks",
+                        "bytes", "peak", "allocs/t", "bytes/t");
+        for (int i = PU_STATIC;i < PU_NUM_TAGS;i++)
+        {
+            if (i != PU_FREE)
+            {
+                PrintZoneStat(Z_TagName(i), Z_TagStats(i));
+            }
+        }
+    }
+    else if (mode == "sites")
+    {
+        size_t count = args.size() > 2 ? atoi(args.at(2).c_str()) : 20;
+        std::vector<zonesite_t> sites = Z_SiteStats();
+
+        console::printf("%-24s %7s %10s %10s %8s %10s\n", "site", "blocks",
+                        "bytes", "peak", "allocs/t", "bytes/t");
+        for (size_t i = 0;i < sites.size() && i < count;i++)
+        {
+            std::string name = sites[i].file;
+            size_t slash = name.find_last_of("/\\");
+            if (slash != std::string::npos)
+            {
+                name.erase(0, slash + 1);
+            }
+            name += ":" + std::to_string(sites[i].line);
+
+            PrintZoneStat(name.c_str(), sites[i].stat);
+        }
+    }
+    else if (mode == "json" && args.size() > 2)
+    {
+        FILE* f = fopen(args.at(2).c_str(), "w");
+        if (f == NULL)
+        {
+            console::printf("zone: couldn't open %s\n", args.at(2).c_str());
+            return;
+        }
+
+        Z_WriteStatsJSON(f);
+        fclose(f);
+        console::printf("zone: wrote %s\n", args.at(2).c_str());
+    }
+    else if (mode == "reset")
+    {
+        Z_StatsResetPeaks();
+    }
+    else
+    {
+        console::printf("zone [tags | sites [count] | json <file> | reset]\n");
+    }
+}
+
+// Command to show how the link to the netgame server is doing
+static void CmdNet(CommandArguments args)
+{
+    net_linkstats_t link;
+    int extratics;
+
+    if (!NET_CL_GetLinkStats(&link, &extratics))
+    {
+        console::printf("net: not in a netgame\n");
+        return;
+    }
+
+    if (link.rtt < 0)
+    {
+        console::printf("round trip: not measured yet\n");
+    }
+    else
+    {
+        console::printf("round trip: %d ms, jitter %d ms\n",
+                        link.rtt, link.rttvar);
+    }
+
+    console::printf("loss: %.1f%% (%u of %u tics in all)\n",
+                    link.loss * 100, link.lost_tics, link.tics);
+    console::printf("resend timeout: %d ms, extra tics: %d\n",
+                    NET_Link_ResendTimeout(&link), extratics);
+}
+
 // Get the global commands instance.
 Commands& Commands::Instance()
 {
@@ -90,7 +192,9 @@ Commands& Commands::Instance()
 Commands::Commands() : command_map({
     { "error", CmdError },
     { "get", CmdGet },
-    { "set", CmdSet }
+    { "net", CmdNet },
+    { "set", CmdSet },
+    { "zone", CmdZone }
 }) { }
 
 // Add a new command to the console.
@@ -37,6 +37,9 @@
 #include "net_sdl.h"
 #include "net_loop.h"
 
+#include "sha1.h"
+#include "z_stats.h"
+
 // TODO: Move nonvanilla demo functions into a dedicated file.
 #include "m_misc.h"
 #include "w_wad.h"
@@ -123,6 +126,48 @@ static boolean local_playeringame[NET_MAXPLAYERS];
 
 static int player_class;
 
+// Whether to run the netgame ahead of the server, and whether the game
+// is running ahead right now.  While it is, these are the gametic it
+// has to go back to and what had been received and made by then.
+
+static boolean predict = false;
+static boolean predicting = false;
+static int predict_gametic;
+static int predict_recvtic;
+static int predict_maketic;
+
+// When checking prediction, tics count as confirmed only this many
+// tics after they are made, as though the server were far away, so
+// that the game is always running ahead.
+
+#define PREDICTCHECK_LAG 3
+
+static int predict_lag = 0;
+
+// Whether this is the host of the netgame, running the server
+// alongside the game.
+
+static boolean hosting = false;
+
+// With -authoritative, the host takes a snapshot of the game every
+// second and sends it out.  Everyone else keeps a hash of their own
+// game at the same tics to check the host's against, and once they
+// have had one, the number of the last they checked.
+
+#define SNAPSHOT_INTERVAL 35
+#define SNAPSHOT_HASHES 8
+
+typedef struct
+{
+    int tic;
+    sha1_digest_t digest;
+} snapshot_hash_t;
+
+static boolean snapshot_host = false;
+static boolean snapshot_sync = false;
+static unsigned int snapshot_checked;
+static snapshot_hash_t snapshot_hashes[SNAPSHOT_HASHES];
+
 
 // 35 fps clock adjusted by offsetms milliseconds
 
@@ -148,7 +193,13 @@ static boolean BuildNewTic(void)
     int	gameticdiv;
     ticcmd_t cmd;
 
-    gameticdiv = gametic/ticdup;
+    // Don't let a prediction on screen count towards how far ahead
+    // we are.
+
+    if (predicting)
+        gameticdiv = predict_gametic/ticdup;
+    else
+        gameticdiv = gametic/ticdup;
 
     I_StartTic ();
     loop_interface->ProcessEvents();
@@ -337,6 +388,31 @@ static void BlockUntilStart(net_gamesettings_t *settings,
     }
 }
 
+// Launch the game once enough players have joined.  Only the
+// controller (the first to join) can launch it.
+
+static void AutoLaunch(int nodes)
+{
+    while (!net_client_received_wait_data
+        || net_client_wait_data.num_players < nodes)
+    {
+        NET_CL_Run();
+        NET_SV_Run();
+
+        if (!net_client_connected)
+        {
+            I_Error("Lost connection to server");
+        }
+
+        I_Sleep(100);
+    }
+
+    if (net_client_wait_data.is_controller)
+    {
+        NET_CL_LaunchGame();
+    }
+}
+
 void D_StartNetGame(net_gamesettings_t *settings,
                     netgame_startup_callback_t callback)
 {
@@ -430,6 +506,46 @@ void D_StartNetGame(net_gamesettings_t *settings,
     ticdup = settings->ticdup;
     new_sync = settings->new_sync;
 
+    //!
+    // @category net
+    //
+    // Don't wait for the other players' input before running the
+    // game: guess that they carry on doing what they did last, and
+    // put the game right once their real input arrives.  Makes the
+    // game react to your own input straight away.
+    //
+
+    predict = (M_ParmExists("-predict") || M_ParmExists("-predictcheck"))
+           && net_client_connected && !drone
+           && loop_interface != NULL
+           && loop_interface->SavePrediction != NULL;
+
+    if (predict && M_ParmExists("-predictcheck"))
+    {
+        predict_lag = PREDICTCHECK_LAG;
+    }
+
+    //!
+    // @category net
+    //
+    // When hosting a netgame, send the other players a snapshot of
+    // the game every second.  Anyone whose game has drifted from the
+    // host's takes on the host's, rather than the game stopping with a
+    // consistency failure.
+    //
+
+    snapshot_host = M_ParmExists("-authoritative") && hosting
+                 && net_client_connected && !drone
+                 && loop_interface != NULL
+                 && loop_interface->SaveSnapshot != NULL;
+    snapshot_sync = false;
+    snapshot_checked = 0;
+
+    for (i = 0; i < SNAPSHOT_HASHES; ++i)
+    {
+        snapshot_hashes[i].tic = -1;
+    }
+
     // TODO: Message disabled until we fix new_sync.
     //if (!new_sync)
     //{
@@ -463,6 +579,8 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
         NET_SV_AddModule(&net_sdl_module);
         NET_SV_RegisterWithMaster();
 
+        hosting = true;
+
         net_loop_client_module.InitClient();
         addr = net_loop_client_module.ResolveAddress(NULL);
     }
@@ -529,6 +647,21 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
         // [AM] Not implemented
         //NET_WaitForLaunch();
 
+        //!
+        // @category net
+        // @arg <n>
+        //
+        // Autostart the netgame when n nodes (clients) have joined the
+        // server.
+        //
+
+        i = M_CheckParmWithArgs("-nodes", 1);
+
+        if (i > 0)
+        {
+            AutoLaunch(atoi(myargv[i+1]));
+        }
+
         result = true;
     }
 
@@ -559,6 +692,19 @@ static int GetLowTic(void)
         {
             lowtic = recvtic;
         }
+
+        // Hold back tics that the server has confirmed, but never
+        // ones that have already been run.
+
+        if (predict_lag > 0 && lowtic > maketic - predict_lag)
+        {
+            lowtic = maketic - predict_lag;
+
+            if (lowtic < gametic / ticdup)
+            {
+                lowtic = gametic / ticdup;
+            }
+        }
     }
 
     return lowtic;
@@ -679,6 +825,178 @@ static void SinglePlayerClear(ticcmd_set_t *set)
     }
 }
 
+// Run the tics that have been made but not yet confirmed by the
+// server, guessing that the other players keep doing what they did in
+// the last confirmed tic.
+
+static void RunPrediction(void)
+{
+    ticcmd_set_t set;
+    boolean keepgoing;
+    int firsttic;
+    int t;
+    int i;
+
+    firsttic = gametic / ticdup;
+
+    if (!predict || singletics || !net_client_connected
+     || firsttic < 1 || firsttic >= maketic)
+    {
+        return;
+    }
+
+    if (!loop_interface->SavePrediction())
+    {
+        return;
+    }
+
+    predicting = true;
+    predict_gametic = gametic;
+    predict_recvtic = recvtic;
+    predict_maketic = maketic;
+
+    set = ticdata[(firsttic - 1) % BACKUPTICS];
+
+    for (t = firsttic; t < maketic; ++t)
+    {
+        set.cmds[localplayer] = ticdata[t % BACKUPTICS].cmds[localplayer];
+
+        for (i = 0; i < ticdup; ++i)
+        {
+            // Pauses, saves and chat are only for confirmed tics.
+
+            TicdupSquash(&set);
+
+            keepgoing = loop_interface->RunPredictedTic(set.cmds, set.ingame);
+            gametic++;
+
+            if (!keepgoing)
+            {
+                return;
+            }
+        }
+    }
+}
+
+static void UndoPrediction(void)
+{
+    loop_interface->RestorePrediction();
+    gametic = predict_gametic;
+    predicting = false;
+}
+
+// Take a snapshot of the game every second, once the game is being
+// kept in step with the host's.  The host sends it out, and everyone
+// keeps a hash of it.
+
+static void TakeSnapshot(void)
+{
+    snapshot_hash_t *hash;
+    sha1_context_t context;
+    const byte *data;
+    size_t len;
+
+    if ((!snapshot_host && !snapshot_sync)
+     || gametic % SNAPSHOT_INTERVAL != 0)
+    {
+        return;
+    }
+
+    if (!loop_interface->SaveSnapshot(&data, &len))
+    {
+        return;
+    }
+
+    hash = &snapshot_hashes[(gametic / SNAPSHOT_INTERVAL) % SNAPSHOT_HASHES];
+    hash->tic = gametic;
+
+    SHA1_Init(&context);
+    SHA1_Update(&context, const_cast<byte *>(data), len);
+    SHA1_Final(hash->digest, &context);
+
+    if (snapshot_host)
+    {
+        NET_SV_PublishSnapshot(gametic, hash->digest, data, len);
+    }
+}
+
+// Check the game against the latest snapshot from the host, once we
+// have run as far as it.  If ours came out differently, take on the
+// host's and run the tics since again.
+
+static void CheckSnapshot(void)
+{
+    const net_snapshot_t *snapshot;
+    snapshot_hash_t *hash;
+    ticcmd_set_t set;
+    int firsttic;
+    int endtic;
+
+    if (snapshot_host || !net_client_connected || drone
+     || loop_interface->ApplySnapshot == NULL)
+    {
+        return;
+    }
+
+    snapshot = NET_CL_LatestSnapshot();
+
+    if (snapshot == NULL || snapshot->seq == snapshot_checked)
+    {
+        return;
+    }
+
+    snapshot_sync = true;
+
+    if (snapshot->tic > gametic)
+    {
+        return;
+    }
+
+    snapshot_checked = snapshot->seq;
+
+    hash = &snapshot_hashes[(snapshot->tic / SNAPSHOT_INTERVAL)
+                            % SNAPSHOT_HASHES];
+
+    if (hash->tic != snapshot->tic
+     || !memcmp(hash->digest, snapshot->digest, sizeof(sha1_digest_t)))
+    {
+        return;
+    }
+
+    // The tics since must not have been overwritten yet.
+
+    firsttic = snapshot->tic / ticdup;
+
+    if (maketic - firsttic >= BACKUPTICS || recvtic - firsttic >= BACKUPTICS)
+    {
+        return;
+    }
+
+    if (!loop_interface->ApplySnapshot(snapshot->data.data(),
+                                       snapshot->data.size()))
+    {
+        return;
+    }
+
+    endtic = gametic;
+    gametic = snapshot->tic;
+
+    while (gametic < endtic)
+    {
+        set = ticdata[(gametic / ticdup) % BACKUPTICS];
+
+        if (gametic % ticdup != 0)
+        {
+            TicdupSquash(&set);
+        }
+
+        loop_interface->RunTic(set.cmds, set.ingame);
+        gametic++;
+
+        TakeSnapshot();
+    }
+}
+
 //
 // TryRunTics
 //
@@ -710,6 +1028,29 @@ void TryRunTics (void)
         NetUpdate ();
     }
 
+    // Until more input comes in, a prediction on screen is as good a
+    // guess as there is.  Once it does, go back to the last confirmed
+    // tic and run the game again from there.
+
+    if (predicting)
+    {
+        while (net_client_connected
+            && recvtic == predict_recvtic && maketic == predict_maketic)
+        {
+            if (I_GetTime() / ticdup - entertic >= MAX_NETGAME_STALL_TICS)
+            {
+                return;
+            }
+
+            I_Sleep(1);
+            NetUpdate();
+        }
+
+        UndoPrediction();
+    }
+
+    CheckSnapshot();
+
     lowtic = GetLowTic();
 
     availabletics = lowtic - gametic/ticdup;
@@ -742,6 +1083,15 @@ void TryRunTics (void)
     if (counts < 1)
 	counts = 1;
 
+    // When predicting, only wait on ourselves, never on the server:
+    // run what has been confirmed and guess at the rest.
+
+    if (predict && net_client_connected && maketic > lowtic
+     && counts > lowtic - gametic/ticdup)
+    {
+        counts = lowtic - gametic/ticdup;
+    }
+
     // wait for new tics if needed
     while (!PlayersInGame() || lowtic < gametic/ticdup + counts)
     {
@@ -793,6 +1143,8 @@ void TryRunTics (void)
 
             loop_interface->RunTic(set->cmds, set->ingame);
 	    gametic++;
+            Z_StatsTic();
+            TakeSnapshot();
 
 	    // modify command for duplicated tics
 
@@ -801,6 +1153,13 @@ void TryRunTics (void)
 
 	NetUpdate ();	// check for new console commands
     }
+
+    RunPrediction();
+}
+
+boolean D_SnapshotSync(void)
+{
+    return snapshot_host || snapshot_sync;
 }
 
 void D_RegisterLoopCallbacks(loop_interface_t *i)
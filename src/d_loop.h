@@ -49,6 +49,39 @@ typedef struct
     // Run the menu (runs independently of the game).
 
     void (*RunMenu)();
+
+    // The rest are for running a netgame ahead of the server, and may
+    // be NULL if the game can't do that.
+
+    // Save the game state before running ahead.  Returns false if the
+    // game can't be run ahead right now.
+
+    boolean (*SavePrediction)();
+
+    // Advance the game forward one tic ahead of the server, using
+    // guessed input.  Returns false if it should go no further.
+
+    boolean (*RunPredictedTic)(ticcmd_t *cmds, boolean *ingame);
+
+    // Put the game state back as it was saved.
+
+    void (*RestorePrediction)();
+
+    // The rest are for keeping a netgame in step with the host's game,
+    // and may be NULL if the game can't do that.
+
+    // Take a snapshot of the game, for the host to send out or for
+    // everyone else to check the host's against.  Returns false if the
+    // game is in no state to be compared right now.
+
+    boolean (*SaveSnapshot)(const byte **data, size_t *len);
+
+    // Take on the host's snapshot in place of the current game.
+    // Returns false if the snapshot can't be used.  If it returns true,
+    // the tics from the snapshot's up to the current gametic are run
+    // again.
+
+    boolean (*ApplySnapshot)(const byte *data, size_t len);
 } loop_interface_t;
 
 // Register callback functions for the main loop code to use.
@@ -77,6 +110,11 @@ boolean D_InitNetGame(net_connect_data_t *connect_data);
 void D_StartNetGame(net_gamesettings_t *settings,
                     netgame_startup_callback_t callback);
 
+// Returns true if the netgame is kept in step by snapshots from the
+// host, so that players who drift apart are put right.
+
+boolean D_SnapshotSync(void);
+
 extern boolean singletics;
 extern int gametic, ticdup;
 
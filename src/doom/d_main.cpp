@@ -70,6 +70,7 @@
 #include "net_query.h"
 
 #include "p_setup.h"
+#include "p_tick.h"
 #include "r_local.h"
 #include "statdump.h"
 
@@ -423,6 +424,8 @@ void D_BindVariables(void)
     M_BindIntVariable("snd_channels",           &snd_channels);
     M_BindIntVariable("vanilla_savegame_limit", &vanilla_savegame_limit);
     M_BindIntVariable("vanilla_demo_limit",     &vanilla_demo_limit);
+    M_BindIntVariable("parallel_monster_ai",    &parallel_monster_ai);
+    M_BindIntVariable("compressed_savegames",   &compressed_savegames);
     M_BindIntVariable("show_endoom",            &show_endoom);
     M_BindIntVariable("show_diskicon",          &show_diskicon);
 
@@ -504,6 +507,10 @@ void D_DoomLoop (void)
 
         TryRunTics (); // will run at least one tic
 
+        // Nothing to see or hear while seeking through a demo.
+        if (G_DemoSeeking ())
+            continue;
+
 	S_UpdateSounds (players[consoleplayer].mo);// move positional sounds
 
 	// Update display, next frame, with current state.
@@ -1844,6 +1851,8 @@ void D_DoomMain (void)
     DEH_printf("ST_Init: Init status bar.\n");
     ST_Init ();
 
+    G_AddConsoleCommands ();
+
     // If Doom II without a MAP01 lump, this is a store demo.
     // Moved this here so that MAP01 isn't constantly looked up
     // in the main loop.
@@ -1857,6 +1866,24 @@ void D_DoomMain (void)
         DEH_printf("External statistics registered.\n");
     }
 
+    //!
+    // @arg <n>
+    // @category net
+    //
+    // Check netgame prediction: play on scripted input for n tics,
+    // with the server's replies held back so that the game is always
+    // running ahead, and check that every tic run ahead comes out the
+    // same once confirmed.  Quits with an error at the first that
+    // does not.
+    //
+
+    p = M_CheckParmWithArgs("-predictcheck", 1);
+
+    if (p)
+    {
+        G_PredictCheck (atoi(myargv[p+1]));
+    }
+
     //!
     // @arg <x>
     // @category demo
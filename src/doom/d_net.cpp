@@ -95,11 +95,25 @@ static void RunTic(ticcmd_t *cmds, boolean *ingame)
     G_Ticker ();
 }
 
+static boolean RunPredictedTic(ticcmd_t *cmds, boolean *ingame)
+{
+    // Nobody leaves during a predicted tic; that waits for the server.
+
+    netcmds = cmds;
+
+    return G_PredictTicker ();
+}
+
 static loop_interface_t doom_loop_interface = {
     D_ProcessEvents,
     G_BuildTiccmd,
     RunTic,
-    M_Ticker
+    M_Ticker,
+    G_SavePrediction,
+    RunPredictedTic,
+    G_RestorePrediction,
+    G_SaveNetSnapshot,
+    G_ApplyNetSnapshot
 };
 
 
@@ -258,6 +258,9 @@ extern  gamestate_t     wipegamestate;
 
 extern  int             mouseSensitivity;
 
+#define BODYQUESIZE	32
+
+extern  mobj_t*         bodyque[BODYQUESIZE];
 extern  int             bodyqueslot;
 
 
@@ -21,6 +21,12 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include <string>
+#include <vector>
+
+#include "c_commands.h"
+#include "c_console.h"
+
 #include "doomdef.h" 
 #include "doomkeys.h"
 #include "doomstat.h"
@@ -50,6 +56,7 @@
 #include "hu_stuff.h"
 #include "st_stuff.h"
 #include "am_map.h"
+#include "sha1.h"
 #include "statdump.h"
 
 // Needs access to LFB.
@@ -91,6 +98,15 @@ void	G_DoCompleted (void);
 void	G_DoVictory (void); 
 void	G_DoWorldDone (void); 
 void	G_DoSaveGame (void); 
+void	G_DoSeekDemo (void); 
+
+static void G_PredictCheckTiccmd (ticcmd_t *cmd, int maketic);
+static void G_CheckPredictedTic (void);
+
+static void G_TakeDemoSnapshot (void);
+static void G_ClearDemoSnapshots (void);
+static void G_DemoSeekTicker (void);
+static void G_EndDemoSeek (void);
  
 // Gamestate the last time G_Ticker was called.
 
@@ -225,13 +241,12 @@ static boolean *joybuttons = &joyarray[1];		// allow [-1]
 static int      savegameslot; 
 static char     savedescription[32]; 
  
-#define	BODYQUESIZE	32
-
 mobj_t*		bodyque[BODYQUESIZE]; 
 int		bodyqueslot; 
  
 int             vanilla_savegame_limit = 1;
 int             vanilla_demo_limit = 1;
+int             compressed_savegames = 0;
  
 int G_CmdChecksum (ticcmd_t* cmd) 
 { 
@@ -578,6 +593,8 @@ void G_BuildTiccmd (ticcmd_t* cmd, int maketic)
 	cmd->buttons = BT_SPECIAL | BTS_SAVEGAME | (savegameslot<<BTS_SAVESHIFT); 
     } 
 
+    G_PredictCheckTiccmd (cmd, maketic);
+
     // low-res turning
 
     if (lowres_turn)
@@ -860,6 +877,18 @@ void G_Ticker (void)
     int		buf; 
     ticcmd_t*	cmd;
     
+    // has a savegame finished going out to disk?  It may also have
+    // been finished off by loading a game or opening the menu.
+    if (P_SaveGameWriteDone ())
+    {
+        P_FinishSaveGameWrite ();
+    }
+
+    if (P_SaveGameWritten ())
+    {
+        players[consoleplayer].message = DEH_String(GGSAVED);
+    }
+
     // do player reborns if needed
     for (i=0 ; i<MAXPLAYERS ; i++) 
 	if (playeringame[i] && players[i].playerstate == PST_REBORN) 
@@ -899,6 +928,9 @@ void G_Ticker (void)
             players[consoleplayer].message = DEH_String("screen shot");
 	    gameaction = ga_nothing; 
 	    break; 
+	  case ga_seekdemo: 
+	    G_DoSeekDemo (); 
+	    break; 
 	  case ga_nothing: 
 	    break; 
 	} 
@@ -946,9 +978,13 @@ void G_Ticker (void)
                 turbodetected[i] = false;
             }
 
-	    if (netgame && !netdemo && !(gametic%ticdup) ) 
+	    // Tics run ahead of the server are not in step with anyone
+	    // else, and must not leave anything for the real ones to
+	    // check against.  Players who drift apart in a game kept
+	    // in step by the host's snapshots are put right instead.
+	    if (netgame && !netdemo && !(gametic%ticdup) && !G_Predicting ())
 	    { 
-		if (gametic > BACKUPTICS 
+		if (gametic > BACKUPTICS && !D_SnapshotSync ()
 		    && consistancy[i][buf] != cmd->consistancy) 
 		{ 
 		    I_Error ("consistency failure (%i should be %i)",
@@ -1026,6 +1062,13 @@ void G_Ticker (void)
 	D_PageTicker (); 
 	break;
     }        
+
+    if (demoplayback)
+    {
+        G_DemoSeekTicker ();
+    }
+
+    G_CheckPredictedTic ();
 } 
  
  
@@ -1550,19 +1593,18 @@ void G_DoLoadGame (void)
     int savedleveltime;
 	 
     gameaction = ga_nothing; 
-	 
-    save_stream = fopen(savename, "rb");
 
-    if (save_stream == NULL)
+    // Make sure the game we're loading has finished being saved.
+    P_FinishSaveGameWrite();
+	 
+    if (!P_ReadSaveGameFile(savename))
     {
         return;
     }
 
-    savegame_error = false;
-
     if (!P_ReadSaveGameHeader())
     {
-        fclose(save_stream);
+        P_CloseSaveGame();
         return;
     }
 
@@ -1582,7 +1624,7 @@ void G_DoLoadGame (void)
     if (!P_ReadSaveGameEOF())
 	I_Error ("Bad savegame");
 
-    fclose(save_stream);
+    P_CloseSaveGame();
     
     if (setsizeneeded)
 	R_ExecuteSetViewSize ();
@@ -1611,32 +1653,13 @@ void G_DoSaveGame (void)
 { 
     char *savegame_file;
     char *temp_savegame_file;
-    char *recovery_savegame_file;
 
-    recovery_savegame_file = NULL;
     temp_savegame_file = P_TempSaveGameFile();
     savegame_file = P_SaveGameFile(savegameslot);
 
-    // Open the savegame file for writing.  We write to a temporary file
-    // and then rename it at the end if it was successfully written.
-    // This prevents an existing savegame from being overwritten by
-    // a corrupted one, or if a savegame buffer overrun occurs.
-    save_stream = fopen(temp_savegame_file, "wb");
-
-    if (save_stream == NULL)
-    {
-        // Failed to save the game, so we're going to have to abort. But
-        // to be nice, save to somewhere else before we call I_Error().
-        recovery_savegame_file = M_TempFile("recovery.dsg");
-        save_stream = fopen(recovery_savegame_file, "wb");
-        if (save_stream == NULL)
-        {
-            I_Error("Failed to open either '%s' or '%s' to write savegame.",
-                    temp_savegame_file, recovery_savegame_file);
-        }
-    }
-
-    savegame_error = false;
+    // Build the savegame up in memory.  It goes out to disk in one
+    // write once it is complete.
+    P_OpenSaveGameWrite();
 
     P_WriteSaveGameHeader(savedescription);
 
@@ -1650,36 +1673,22 @@ void G_DoSaveGame (void)
     // Enforce the same savegame size limit as in Vanilla Doom,
     // except if the vanilla_savegame_limit setting is turned off.
 
-    if (vanilla_savegame_limit && ftell(save_stream) > SAVEGAMESIZE)
+    if (vanilla_savegame_limit && P_SaveGameTell() > SAVEGAMESIZE)
     {
         I_Error("Savegame buffer overrun");
     }
 
-    // Finish up, close the savegame file.
-
-    fclose(save_stream);
-
-    if (recovery_savegame_file != NULL)
-    {
-        // We failed to save to the normal location, but we wrote a
-        // recovery file to the temp directory. Now we can bomb out
-        // with an error.
-        I_Error("Failed to open savegame file '%s' for writing.\n"
-                "But your game has been saved to '%s' for recovery.",
-                temp_savegame_file, recovery_savegame_file);
-    }
-
-    // Now rename the temporary savegame file to the actual savegame
-    // file, overwriting the old savegame if there was one there.
+    // Write it out in the background.  It goes to a temporary file
+    // that is only renamed over the real one once it has been
+    // written successfully.  This prevents an existing savegame from
+    // being overwritten by a corrupted one.  The "game saved" message
+    // waits until it is done.
 
-    remove(savegame_file);
-    rename(temp_savegame_file, savegame_file);
+    P_WriteSaveGameAsync(temp_savegame_file, savegame_file);
 
     gameaction = ga_nothing;
     M_StringCopy(savedescription, "", sizeof(savedescription));
 
-    players[consoleplayer].message = DEH_String(GGSAVED);
-
     // draw the pattern into the back screen
     R_FillBackScreen ();
 }
@@ -2213,6 +2222,9 @@ void G_DoPlayDemo (void)
 
     usergame = false; 
     demoplayback = true; 
+
+    G_ClearDemoSnapshots ();
+    G_TakeDemoSnapshot ();
 } 
 
 //
@@ -2237,6 +2249,628 @@ void G_TimeDemo (char* name)
 } 
  
  
+//
+// DEMO SEEKING
+//
+// A seek runs the demo as fast as the machine allows, with nothing
+// drawn or heard, until it reaches the target tic.  Snapshots of the
+// level are taken every DEMOSNAPSHOTTICS tics as the demo plays, so
+// seeking backwards restores the nearest one and replays from there.
+//
+
+#define DEMOSNAPSHOTTICS	(30*TICRATE)
+
+typedef struct
+{
+    int			tic;		// demo tics played before it
+    int			demopos;	// offset of the next ticcmd
+    skill_t		skill;
+    int			episode;
+    int			map;
+    boolean		paused;
+    std::vector<byte>	data;
+} demosnapshot_t;
+
+static std::vector<demosnapshot_t> demosnapshots;
+
+// Number of tics of the current demo that have been played.
+
+static int demotic;
+
+// Tic being seeked to, and the singletics setting to go back to once
+// it has been reached.
+
+static boolean demoseeking;
+static int demoseektic;
+static boolean demoseeksingletics;
+
+static void G_TakeDemoSnapshot (void)
+{
+    demosnapshot_t snapshot;
+    void *buf;
+    size_t buflen;
+
+    P_OpenSaveGameWrite ();
+    P_ArchiveSnapshot (true);
+
+    P_GetSaveGameBuffer (&buf, &buflen);
+    snapshot.data.assign(static_cast<byte*>(buf),
+                         static_cast<byte*>(buf) + buflen);
+    P_CloseSaveGame ();
+
+    snapshot.tic = demotic;
+    snapshot.demopos = demo_p - demobuffer;
+    snapshot.skill = gameskill;
+    snapshot.episode = gameepisode;
+    snapshot.map = gamemap;
+    snapshot.paused = paused;
+
+    demosnapshots.push_back(std::move(snapshot));
+}
+
+static void G_RestoreDemoSnapshot (demosnapshot_t *snapshot)
+{
+    boolean oldnetdemo = netdemo;
+    int olddisplayplayer = displayplayer;
+    int i;
+
+    // Load the level fresh, the same way loading a savegame does.
+    precache = false;
+    G_InitNew (snapshot->skill, snapshot->episode, snapshot->map);
+    precache = true;
+
+    usergame = false;
+    demoplayback = true;
+    netdemo = oldnetdemo;
+    displayplayer = olddisplayplayer;
+
+    P_OpenSaveGameRead (snapshot->data.data(), snapshot->data.size());
+    P_UnArchiveSnapshot (true);
+    P_CloseSaveGame ();
+
+    demotic = snapshot->tic;
+    demo_p = demobuffer + snapshot->demopos;
+    paused = snapshot->paused;
+
+    // The snapshot was taken at the end of a tic, so anything due at
+    // the start of the next one still has to happen.
+    for (i=0 ; i<MAXPLAYERS ; i++) 
+	if (playeringame[i] && players[i].playerstate == PST_REBORN) 
+	    G_DoReborn (i);
+}
+
+static void G_ClearDemoSnapshots (void)
+{
+    demosnapshots.clear();
+    demotic = 0;
+}
+
+// Called at the end of every tic of demo playback.
+
+static void G_DemoSeekTicker (void)
+{
+    demotic++;
+
+    if (gamestate == GS_LEVEL && gameaction == ga_nothing
+     && demotic % DEMOSNAPSHOTTICS == 0
+     && (demosnapshots.empty() || demosnapshots.back().tic < demotic))
+    {
+        G_TakeDemoSnapshot ();
+    }
+
+    if (demoseeking && demotic >= demoseektic)
+    {
+        G_EndDemoSeek ();
+    }
+}
+
+static void G_EndDemoSeek (void)
+{
+    if (!demoseeking)
+    {
+        return;
+    }
+
+    demoseeking = false;
+    singletics = demoseeksingletics;
+
+    // Go back to running in real time from here, and don't wipe to
+    // wherever we ended up.
+    D_StartGameLoop ();
+    wipegamestate = gamestate;
+}
+
+void G_DoSeekDemo (void)
+{
+    demosnapshot_t *snapshot;
+
+    gameaction = ga_nothing;
+
+    if (!demoplayback)
+    {
+        return;
+    }
+
+    if (demoseektic < demotic && !demosnapshots.empty())
+    {
+        // Find the last snapshot at or before the target.  There is
+        // always one from the start of the demo.
+        snapshot = &demosnapshots.front();
+
+        for (demosnapshot_t &s : demosnapshots)
+        {
+            if (s.tic <= demoseektic)
+            {
+                snapshot = &s;
+            }
+        }
+
+        G_RestoreDemoSnapshot (snapshot);
+    }
+
+    if (demoseektic > demotic)
+    {
+        if (!demoseeking)
+        {
+            demoseeking = true;
+            demoseeksingletics = singletics;
+            singletics = true;
+        }
+    }
+    else
+    {
+        // Landed right on a snapshot.
+        G_EndDemoSeek ();
+        wipegamestate = gamestate;
+    }
+}
+
+//
+// G_SeekDemo
+// Jump to the given tic of the demo being played back.
+//
+void G_SeekDemo (int tic)
+{
+    if (!demoplayback)
+    {
+        return;
+    }
+
+    demoseektic = tic < 0 ? 0 : tic;
+    gameaction = ga_seekdemo;
+}
+
+boolean G_DemoSeeking (void)
+{
+    return demoseeking;
+}
+
+static void CmdDemoSeek (console::CommandArguments args)
+{
+    const char *arg;
+    int minutes, seconds;
+    int tic;
+
+    if (!demoplayback)
+    {
+        console::printf("demoseek: no demo is playing\n");
+        return;
+    }
+
+    if (args.size() < 2)
+    {
+        console::printf("demo is at tic %d (%d:%02d)\n", demotic,
+                        demotic / TICRATE / 60, demotic / TICRATE % 60);
+        console::printf("demoseek <tic|+tics|-tics|mm:ss>\n");
+        return;
+    }
+
+    arg = args.at(1).c_str();
+
+    if (sscanf(arg, "%d:%d", &minutes, &seconds) == 2)
+    {
+        tic = (minutes * 60 + seconds) * TICRATE;
+    }
+    else if (M_StrToInt(arg, &tic))
+    {
+        if (arg[0] == '+' || arg[0] == '-')
+        {
+            tic += demotic;
+        }
+    }
+    else
+    {
+        console::printf("demoseek: bad position %s\n", arg);
+        return;
+    }
+
+    G_SeekDemo (tic);
+}
+
+
+//
+// NETGAME PREDICTION
+//
+// Rather than wait on the server, the loop code can run a netgame ahead
+// on guesses at what the other players are doing, so that the local
+// player sees their own moves straight away.  The level is snapshotted
+// first and put back once the real ticcmds arrive.  Snapshots are
+// taken many times a second, so they are left uncompressed.
+//
+
+static std::vector<byte> predictsnapshot;
+static boolean predicting;
+
+static void G_RecordPredictedTic (void);
+
+//
+// G_SnapshotLevel
+// Take an uncompressed snapshot of the level.  The copy keeps its
+// capacity from one snapshot to the next.
+//
+// The menu random number is left out.  It is not part of the game:
+// sounds draw on it, and only confirmed tics play sounds.
+//
+static void G_SnapshotLevel (std::vector<byte> *snapshot)
+{
+    void *buf;
+    size_t buflen;
+    int oldrndindex;
+
+    oldrndindex = rndindex;
+    rndindex = 0;
+
+    P_OpenSaveGameWrite ();
+    P_ArchiveSnapshot (false);
+
+    P_GetSaveGameBuffer (&buf, &buflen);
+    snapshot->assign(static_cast<byte*>(buf),
+                     static_cast<byte*>(buf) + buflen);
+    P_CloseSaveGame ();
+
+    rndindex = oldrndindex;
+}
+
+//
+// G_SavePrediction
+// Snapshot the level before running ahead.  Returns false if the game
+// is in no state to be run ahead.
+//
+boolean G_SavePrediction (void)
+{
+    if (gamestate != GS_LEVEL || gameaction != ga_nothing || paused
+     || demoplayback || demorecording)
+    {
+        return false;
+    }
+
+    G_SnapshotLevel (&predictsnapshot);
+
+    predicting = true;
+
+    return true;
+}
+
+//
+// G_PredictTicker
+// Run one tic ahead of the server.  Returns false if it is not worth
+// going any further.
+//
+boolean G_PredictTicker (void)
+{
+    G_Ticker ();
+
+    // Leaving the level has to wait until the server says so.
+    if (gameaction != ga_nothing)
+    {
+        gameaction = ga_nothing;
+        return false;
+    }
+
+    G_RecordPredictedTic ();
+
+    return true;
+}
+
+//
+// G_RestorePrediction
+// Put the level back the way it was before running ahead.
+//
+void G_RestorePrediction (void)
+{
+    int oldrndindex;
+
+    if (!predicting)
+    {
+        return;
+    }
+
+    S_DetachSounds ();
+
+    oldrndindex = rndindex;
+
+    P_OpenSaveGameRead (predictsnapshot.data(), predictsnapshot.size());
+    P_UnArchiveSnapshot (false);
+    P_CloseSaveGame ();
+
+    rndindex = oldrndindex;
+
+    S_ReattachSounds ();
+
+    predicting = false;
+}
+
+boolean G_Predicting (void)
+{
+    return predicting;
+}
+
+
+//
+// PREDICTION CHECK
+//
+// With -predictcheck, the game plays itself on scripted input while
+// the loop code holds back the server's replies, so that it is always
+// running ahead.  Each tic run ahead is checked against the same tic
+// once it is confirmed: given the same input, the two must come out
+// exactly the same, or restoring a snapshot has lost something.
+//
+
+typedef struct
+{
+    int gametic;
+    ticcmd_t cmds[MAXPLAYERS];
+    std::vector<byte> snapshot;
+} predictcheck_t;
+
+static int predictcheck_tics;
+static predictcheck_t predictchecks[BACKUPTICS];
+static std::vector<byte> predictcheck_snapshot;
+static int predictcheck_matched;
+
+//
+// G_PredictCheck
+// Check prediction for the given number of tics, then quit.
+//
+void G_PredictCheck (int tics)
+{
+    int i;
+
+    predictcheck_tics = tics;
+
+    for (i = 0; i < BACKUPTICS; i++)
+    {
+        predictchecks[i].gametic = -1;
+    }
+}
+
+//
+// G_PredictCheckTiccmd
+// Replace the player's input with a walk around the level: a new
+// direction every second, firing and pressing use along the way, and a
+// change of weapon every few seconds.
+//
+static void G_PredictCheckTiccmd (ticcmd_t *cmd, int maketic)
+{
+    unsigned int r;
+    int weapon;
+
+    if (predictcheck_tics <= 0 || (cmd->buttons & BT_SPECIAL))
+    {
+        return;
+    }
+
+    r = static_cast<unsigned int>(maketic / TICRATE) * 2654435761u;
+
+    cmd->forwardmove = static_cast<signed char>(
+        static_cast<int>((r >> 8) % 101) - 50);
+    cmd->sidemove = static_cast<signed char>(
+        static_cast<int>((r >> 16) % 81) - 40);
+    cmd->angleturn = static_cast<short>(
+        (static_cast<int>((r >> 24) % 7) - 3) * 256);
+
+    r = static_cast<unsigned int>(maketic) * 2246822519u;
+
+    cmd->buttons = 0;
+
+    if ((r >> 12) % 4 == 0)
+    {
+        cmd->buttons |= BT_ATTACK;
+    }
+
+    if ((r >> 16) % 16 == 0)
+    {
+        cmd->buttons |= BT_USE;
+    }
+
+    if (maketic % (TICRATE * 5) == 0)
+    {
+        weapon = (maketic / (TICRATE * 5)) % wp_missile;
+        cmd->buttons |= BT_CHANGE | (weapon << BT_WEAPONSHIFT);
+    }
+}
+
+//
+// G_RecordPredictedTic
+// Keep what a tic run ahead came out as.
+//
+static void G_RecordPredictedTic (void)
+{
+    predictcheck_t *check;
+
+    if (predictcheck_tics <= 0)
+    {
+        return;
+    }
+
+    check = &predictchecks[gametic % BACKUPTICS];
+    check->gametic = gametic;
+    memcpy(check->cmds, netcmds, sizeof(check->cmds));
+    G_SnapshotLevel (&check->snapshot);
+}
+
+//
+// G_CheckPredictedTic
+// Compare a confirmed tic with what it came out as when run ahead, if
+// it was run ahead on the same input.
+//
+static void G_CheckPredictedTic (void)
+{
+    predictcheck_t *check;
+    size_t i;
+
+    if (predictcheck_tics <= 0 || predicting)
+    {
+        return;
+    }
+
+    check = &predictchecks[gametic % BACKUPTICS];
+
+    if (check->gametic == gametic && gamestate == GS_LEVEL
+     && !memcmp(check->cmds, netcmds, sizeof(check->cmds)))
+    {
+        G_SnapshotLevel (&predictcheck_snapshot);
+
+        if (predictcheck_snapshot != check->snapshot)
+        {
+            for (i = 0; i < predictcheck_snapshot.size()
+                     && i < check->snapshot.size()
+                     && predictcheck_snapshot[i] == check->snapshot[i]; i++);
+
+            I_Error ("G_CheckPredictedTic: Tic %i came out differently "
+                     "when run ahead (snapshots differ from byte %i)",
+                     gametic, static_cast<int>(i));
+        }
+
+        predictcheck_matched++;
+    }
+
+    check->gametic = -1;
+
+    if (gametic + 1 >= predictcheck_tics)
+    {
+        if (predictcheck_matched == 0)
+        {
+            I_Error ("G_CheckPredictedTic: No tics were run ahead");
+        }
+
+        printf ("Prediction check: %i tics run ahead matched\n",
+                predictcheck_matched);
+        I_Quit ();
+    }
+}
+
+//
+// NETGAME SNAPSHOTS
+//
+// With -authoritative, the host of a netgame sends out a snapshot of
+// the level every second.  Everyone else checks their own level at the
+// same tic against it, and takes on the host's if the two differ.  The
+// snapshots start with the episode and map, so that a level is never
+// taken on over a different one.
+//
+
+static std::vector<byte> netsnapshot;
+static int resync_endtic;
+
+// Taking on the host's level is reported on the console at most once
+// in this many tics, with how many times it has happened since.
+
+#define RESYNC_MESSAGE_TICS (10 * TICRATE)
+
+static int resync_count;
+static int resync_messagetic = -RESYNC_MESSAGE_TICS;
+
+//
+// G_SaveNetSnapshot
+// Take a snapshot of the level to check against the host's.  Returns
+// false if there is no level to take.
+//
+boolean G_SaveNetSnapshot (const byte **data, size_t *len)
+{
+    byte header[2];
+
+    if (gamestate != GS_LEVEL || gameaction != ga_nothing || demoplayback)
+    {
+        return false;
+    }
+
+    header[0] = static_cast<byte>(gameepisode);
+    header[1] = static_cast<byte>(gamemap);
+
+    G_SnapshotLevel (&netsnapshot);
+    netsnapshot.insert(netsnapshot.begin(), header, header + sizeof(header));
+
+    *data = netsnapshot.data();
+    *len = netsnapshot.size();
+
+    return true;
+}
+
+//
+// G_ApplyNetSnapshot
+// Take on the host's level in place of our own.  Returns false if the
+// snapshot is of another level, or the game can't take it on now.
+//
+boolean G_ApplyNetSnapshot (const byte *data, size_t len)
+{
+    int oldrndindex;
+
+    if (len < 2 || data[0] != gameepisode || data[1] != gamemap
+     || gamestate != GS_LEVEL || gameaction != ga_nothing || demorecording)
+    {
+        return false;
+    }
+
+    ++resync_count;
+
+    if (gametic - resync_messagetic >= RESYNC_MESSAGE_TICS
+     || gametic < resync_messagetic)
+    {
+        console::printf ("Out of step with the host %i time%s, "
+                         "taking on its game\n",
+                         resync_count, resync_count == 1 ? "" : "s");
+        resync_count = 0;
+        resync_messagetic = gametic;
+    }
+
+    // Number the mobjs as they are, so that the sounds coming from them
+    // go to whichever take their numbers in the host's level.
+    G_SnapshotLevel (&netsnapshot);
+
+    S_DetachSounds ();
+
+    oldrndindex = rndindex;
+
+    P_OpenSaveGameRead (const_cast<byte *>(data) + 2, len - 2);
+    P_UnArchiveSnapshot (false);
+    P_CloseSaveGame ();
+
+    rndindex = oldrndindex;
+
+    S_ReattachSounds ();
+
+    // The tics since were heard the first time they ran.
+    resync_endtic = gametic;
+
+    return true;
+}
+
+boolean G_Resyncing (void)
+{
+    return gametic < resync_endtic;
+}
+
+//
+// G_AddConsoleCommands
+// Register the game's console commands.
+//
+void G_AddConsoleCommands (void)
+{
+    console::Commands::Instance().Add("demoseek", CmdDemoSeek);
+}
+
+
 /* 
 =================== 
 = 
@@ -2247,9 +2881,74 @@ void G_TimeDemo (char* name)
 =================== 
 */ 
  
+//
+// G_WriteDemoState
+// With -demostate, write out where a single demo ended up: the tic,
+// both random number indexes and a hash of the level.  Two runs of the
+// same demo that stay in sync write the same state.
+//
+static void G_WriteDemoState (void)
+{
+    static std::vector<byte> snapshot;
+    sha1_context_t context;
+    sha1_digest_t digest;
+    char state[128];
+    char hash[sizeof(sha1_digest_t) * 2 + 1];
+    size_t i;
+    int p;
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // When a demo played with -playdemo or -timedemo ends, write the
+    // game tic, random number indexes and a hash of the level to the
+    // given file, for checking that two runs of a demo stay in sync.
+    //
+
+    p = M_CheckParmWithArgs ("-demostate", 1);
+
+    if (!p)
+    {
+        return;
+    }
+
+    if (gamestate == GS_LEVEL)
+    {
+        G_SnapshotLevel (&snapshot);
+
+        SHA1_Init (&context);
+        SHA1_Update (&context, snapshot.data(), snapshot.size());
+        SHA1_Final (digest, &context);
+
+        for (i = 0; i < sizeof(sha1_digest_t); ++i)
+        {
+            M_snprintf (hash + i * 2, 3, "%02x", digest[i]);
+        }
+    }
+    else
+    {
+        M_StringCopy (hash, "none", sizeof(hash));
+    }
+
+    M_snprintf (state, sizeof(state),
+                "gametic %i\nrndindex %i\nprndindex %i\nlevel %s\n",
+                gametic, rndindex, prndindex, hash);
+
+    if (!M_WriteFile (myargv[p + 1], state, strlen(state)))
+    {
+        I_Error ("G_WriteDemoState: Failed to write %s", myargv[p + 1]);
+    }
+}
+
 boolean G_CheckDemoStatus (void) 
 { 
     int             endtime; 
+
+    if (timingdemo || (demoplayback && singledemo))
+    {
+        G_WriteDemoState ();
+    }
 	 
     if (timingdemo) 
     { 
@@ -2270,6 +2969,9 @@ boolean G_CheckDemoStatus (void)
 	 
     if (demoplayback) 
     { 
+        G_EndDemoSeek ();
+        G_ClearDemoSnapshots ();
+
         W_ReleaseLumpName(defdemoname);
 	demoplayback = false; 
 	netdemo = false;
@@ -59,6 +59,33 @@ void G_PlayDemo (char* name);
 void G_TimeDemo (char* name);
 boolean G_CheckDemoStatus (void);
 
+// Jump to a tic of the demo being played back.  While the demo is
+// being run forward to get there, G_DemoSeeking returns true and
+// nothing should be drawn or played.
+void G_SeekDemo (int tic);
+boolean G_DemoSeeking (void);
+
+// Run a netgame ahead of the server from a snapshot of the level, and
+// put it back afterwards.  G_Predicting returns true in between, when
+// nothing that happens is for real.
+boolean G_SavePrediction (void);
+boolean G_PredictTicker (void);
+void G_RestorePrediction (void);
+boolean G_Predicting (void);
+
+// Check that prediction puts the game back exactly, over the given
+// number of tics.
+void G_PredictCheck (int tics);
+
+// Snapshots of the level for the host of a netgame to send out, and
+// for everyone else to take on if they drift from the host.  While the
+// tics since are being run again, G_Resyncing returns true.
+boolean G_SaveNetSnapshot (const byte **data, size_t *len);
+boolean G_ApplyNetSnapshot (const byte *data, size_t len);
+boolean G_Resyncing (void);
+
+void G_AddConsoleCommands (void);
+
 void G_ExitLevel (void);
 void G_SecretExitLevel (void);
 
@@ -78,6 +105,7 @@ int G_VanillaVersionCode(void);
 
 extern int vanilla_savegame_limit;
 extern int vanilla_demo_limit;
+extern int compressed_savegames;
 
 }
 
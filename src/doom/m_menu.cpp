@@ -510,6 +510,9 @@ void M_ReadSaveStrings(void)
     int     i;
     char    name[256];
 
+    // Let any savegame still being written finish first.
+    P_FinishSaveGameWrite();
+
     for (i = 0;i < load_end;i++)
     {
         M_StringCopy(name, P_SaveGameFile(i), sizeof(name));
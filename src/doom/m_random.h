@@ -33,6 +33,10 @@ int M_Random (void);
 // As M_Random, but used only by the play simulation.
 int P_Random (void);
 
+// Current positions in the random number table.
+extern int rndindex;
+extern int prndindex;
+
 // Fix randoms for demos.
 void M_ClearRandom (void);
 
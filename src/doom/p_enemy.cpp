@@ -1808,6 +1808,7 @@ A_CloseShotgun2
 mobj_t*		braintargets[32];
 int		numbraintargets;
 int		braintargeton = 0;
+int		brainspiteasy = 0;
 
 void A_BrainAwake (mobj_t* mo)
 {
@@ -1901,11 +1902,9 @@ void A_BrainSpit (mobj_t*	mo)
 {
     mobj_t*	targ;
     mobj_t*	newmobj;
-    
-    static int	easy = 0;
 	
-    easy ^= 1;
-    if (gameskill <= sk_easy && (!easy))
+    brainspiteasy ^= 1;
+    if (gameskill <= sk_easy && (!brainspiteasy))
 	return;
 		
     // shoot a cube at current target
@@ -129,6 +129,12 @@ void	P_SpawnPlayerMissile (mobj_t* source, mobjtype_t type);
 //
 void P_NoiseAlert (mobj_t* target, mobj_t* emmiter);
 
+// Spawn targets for the boss brain.
+extern mobj_t*		braintargets[32];
+extern int		numbraintargets;
+extern int		braintargeton;
+extern int		brainspiteasy;
+
 
 //
 // P_MAPUTL
@@ -152,16 +158,18 @@ typedef struct
     }			d;
 } intercept_t;
 
-// Extended MAXINTERCEPTS, to allow for intercepts overrun emulation.
+// The intercepts list grows as needed.  Past MAXINTERCEPTS_ORIGINAL,
+// intercepts overrun emulation kicks in if P_DemoCompatible says so.
 
 #define MAXINTERCEPTS_ORIGINAL 128
 #define MAXINTERCEPTS          (MAXINTERCEPTS_ORIGINAL + 61)
 
-extern intercept_t	intercepts[MAXINTERCEPTS];
+extern intercept_t*	intercepts;
 extern intercept_t*	intercept_p;
 
 typedef boolean (*traverser_t) (intercept_t *in);
 
+boolean P_DemoCompatible (void);
 fixed_t P_AproxDistance (fixed_t dx, fixed_t dy);
 int 	P_PointOnLineSide (fixed_t x, fixed_t y, line_t* line);
 int 	P_PointOnDivlineSide (fixed_t x, fixed_t y, divline_t* line);
@@ -194,6 +202,7 @@ P_PathTraverse
   int		flags,
   boolean	(*trav) (intercept_t *));
 
+void P_InitTouchNodes (void);
 void P_UnsetThingPosition (mobj_t* thing);
 void P_SetThingPosition (mobj_t* thing);
 
@@ -218,11 +227,14 @@ extern	line_t*		ceilingline;
 //
 // We keep the original limit, to detect what variables in memory were
 // overwritten (see SpechitOverrun())
+//
+// The buffer now grows as needed, MAXSPECIALCROSS is only its initial
+// size.  Overruns are only emulated if P_DemoCompatible says so.
 
 #define MAXSPECIALCROSS 		20
 #define MAXSPECIALCROSS_ORIGINAL	8
 
-extern	line_t*	spechit[MAXSPECIALCROSS];
+extern	line_t**	spechit;
 extern	int	numspechit;
 
 boolean P_CheckPosition (mobj_t *thing, fixed_t x, fixed_t y);
@@ -230,6 +242,8 @@ boolean P_TryMove (mobj_t* thing, fixed_t x, fixed_t y);
 boolean P_TeleportMove (mobj_t* thing, fixed_t x, fixed_t y);
 void	P_SlideMove (mobj_t* mo);
 boolean P_CheckSight (mobj_t* t1, mobj_t* t2);
+void	P_SpeculateSight (void);
+void	P_DiscardSpeculatedSight (void);
 void 	P_UseLines (player_t* player);
 
 boolean P_ChangeSector (sector_t* sector, boolean crunch);
@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "deh_misc.h"
 
@@ -85,9 +86,12 @@ line_t*		ceilingline;
 // keep track of special lines as they are hit,
 // but don't process them until the move is proven valid
 
-line_t*		spechit[MAXSPECIALCROSS];
+line_t**	spechit;
 int		numspechit;
 
+// space allocated for spechit
+static int	maxspechit;
+
 
 
 //
@@ -259,11 +263,17 @@ boolean PIT_CheckLine (line_t* ld)
     // if contacted a special line, add it to the list
     if (ld->special)
     {
+        if (numspechit == maxspechit)
+        {
+            maxspechit = maxspechit ? maxspechit * 2 : MAXSPECIALCROSS;
+            spechit = static_cast<line_t**>(I_Realloc(spechit, maxspechit * sizeof(*spechit)));
+        }
+
         spechit[numspechit] = ld;
 	numspechit++;
 
         // fraggle: spechits overrun emulation code from prboom-plus
-        if (numspechit > MAXSPECIALCROSS_ORIGINAL)
+        if (numspechit > MAXSPECIALCROSS_ORIGINAL && P_DemoCompatible())
         {
             SpechitOverrun(ld);
         }
@@ -1364,6 +1374,41 @@ boolean PIT_ChangeSector (mobj_t*	thing)
 
 
 
+//
+// P_ChangeTouchingThings
+// Run PIT_ChangeSector on the things touching
+// the sector.  Crushing things can spawn and remove
+// others, which changes the list, so work from a copy.
+//
+static std::vector<mobj_t*> changethings;
+
+static void P_ChangeTouchingThings (sector_t* sector)
+{
+    touchnode_t*	node;
+    mobj_t*		thing;
+    size_t		base;
+    size_t		i;
+
+    base = changethings.size();
+
+    for (node = sector->touchingthings ; node ; node = node->snext)
+	changethings.push_back(node->thing);
+
+    for (i = base ; i < changethings.size() ; i++)
+    {
+	thing = changethings[i];
+
+	// removed while crushing something else?
+	if (thing->thinker.function.acv == (actionf_v)(-1))
+	    continue;
+
+	PIT_ChangeSector (thing);
+    }
+
+    changethings.resize(base);
+}
+
+
 //
 // P_ChangeSector
 //
@@ -1377,7 +1422,21 @@ P_ChangeSector
 	
     nofit = false;
     crushchange = crunch;
+
+    // sight answers worked out earlier this tic
+    // may no longer hold
+    P_DiscardSpeculatedSight ();
+
+    // let the neighbors know
+    P_SectorHeightsChanged (sector);
 	
+    if (!P_DemoCompatible ())
+    {
+	// only things touching the sector can be affected
+	P_ChangeTouchingThings (sector);
+	return nofit;
+    }
+
     // re-check heights for all things near the moving sector
     for (x=sector->blockbox[BOXLEFT] ; x<= sector->blockbox[BOXRIGHT] ; x++)
 	for (y=sector->blockbox[BOXBOTTOM];y<= sector->blockbox[BOXTOP] ; y++)
@@ -23,9 +23,12 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 
 
+#include "i_system.h"
 #include "m_bbox.h"
+#include "z_zone.h"
 
 #include "doomdef.h"
 #include "doomstat.h"
@@ -335,6 +338,170 @@ void P_LineOpening (line_t* linedef)
 //
 
 
+//
+// TOUCHING SECTORS
+// Every blockmap thing keeps a list of the sectors its
+// bounding box touches, and every sector keeps a list of
+// the things touching it.  This lets P_ChangeSector go
+// straight to the things a moving sector can affect.
+//
+
+static touchnode_t*	touchnodefree;
+
+static mobj_t*		touchthing;
+static fixed_t		touchbbox[4];
+
+
+//
+// P_InitTouchNodes
+// Called at level start, after the previous
+// level's nodes were freed along with it.
+//
+void P_InitTouchNodes (void)
+{
+    touchnodefree = NULL;
+}
+
+
+static void P_AddTouchingSector (sector_t* sec)
+{
+    touchnode_t*	node;
+
+    // already linked?
+    for (node = touchthing->touchingsectors ; node ; node = node->tnext)
+    {
+	if (node->sector == sec)
+	    return;
+    }
+
+    if (touchnodefree)
+    {
+	node = touchnodefree;
+	touchnodefree = node->tnext;
+    }
+    else
+    {
+	node = static_cast<touchnode_t*>(Z_Malloc (sizeof(*node), PU_LEVEL, NULL));
+    }
+
+    node->sector = sec;
+    node->thing = touchthing;
+
+    node->tprev = NULL;
+    node->tnext = touchthing->touchingsectors;
+    if (node->tnext)
+	node->tnext->tprev = node;
+    touchthing->touchingsectors = node;
+
+    node->sprev = NULL;
+    node->snext = sec->touchingthings;
+    if (node->snext)
+	node->snext->sprev = node;
+    sec->touchingthings = node;
+}
+
+
+//
+// P_LinkTouchingSectors
+// Link a thing to every sector its bounding box touches.
+//
+static void P_LinkTouchingSectors (mobj_t* thing)
+{
+    int			xl;
+    int			xh;
+    int			yl;
+    int			yh;
+    int			bx;
+    int			by;
+    int			offset;
+    short*		list;
+    line_t*		ld;
+
+    touchthing = thing;
+
+    touchbbox[BOXTOP] = thing->y + thing->radius;
+    touchbbox[BOXBOTTOM] = thing->y - thing->radius;
+    touchbbox[BOXRIGHT] = thing->x + thing->radius;
+    touchbbox[BOXLEFT] = thing->x - thing->radius;
+
+    P_AddTouchingSector (thing->subsector->sector);
+
+    xl = (touchbbox[BOXLEFT] - bmaporgx)>>MAPBLOCKSHIFT;
+    xh = (touchbbox[BOXRIGHT] - bmaporgx)>>MAPBLOCKSHIFT;
+    yl = (touchbbox[BOXBOTTOM] - bmaporgy)>>MAPBLOCKSHIFT;
+    yh = (touchbbox[BOXTOP] - bmaporgy)>>MAPBLOCKSHIFT;
+
+    if (xl < 0)
+	xl = 0;
+    if (yl < 0)
+	yl = 0;
+    if (xh >= bmapwidth)
+	xh = bmapwidth - 1;
+    if (yh >= bmapheight)
+	yh = bmapheight - 1;
+
+    for (bx=xl ; bx<=xh ; bx++)
+    {
+	for (by=yl ; by<=yh ; by++)
+	{
+	    // Not P_BlockLinesIterator, so that we don't
+	    // disturb validcount in the middle of a move.
+	    // A line in several blocks just gets seen again.
+	    offset = *(blockmap + by*bmapwidth+bx);
+
+	    for (list = blockmaplump+offset ; *list != -1 ; list++)
+	    {
+		ld = &lines[*list];
+
+		if (touchbbox[BOXRIGHT] <= ld->bbox[BOXLEFT]
+		    || touchbbox[BOXLEFT] >= ld->bbox[BOXRIGHT]
+		    || touchbbox[BOXTOP] <= ld->bbox[BOXBOTTOM]
+		    || touchbbox[BOXBOTTOM] >= ld->bbox[BOXTOP])
+		{
+		    continue;
+		}
+
+		if (P_BoxOnLineSide (touchbbox, ld) != -1)
+		    continue;
+
+		P_AddTouchingSector (ld->frontsector);
+
+		if (ld->backsector)
+		    P_AddTouchingSector (ld->backsector);
+	    }
+	}
+    }
+}
+
+
+//
+// P_UnlinkTouchingSectors
+//
+static void P_UnlinkTouchingSectors (mobj_t* thing)
+{
+    touchnode_t*	node;
+    touchnode_t*	next;
+
+    for (node = thing->touchingsectors ; node ; node = next)
+    {
+	next = node->tnext;
+
+	if (node->sprev)
+	    node->sprev->snext = node->snext;
+	else
+	    node->sector->touchingthings = node->snext;
+
+	if (node->snext)
+	    node->snext->sprev = node->sprev;
+
+	node->tnext = touchnodefree;
+	touchnodefree = node;
+    }
+
+    thing->touchingsectors = NULL;
+}
+
+
 //
 // P_UnsetThingPosition
 // Unlinks a thing from block map and sectors.
@@ -381,6 +548,10 @@ void P_UnsetThingPosition (mobj_t* thing)
 	    }
 	}
     }
+
+    // Goes by the list rather than the flags, in case
+    // those changed since the thing was linked.
+    P_UnlinkTouchingSectors (thing);
 }
 
 
@@ -444,6 +615,8 @@ P_SetThingPosition (mobj_t* thing)
 	    // thing is off the map
 	    thing->bnext = thing->bprev = NULL;
 	}
+
+	P_LinkTouchingSectors (thing);
     }
 }
 
@@ -539,15 +712,73 @@ P_BlockThingsIterator
 //
 // INTERCEPT ROUTINES
 //
-intercept_t	intercepts[MAXINTERCEPTS];
+intercept_t*	intercepts;
 intercept_t*	intercept_p;
 
+// end of the space allocated for intercepts
+static intercept_t*	intercepts_end;
+
 divline_t 	trace;
 boolean 	earlyout;
 int		ptflags;
 
 static void InterceptsOverrun(int num_intercepts, intercept_t *intercept);
 
+
+//
+// P_DemoCompatible
+// Returns true if the game has to behave exactly like
+// Vanilla Doom, overruns and all.  Only demos and
+// netgames can tell the difference, everything else
+// gets the limit-removing behavior.
+//
+boolean P_DemoCompatible (void)
+{
+    return demoplayback || demorecording || netgame;
+}
+
+
+//
+// P_NewIntercept
+// Makes room for one more intercept at the given fraction
+// along the trace, growing the list if necessary.
+//
+static intercept_t* P_NewIntercept (fixed_t frac)
+{
+    intercept_t*	in;
+    size_t		count;
+    size_t		size;
+
+    if (intercept_p == intercepts_end)
+    {
+	count = intercept_p - intercepts;
+	size = count ? count * 2 : MAXINTERCEPTS;
+
+	intercepts = static_cast<intercept_t*>(I_Realloc(intercepts, size * sizeof(*intercepts)));
+	intercept_p = intercepts + count;
+	intercepts_end = intercepts + size;
+    }
+
+    if (P_DemoCompatible ())
+    {
+	// P_TraverseIntercepts scans for the
+	// closest intercept each step.
+	return intercept_p++;
+    }
+
+    // Keep the list sorted by fraction so that
+    // P_TraverseIntercepts can just walk it.
+    // Equal fractions stay in the order they were
+    // added, which is the order Vanilla picks them.
+    for (in = intercept_p ; in > intercepts && (in-1)->frac > frac ; in--)
+	;
+
+    memmove(in + 1, in, (intercept_p - in) * sizeof(*in));
+    intercept_p++;
+
+    return in;
+}
+
 //
 // PIT_AddLineIntercepts.
 // Looks for lines in the given block
@@ -565,6 +796,7 @@ PIT_AddLineIntercepts (line_t* ld)
     int			s2;
     fixed_t		frac;
     divline_t		dl;
+    intercept_t*	in;
 	
     // avoid precision problems with two routines
     if ( trace.dx > FRACUNIT*16
@@ -600,11 +832,13 @@ PIT_AddLineIntercepts (line_t* ld)
     }
     
 	
-    intercept_p->frac = frac;
-    intercept_p->isaline = true;
-    intercept_p->d.line = ld;
-    InterceptsOverrun(intercept_p - intercepts, intercept_p);
-    intercept_p++;
+    in = P_NewIntercept (frac);
+    in->frac = frac;
+    in->isaline = true;
+    in->d.line = ld;
+
+    if (P_DemoCompatible ())
+	InterceptsOverrun(in - intercepts, in);
 
     return true;	// continue
 }
@@ -629,6 +863,7 @@ boolean PIT_AddThingIntercepts (mobj_t* thing)
     divline_t		dl;
     
     fixed_t		frac;
+    intercept_t*	in;
 	
     tracepositive = (trace.dx ^ trace.dy)>0;
 		
@@ -666,11 +901,13 @@ boolean PIT_AddThingIntercepts (mobj_t* thing)
     if (frac < 0)
 	return true;		// behind source
 
-    intercept_p->frac = frac;
-    intercept_p->isaline = false;
-    intercept_p->d.thing = thing;
-    InterceptsOverrun(intercept_p - intercepts, intercept_p);
-    intercept_p++;
+    in = P_NewIntercept (frac);
+    in->frac = frac;
+    in->isaline = false;
+    in->d.thing = thing;
+
+    if (P_DemoCompatible ())
+	InterceptsOverrun(in - intercepts, in);
 
     return true;		// keep going
 }
@@ -694,6 +931,21 @@ P_TraverseIntercepts
     count = intercept_p - intercepts;
     
     in = 0;			// shut up compiler warning
+
+    if (!P_DemoCompatible ())
+    {
+	// already sorted by P_NewIntercept
+	for (in = intercepts ; in < intercept_p ; in++)
+	{
+	    if (in->frac > maxfrac)
+		return true;	// checked everything in range
+
+	    if ( !func (in) )
+		return false;	// don't bother going farther
+	}
+
+	return true;		// everything was traversed
+    }
 	
     while (count--)
     {
@@ -277,6 +277,9 @@ typedef struct mobj_s
 
     // Thing being chased/attacked for tracers.
     struct mobj_s*	tracer;	
+
+    // Sectors the thing touches (blockmap things only).
+    struct touchnode_s*	touchingsectors;
     
 } mobj_t;
 
@@ -19,10 +19,28 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "dstrings.h"
 #include "deh_main.h"
 #include "i_system.h"
+#include "m_lz.h"
+#include "m_random.h"
+#include "memio.h"
 #include "z_zone.h"
 #include "p_local.h"
 #include "p_saveg.h"
@@ -31,15 +49,42 @@
 #include "doomstat.h"
 #include "g_game.h"
 #include "m_misc.h"
+#include "r_sky.h"
 #include "r_state.h"
+#include "v_diskicon.h"
 
 namespace theta
 {
 
-FILE *save_stream;
+MEMFILE *save_stream;
 int savegamelength;
 boolean savegame_error;
 
+// Buffer holding a savegame file read in by P_ReadSaveGameFile.
+
+static void *save_filebuffer;
+
+// True while reading or writing a snapshot rather than a savegame.
+
+static boolean savegame_snapshot;
+
+// True while reading or writing a compressed savegame, in which the
+// world is stored as changes from the freshly loaded level and
+// everything after the header is compressed.
+
+static boolean savegame_compressed;
+
+// Version of the compressed savegame format, stored in the header.
+
+#define SAVEGAME_LZ_VERSION 1
+
+// While a compressed body is being read or written, save_stream is an
+// inner stream holding the uncompressed data and this is the stream
+// it came from or goes to.
+
+static MEMFILE *save_outerstream;
+static void *save_bodybuffer;
+
 // Get the filename of a temporary file to write the savegame to.  After
 // the file has been successfully saved, it will be renamed to the 
 // real file.
@@ -76,73 +121,366 @@ char *P_SaveGameFile(int slot)
     return filename;
 }
 
-// Endian-safe integer read/write functions
+//
+// Savegame streams
+//
+// Savegames are built up in memory and written out to disk in one go,
+// and read in whole before being parsed, rather than going through
+// stdio a byte at a time.
+//
 
-static byte saveg_read8(void)
+void P_OpenSaveGameWrite(void)
+{
+    save_stream = mem_fopen_write();
+    savegame_error = false;
+}
+
+void P_OpenSaveGameRead(void *buf, size_t buflen)
+{
+    save_stream = mem_fopen_read(buf, buflen);
+    savegame_error = false;
+}
+
+// Read the whole of a savegame file in and open it for reading.
+// Returns false if the file could not be read.
+
+boolean P_ReadSaveGameFile(const char *filename)
+{
+    FILE *handle;
+    long length;
+
+    handle = fopen(filename, "rb");
+
+    if (handle == NULL)
+    {
+        return false;
+    }
+
+    length = M_FileLength(handle);
+    save_filebuffer = Z_Malloc(length > 0 ? length : 1, PU_STATIC, NULL);
+
+    if (length < 0
+     || fread(save_filebuffer, 1, length, handle) < (size_t) length)
+    {
+        fclose(handle);
+        Z_Free(save_filebuffer);
+        save_filebuffer = NULL;
+        return false;
+    }
+
+    fclose(handle);
+
+    P_OpenSaveGameRead(save_filebuffer, length);
+
+    return true;
+}
+
+void P_GetSaveGameBuffer(void **buf, size_t *buflen)
+{
+    mem_get_buf(save_stream, buf, buflen);
+}
+
+void P_CloseSaveGame(void)
+{
+    if (save_outerstream != NULL)
+    {
+        mem_fclose(save_stream);
+        save_stream = save_outerstream;
+        save_outerstream = NULL;
+    }
+
+    if (save_bodybuffer != NULL)
+    {
+        Z_Free(save_bodybuffer);
+        save_bodybuffer = NULL;
+    }
+
+    mem_fclose(save_stream);
+    save_stream = NULL;
+
+    if (save_filebuffer != NULL)
+    {
+        Z_Free(save_filebuffer);
+        save_filebuffer = NULL;
+    }
+}
+
+//
+// Background savegame writing
+//
+// A finished savegame is handed to a thread that writes it to the
+// temporary file, flushes it all the way to disk and renames it over
+// the real savegame, so that slow storage never holds up the game.
+// Only one write is in flight at a time.
+//
+
+typedef enum
+{
+    SAVEWRITE_OK,
+    SAVEWRITE_RECOVERED,
+    SAVEWRITE_FAILED
+} savewrite_t;
+
+static std::thread save_writer;
+static std::atomic<bool> save_writer_done;
+static boolean save_writer_running;
+static boolean save_writer_written;
+static savewrite_t save_writer_result;
+static std::string save_writer_temp;
+static std::string save_writer_recovery;
+
+// Write a file and make sure it has reached the disk.
+
+static boolean WriteFileSynced(const char *filename,
+                               const std::vector<byte> &data)
+{
+    FILE *handle;
+    boolean result;
+
+    handle = fopen(filename, "wb");
+
+    if (handle == NULL)
+    {
+        return false;
+    }
+
+    result = fwrite(data.data(), 1, data.size(), handle) == data.size()
+          && fflush(handle) == 0;
+
+#ifdef _WIN32
+    result = result && _commit(_fileno(handle)) == 0;
+#else
+    result = result && fsync(fileno(handle)) == 0;
+#endif
+
+    return fclose(handle) == 0 && result;
+}
+
+static void SaveGameWriter(std::vector<byte> data, std::string save_file)
+{
+    if (WriteFileSynced(save_writer_temp.c_str(), data))
+    {
+        // Replace the old savegame only now that the new one is safe.
+#ifdef _WIN32
+        remove(save_file.c_str());
+#endif
+        rename(save_writer_temp.c_str(), save_file.c_str());
+        save_writer_result = SAVEWRITE_OK;
+    }
+    else if (WriteFileSynced(save_writer_recovery.c_str(), data))
+    {
+        save_writer_result = SAVEWRITE_RECOVERED;
+    }
+    else
+    {
+        save_writer_result = SAVEWRITE_FAILED;
+    }
+
+    save_writer_done = true;
+}
+
+// Wait for the writer thread without reporting anything, for use at
+// exit.
+
+static void WaitForSaveGameWriter(void)
+{
+    if (save_writer.joinable())
+    {
+        save_writer.join();
+    }
+}
+
+//
+// P_WriteSaveGameAsync
+// Close the stream and write everything that was written to it out to
+// save_file in the background, by way of temp_file.
+//
+void P_WriteSaveGameAsync(const char *temp_file, const char *save_file)
+{
+    static boolean atexit_added = false;
+    std::vector<byte> data;
+    char *recovery_file;
+    void *buf;
+    size_t buflen;
+
+    P_FinishSaveGameWrite();
+
+    mem_get_buf(save_stream, &buf, &buflen);
+    data.assign(static_cast<byte*>(buf), static_cast<byte*>(buf) + buflen);
+    P_CloseSaveGame();
+
+    // If the real location can't be written, the game gets saved to
+    // somewhere else before we give up.
+    recovery_file = M_TempFile("recovery.dsg");
+    save_writer_recovery = recovery_file;
+    Z_Free(recovery_file);
+    save_writer_temp = temp_file;
+
+    if (!atexit_added)
+    {
+        I_AtExit(WaitForSaveGameWriter, true);
+        atexit_added = true;
+    }
+
+    V_BeginWrite();
+    save_writer_done = false;
+    save_writer_running = true;
+    save_writer = std::thread(SaveGameWriter, std::move(data),
+                              std::string(save_file));
+}
+
+//
+// P_SaveGameWriteDone
+// Returns true once a background write has finished and is waiting
+// for P_FinishSaveGameWrite.
+//
+boolean P_SaveGameWriteDone(void)
+{
+    return save_writer_running && save_writer_done;
+}
+
+//
+// P_FinishSaveGameWrite
+// Wait for any background write to finish and deal with the outcome.
+// Returns true if there was one.
+//
+boolean P_FinishSaveGameWrite(void)
+{
+    if (!save_writer_running)
+    {
+        return false;
+    }
+
+    save_writer.join();
+    save_writer_running = false;
+    V_EndWrite();
+
+    if (save_writer_result == SAVEWRITE_RECOVERED)
+    {
+        // We failed to save to the normal location, but we wrote a
+        // recovery file to the temp directory. Now we can bomb out
+        // with an error.
+        I_Error("Failed to open savegame file '%s' for writing.\n"
+                "But your game has been saved to '%s' for recovery.",
+                save_writer_temp.c_str(), save_writer_recovery.c_str());
+    }
+    else if (save_writer_result == SAVEWRITE_FAILED)
+    {
+        I_Error("Failed to write either '%s' or '%s' to save game.",
+                save_writer_temp.c_str(), save_writer_recovery.c_str());
+    }
+
+    save_writer_written = true;
+
+    return true;
+}
+
+//
+// P_SaveGameWritten
+// Returns true once after each background write is finished, by
+// whichever caller of P_FinishSaveGameWrite got there first.
+//
+boolean P_SaveGameWritten(void)
 {
-    byte result = -1;
+    boolean result = save_writer_written;
+
+    save_writer_written = false;
+
+    return result;
+}
+
+// Endian-safe integer read/write functions.  Each value is moved in a
+// single call, least significant byte first.
 
-    if (fread(&result, 1, 1, save_stream) < 1)
+static void saveg_read_bytes(byte *buf, size_t len)
+{
+    if (mem_fread(buf, len, 1, save_stream) < 1)
     {
+        memset(buf, 0xff, len);
+
         if (!savegame_error)
         {
-            fprintf(stderr, "saveg_read8: Unexpected end of file while "
+            fprintf(stderr, "saveg_read_bytes: Unexpected end of file while "
                             "reading save game\n");
 
             savegame_error = true;
         }
     }
-
-    return result;
 }
 
-static void saveg_write8(byte value)
+static void saveg_write_bytes(const byte *buf, size_t len)
 {
-    if (fwrite(&value, 1, 1, save_stream) < 1)
+    if (mem_fwrite(buf, len, 1, save_stream) < 1)
     {
         if (!savegame_error)
         {
-            fprintf(stderr, "saveg_write8: Error while writing save game\n");
+            fprintf(stderr, "saveg_write_bytes: Error while writing save game\n");
 
             savegame_error = true;
         }
     }
 }
 
-static short saveg_read16(void)
+static byte saveg_read8(void)
 {
-    int result;
+    byte result;
 
-    result = saveg_read8();
-    result |= saveg_read8() << 8;
+    saveg_read_bytes(&result, 1);
 
     return result;
 }
 
+static void saveg_write8(byte value)
+{
+    saveg_write_bytes(&value, 1);
+}
+
+static short saveg_read16(void)
+{
+    byte buf[2];
+
+    saveg_read_bytes(buf, sizeof(buf));
+
+    return buf[0] | (buf[1] << 8);
+}
+
 static void saveg_write16(short value)
 {
-    saveg_write8(value & 0xff);
-    saveg_write8((value >> 8) & 0xff);
+    byte buf[2];
+
+    buf[0] = value & 0xff;
+    buf[1] = (value >> 8) & 0xff;
+
+    saveg_write_bytes(buf, sizeof(buf));
 }
 
 static int saveg_read32(void)
 {
-    int result;
+    byte buf[4];
 
-    result = saveg_read8();
-    result |= saveg_read8() << 8;
-    result |= saveg_read8() << 16;
-    result |= saveg_read8() << 24;
+    saveg_read_bytes(buf, sizeof(buf));
 
-    return result;
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16)
+         | ((unsigned int) buf[3] << 24);
 }
 
 static void saveg_write32(int value)
 {
-    saveg_write8(value & 0xff);
-    saveg_write8((value >> 8) & 0xff);
-    saveg_write8((value >> 16) & 0xff);
-    saveg_write8((value >> 24) & 0xff);
+    byte buf[4];
+
+    buf[0] = value & 0xff;
+    buf[1] = (value >> 8) & 0xff;
+    buf[2] = (value >> 16) & 0xff;
+    buf[3] = (value >> 24) & 0xff;
+
+    saveg_write_bytes(buf, sizeof(buf));
+}
+
+// Current position in the stream being read or written.
+
+long P_SaveGameTell(void)
+{
+    return mem_ftell(save_stream);
 }
 
 // Pad to 4-byte boundaries
@@ -153,7 +491,7 @@ static void saveg_read_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = P_SaveGameTell();
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -169,7 +507,7 @@ static void saveg_write_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = P_SaveGameTell();
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -192,6 +530,45 @@ static void saveg_writep(void *p)
     saveg_write32((intptr_t) p);
 }
 
+// Mobj references.  A savegame stores the raw pointer and throws it
+// away on load.  A snapshot stores the one-based position of the mobj
+// in the thinker list instead, which is turned back into a pointer by
+// saveg_resolve_mobj once every mobj has been read back in.
+
+static std::unordered_map<mobj_t *, int> snapshot_indexes;
+static std::vector<mobj_t *> snapshot_mobjs;
+
+static mobj_t *saveg_read_mobjp(void)
+{
+    return static_cast<mobj_t*>(saveg_readp());
+}
+
+static void saveg_write_mobjp(mobj_t *mo)
+{
+    if (savegame_snapshot)
+    {
+        auto it = snapshot_indexes.find(mo);
+
+        saveg_write32(it != snapshot_indexes.end() ? it->second : 0);
+    }
+    else
+    {
+        saveg_writep(mo);
+    }
+}
+
+static mobj_t *saveg_resolve_mobj(mobj_t *ref)
+{
+    size_t index = (size_t) (intptr_t) ref;
+
+    if (index < 1 || index > snapshot_mobjs.size())
+    {
+        return NULL;
+    }
+
+    return snapshot_mobjs[index - 1];
+}
+
 // Strings
 
 static char *saveg_readstr(void)
@@ -399,7 +776,7 @@ static void saveg_read_mobj_t(mobj_t *str)
     str->movecount = saveg_read32();
 
     // struct mobj_s* target;
-    str->target = static_cast<mobj_s*>(saveg_readp());
+    str->target = saveg_read_mobjp();
 
     // int reactiontime;
     str->reactiontime = saveg_read32();
@@ -427,7 +804,7 @@ static void saveg_read_mobj_t(mobj_t *str)
     saveg_read_mapthing_t(&str->spawnpoint);
 
     // struct mobj_s* tracer;
-    str->tracer = static_cast<mobj_s*>(saveg_readp());
+    str->tracer = saveg_read_mobjp();
 }
 
 static void saveg_write_mobj_t(mobj_t *str)
@@ -517,7 +894,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->movecount);
 
     // struct mobj_s* target;
-    saveg_writep(str->target);
+    saveg_write_mobjp(str->target);
 
     // int reactiontime;
     saveg_write32(str->reactiontime);
@@ -542,7 +919,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write_mapthing_t(&str->spawnpoint);
 
     // struct mobj_s* tracer;
-    saveg_writep(str->tracer);
+    saveg_write_mobjp(str->tracer);
 }
 
 
@@ -655,7 +1032,7 @@ static void saveg_read_player_t(player_t *str)
     int i;
 
     // mobj_t* mo;
-    str->mo = static_cast<mobj_t*>(saveg_readp());
+    str->mo = saveg_read_mobjp();
 
     // playerstate_t playerstate;
     str->playerstate = static_cast<playerstate_t>(saveg_read_enum());
@@ -760,7 +1137,7 @@ static void saveg_read_player_t(player_t *str)
     str->bonuscount = saveg_read32();
 
     // mobj_t* attacker;
-    str->attacker = static_cast<mobj_t*>(saveg_readp());
+    str->attacker = saveg_read_mobjp();
 
     // int extralight;
     str->extralight = saveg_read32();
@@ -786,7 +1163,7 @@ static void saveg_write_player_t(player_t *str)
     int i;
 
     // mobj_t* mo;
-    saveg_writep(str->mo);
+    saveg_write_mobjp(str->mo);
 
     // playerstate_t playerstate;
     saveg_write_enum(str->playerstate);
@@ -891,7 +1268,7 @@ static void saveg_write_player_t(player_t *str)
     saveg_write32(str->bonuscount);
 
     // mobj_t* attacker;
-    saveg_writep(str->attacker);
+    saveg_write_mobjp(str->attacker);
 
     // int extralight;
     saveg_write32(str->extralight);
@@ -1352,6 +1729,95 @@ static void saveg_write_glow_t(glow_t *str)
     saveg_write32(str->direction);
 }
 
+//
+// Compressed bodies
+//
+// Everything after the header of a compressed savegame, and the whole
+// of a snapshot, is written to an inner stream and then compressed
+// into the outer one, preceded by its uncompressed and compressed
+// lengths.
+//
+
+static void saveg_begin_body_write(void)
+{
+    save_outerstream = save_stream;
+    save_stream = mem_fopen_write();
+}
+
+static void saveg_end_body_write(void)
+{
+    void *raw;
+    size_t rawlen;
+    byte *packed;
+    size_t packedlen;
+
+    mem_get_buf(save_stream, &raw, &rawlen);
+
+    packed = static_cast<byte*>(Z_Malloc(M_LZCompressBound(rawlen),
+                                         PU_STATIC, NULL));
+    packedlen = M_LZCompress(static_cast<byte*>(raw), rawlen, packed);
+
+    mem_fclose(save_stream);
+    save_stream = save_outerstream;
+    save_outerstream = NULL;
+
+    saveg_write32(rawlen);
+    saveg_write32(packedlen);
+    saveg_write_bytes(packed, packedlen);
+
+    Z_Free(packed);
+}
+
+// Decompress the body at the current position of save_stream and
+// carry on reading from that instead.  Returns false if it is corrupt.
+
+static boolean saveg_begin_body_read(void)
+{
+    void *buf;
+    size_t buflen;
+    size_t pos;
+    size_t rawlen;
+    size_t packedlen;
+
+    rawlen = static_cast<unsigned int>(saveg_read32());
+    packedlen = static_cast<unsigned int>(saveg_read32());
+
+    mem_get_buf(save_stream, &buf, &buflen);
+    pos = mem_ftell(save_stream);
+
+    if (savegame_error || packedlen > buflen - pos)
+    {
+        return false;
+    }
+
+    save_bodybuffer = Z_Malloc(rawlen > 0 ? rawlen : 1, PU_STATIC, NULL);
+
+    if (!M_LZDecompress(static_cast<byte*>(buf) + pos, packedlen,
+                        static_cast<byte*>(save_bodybuffer), rawlen))
+    {
+        Z_Free(save_bodybuffer);
+        save_bodybuffer = NULL;
+        return false;
+    }
+
+    mem_fseek(save_stream, pos + packedlen, MEM_SEEK_SET);
+
+    save_outerstream = save_stream;
+    save_stream = mem_fopen_read(save_bodybuffer, rawlen);
+
+    return true;
+}
+
+static void saveg_end_body_read(void)
+{
+    mem_fclose(save_stream);
+    save_stream = save_outerstream;
+    save_outerstream = NULL;
+
+    Z_Free(save_bodybuffer);
+    save_bodybuffer = NULL;
+}
+
 //
 // Write the header for a savegame
 //
@@ -1366,8 +1832,18 @@ void P_WriteSaveGameHeader(char *description)
     for (; i<SAVESTRINGSIZE; ++i)
         saveg_write8(0);
 
+    savegame_compressed = compressed_savegames != 0;
+
     memset(name, 0, sizeof(name));
-    M_snprintf(name, sizeof(name), "version %i", G_VanillaVersionCode());
+    if (savegame_compressed)
+    {
+        M_snprintf(name, sizeof(name), "version %i lz%i",
+                   G_VanillaVersionCode(), SAVEGAME_LZ_VERSION);
+    }
+    else
+    {
+        M_snprintf(name, sizeof(name), "version %i", G_VanillaVersionCode());
+    }
 
     for (i=0; i<VERSIONSIZE; ++i)
         saveg_write8(name[i]);
@@ -1382,6 +1858,11 @@ void P_WriteSaveGameHeader(char *description)
     saveg_write8((leveltime >> 16) & 0xff);
     saveg_write8((leveltime >> 8) & 0xff);
     saveg_write8(leveltime & 0xff);
+
+    if (savegame_compressed)
+    {
+        saveg_begin_body_write();
+    }
 }
 
 // 
@@ -1405,8 +1886,17 @@ boolean P_ReadSaveGameHeader(void)
 
     memset(vcheck, 0, sizeof(vcheck));
     M_snprintf(vcheck, sizeof(vcheck), "version %i", G_VanillaVersionCode());
-    if (strcmp(read_vcheck, vcheck) != 0)
-	return false;				// bad version 
+    savegame_compressed = false;
+    if (strncmp(read_vcheck, vcheck, VERSIONSIZE) != 0)
+    {
+        // Not vanilla; perhaps a compressed savegame.
+        memset(vcheck, 0, sizeof(vcheck));
+        M_snprintf(vcheck, sizeof(vcheck), "version %i lz%i",
+                   G_VanillaVersionCode(), SAVEGAME_LZ_VERSION);
+        if (strncmp(read_vcheck, vcheck, VERSIONSIZE) != 0)
+            return false;			// bad version 
+        savegame_compressed = true;
+    }
 
     gameskill = static_cast<skill_t>(saveg_read8());
     gameepisode = saveg_read8();
@@ -1421,6 +1911,9 @@ boolean P_ReadSaveGameHeader(void)
     c = saveg_read8();
     leveltime = (a<<16) + (b<<8) + c; 
 
+    if (savegame_compressed && !saveg_begin_body_read())
+	return false;
+
     return true;
 }
 
@@ -1434,6 +1927,17 @@ boolean P_ReadSaveGameEOF(void)
 
     value = saveg_read8();
 
+    // The body of a compressed savegame ends with one too.
+    if (save_outerstream != NULL)
+    {
+        saveg_end_body_read();
+
+        if (value == SAVEGAME_EOF)
+        {
+            value = saveg_read8();
+        }
+    }
+
     return value == SAVEGAME_EOF;
 }
 
@@ -1444,6 +1948,12 @@ boolean P_ReadSaveGameEOF(void)
 void P_WriteSaveGameEOF(void)
 {
     saveg_write8(SAVEGAME_EOF);
+
+    if (save_outerstream != NULL)
+    {
+        saveg_end_body_write();
+        saveg_write8(SAVEGAME_EOF);
+    }
 }
 
 //
@@ -1491,38 +2001,296 @@ void P_UnArchivePlayers (void)
 
 
 //
-// P_ArchiveWorld
+// World baseline
 //
-void P_ArchiveWorld (void)
+// Compressed savegames and snapshots only store the sectors, lines
+// and sides that differ from how they were when the level was loaded.
+//
+
+typedef struct
 {
-    int			i;
-    int			j;
-    sector_t*		sec;
-    line_t*		li;
-    side_t*		si;
-    
-    // do sectors
-    for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
-    {
-	saveg_write16(sec->floorheight >> FRACBITS);
-	saveg_write16(sec->ceilingheight >> FRACBITS);
-	saveg_write16(sec->floorpic);
-	saveg_write16(sec->ceilingpic);
-	saveg_write16(sec->lightlevel);
-	saveg_write16(sec->special);		// needed?
-	saveg_write16(sec->tag);		// needed?
-    }
+    fixed_t floorheight;
+    fixed_t ceilingheight;
+    short floorpic;
+    short ceilingpic;
+    short lightlevel;
+    short special;
+    short tag;
+} sectorbase_t;
+
+typedef struct
+{
+    short flags;
+    short special;
+    short tag;
+} linebase_t;
 
-    
-    // do lines
-    for (i=0, li = lines ; i<numlines ; i++,li++)
-    {
-	saveg_write16(li->flags);
-	saveg_write16(li->special);
-	saveg_write16(li->tag);
-	for (j=0 ; j<2 ; j++)
-	{
-	    if (li->sidenum[j] == -1)
+typedef struct
+{
+    fixed_t textureoffset;
+    fixed_t rowoffset;
+    short toptexture;
+    short bottomtexture;
+    short midtexture;
+} sidebase_t;
+
+static std::vector<sectorbase_t> sectorbase;
+static std::vector<linebase_t> linebase;
+static std::vector<sidebase_t> sidebase;
+
+static boolean saveg_sector_changed(const sector_t *sec,
+                                    const sectorbase_t *base)
+{
+    return sec->floorheight != base->floorheight
+        || sec->ceilingheight != base->ceilingheight
+        || sec->floorpic != base->floorpic
+        || sec->ceilingpic != base->ceilingpic
+        || sec->lightlevel != base->lightlevel
+        || sec->special != base->special
+        || sec->tag != base->tag;
+}
+
+static boolean saveg_line_changed(const line_t *li, const linebase_t *base)
+{
+    return li->flags != base->flags
+        || li->special != base->special
+        || li->tag != base->tag;
+}
+
+static boolean saveg_side_changed(const side_t *si, const sidebase_t *base)
+{
+    return si->textureoffset != base->textureoffset
+        || si->rowoffset != base->rowoffset
+        || si->toptexture != base->toptexture
+        || si->bottomtexture != base->bottomtexture
+        || si->midtexture != base->midtexture;
+}
+
+//
+// P_RecordWorldBaseline
+//
+void P_RecordWorldBaseline (void)
+{
+    int i;
+
+    sectorbase.resize(numsectors);
+    for (i = 0; i < numsectors; i++)
+    {
+        sectorbase[i].floorheight = sectors[i].floorheight;
+        sectorbase[i].ceilingheight = sectors[i].ceilingheight;
+        sectorbase[i].floorpic = sectors[i].floorpic;
+        sectorbase[i].ceilingpic = sectors[i].ceilingpic;
+        sectorbase[i].lightlevel = sectors[i].lightlevel;
+        sectorbase[i].special = sectors[i].special;
+        sectorbase[i].tag = sectors[i].tag;
+    }
+
+    linebase.resize(numlines);
+    for (i = 0; i < numlines; i++)
+    {
+        linebase[i].flags = lines[i].flags;
+        linebase[i].special = lines[i].special;
+        linebase[i].tag = lines[i].tag;
+    }
+
+    sidebase.resize(numsides);
+    for (i = 0; i < numsides; i++)
+    {
+        sidebase[i].textureoffset = sides[i].textureoffset;
+        sidebase[i].rowoffset = sides[i].rowoffset;
+        sidebase[i].toptexture = sides[i].toptexture;
+        sidebase[i].bottomtexture = sides[i].bottomtexture;
+        sidebase[i].midtexture = sides[i].midtexture;
+    }
+}
+
+// Write out each changed sector, line and side in full, preceded by
+// its number plus one.  Each kind ends with a zero.
+
+static void saveg_write_world_changes(void)
+{
+    int i;
+    sector_t *sec;
+    line_t *li;
+    side_t *si;
+
+    for (i = 0, sec = sectors; i < numsectors; i++, sec++)
+    {
+        if (!saveg_sector_changed(sec, &sectorbase[i]))
+            continue;
+
+        saveg_write32(i + 1);
+        saveg_write32(sec->floorheight);
+        saveg_write32(sec->ceilingheight);
+        saveg_write16(sec->floorpic);
+        saveg_write16(sec->ceilingpic);
+        saveg_write16(sec->lightlevel);
+        saveg_write16(sec->special);
+        saveg_write16(sec->tag);
+    }
+    saveg_write32(0);
+
+    for (i = 0, li = lines; i < numlines; i++, li++)
+    {
+        if (!saveg_line_changed(li, &linebase[i]))
+            continue;
+
+        saveg_write32(i + 1);
+        saveg_write16(li->flags);
+        saveg_write16(li->special);
+        saveg_write16(li->tag);
+    }
+    saveg_write32(0);
+
+    for (i = 0, si = sides; i < numsides; i++, si++)
+    {
+        if (!saveg_side_changed(si, &sidebase[i]))
+            continue;
+
+        saveg_write32(i + 1);
+        saveg_write32(si->textureoffset);
+        saveg_write32(si->rowoffset);
+        saveg_write16(si->toptexture);
+        saveg_write16(si->bottomtexture);
+        saveg_write16(si->midtexture);
+    }
+    saveg_write32(0);
+}
+
+// Read a number written by saveg_write_world_changes, checking that
+// it is in range.  Returns -1 at the end of the list.
+
+static int saveg_read_world_index(int count)
+{
+    int i = saveg_read32();
+
+    if (savegame_error)
+    {
+        return -1;
+    }
+
+    if (i < 0 || i > count)
+    {
+        I_Error("Bad world index %i in savegame", i);
+    }
+
+    return i - 1;
+}
+
+// Put the world back as it was when the level was loaded, then apply
+// the changes written by saveg_write_world_changes.
+
+static void saveg_read_world_changes(void)
+{
+    int i;
+    sector_t *sec;
+    line_t *li;
+    side_t *si;
+
+    if (sectorbase.size() != static_cast<size_t>(numsectors)
+     || linebase.size() != static_cast<size_t>(numlines)
+     || sidebase.size() != static_cast<size_t>(numsides))
+    {
+        I_Error("saveg_read_world_changes: No baseline for this level");
+    }
+
+    for (i = 0, sec = sectors; i < numsectors; i++, sec++)
+    {
+        sec->floorheight = sectorbase[i].floorheight;
+        sec->ceilingheight = sectorbase[i].ceilingheight;
+        sec->floorpic = sectorbase[i].floorpic;
+        sec->ceilingpic = sectorbase[i].ceilingpic;
+        sec->lightlevel = sectorbase[i].lightlevel;
+        sec->special = sectorbase[i].special;
+        sec->tag = sectorbase[i].tag;
+    }
+
+    for (i = 0, li = lines; i < numlines; i++, li++)
+    {
+        li->flags = linebase[i].flags;
+        li->special = linebase[i].special;
+        li->tag = linebase[i].tag;
+    }
+
+    for (i = 0, si = sides; i < numsides; i++, si++)
+    {
+        si->textureoffset = sidebase[i].textureoffset;
+        si->rowoffset = sidebase[i].rowoffset;
+        si->toptexture = sidebase[i].toptexture;
+        si->bottomtexture = sidebase[i].bottomtexture;
+        si->midtexture = sidebase[i].midtexture;
+    }
+
+    while ((i = saveg_read_world_index(numsectors)) >= 0)
+    {
+        sec = &sectors[i];
+        sec->floorheight = saveg_read32();
+        sec->ceilingheight = saveg_read32();
+        sec->floorpic = saveg_read16();
+        sec->ceilingpic = saveg_read16();
+        sec->lightlevel = saveg_read16();
+        sec->special = saveg_read16();
+        sec->tag = saveg_read16();
+    }
+
+    while ((i = saveg_read_world_index(numlines)) >= 0)
+    {
+        li = &lines[i];
+        li->flags = saveg_read16();
+        li->special = saveg_read16();
+        li->tag = saveg_read16();
+    }
+
+    while ((i = saveg_read_world_index(numsides)) >= 0)
+    {
+        si = &sides[i];
+        si->textureoffset = saveg_read32();
+        si->rowoffset = saveg_read32();
+        si->toptexture = saveg_read16();
+        si->bottomtexture = saveg_read16();
+        si->midtexture = saveg_read16();
+    }
+}
+
+//
+// P_ArchiveWorld
+//
+void P_ArchiveWorld (void)
+{
+    int			i;
+    int			j;
+    sector_t*		sec;
+    line_t*		li;
+    side_t*		si;
+
+    if (savegame_compressed)
+    {
+	saveg_write_world_changes ();
+	return;
+    }
+    
+    // do sectors
+    for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
+    {
+	saveg_write16(sec->floorheight >> FRACBITS);
+	saveg_write16(sec->ceilingheight >> FRACBITS);
+	saveg_write16(sec->floorpic);
+	saveg_write16(sec->ceilingpic);
+	saveg_write16(sec->lightlevel);
+	saveg_write16(sec->special);		// needed?
+	saveg_write16(sec->tag);		// needed?
+    }
+
+    
+    // do lines
+    for (i=0, li = lines ; i<numlines ; i++,li++)
+    {
+	saveg_write16(li->flags);
+	saveg_write16(li->special);
+	saveg_write16(li->tag);
+	for (j=0 ; j<2 ; j++)
+	{
+	    if (li->sidenum[j] == -1)
 		continue;
 	    
 	    si = &sides[li->sidenum[j]];
@@ -1548,6 +2316,20 @@ void P_UnArchiveWorld (void)
     sector_t*		sec;
     line_t*		li;
     side_t*		si;
+
+    if (savegame_compressed)
+    {
+	saveg_read_world_changes ();
+
+	for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
+	{
+	    sec->specialdata = 0;
+	    sec->soundtarget = 0;
+	}
+
+	P_ResetNeighborHeights ();
+	return;
+    }
     
     // do sectors
     for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
@@ -1581,6 +2363,8 @@ void P_UnArchiveWorld (void)
 	    si->midtexture = saveg_read16();
 	}
     }
+
+    P_ResetNeighborHeights ();
 }
 
 
@@ -1627,29 +2411,50 @@ void P_ArchiveThinkers (void)
 
 
 //
-// P_UnArchiveThinkers
+// saveg_remove_thinkers
+// Get rid of all the current thinkers.
 //
-void P_UnArchiveThinkers (void)
+static void saveg_remove_thinkers (void)
 {
-    byte		tclass;
     thinker_t*		currentthinker;
     thinker_t*		next;
-    mobj_t*		mobj;
-    
-    // remove all the current thinkers
+    int			i;
+
     currentthinker = thinkercap.next;
     while (currentthinker != &thinkercap)
     {
 	next = currentthinker->next;
 	
+	// Nothing will come back round to free removed mobjs once they
+	// are off the list, so they go now.
 	if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
 	    P_RemoveMobj ((mobj_t *)currentthinker);
-	else
-	    Z_Free (currentthinker);
+
+	Z_Free (currentthinker);
 
 	currentthinker = next;
     }
     P_InitThinkers ();
+
+    // The plats and ceilings these list have just been freed; the
+    // specials read back in add themselves again.
+    for (i = 0; i < MAXPLATS; i++)
+	activeplats[i] = NULL;
+
+    for (i = 0; i < MAXCEILINGS; i++)
+	activeceilings[i] = NULL;
+}
+
+
+//
+// P_UnArchiveThinkers
+//
+void P_UnArchiveThinkers (void)
+{
+    byte		tclass;
+    mobj_t*		mobj;
+    
+    saveg_remove_thinkers ();
     
     // read in saved thinkers
     while (1)
@@ -1667,6 +2472,7 @@ void P_UnArchiveThinkers (void)
 
 	    mobj->target = NULL;
             mobj->tracer = NULL;
+            mobj->touchingsectors = NULL;
 	    P_SetThingPosition (mobj);
 	    mobj->info = &mobjinfo[mobj->type];
 	    mobj->floorz = mobj->subsector->sector->floorheight;
@@ -1713,86 +2519,118 @@ enum
 // T_Glow, (glow_t: sector_t *),
 // T_PlatRaise, (plat_t: sector_t *), - active list
 //
-void P_ArchiveSpecials (void)
+
+//
+// saveg_write_special
+// Writes out a single special thinker, returning false if th is not
+// one that gets archived.
+//
+static boolean saveg_write_special (thinker_t* th)
 {
-    thinker_t*		th;
     int			i;
-	
-    // save off the current thinkers
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+
+    if (th->function.acv == (actionf_v)NULL)
     {
-	if (th->function.acv == (actionf_v)NULL)
+	for (i = 0; i < MAXCEILINGS;i++)
+	    if (activeceilings[i] == (ceiling_t *)th)
+		break;
+
+	if (i<MAXCEILINGS)
 	{
-	    for (i = 0; i < MAXCEILINGS;i++)
-		if (activeceilings[i] == (ceiling_t *)th)
+	    saveg_write8(tc_ceiling);
+	    saveg_write_pad();
+	    saveg_write_ceiling_t((ceiling_t *) th);
+	    return true;
+	}
+
+	// Platforms in stasis are lost by savegames, but a snapshot
+	// has to bring them back.
+	if (savegame_snapshot)
+	{
+	    for (i = 0; i < MAXPLATS;i++)
+		if (activeplats[i] == (plat_t *)th)
 		    break;
-	    
-	    if (i<MAXCEILINGS)
+
+	    if (i<MAXPLATS)
 	    {
-                saveg_write8(tc_ceiling);
+		saveg_write8(tc_plat);
 		saveg_write_pad();
-                saveg_write_ceiling_t((ceiling_t *) th);
+		saveg_write_plat_t((plat_t *) th);
+		return true;
 	    }
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_MoveCeiling)
-	{
-            saveg_write8(tc_ceiling);
-	    saveg_write_pad();
-            saveg_write_ceiling_t((ceiling_t *) th);
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_VerticalDoor)
-	{
-            saveg_write8(tc_door);
-	    saveg_write_pad();
-            saveg_write_vldoor_t((vldoor_t *) th);
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_MoveFloor)
-	{
-            saveg_write8(tc_floor);
-	    saveg_write_pad();
-            saveg_write_floormove_t((floormove_t *) th);
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_PlatRaise)
-	{
-            saveg_write8(tc_plat);
-	    saveg_write_pad();
-            saveg_write_plat_t((plat_t *) th);
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_LightFlash)
-	{
-            saveg_write8(tc_flash);
-	    saveg_write_pad();
-            saveg_write_lightflash_t((lightflash_t *) th);
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_StrobeFlash)
-	{
-            saveg_write8(tc_strobe);
-	    saveg_write_pad();
-            saveg_write_strobe_t((strobe_t *) th);
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_Glow)
-	{
-            saveg_write8(tc_glow);
-	    saveg_write_pad();
-            saveg_write_glow_t((glow_t *) th);
-	    continue;
 	}
+	return false;
     }
-	
+
+    if (th->function.acp1 == (actionf_p1)T_MoveCeiling)
+    {
+	saveg_write8(tc_ceiling);
+	saveg_write_pad();
+	saveg_write_ceiling_t((ceiling_t *) th);
+	return true;
+    }
+
+    if (th->function.acp1 == (actionf_p1)T_VerticalDoor)
+    {
+	saveg_write8(tc_door);
+	saveg_write_pad();
+	saveg_write_vldoor_t((vldoor_t *) th);
+	return true;
+    }
+
+    if (th->function.acp1 == (actionf_p1)T_MoveFloor)
+    {
+	saveg_write8(tc_floor);
+	saveg_write_pad();
+	saveg_write_floormove_t((floormove_t *) th);
+	return true;
+    }
+
+    if (th->function.acp1 == (actionf_p1)T_PlatRaise)
+    {
+	saveg_write8(tc_plat);
+	saveg_write_pad();
+	saveg_write_plat_t((plat_t *) th);
+	return true;
+    }
+
+    if (th->function.acp1 == (actionf_p1)T_LightFlash)
+    {
+	saveg_write8(tc_flash);
+	saveg_write_pad();
+	saveg_write_lightflash_t((lightflash_t *) th);
+	return true;
+    }
+
+    if (th->function.acp1 == (actionf_p1)T_StrobeFlash)
+    {
+	saveg_write8(tc_strobe);
+	saveg_write_pad();
+	saveg_write_strobe_t((strobe_t *) th);
+	return true;
+    }
+
+    if (th->function.acp1 == (actionf_p1)T_Glow)
+    {
+	saveg_write8(tc_glow);
+	saveg_write_pad();
+	saveg_write_glow_t((glow_t *) th);
+	return true;
+    }
+
+    return false;
+}
+
+void P_ArchiveSpecials (void)
+{
+    thinker_t*		th;
+
+    // save off the current thinkers
+    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    {
+	saveg_write_special(th);
+    }
+
     // add a terminating marker
     saveg_write8(tc_endspecials);
 
@@ -1800,11 +2638,11 @@ void P_ArchiveSpecials (void)
 
 
 //
-// P_UnArchiveSpecials
+// saveg_read_special
+// Reads back in a single special thinker of the given class.
 //
-void P_UnArchiveSpecials (void)
+static void saveg_read_special (byte tclass)
 {
-    byte		tclass;
     ceiling_t*		ceiling;
     vldoor_t*		door;
     floormove_t*	floor;
@@ -1812,93 +2650,633 @@ void P_UnArchiveSpecials (void)
     lightflash_t*	flash;
     strobe_t*		strobe;
     glow_t*		glow;
-	
-	
-    // read in saved thinkers
-    while (1)
+
+    switch (tclass)
     {
-	tclass = saveg_read8();
+      case tc_ceiling:
+	saveg_read_pad();
+	ceiling = static_cast<ceiling_t*>(Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL));
+	saveg_read_ceiling_t(ceiling);
+	ceiling->sector->specialdata = ceiling;
 
-	switch (tclass)
-	{
-	  case tc_endspecials:
-	    return;	// end of list
-			
-	  case tc_ceiling:
-	    saveg_read_pad();
-	    ceiling = static_cast<ceiling_t*>(Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL));
-            saveg_read_ceiling_t(ceiling);
-	    ceiling->sector->specialdata = ceiling;
+	if (ceiling->thinker.function.acp1)
+	    ceiling->thinker.function.acp1 = (actionf_p1)T_MoveCeiling;
 
-	    if (ceiling->thinker.function.acp1)
-		ceiling->thinker.function.acp1 = (actionf_p1)T_MoveCeiling;
+	P_AddThinker (&ceiling->thinker);
+	P_AddActiveCeiling(ceiling);
+	break;
 
-	    P_AddThinker (&ceiling->thinker);
-	    P_AddActiveCeiling(ceiling);
-	    break;
-				
-	  case tc_door:
-	    saveg_read_pad();
-	    door = static_cast<vldoor_t*>(Z_Malloc (sizeof(*door), PU_LEVEL, NULL));
-            saveg_read_vldoor_t(door);
-	    door->sector->specialdata = door;
-	    door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
-	    P_AddThinker (&door->thinker);
-	    break;
-				
-	  case tc_floor:
-	    saveg_read_pad();
-	    floor = static_cast<floormove_t*>(Z_Malloc (sizeof(*floor), PU_LEVEL, NULL));
-            saveg_read_floormove_t(floor);
-	    floor->sector->specialdata = floor;
-	    floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
-	    P_AddThinker (&floor->thinker);
-	    break;
-				
-	  case tc_plat:
-	    saveg_read_pad();
-	    plat = static_cast<plat_t*>(Z_Malloc (sizeof(*plat), PU_LEVEL, NULL));
-            saveg_read_plat_t(plat);
-	    plat->sector->specialdata = plat;
+      case tc_door:
+	saveg_read_pad();
+	door = static_cast<vldoor_t*>(Z_Malloc (sizeof(*door), PU_LEVEL, NULL));
+	saveg_read_vldoor_t(door);
+	door->sector->specialdata = door;
+	door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
+	P_AddThinker (&door->thinker);
+	break;
+
+      case tc_floor:
+	saveg_read_pad();
+	floor = static_cast<floormove_t*>(Z_Malloc (sizeof(*floor), PU_LEVEL, NULL));
+	saveg_read_floormove_t(floor);
+	floor->sector->specialdata = floor;
+	floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
+	P_AddThinker (&floor->thinker);
+	break;
+
+      case tc_plat:
+	saveg_read_pad();
+	plat = static_cast<plat_t*>(Z_Malloc (sizeof(*plat), PU_LEVEL, NULL));
+	saveg_read_plat_t(plat);
+	plat->sector->specialdata = plat;
 
-	    if (plat->thinker.function.acp1)
-		plat->thinker.function.acp1 = (actionf_p1)T_PlatRaise;
+	if (plat->thinker.function.acp1)
+	    plat->thinker.function.acp1 = (actionf_p1)T_PlatRaise;
 
-	    P_AddThinker (&plat->thinker);
-	    P_AddActivePlat(plat);
-	    break;
-				
-	  case tc_flash:
-	    saveg_read_pad();
-	    flash = static_cast<lightflash_t*>(Z_Malloc (sizeof(*flash), PU_LEVEL, NULL));
-            saveg_read_lightflash_t(flash);
-	    flash->thinker.function.acp1 = (actionf_p1)T_LightFlash;
-	    P_AddThinker (&flash->thinker);
-	    break;
-				
-	  case tc_strobe:
-	    saveg_read_pad();
-	    strobe = static_cast<strobe_t*>(Z_Malloc (sizeof(*strobe), PU_LEVEL, NULL));
-            saveg_read_strobe_t(strobe);
-	    strobe->thinker.function.acp1 = (actionf_p1)T_StrobeFlash;
-	    P_AddThinker (&strobe->thinker);
-	    break;
-				
-	  case tc_glow:
-	    saveg_read_pad();
-	    glow = static_cast<glow_t*>(Z_Malloc (sizeof(*glow), PU_LEVEL, NULL));
-            saveg_read_glow_t(glow);
-	    glow->thinker.function.acp1 = (actionf_p1)T_Glow;
-	    P_AddThinker (&glow->thinker);
-	    break;
-				
-	  default:
-	    I_Error ("P_UnarchiveSpecials:Unknown tclass %i "
-		     "in savegame",tclass);
-	}
-	
+	P_AddThinker (&plat->thinker);
+	P_AddActivePlat(plat);
+	break;
+
+      case tc_flash:
+	saveg_read_pad();
+	flash = static_cast<lightflash_t*>(Z_Malloc (sizeof(*flash), PU_LEVEL, NULL));
+	saveg_read_lightflash_t(flash);
+	flash->thinker.function.acp1 = (actionf_p1)T_LightFlash;
+	P_AddThinker (&flash->thinker);
+	break;
+
+      case tc_strobe:
+	saveg_read_pad();
+	strobe = static_cast<strobe_t*>(Z_Malloc (sizeof(*strobe), PU_LEVEL, NULL));
+	saveg_read_strobe_t(strobe);
+	strobe->thinker.function.acp1 = (actionf_p1)T_StrobeFlash;
+	P_AddThinker (&strobe->thinker);
+	break;
+
+      case tc_glow:
+	saveg_read_pad();
+	glow = static_cast<glow_t*>(Z_Malloc (sizeof(*glow), PU_LEVEL, NULL));
+	saveg_read_glow_t(glow);
+	glow->thinker.function.acp1 = (actionf_p1)T_Glow;
+	P_AddThinker (&glow->thinker);
+	break;
+
+      default:
+	I_Error ("P_UnarchiveSpecials:Unknown tclass %i "
+		 "in savegame",tclass);
+    }
+}
+
+//
+// P_UnArchiveSpecials
+//
+void P_UnArchiveSpecials (void)
+{
+    byte		tclass;
+
+    // read in saved thinkers
+    while (1)
+    {
+	tclass = saveg_read8();
+
+	if (tclass == tc_endspecials)
+	    return;	// end of list
+
+	saveg_read_special(tclass);
+    }
+}
+
+
+
+//
+// Snapshots
+//
+// A snapshot is a copy of the running level, kept in memory so that
+// demo playback can jump back to it.  Unlike a savegame, everything
+// that feeds back into the play simulation is kept exactly: mobj
+// references, fractional heights, the order of the thinker, sector
+// and blockmap lists and the random number indexes.  A level restored
+// from a snapshot plays on exactly as the original did.
+//
+
+enum
+{
+    tc_snapmobj = tc_endspecials + 1,
+    tc_snapremoved
+};
+
+// Write out the members of a mobj list in order, linked through next.
+
+static void saveg_write_mobjlist(mobj_t *list, mobj_t *mobj_t::*next)
+{
+    mobj_t *mo;
+
+    for (mo = list; mo != NULL; mo = mo->*next)
+    {
+        saveg_write_mobjp(mo);
+    }
+
+    saveg_write32(0);
+}
+
+// Read back a mobj list written by saveg_write_mobjlist, relinking the
+// mobjs in it in their original order.  Returns the head of the list.
+
+static mobj_t *saveg_read_mobjlist(mobj_t *mobj_t::*next,
+                                   mobj_t *mobj_t::*prev)
+{
+    mobj_t *head = NULL;
+    mobj_t *tail = NULL;
+    mobj_t *mo;
+
+    while ((mo = saveg_resolve_mobj(saveg_read_mobjp())) != NULL)
+    {
+        mo->*prev = tail;
+        mo->*next = NULL;
+
+        if (tail != NULL)
+        {
+            tail->*next = mo;
+        }
+        else
+        {
+            head = mo;
+        }
+
+        tail = mo;
+    }
+
+    return head;
+}
+
+// The world goes out as changes from the freshly loaded level, with
+// the sound propagation state of any sector that has some.
+
+static void saveg_write_snapshot_world(void)
+{
+    int i;
+    sector_t *sec;
+
+    saveg_write_world_changes();
+
+    for (i = 0, sec = sectors; i < numsectors; i++, sec++)
+    {
+        if (sec->soundtraversed == 0 && sec->soundtarget == NULL)
+        {
+            continue;
+        }
+
+        saveg_write32(i + 1);
+        saveg_write32(sec->soundtraversed);
+        saveg_write_mobjp(sec->soundtarget);
+    }
+    saveg_write32(0);
+}
+
+static void saveg_read_snapshot_world(void)
+{
+    int i;
+    sector_t *sec;
+
+    saveg_read_world_changes();
+
+    for (i = 0, sec = sectors; i < numsectors; i++, sec++)
+    {
+        sec->soundtraversed = 0;
+        sec->soundtarget = NULL;
+        sec->specialdata = NULL;
+    }
+
+    while ((i = saveg_read_world_index(numsectors)) >= 0)
+    {
+        sec = &sectors[i];
+        sec->soundtraversed = saveg_read32();
+
+        // Resolved once the mobjs are back.
+        sec->soundtarget = saveg_read_mobjp();
+    }
+
+    P_ResetNeighborHeights();
+}
+
+// Mobjs and specials go out in a single list so that they come back
+// in the order they think in.  Mobjs that have been removed this tic
+// but not yet freed are kept too, since others may still refer to
+// them.
+
+static void saveg_write_snapshot_thinkers(void)
+{
+    thinker_t *th;
+
+    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    {
+        if (snapshot_indexes.count((mobj_t *) th) > 0)
+        {
+            if (th->function.acv == (actionf_v) -1)
+            {
+                saveg_write8(tc_snapremoved);
+            }
+            else
+            {
+                saveg_write8(tc_snapmobj);
+            }
+
+            saveg_write_pad();
+            saveg_write_mobj_t((mobj_t *) th);
+            continue;
+        }
+
+        if (th->function.acv != (actionf_v) -1)
+        {
+            saveg_write_special(th);
+        }
+    }
+
+    saveg_write8(tc_endspecials);
+}
+
+static void saveg_read_snapshot_thinkers(void)
+{
+    byte tclass;
+    mobj_t *mobj;
+
+    for (;;)
+    {
+        tclass = saveg_read8();
+
+        if (tclass == tc_endspecials)
+        {
+            break;
+        }
+
+        if (tclass != tc_snapmobj && tclass != tc_snapremoved)
+        {
+            saveg_read_special(tclass);
+            continue;
+        }
+
+        saveg_read_pad();
+        mobj = static_cast<mobj_t*>(Z_Malloc(sizeof(*mobj), PU_LEVEL, NULL));
+        saveg_read_mobj_t(mobj);
+
+        mobj->info = &mobjinfo[mobj->type];
+        mobj->touchingsectors = NULL;
+        mobj->thinker.function.acp1 = (actionf_p1) P_MobjThinker;
+
+        if (tclass == tc_snapremoved)
+        {
+            mobj->subsector = R_PointInSubsector(mobj->x, mobj->y);
+            mobj->thinker.function.acv = (actionf_v) -1;
+        }
+        else
+        {
+            // Keeps floorz and ceilingz as they were.
+            P_SetThingPosition(mobj);
+        }
+
+        P_AddThinker(&mobj->thinker);
+        snapshot_mobjs.push_back(mobj);
+    }
+}
+
+// Work out which thinkers are mobjs and number them.  A thinker that
+// has been removed but not yet freed could be a mobj or a special, but
+// only a mobj can be referred to by something else, so those are the
+// only ones worth keeping.
+
+static void saveg_index_mobjs(void)
+{
+    std::unordered_set<thinker_t *> removed;
+    std::unordered_set<thinker_t *> referenced;
+    thinker_t *th;
+    mobj_t *mo;
+    int count;
+    int i;
+
+    auto refer = [&](mobj_t *ref) {
+        if (ref != NULL && removed.count(&ref->thinker) > 0)
+        {
+            referenced.insert(&ref->thinker);
+        }
+    };
+
+    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    {
+        if (th->function.acv == (actionf_v) -1)
+        {
+            removed.insert(th);
+        }
+    }
+
+    if (!removed.empty())
+    {
+        for (th = thinkercap.next; th != &thinkercap; th = th->next)
+        {
+            if (th->function.acp1 == (actionf_p1) P_MobjThinker)
+            {
+                mo = (mobj_t *) th;
+                refer(mo->target);
+                refer(mo->tracer);
+            }
+        }
+
+        for (i = 0; i < MAXPLAYERS; i++)
+        {
+            if (playeringame[i])
+            {
+                refer(players[i].mo);
+                refer(players[i].attacker);
+            }
+        }
+
+        for (i = 0; i < numsectors; i++)
+        {
+            refer(sectors[i].soundtarget);
+        }
+
+        for (i = 0; i < BODYQUESIZE; i++)
+        {
+            refer(bodyque[i]);
+        }
+
+        for (i = 0; i < numbraintargets; i++)
+        {
+            refer(braintargets[i]);
+        }
+    }
+
+    count = 0;
+    snapshot_indexes.clear();
+
+    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    {
+        if (th->function.acp1 == (actionf_p1) P_MobjThinker
+         || referenced.count(th) > 0)
+        {
+            snapshot_indexes[(mobj_t *) th] = ++count;
+        }
+    }
+}
+
+// Everything else the play simulation depends on that a savegame
+// leaves to chance.
+
+static void saveg_write_snapshot_misc(void)
+{
+    int i;
+
+    saveg_write32(leveltime);
+    saveg_write32(rndindex);
+    saveg_write32(prndindex);
+    saveg_write32(totalkills);
+    saveg_write32(totalitems);
+    saveg_write32(totalsecret);
+    saveg_write32(skytexture);
+
+    saveg_write32(bodyqueslot);
+    for (i = 0; i < BODYQUESIZE; i++)
+    {
+        saveg_write_mobjp(bodyque[i]);
+    }
+
+    saveg_write32(numbraintargets);
+    saveg_write32(braintargeton);
+    saveg_write32(brainspiteasy);
+    for (i = 0; i < numbraintargets; i++)
+    {
+        saveg_write_mobjp(braintargets[i]);
+    }
+
+    saveg_write32(iquehead);
+    saveg_write32(iquetail);
+    for (i = 0; i < ITEMQUESIZE; i++)
+    {
+        saveg_write_mapthing_t(&itemrespawnque[i]);
+        saveg_write32(itemrespawntime[i]);
+    }
+
+    saveg_write32(levelTimer);
+    saveg_write32(levelTimeCount);
+
+    for (i = 0; i < MAXBUTTONS; i++)
+    {
+        saveg_write32(buttonlist[i].line ? buttonlist[i].line - lines : -1);
+        saveg_write_enum(buttonlist[i].where);
+        saveg_write32(buttonlist[i].btexture);
+        saveg_write32(buttonlist[i].btimer);
+    }
+}
+
+static void saveg_read_snapshot_misc(void)
+{
+    int i;
+    int line;
+
+    leveltime = saveg_read32();
+    rndindex = saveg_read32();
+    prndindex = saveg_read32();
+    totalkills = saveg_read32();
+    totalitems = saveg_read32();
+    totalsecret = saveg_read32();
+    skytexture = saveg_read32();
+
+    bodyqueslot = saveg_read32();
+    for (i = 0; i < BODYQUESIZE; i++)
+    {
+        bodyque[i] = saveg_resolve_mobj(saveg_read_mobjp());
     }
 
+    numbraintargets = saveg_read32();
+    braintargeton = saveg_read32();
+    brainspiteasy = saveg_read32();
+    for (i = 0; i < numbraintargets; i++)
+    {
+        braintargets[i] = saveg_resolve_mobj(saveg_read_mobjp());
+    }
+
+    iquehead = saveg_read32();
+    iquetail = saveg_read32();
+    for (i = 0; i < ITEMQUESIZE; i++)
+    {
+        saveg_read_mapthing_t(&itemrespawnque[i]);
+        itemrespawntime[i] = saveg_read32();
+    }
+
+    levelTimer = saveg_read32();
+    levelTimeCount = saveg_read32();
+
+    for (i = 0; i < MAXBUTTONS; i++)
+    {
+        line = saveg_read32();
+        buttonlist[i].line = line >= 0 ? &lines[line] : NULL;
+        buttonlist[i].where = static_cast<bwhere_e>(saveg_read_enum());
+        buttonlist[i].btexture = saveg_read32();
+        buttonlist[i].btimer = saveg_read32();
+        buttonlist[i].soundorg = line >= 0 ?
+            &lines[line].frontsector->soundorg : NULL;
+    }
+}
+
+//
+// P_ArchiveSnapshot
+// Write a snapshot of the current level to save_stream.  An
+// uncompressed one is bigger but much quicker to take and restore.
+//
+void P_ArchiveSnapshot (boolean compress)
+{
+    int i;
+
+    savegame_snapshot = true;
+    saveg_index_mobjs();
+
+    if (compress)
+    {
+        saveg_begin_body_write();
+    }
+
+    for (i = 0; i < MAXPLAYERS; i++)
+    {
+        saveg_write8(playeringame[i]);
+    }
+
+    P_ArchivePlayers();
+    saveg_write_snapshot_world();
+    saveg_write_snapshot_thinkers();
+
+    for (i = 0; i < numsectors; i++)
+    {
+        saveg_write_mobjlist(sectors[i].thinglist, &mobj_t::snext);
+    }
+
+    for (i = 0; i < bmapwidth * bmapheight; i++)
+    {
+        if (blocklinks[i] != NULL)
+        {
+            saveg_write32(i + 1);
+            saveg_write_mobjlist(blocklinks[i], &mobj_t::bnext);
+        }
+    }
+    saveg_write32(0);
+
+    saveg_write_snapshot_misc();
+    P_WriteSaveGameEOF();
+
+    savegame_snapshot = false;
+}
+
+//
+// P_UnArchiveSnapshot
+// Restore the level from a snapshot in save_stream.  The level the
+// snapshot was taken on must already be loaded.
+//
+void P_UnArchiveSnapshot (boolean compressed)
+{
+    mobj_t *playermo[MAXPLAYERS];
+    int cell;
+    int i;
+
+    savegame_snapshot = true;
+    snapshot_mobjs.clear();
+
+    if (compressed && !saveg_begin_body_read())
+    {
+        I_Error("P_UnArchiveSnapshot: Bad snapshot");
+    }
+
+    for (i = 0; i < MAXPLAYERS; i++)
+    {
+        playeringame[i] = saveg_read8();
+    }
+
+    for (i = 0; i < MAXPLAYERS; i++)
+    {
+        if (!playeringame[i])
+            continue;
+
+        saveg_read_pad();
+        saveg_read_player_t(&players[i]);
+        playermo[i] = players[i].mo;
+        players[i].message = NULL;
+    }
+
+    saveg_read_snapshot_world();
+
+    saveg_remove_thinkers();
+    saveg_read_snapshot_thinkers();
+
+    // Now that every mobj exists, turn the references back into
+    // pointers.
+    for (mobj_t *mo : snapshot_mobjs)
+    {
+        mo->target = saveg_resolve_mobj(mo->target);
+        mo->tracer = saveg_resolve_mobj(mo->tracer);
+    }
+
+    for (i = 0; i < MAXPLAYERS; i++)
+    {
+        if (!playeringame[i])
+            continue;
+
+        players[i].mo = saveg_resolve_mobj(playermo[i]);
+        players[i].attacker = saveg_resolve_mobj(players[i].attacker);
+    }
+
+    for (i = 0; i < numsectors; i++)
+    {
+        sectors[i].soundtarget = saveg_resolve_mobj(sectors[i].soundtarget);
+    }
+
+    // Put the sector and blockmap lists back exactly as they were.
+    for (mobj_t *mo : snapshot_mobjs)
+    {
+        mo->snext = mo->sprev = NULL;
+        mo->bnext = mo->bprev = NULL;
+    }
+
+    memset(blocklinks, 0, sizeof(*blocklinks) * bmapwidth * bmapheight);
+
+    for (i = 0; i < numsectors; i++)
+    {
+        sectors[i].thinglist = saveg_read_mobjlist(&mobj_t::snext,
+                                                   &mobj_t::sprev);
+    }
+
+    while ((cell = saveg_read32()) != 0)
+    {
+        blocklinks[cell - 1] = saveg_read_mobjlist(&mobj_t::bnext,
+                                                   &mobj_t::bprev);
+    }
+
+    saveg_read_snapshot_misc();
+
+    if (!P_ReadSaveGameEOF())
+    {
+        I_Error("P_UnArchiveSnapshot: Bad snapshot");
+    }
+
+    savegame_snapshot = false;
+}
+
+//
+// P_SnapshotIndex
+// The number a mobj was given in the last snapshot taken, or 0 if it
+// was not in it.
+//
+int P_SnapshotIndex (mobj_t *mo)
+{
+    auto it = snapshot_indexes.find(mo);
+
+    return it != snapshot_indexes.end() ? it->second : 0;
+}
+
+//
+// P_SnapshotMobj
+// The mobj that took the given number in the last snapshot restored.
+// Only good until the level next runs.
+//
+mobj_t *P_SnapshotMobj (int index)
+{
+    return saveg_resolve_mobj((mobj_t *) (intptr_t) index);
 }
 
 }
@@ -22,6 +22,9 @@
 
 #include <stdio.h>
 
+#include "memio.h"
+#include "p_mobj.h"
+
 namespace theta
 {
 
@@ -32,6 +35,26 @@ namespace theta
 
 #define SAVESTRINGSIZE 24
 
+// Savegame streams.  Savegames are written to and read from memory,
+// and go to and from disk in a single write or read.
+
+void P_OpenSaveGameWrite(void);
+void P_OpenSaveGameRead(void *buf, size_t buflen);
+boolean P_ReadSaveGameFile(const char *filename);
+void P_GetSaveGameBuffer(void **buf, size_t *buflen);
+long P_SaveGameTell(void);
+void P_CloseSaveGame(void);
+
+// Savegames go out to disk on a background thread.  P_SaveGameWriteDone
+// says when the last one has finished; P_FinishSaveGameWrite waits for
+// it and reports any failure.  P_SaveGameWritten says, once, that a
+// write has been finished successfully.
+
+void P_WriteSaveGameAsync(const char *temp_file, const char *save_file);
+boolean P_SaveGameWriteDone(void);
+boolean P_FinishSaveGameWrite(void);
+boolean P_SaveGameWritten(void);
+
 // temporary filename to use while saving.
 
 char *P_TempSaveGameFile(void);
@@ -61,7 +84,21 @@ void P_UnArchiveThinkers (void);
 void P_ArchiveSpecials (void);
 void P_UnArchiveSpecials (void);
 
-extern FILE *save_stream;
+// Record the state of the freshly loaded level, which compressed
+// savegames and snapshots store their differences against.
+void P_RecordWorldBaseline (void);
+
+// In-memory snapshots of the current level, used for seeking within
+// demos and for netgame prediction.
+void P_ArchiveSnapshot (boolean compress);
+void P_UnArchiveSnapshot (boolean compressed);
+
+// Snapshot numbers of mobjs, for anything outside the level that
+// refers to one and has to follow it through a restore.
+int P_SnapshotIndex (mobj_t *mo);
+mobj_t *P_SnapshotMobj (int index);
+
+extern MEMFILE *save_stream;
 extern boolean savegame_error;
 
 }
@@ -21,6 +21,8 @@
 
 #include <math.h>
 
+#include <unordered_set>
+
 #include "z_zone.h"
 
 #include "deh_main.h"
@@ -35,6 +37,7 @@
 
 #include "doomdef.h"
 #include "p_local.h"
+#include "p_saveg.h"
 
 #include "s_sound.h"
 
@@ -119,34 +122,28 @@ mapthing_t	playerstarts[MAXPLAYERS];
 //
 void P_LoadVertexes (int lump)
 {
-    byte*		data;
-    int			i;
-    mapvertex_t*	ml;
+    LumpView<mapvertex_t> data(lump);
     vertex_t*		li;
 
     // Determine number of lumps:
     //  total lump length / vertex record length.
-    numvertexes = W_LumpLength (lump) / sizeof(mapvertex_t);
+    numvertexes = data.Size();
 
     // Allocate zone memory for buffer.
     vertexes = static_cast<vertex_t*>(Z_Malloc (numvertexes*sizeof(vertex_t),PU_LEVEL,0));	
 
-    // Load data into cache.
-    data = static_cast<byte*>(W_CacheLumpNum (lump, PU_STATIC));
-	
-    ml = (mapvertex_t *)data;
     li = vertexes;
 
     // Copy and convert vertex coordinates,
     // internal representation as fixed.
-    for (i=0 ; i<numvertexes ; i++, li++, ml++)
+    // The view reads straight from the WAD, and lets go of it
+    // when it goes out of scope.
+    for (const mapvertex_t& ml : data)
     {
-	li->x = SHORT(ml->x)<<FRACBITS;
-	li->y = SHORT(ml->y)<<FRACBITS;
+	li->x = SHORT(ml.x)<<FRACBITS;
+	li->y = SHORT(ml.y)<<FRACBITS;
+	li++;
     }
-
-    // Free buffer memory.
-    W_ReleaseLumpNum(lump);
 }
 
 //
@@ -555,10 +552,13 @@ void P_LoadBlockMap (int lump)
 void P_GroupLines (void)
 {
     line_t**		linebuffer;
+    sector_t**		neighborbuffer;
+    int*		neighbormarks;
     int			i;
     int			j;
     line_t*		li;
     sector_t*		sector;
+    sector_t*		other;
     subsector_t*	ss;
     seg_t*		seg;
     fixed_t		bbox[4];
@@ -625,6 +625,48 @@ void P_GroupLines (void)
             ++sector->linecount;
         }
     }
+
+    // Build neighbor tables for each sector.  Each sector that
+    // getNextSector returns for one of the lines is listed once.
+
+    neighborbuffer = static_cast<sector_t**>(Z_Malloc (totallines*sizeof(sector_t *), PU_LEVEL, 0));
+    neighbormarks = static_cast<int*>(Z_Malloc (numsectors*sizeof(int), PU_STATIC, 0));
+
+    for (i=0; i<numsectors; ++i)
+    {
+        neighbormarks[i] = -1;
+    }
+
+    sector = sectors;
+    for (i=0 ; i<numsectors ; i++, sector++)
+    {
+        sector->neighbors = neighborbuffer;
+        sector->neighborcount = 0;
+        sector->neighborlines = 0;
+
+        for (j=0 ; j<sector->linecount ; j++)
+        {
+            other = getNextSector(sector->lines[j], sector);
+
+            if (other == NULL)
+                continue;
+
+            ++sector->neighborlines;
+
+            if (neighbormarks[other - sectors] == i)
+                continue;
+
+            neighbormarks[other - sectors] = i;
+            sector->neighbors[sector->neighborcount] = other;
+            ++sector->neighborcount;
+        }
+
+        neighborbuffer += sector->neighborcount;
+    }
+
+    Z_Free(neighbormarks);
+
+    P_ResetNeighborHeights ();
     
     // Generate bounding boxes for sectors
 	
@@ -749,6 +791,64 @@ static void P_LoadReject(int lumpnum)
     }
 }
 
+//
+// P_PrefetchLevel
+// Starts reading in a level's lumps, and the textures and flats
+//  its sides and sectors use, so that the reads overlap with each
+//  other rather than each waiting on the last.
+//
+static void P_PrefetchLevel (int lumpnum)
+{
+    int		i;
+    int		tex;
+    int		flat;
+    char	name[9];
+
+    for (i=ML_THINGS ; i<=ML_BLOCKMAP ; i++)
+    {
+	if (lumpnum+i < (int) numlumps)
+	    W_PrefetchLump (lumpnum+i);
+    }
+
+    // Graphics are only wanted straight away when precaching.
+    if (!precache || lumpnum+ML_SECTORS >= (int) numlumps)
+	return;
+
+    std::unordered_set<int> seen;
+
+    // Reading these waits for them, but the rest of
+    //  the level carries on loading in the meantime.
+    LumpView<mapsidedef_t> sides (lumpnum+ML_SIDEDEFS);
+
+    for (const mapsidedef_t& side : sides)
+    {
+	const char *names[] =
+	    { side.toptexture, side.bottomtexture, side.midtexture };
+
+	for (const char *texname : names)
+	{
+	    tex = R_CheckTextureNumForName (texname);
+
+	    if (tex > 0 && seen.insert (tex).second)
+		R_PrefetchTexture (tex);
+	}
+    }
+
+    LumpView<mapsector_t> secs (lumpnum+ML_SECTORS);
+
+    name[8] = 0;
+    for (const mapsector_t& sec : secs)
+    {
+	memcpy (name, sec.floorpic, 8);
+	if ((flat = R_CheckFlatNumForName (name)) >= 0)
+	    W_PrefetchLump (firstflat + flat);
+
+	memcpy (name, sec.ceilingpic, 8);
+	if ((flat = R_CheckFlatNumForName (name)) >= 0)
+	    W_PrefetchLump (firstflat + flat);
+    }
+}
+
 //
 // P_SetupLevel
 //
@@ -782,6 +882,7 @@ P_SetupLevel
 
     // UNUSED W_Profile ();
     P_InitThinkers ();
+    P_InitTouchNodes ();
 
     // if working with a devlopment map, reload it
     W_Reload ();
@@ -804,6 +905,9 @@ P_SetupLevel
     }
 
     lumpnum = W_GetNumForName (lumpname);
+
+    // start the level data on its way in from disk
+    P_PrefetchLevel (lumpnum);
 	
     leveltime = 0;
 	
@@ -842,6 +946,9 @@ P_SetupLevel
 	
     // set up world state
     P_SpawnSpecials ();
+
+    // remember it, so compressed savegames only store what changes
+    P_RecordWorldBaseline ();
 	
     // build subsector connect matrix
     //	UNUSED P_ConnectSubsectors ();
@@ -850,6 +957,9 @@ P_SetupLevel
     if (precache)
 	R_PrecacheLevel ();
 
+    // anything read ahead that wasn't wanted after all
+    W_DropPrefetchedLumps ();
+
     //printf ("free memory: 0x%x\n", Z_FreeMemory());
 
 }
@@ -18,30 +18,62 @@
 
 
 
+#include <unordered_map>
+#include <vector>
+
 #include "doomdef.h"
 
 #include "i_system.h"
+#include "i_thread.h"
 #include "p_local.h"
 
 // State.
+#include "doomstat.h"
 #include "r_state.h"
 
 namespace theta
 {
 
+void A_Look (mobj_t* actor);
+void A_Chase (mobj_t* actor);
+void A_CPosRefire (mobj_t* actor);
+void A_SpidRefire (mobj_t* actor);
+void A_VileAttack (mobj_t* actor);
+void A_Fire (mobj_t* actor);
+
 //
 // P_CheckSight
 //
-fixed_t		sightzstart;		// eye z of looker
-fixed_t		topslope;
-fixed_t		bottomslope;		// slopes to top and bottom of target
 
-divline_t	strace;			// from t1 to t2
-fixed_t		t2x;
-fixed_t		t2y;
+// Working state of a single line of sight check.  This used to be a
+// handful of globals, but sight checks may now run on worker threads.
+typedef struct
+{
+    fixed_t	sightzstart;		// eye z of looker
+    fixed_t	topslope;
+    fixed_t	bottomslope;		// slopes to top and bottom of target
+
+    divline_t	strace;			// from t1 to t2
+    fixed_t	t2x;
+    fixed_t	t2y;
+
+    // If non-NULL, lines are marked as checked in here
+    // instead of in line->validcount.
+    int*	linemarks;
+    int		linemark;
+} sighttrace_t;
+
+// Still shared with P_AimLineAttack.
+fixed_t		topslope;
+fixed_t		bottomslope;
 
 int		sightcounts[2];
 
+// Per-thread line marks for speculative checks, which must not
+// touch validcount.
+static thread_local std::vector<int> speclinemarks;
+static thread_local int speclinemark;
+
 
 //
 // P_DivlineSide
@@ -128,7 +160,7 @@ P_InterceptVector2
 // Returns true
 //  if strace crosses the given subsector successfully.
 //
-boolean P_CrossSubsector (int num)
+static boolean P_CrossSubsector (sighttrace_t* st, int num)
 {
     seg_t*		seg;
     line_t*		line;
@@ -164,15 +196,25 @@ boolean P_CrossSubsector (int num)
 	line = seg->linedef;
 
 	// allready checked other side?
-	if (line->validcount == validcount)
-	    continue;
-	
-	line->validcount = validcount;
+	if (st->linemarks)
+	{
+	    if (st->linemarks[line - lines] == st->linemark)
+		continue;
+
+	    st->linemarks[line - lines] = st->linemark;
+	}
+	else
+	{
+	    if (line->validcount == validcount)
+		continue;
+
+	    line->validcount = validcount;
+	}
 
 	v1 = line->v1;
 	v2 = line->v2;
-	s1 = P_DivlineSide (v1->x,v1->y, &strace);
-	s2 = P_DivlineSide (v2->x, v2->y, &strace);
+	s1 = P_DivlineSide (v1->x,v1->y, &st->strace);
+	s2 = P_DivlineSide (v2->x, v2->y, &st->strace);
 
 	// line isn't crossed?
 	if (s1 == s2)
@@ -182,8 +224,8 @@ boolean P_CrossSubsector (int num)
 	divl.y = v1->y;
 	divl.dx = v2->x - v1->x;
 	divl.dy = v2->y - v1->y;
-	s1 = P_DivlineSide (strace.x, strace.y, &divl);
-	s2 = P_DivlineSide (t2x, t2y, &divl);
+	s1 = P_DivlineSide (st->strace.x, st->strace.y, &divl);
+	s2 = P_DivlineSide (st->t2x, st->t2y, &divl);
 
 	// line isn't crossed?
 	if (s1 == s2)
@@ -228,23 +270,23 @@ boolean P_CrossSubsector (int num)
 	if (openbottom >= opentop)	
 	    return false;		// stop
 	
-	frac = P_InterceptVector2 (&strace, &divl);
+	frac = P_InterceptVector2 (&st->strace, &divl);
 		
 	if (front->floorheight != back->floorheight)
 	{
-	    slope = FixedDiv (openbottom - sightzstart , frac);
-	    if (slope > bottomslope)
-		bottomslope = slope;
+	    slope = FixedDiv (openbottom - st->sightzstart , frac);
+	    if (slope > st->bottomslope)
+		st->bottomslope = slope;
 	}
 		
 	if (front->ceilingheight != back->ceilingheight)
 	{
-	    slope = FixedDiv (opentop - sightzstart , frac);
-	    if (slope < topslope)
-		topslope = slope;
+	    slope = FixedDiv (opentop - st->sightzstart , frac);
+	    if (slope < st->topslope)
+		st->topslope = slope;
 	}
 		
-	if (topslope <= bottomslope)
+	if (st->topslope <= st->bottomslope)
 	    return false;		// stop				
     }
     // passed the subsector ok
@@ -258,7 +300,7 @@ boolean P_CrossSubsector (int num)
 // Returns true
 //  if strace crosses the given node successfully.
 //
-boolean P_CrossBSPNode (int bspnum)
+static boolean P_CrossBSPNode (sighttrace_t* st, int bspnum)
 {
     node_t*	bsp;
     int		side;
@@ -266,42 +308,41 @@ boolean P_CrossBSPNode (int bspnum)
     if (bspnum & NF_SUBSECTOR)
     {
 	if (bspnum == -1)
-	    return P_CrossSubsector (0);
+	    return P_CrossSubsector (st, 0);
 	else
-	    return P_CrossSubsector (bspnum&(~NF_SUBSECTOR));
+	    return P_CrossSubsector (st, bspnum&(~NF_SUBSECTOR));
     }
 		
     bsp = &nodes[bspnum];
     
     // decide which side the start point is on
-    side = P_DivlineSide (strace.x, strace.y, (divline_t *)bsp);
+    side = P_DivlineSide (st->strace.x, st->strace.y, (divline_t *)bsp);
     if (side == 2)
 	side = 0;	// an "on" should cross both sides
 
     // cross the starting side
-    if (!P_CrossBSPNode (bsp->children[side]) )
+    if (!P_CrossBSPNode (st, bsp->children[side]) )
 	return false;
 	
     // the partition plane is crossed here
-    if (side == P_DivlineSide (t2x, t2y,(divline_t *)bsp))
+    if (side == P_DivlineSide (st->t2x, st->t2y,(divline_t *)bsp))
     {
 	// the line doesn't touch the other side
 	return true;
     }
     
     // cross the ending side		
-    return P_CrossBSPNode (bsp->children[side^1]);
+    return P_CrossBSPNode (st, bsp->children[side^1]);
 }
 
 
 //
-// P_CheckSight
-// Returns true
-//  if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// P_SightRejected
+// Returns true if the REJECT table says
+//  t1 and t2 can't possibly see each other.
 //
-boolean
-P_CheckSight
+static boolean
+P_SightRejected
 ( mobj_t*	t1,
   mobj_t*	t2 )
 {
@@ -311,8 +352,6 @@ P_CheckSight
     int		bytenum;
     int		bitnum;
     
-    // First check for trivial rejection.
-
     // Determine subsector entries in REJECT table.
     s1 = (t1->subsector->sector - sectors);
     s2 = (t2->subsector->sector - sectors);
@@ -321,7 +360,305 @@ P_CheckSight
     bitnum = 1 << (pnum&7);
 
     // Check in REJECT table.
-    if (rejectmatrix[bytenum]&bitnum)
+    return (rejectmatrix[bytenum]&bitnum) != 0;
+}
+
+
+//
+// P_SightTrace
+// Walks the BSP looking from the eyes of t1
+//  to any part of t2.
+//
+static boolean
+P_SightTrace
+( sighttrace_t*	st,
+  mobj_t*	t1,
+  mobj_t*	t2 )
+{
+    st->sightzstart = t1->z + t1->height - (t1->height>>2);
+    st->topslope = (t2->z+t2->height) - st->sightzstart;
+    st->bottomslope = (t2->z) - st->sightzstart;
+	
+    st->strace.x = t1->x;
+    st->strace.y = t1->y;
+    st->t2x = t2->x;
+    st->t2y = t2->y;
+    st->strace.dx = t2->x - t1->x;
+    st->strace.dy = t2->y - t1->y;
+
+    // the head node is the last node output
+    return P_CrossBSPNode (st, numnodes-1);	
+}
+
+
+//
+// SPECULATIVE SIGHT
+// With parallel_monster_ai set, the sight checks that
+//  monster actions are about to make are run on the
+//  worker pool before any thinker runs.  P_CheckSight
+//  only trusts an answer if nothing it depends on has
+//  changed since, so thinkers still see exactly what
+//  they would have seen serially.
+//
+typedef struct
+{
+    mobj_t*	t1;
+    mobj_t*	t2;
+
+    // Everything the answer depends on,
+    // aside from sector heights.
+    fixed_t	t1x;
+    fixed_t	t1y;
+    fixed_t	t1z;
+    fixed_t	t1height;
+    subsector_t* t1subsector;
+    fixed_t	t2x;
+    fixed_t	t2y;
+    fixed_t	t2z;
+    fixed_t	t2height;
+    subsector_t* t2subsector;
+
+    boolean	rejected;
+    boolean	result;
+} sightspec_t;
+
+struct SightSpecKey
+{
+    mobj_t*	t1;
+    mobj_t*	t2;
+
+    bool operator==(const SightSpecKey &other) const
+    {
+	return t1 == other.t1 && t2 == other.t2;
+    }
+};
+
+struct SightSpecKeyHash
+{
+    size_t operator()(const SightSpecKey &key) const
+    {
+	return std::hash<mobj_t*>()(key.t1)
+	     ^ (std::hash<mobj_t*>()(key.t2) * 2654435761u);
+    }
+};
+
+static std::vector<sightspec_t> sightspecs;
+static std::unordered_map<SightSpecKey, size_t, SightSpecKeyHash> sightspecindex;
+static boolean sightspecvalid;
+
+
+static void P_AddSightSpec (mobj_t* t1, mobj_t* t2)
+{
+    sightspec_t	spec;
+    SightSpecKey key = { t1, t2 };
+
+    if (!t1 || !t2 || !sightspecindex.emplace(key, sightspecs.size()).second)
+	return;
+
+    spec.t1 = t1;
+    spec.t2 = t2;
+    spec.t1x = t1->x;
+    spec.t1y = t1->y;
+    spec.t1z = t1->z;
+    spec.t1height = t1->height;
+    spec.t1subsector = t1->subsector;
+    spec.t2x = t2->x;
+    spec.t2y = t2->y;
+    spec.t2z = t2->z;
+    spec.t2height = t2->height;
+    spec.t2subsector = t2->subsector;
+    spec.rejected = false;
+    spec.result = false;
+
+    sightspecs.push_back(spec);
+}
+
+
+//
+// P_RunSightSpec
+// Called on a worker thread.  Must not touch validcount,
+//  so lines are marked in a per-thread array instead.
+//
+static void P_RunSightSpec (sightspec_t* spec)
+{
+    sighttrace_t	st;
+
+    if (P_SightRejected (spec->t1, spec->t2))
+    {
+	spec->rejected = true;
+	spec->result = false;
+	return;
+    }
+
+    if (speclinemarks.size() != (size_t) numlines)
+    {
+	speclinemarks.assign(numlines, 0);
+	speclinemark = 0;
+    }
+
+    st.linemarks = speclinemarks.data();
+    st.linemark = ++speclinemark;
+
+    spec->rejected = false;
+    spec->result = P_SightTrace (&st, spec->t1, spec->t2);
+}
+
+
+//
+// P_SightSpecCurrent
+// Returns true if neither thing has moved
+//  since the answer was worked out.
+//
+static boolean P_SightSpecCurrent (sightspec_t* spec)
+{
+    mobj_t*	t1 = spec->t1;
+    mobj_t*	t2 = spec->t2;
+
+    return t1->x == spec->t1x && t1->y == spec->t1y
+        && t1->z == spec->t1z && t1->height == spec->t1height
+        && t1->subsector == spec->t1subsector
+        && t2->x == spec->t2x && t2->y == spec->t2y
+        && t2->z == spec->t2z && t2->height == spec->t2height
+        && t2->subsector == spec->t2subsector;
+}
+
+
+static sightspec_t* P_FindSightSpec (mobj_t* t1, mobj_t* t2)
+{
+    SightSpecKey key = { t1, t2 };
+
+    if (!sightspecvalid)
+	return NULL;
+
+    auto it = sightspecindex.find(key);
+    if (it == sightspecindex.end())
+	return NULL;
+
+    if (!P_SightSpecCurrent (&sightspecs[it->second]))
+	return NULL;
+
+    return &sightspecs[it->second];
+}
+
+
+//
+// P_SpeculateMobjSight
+// Adds the sight checks the mobj is likely to make if
+//  it enters a state with a sight-checking action
+//  on this tic.
+//
+static void P_SpeculateMobjSight (mobj_t* mo)
+{
+    actionf_p1	action;
+    mobj_t*	soundtarg;
+    player_t*	player;
+    int		i;
+
+    if (mo->tics != 1)
+	return;
+
+    action = states[mo->state->nextstate].action.acp1;
+
+    if (action == (actionf_p1)A_Look
+     || action == (actionf_p1)A_Chase)
+    {
+	if (action == (actionf_p1)A_Look)
+	{
+	    // A_Look never looks at the target, which on a
+	    //  dormant monster may be long gone.
+	    soundtarg = mo->subsector->sector->soundtarget;
+	    P_AddSightSpec (mo, soundtarg);
+	}
+	else
+	{
+	    // P_CheckMeleeRange and P_CheckMissileRange
+	    //  look at the target.
+	    P_AddSightSpec (mo, mo->target);
+	}
+
+	for (i=0 ; i<MAXPLAYERS ; i++)
+	{
+	    player = &players[i];
+
+	    if (playeringame[i] && player->health > 0)
+		P_AddSightSpec (mo, player->mo);
+	}
+    }
+    else if (action == (actionf_p1)A_CPosRefire
+	  || action == (actionf_p1)A_SpidRefire
+	  || action == (actionf_p1)A_VileAttack)
+    {
+	P_AddSightSpec (mo, mo->target);
+    }
+    else if (action == (actionf_p1)A_Fire)
+    {
+	// the arch-vile's fire follows the victim
+	//  while the vile can see it
+	P_AddSightSpec (mo->target, mo->tracer);
+    }
+}
+
+
+//
+// P_SpeculateSight
+// Work out the sight checks monsters are likely to
+//  make this tic on the worker pool.
+//
+void P_SpeculateSight (void)
+{
+    thinker_t*	th;
+
+    sightspecs.clear();
+    sightspecindex.clear();
+
+    for (th = thinkercap.next ; th != &thinkercap ; th = th->next)
+    {
+	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+	    P_SpeculateMobjSight ((mobj_t *)th);
+    }
+
+    thread::WorkerPool::Instance().ParallelFor(sightspecs.size(),
+	[](size_t i) { P_RunSightSpec (&sightspecs[i]); });
+
+    sightspecvalid = true;
+}
+
+
+//
+// P_DiscardSpeculatedSight
+// Called at the end of the thinker pass, and whenever
+//  a sector height changes underneath the answers.
+//
+void P_DiscardSpeculatedSight (void)
+{
+    sightspecvalid = false;
+}
+
+
+//
+// P_CheckSight
+// Returns true
+//  if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT.
+//
+boolean
+P_CheckSight
+( mobj_t*	t1,
+  mobj_t*	t2 )
+{
+    sighttrace_t	st;
+    sightspec_t*	spec;
+
+    // Already worked out?
+    spec = P_FindSightSpec (t1, t2);
+    if (spec)
+    {
+	sightcounts[spec->rejected ? 0 : 1]++;
+	return spec->result;
+    }
+
+    // First check for trivial rejection.
+    if (P_SightRejected (t1, t2))
     {
 	sightcounts[0]++;
 
@@ -334,20 +671,11 @@ P_CheckSight
     sightcounts[1]++;
 
     validcount++;
-	
-    sightzstart = t1->z + t1->height - (t1->height>>2);
-    topslope = (t2->z+t2->height) - sightzstart;
-    bottomslope = (t2->z) - sightzstart;
-	
-    strace.x = t1->x;
-    strace.y = t1->y;
-    t2x = t2->x;
-    t2y = t2->y;
-    strace.dx = t2->x - t1->x;
-    strace.dy = t2->y - t1->y;
 
-    // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    st.linemarks = NULL;
+    st.linemark = 0;
+
+    return P_SightTrace (&st, t1, t2);
 }
 
 }
@@ -265,27 +265,164 @@ getNextSector
 
 
 //
-// P_FindLowestFloorSurrounding()
-// FIND LOWEST FLOOR HEIGHT IN SURROUNDING SECTORS
+// NEIGHBOR HEIGHTS
+// Every sector caches the lowest and highest floor and
+// ceiling among its neighbors.  When a sector moves, the
+// caches of its neighbors are updated in place if possible,
+// and only marked for recalculation if a moving sector that
+// was the extreme moves back towards the others.
 //
-fixed_t	P_FindLowestFloorSurrounding(sector_t* sec)
+
+//
+// P_RecalcNeighborHeights
+//
+static void P_RecalcNeighborHeights(sector_t* sec)
 {
     int			i;
-    line_t*		check;
     sector_t*		other;
-    fixed_t		floor = sec->floorheight;
-	
-    for (i=0 ;i < sec->linecount ; i++)
+
+    sec->neighborminfloor = INT_MAX;
+    sec->neighbormaxfloor = INT_MIN;
+    sec->neighborminceiling = INT_MAX;
+    sec->neighbormaxceiling = INT_MIN;
+
+    for (i=0 ; i < sec->neighborcount ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
+	other = sec->neighbors[i];
+
+	if (other->floorheight < sec->neighborminfloor)
+	    sec->neighborminfloor = other->floorheight;
+	if (other->floorheight > sec->neighbormaxfloor)
+	    sec->neighbormaxfloor = other->floorheight;
+	if (other->ceilingheight < sec->neighborminceiling)
+	    sec->neighborminceiling = other->ceilingheight;
+	if (other->ceilingheight > sec->neighbormaxceiling)
+	    sec->neighbormaxceiling = other->ceilingheight;
+    }
 
-	if (!other)
-	    continue;
-	
-	if (other->floorheight < floor)
-	    floor = other->floorheight;
+    sec->neighborheightsvalid = true;
+}
+
+
+//
+// P_NeighborHeights
+// Returns the sector with its neighbor heights up to date.
+//
+static sector_t* P_NeighborHeights(sector_t* sec)
+{
+    if (!sec->neighborheightsvalid)
+	P_RecalcNeighborHeights(sec);
+
+    return sec;
+}
+
+
+//
+// P_NeighborMoved
+// Fold a single neighbor height change into a cached
+// minimum and maximum.  Returns false if the cache has
+// to be recalculated instead.
+//
+static boolean
+P_NeighborMoved
+( fixed_t*	min,
+  fixed_t*	max,
+  fixed_t	oldheight,
+  fixed_t	newheight )
+{
+    if (newheight <= *min)
+	*min = newheight;
+    else if (oldheight == *min)
+	return false;
+
+    if (newheight >= *max)
+	*max = newheight;
+    else if (oldheight == *max)
+	return false;
+
+    return true;
+}
+
+
+//
+// P_SectorHeightsChanged
+// Called whenever a sector's floor or ceiling has moved.
+//
+void P_SectorHeightsChanged(sector_t* sec)
+{
+    int			i;
+    sector_t*		other;
+
+    if (sec->floorheight != sec->lastfloorheight)
+    {
+	for (i=0 ; i < sec->neighborcount ; i++)
+	{
+	    other = sec->neighbors[i];
+
+	    if (other->neighborheightsvalid
+		&& !P_NeighborMoved(&other->neighborminfloor,
+				    &other->neighbormaxfloor,
+				    sec->lastfloorheight,
+				    sec->floorheight))
+	    {
+		other->neighborheightsvalid = false;
+	    }
+	}
+
+	sec->lastfloorheight = sec->floorheight;
+    }
+
+    if (sec->ceilingheight != sec->lastceilingheight)
+    {
+	for (i=0 ; i < sec->neighborcount ; i++)
+	{
+	    other = sec->neighbors[i];
+
+	    if (other->neighborheightsvalid
+		&& !P_NeighborMoved(&other->neighborminceiling,
+				    &other->neighbormaxceiling,
+				    sec->lastceilingheight,
+				    sec->ceilingheight))
+	    {
+		other->neighborheightsvalid = false;
+	    }
+	}
+
+	sec->lastceilingheight = sec->ceilingheight;
+    }
+}
+
+
+//
+// P_ResetNeighborHeights
+// Throw away all cached neighbor heights, for when
+// sector heights have been set wholesale.
+//
+void P_ResetNeighborHeights(void)
+{
+    int			i;
+    sector_t*		sec;
+
+    for (i=0, sec = sectors ; i<numsectors ; i++, sec++)
+    {
+	sec->neighborheightsvalid = false;
+	sec->lastfloorheight = sec->floorheight;
+	sec->lastceilingheight = sec->ceilingheight;
     }
+}
+
+
+//
+// P_FindLowestFloorSurrounding()
+// FIND LOWEST FLOOR HEIGHT IN SURROUNDING SECTORS
+//
+fixed_t	P_FindLowestFloorSurrounding(sector_t* sec)
+{
+    fixed_t		floor = sec->floorheight;
+
+    if (P_NeighborHeights(sec)->neighborminfloor < floor)
+	floor = sec->neighborminfloor;
+
     return floor;
 }
 
@@ -297,22 +434,11 @@ fixed_t	P_FindLowestFloorSurrounding(sector_t* sec)
 //
 fixed_t	P_FindHighestFloorSurrounding(sector_t *sec)
 {
-    int			i;
-    line_t*		check;
-    sector_t*		other;
     fixed_t		floor = -500*FRACUNIT;
-	
-    for (i=0 ;i < sec->linecount ; i++)
-    {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-	
-	if (!other)
-	    continue;
-	
-	if (other->floorheight > floor)
-	    floor = other->floorheight;
-    }
+
+    if (P_NeighborHeights(sec)->neighbormaxfloor > floor)
+	floor = sec->neighbormaxfloor;
+
     return floor;
 }
 
@@ -341,6 +467,25 @@ P_FindNextHighestFloor
     fixed_t     height = currentheight;
     fixed_t     heightlist[MAX_ADJOINING_SECTORS + 2];
 
+    // Too few lines to overflow the list, so
+    // only the distinct neighbors matter.
+    if (sec->neighborlines <= MAX_ADJOINING_SECTORS)
+    {
+        min = INT_MAX;
+
+        for (i=0; i < sec->neighborcount; i++)
+        {
+            other = sec->neighbors[i];
+
+            if (other->floorheight > height && other->floorheight < min)
+            {
+                min = other->floorheight;
+            }
+        }
+
+        return min == INT_MAX ? currentheight : min;
+    }
+
     for (i=0, h=0; i < sec->linecount; i++)
     {
         check = sec->lines[i];
@@ -393,23 +538,7 @@ P_FindNextHighestFloor
 fixed_t
 P_FindLowestCeilingSurrounding(sector_t* sec)
 {
-    int			i;
-    line_t*		check;
-    sector_t*		other;
-    fixed_t		height = INT_MAX;
-	
-    for (i=0 ;i < sec->linecount ; i++)
-    {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-
-	if (!other)
-	    continue;
-
-	if (other->ceilingheight < height)
-	    height = other->ceilingheight;
-    }
-    return height;
+    return P_NeighborHeights(sec)->neighborminceiling;
 }
 
 
@@ -418,22 +547,11 @@ P_FindLowestCeilingSurrounding(sector_t* sec)
 //
 fixed_t	P_FindHighestCeilingSurrounding(sector_t* sec)
 {
-    int		i;
-    line_t*	check;
-    sector_t*	other;
     fixed_t	height = 0;
-	
-    for (i=0 ;i < sec->linecount ; i++)
-    {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
 
-	if (!other)
-	    continue;
+    if (P_NeighborHeights(sec)->neighbormaxceiling > height)
+	height = sec->neighbormaxceiling;
 
-	if (other->ceilingheight > height)
-	    height = other->ceilingheight;
-    }
     return height;
 }
 
@@ -469,17 +587,12 @@ P_FindMinSurroundingLight
 {
     int		i;
     int		min;
-    line_t*	line;
     sector_t*	check;
 	
     min = max;
-    for (i=0 ; i < sector->linecount ; i++)
+    for (i=0 ; i < sector->neighborcount ; i++)
     {
-	line = sector->lines[i];
-	check = getNextSector(line,sector);
-
-	if (!check)
-	    continue;
+	check = sector->neighbors[i];
 
 	if (check->lightlevel < min)
 	    min = check->lightlevel;
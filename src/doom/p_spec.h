@@ -83,6 +83,9 @@ getSide
   int		line,
   int		side );
 
+void P_SectorHeightsChanged(sector_t* sec);
+void P_ResetNeighborHeights(void);
+
 fixed_t P_FindLowestFloorSurrounding(sector_t* sec);
 fixed_t P_FindHighestFloorSurrounding(sector_t* sec);
 
@@ -28,6 +28,10 @@ namespace theta
 
 int	leveltime;
 
+// If non-zero, monster sight checks are worked out
+// on the worker pool ahead of the thinker pass.
+int	parallel_monster_ai = 0;
+
 //
 // THINKERS
 // All thinkers should be allocated by Z_Malloc
@@ -97,6 +101,9 @@ void P_RunThinkers (void)
 {
     thinker_t *currentthinker, *nextthinker;
 
+    if (parallel_monster_ai)
+	P_SpeculateSight ();
+
     currentthinker = thinkercap.next;
     while (currentthinker != &thinkercap)
     {
@@ -116,6 +123,8 @@ void P_RunThinkers (void)
 	}
 	currentthinker = nextthinker;
     }
+
+    P_DiscardSpeculatedSight ();
 }
 
 
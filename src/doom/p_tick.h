@@ -24,6 +24,10 @@
 namespace theta
 {
 
+// If non-zero, run monster sight checks on the worker pool
+// before the thinker pass.  Does not affect demo sync.
+extern int parallel_monster_ai;
+
 // Called by C_Ticker,
 // can call G_PlayerExited.
 // Carries out all thinking of monsters and players.
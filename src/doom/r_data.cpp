@@ -18,6 +18,9 @@
 //
 
 #include <stdio.h>
+#include <string.h>
+
+#include <vector>
 
 #include "deh_main.h"
 #include "i_swap.h"
@@ -28,7 +31,11 @@
 #include "w_wad.h"
 
 #include "doomdef.h"
+#include "m_argv.h"
+#include "m_config.h"
 #include "m_misc.h"
+#include "sha1.h"
+#include "w_checksum.h"
 #include "r_local.h"
 #include "p_local.h"
 
@@ -447,6 +454,286 @@ static void GenerateTextureHashTable(void)
 }
 
 
+//
+// STARTUP DATA CACHE
+// Building the texture column lookups and the sprite size
+//  tables means reading every patch and sprite in the WADs,
+//  which takes a while with big PWADs.  The results are kept
+//  in a cache file, keyed by a checksum of the loaded WADs,
+//  and mapped back in on later runs.
+//
+
+#define DATACACHE_MAGIC		"thetadc1"
+#define DATACACHE_MAGICLEN	8
+
+static sha1_digest_t	datacache_key;
+static wad_file_t*	datacache_file;
+static byte*		datacache_buffer;
+static const byte*	datacache_data;
+static size_t		datacache_length;
+static size_t		datacache_pos;
+
+// Still reading good data from the cache.
+static boolean		datacache_valid;
+
+// A new cache needs writing out once everything is built.
+static boolean		datacache_stale;
+
+static char *R_DataCachePath (void)
+{
+    return M_StringJoin (configdir, "datacache.dat", NULL);
+}
+
+//
+// R_OpenDataCache
+// Open the cache file, if there is one, and check that it
+//  was made from the WADs that are loaded now.
+//
+static void R_OpenDataCache (void)
+{
+    static const char *lumpnames[] =
+	{ "PNAMES", "TEXTURE1", "TEXTURE2", "S_START", "S_END" };
+    sha1_context_t	context;
+    sha1_digest_t	files;
+    const char*		name;
+    char*		path;
+
+    datacache_valid = false;
+    datacache_stale = false;
+
+    //!
+    // Don't read or write the startup data cache; always build
+    // the texture and sprite tables from the WADs.
+    //
+
+    if (M_CheckParm ("-nodatacache"))
+	return;
+
+    // Lump name replacements change what gets built, too.
+    W_FilesChecksum (files);
+    SHA1_Init (&context);
+    SHA1_Update (&context, files, sizeof(files));
+    for (const char *lumpname : lumpnames)
+    {
+	name = DEH_String (lumpname);
+	SHA1_Update (&context, (byte *) name, strlen(name) + 1);
+    }
+    SHA1_Final (datacache_key, &context);
+
+    datacache_stale = true;
+
+    path = R_DataCachePath ();
+    datacache_file = W_OpenFile (path);
+    free (path);
+
+    if (datacache_file == NULL)
+	return;
+
+    datacache_length = datacache_file->length;
+
+    if (datacache_file->mapped != NULL)
+    {
+	datacache_data = datacache_file->mapped;
+    }
+    else
+    {
+	datacache_buffer = static_cast<byte*>(Z_Malloc (datacache_length + 1, PU_STATIC, NULL));
+	datacache_length = W_Read (datacache_file, 0, datacache_buffer, datacache_length);
+	datacache_data = datacache_buffer;
+    }
+
+    if (datacache_length < DATACACHE_MAGICLEN + sizeof(sha1_digest_t)
+     || memcmp (datacache_data, DATACACHE_MAGIC, DATACACHE_MAGICLEN) != 0
+     || memcmp (datacache_data + DATACACHE_MAGICLEN, datacache_key,
+		sizeof(sha1_digest_t)) != 0)
+    {
+	return;
+    }
+
+    datacache_pos = DATACACHE_MAGICLEN + sizeof(sha1_digest_t);
+    datacache_valid = true;
+}
+
+//
+// R_ReadDataCache
+// Copy the next len bytes out of the cache.  Once anything
+//  fails to match, the rest of the cache is ignored.
+//
+static boolean R_ReadDataCache (void *dest, size_t len)
+{
+    if (!datacache_valid || len > datacache_length - datacache_pos)
+    {
+	datacache_valid = false;
+	return false;
+    }
+
+    memcpy (dest, datacache_data + datacache_pos, len);
+    datacache_pos += len;
+
+    return true;
+}
+
+static boolean R_ReadCacheCount (int count)
+{
+    int		stored;
+
+    if (!R_ReadDataCache (&stored, sizeof(stored)) || stored != count)
+    {
+	datacache_valid = false;
+	return false;
+    }
+
+    return true;
+}
+
+static void R_WriteDataCache (void);
+
+//
+// R_CloseDataCache
+// Done with the cache; if any of it had to be built afresh,
+//  write out a new one.
+//
+static void R_CloseDataCache (void)
+{
+    if (datacache_valid && datacache_pos == datacache_length)
+	datacache_stale = false;
+
+    datacache_valid = false;
+    datacache_data = NULL;
+
+    if (datacache_buffer != NULL)
+    {
+	Z_Free (datacache_buffer);
+	datacache_buffer = NULL;
+    }
+
+    if (datacache_file != NULL)
+    {
+	W_CloseFile (datacache_file);
+	datacache_file = NULL;
+    }
+
+    if (datacache_stale)
+    {
+	R_WriteDataCache ();
+	datacache_stale = false;
+    }
+}
+
+//
+// R_ReadLookupCache
+// Fill in the texture column lookups from the cache.
+//
+static boolean R_ReadLookupCache (void)
+{
+    int		i;
+    int		width;
+
+    if (!R_ReadCacheCount (numtextures))
+	return false;
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	width = textures[i]->width;
+
+	if (!R_ReadCacheCount (width)
+	 || !R_ReadDataCache (&texturecompositesize[i], sizeof(int))
+	 || !R_ReadDataCache (texturecolumnlump[i], width * sizeof(short))
+	 || !R_ReadDataCache (texturecolumnofs[i], width * sizeof(unsigned short)))
+	{
+	    return false;
+	}
+
+	texturecomposite[i] = 0;
+    }
+
+    return true;
+}
+
+//
+// R_ReadSpriteCache
+// Fill in the sprite size tables from the cache.
+//
+static boolean R_ReadSpriteCache (void)
+{
+    size_t	len;
+
+    len = numspritelumps * sizeof(fixed_t);
+
+    return R_ReadCacheCount (numspritelumps)
+	&& R_ReadDataCache (spritewidth, len)
+	&& R_ReadDataCache (spriteoffset, len)
+	&& R_ReadDataCache (spritetopoffset, len);
+}
+
+static void R_AppendCache (std::vector<byte>& out, const void *data, size_t len)
+{
+    const byte *p = static_cast<const byte*>(data);
+
+    out.insert (out.end(), p, p + len);
+}
+
+//
+// R_WriteDataCache
+// Write out the tables in the same order they are read back.
+//
+static void R_WriteDataCache (void)
+{
+    std::vector<byte>	out;
+    char*		path;
+    char*		temppath;
+    size_t		len;
+    int			i;
+    int			width;
+
+    R_AppendCache (out, DATACACHE_MAGIC, DATACACHE_MAGICLEN);
+    R_AppendCache (out, datacache_key, sizeof(datacache_key));
+
+    R_AppendCache (out, &numtextures, sizeof(numtextures));
+    for (i=0 ; i<numtextures ; i++)
+    {
+	width = textures[i]->width;
+	R_AppendCache (out, &width, sizeof(width));
+	R_AppendCache (out, &texturecompositesize[i], sizeof(int));
+	R_AppendCache (out, texturecolumnlump[i], width * sizeof(short));
+	R_AppendCache (out, texturecolumnofs[i], width * sizeof(unsigned short));
+    }
+
+    len = numspritelumps * sizeof(fixed_t);
+    R_AppendCache (out, &numspritelumps, sizeof(numspritelumps));
+    R_AppendCache (out, spritewidth, len);
+    R_AppendCache (out, spriteoffset, len);
+    R_AppendCache (out, spritetopoffset, len);
+
+    // Other copies of the game may have the old cache mapped, and
+    //  would see it change or shrink under them if it were
+    //  rewritten in place.  Write a new file and rename it over the
+    //  old one instead, which leaves their mapping alone.
+    path = R_DataCachePath ();
+    temppath = M_StringJoin (configdir, "datacache.tmp", NULL);
+
+    if (M_WriteFile (temppath, out.data(), out.size()))
+    {
+#ifdef _WIN32
+	remove (path);
+#endif
+	if (rename (temppath, path) != 0)
+	{
+	    fprintf (stderr, "R_WriteDataCache: Unable to write %s\n", path);
+	    remove (temppath);
+	}
+    }
+    else
+    {
+	fprintf (stderr, "R_WriteDataCache: Unable to write %s\n", temppath);
+    }
+
+    free (temppath);
+    free (path);
+}
+
+
+
 //
 // R_InitTextures
 // Initializes the texture list
@@ -454,33 +741,33 @@ static void GenerateTextureHashTable(void)
 //
 void R_InitTextures (void)
 {
-    maptexture_t*	mtexture;
+    const maptexture_t*	mtexture;
     texture_t*		texture;
-    mappatch_t*		mpatch;
+    const mappatch_t*	mpatch;
     texpatch_t*		patch;
 
     int			i;
     int			j;
 
-    int*		maptex;
-    int*		maptex2;
-    int*		maptex1;
+    const int*		maptex;
+    const int*		maptex2;
+    const int*		maptex1;
     
     char		name[9];
-    char*		names;
-    char*		name_p;
+    const char*		name_p;
     
     int*		patchlookup;
     
     int			totalwidth;
     int			nummappatches;
+    const int*		pnames_count;
     int			offset;
     int			maxoff;
     int			maxoff2;
     int			numtextures1;
     int			numtextures2;
 
-    int*		directory;
+    const int*		directory;
     
     int			temp1;
     int			temp2;
@@ -488,32 +775,50 @@ void R_InitTextures (void)
 
     
     // Load the patch names from pnames.lmp.
+    // These are read straight out of the WAD through lump views.
     name[8] = 0;
-    names = static_cast<char*>(W_CacheLumpName (DEH_String("PNAMES"), PU_STATIC));
-    nummappatches = LONG ( *((int *)names) );
-    name_p = names + 4;
-    patchlookup = static_cast<int*>(Z_Malloc(nummappatches*sizeof(*patchlookup), PU_STATIC, NULL));
-
-    for (i = 0; i < nummappatches; i++)
     {
-        M_StringCopy(name, name_p + i * 8, sizeof(name));
-        patchlookup[i] = W_CheckNumForName(name);
+        LumpView<char> names(W_GetNumForName(DEH_String("PNAMES")));
+
+        pnames_count = names.At<int>(0);
+
+        if (pnames_count == NULL)
+            I_Error ("R_InitTextures: %s lump is too short",
+                     DEH_String("PNAMES"));
+
+        nummappatches = LONG ( *pnames_count );
+
+        if (nummappatches < 0
+         || (size_t) nummappatches > (names.Bytes() - 4) / 8)
+            I_Error ("R_InitTextures: %s lump is too short for %i patches",
+                     DEH_String("PNAMES"), nummappatches);
+
+        name_p = names.Data() + 4;
+        patchlookup = static_cast<int*>(Z_Malloc(nummappatches*sizeof(*patchlookup), PU_STATIC, NULL));
+
+        for (i = 0; i < nummappatches; i++)
+        {
+            M_StringCopy(name, name_p + i * 8, sizeof(name));
+            patchlookup[i] = W_CheckNumForName(name);
+        }
     }
-    W_ReleaseLumpName(DEH_String("PNAMES"));
 
     // Load the map texture definitions from textures.lmp.
     // The data is contained in one or two lumps,
     //  TEXTURE1 for shareware, plus TEXTURE2 for commercial.
-    maptex = maptex1 = static_cast<int*>(W_CacheLumpName (DEH_String("TEXTURE1"), PU_STATIC));
+    LumpView<int> texture1(W_GetNumForName(DEH_String("TEXTURE1")));
+    LumpView<int> texture2(W_CheckNumForName(DEH_String("TEXTURE2")));
+
+    maptex = maptex1 = texture1.Data();
     numtextures1 = LONG(*maptex);
-    maxoff = W_LumpLength (W_GetNumForName (DEH_String("TEXTURE1")));
+    maxoff = texture1.Bytes();
     directory = maptex+1;
 	
-    if (W_CheckNumForName (DEH_String("TEXTURE2")) != -1)
+    if (texture2.Size() > 0)
     {
-	maptex2 = static_cast<int*>(W_CacheLumpName (DEH_String("TEXTURE2"), PU_STATIC));
+	maptex2 = texture2.Data();
 	numtextures2 = LONG(*maptex2);
-	maxoff2 = W_LumpLength (W_GetNumForName (DEH_String("TEXTURE2")));
+	maxoff2 = texture2.Bytes();
     }
     else
     {
@@ -570,7 +875,7 @@ void R_InitTextures (void)
 	if (offset > maxoff)
 	    I_Error ("R_InitTextures: bad texture directory");
 	
-	mtexture = (maptexture_t *) ( (byte *)maptex + offset);
+	mtexture = (const maptexture_t *) ( (const byte *)maptex + offset);
 
 	texture = textures[i] = static_cast<texture_t*>(
 	    Z_Malloc (sizeof(texture_t)
@@ -610,15 +915,14 @@ void R_InitTextures (void)
     }
 
     Z_Free(patchlookup);
-
-    W_ReleaseLumpName(DEH_String("TEXTURE1"));
-    if (maptex2)
-        W_ReleaseLumpName(DEH_String("TEXTURE2"));
     
     // Precalculate whatever possible.	
 
-    for (i=0 ; i<numtextures ; i++)
-	R_GenerateLookup (i);
+    if (!R_ReadLookupCache ())
+    {
+	for (i=0 ; i<numtextures ; i++)
+	    R_GenerateLookup (i);
+    }
     
     // Create translation table for global animation.
     texturetranslation = static_cast<int*>(Z_Malloc ((numtextures+1)*sizeof(*texturetranslation), PU_STATIC, 0));
@@ -668,6 +972,9 @@ void R_InitSpriteLumps (void)
     spritewidth = static_cast<fixed_t*>(Z_Malloc (numspritelumps*sizeof(*spritewidth), PU_STATIC, 0));
     spriteoffset = static_cast<fixed_t*>(Z_Malloc (numspritelumps*sizeof(*spriteoffset), PU_STATIC, 0));
     spritetopoffset = static_cast<fixed_t*>(Z_Malloc (numspritelumps*sizeof(*spritetopoffset), PU_STATIC, 0));
+
+    if (R_ReadSpriteCache ())
+	return;
 	
     for (i=0 ; i< numspritelumps ; i++)
     {
@@ -706,11 +1013,13 @@ void R_InitColormaps (void)
 //
 void R_InitData (void)
 {
+    R_OpenDataCache ();
     R_InitTextures ();
     console::printf (".");
     R_InitFlats ();
     console::printf (".");
     R_InitSpriteLumps ();
+    R_CloseDataCache ();
     console::printf (".");
     R_InitColormaps ();
 }
@@ -738,6 +1047,31 @@ int R_FlatNumForName (const char* name)
 }
 
 
+//
+// R_CheckFlatNumForName
+// Like R_FlatNumForName, but only finds lumps between
+//  F_START and F_END, and returns -1 if there is none.
+//
+int R_CheckFlatNumForName (const char* name)
+{
+    int		i;
+
+    i = W_CheckNumForName (name);
+
+    if (i >= firstflat && i <= lastflat)
+	return i - firstflat;
+
+    // Something outside the flats has the same name.
+    for (i=lastflat ; i>=firstflat ; i--)
+    {
+	if (!strncasecmp (lumpinfo[i]->name, name, 8))
+	    return i - firstflat;
+    }
+
+    return -1;
+}
+
+
 
 
 //
@@ -792,6 +1126,24 @@ int	R_TextureNumForName (const char* name)
 
 
 
+//
+// R_PrefetchTexture
+// Starts reading in the patches a texture is built from,
+//  ahead of it being drawn or precached.
+//
+void R_PrefetchTexture (int texnum)
+{
+    texture_t*	texture;
+    int		j;
+
+    texture = textures[texnum];
+
+    for (j=0 ; j<texture->patchcount ; j++)
+	W_PrefetchLump (texture->patches[j].patch);
+}
+
+
+
 
 //
 // R_PrecacheLevel
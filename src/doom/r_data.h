@@ -43,6 +43,7 @@ void R_PrecacheLevel (void);
 // Floor/ceiling opaque texture tiles,
 // lookup by name. For animation?
 int R_FlatNumForName (const char* name);
+int R_CheckFlatNumForName (const char* name);
 
 
 // Called by P_Ticker for switches and animations,
@@ -50,6 +51,9 @@ int R_FlatNumForName (const char* name);
 int R_TextureNumForName (const char *name);
 int R_CheckTextureNumForName (const char *name);
 
+// Start reading in the patches that make up a texture.
+void R_PrefetchTexture (int texnum);
+
 }
 
 #endif
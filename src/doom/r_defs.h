@@ -91,11 +91,31 @@ typedef struct
 
 } degenmobj_t;
 
+//
+// Links a thing to a sector that it touches.  Each node is
+// on two lists at once: the sectors touched by the thing,
+// and the things touching the sector.
+//
+typedef struct touchnode_s
+{
+    struct sector_s*	sector;
+    mobj_t*		thing;
+
+    // thing's list of sectors
+    struct touchnode_s*	tprev;
+    struct touchnode_s*	tnext;
+
+    // sector's list of things
+    struct touchnode_s*	sprev;
+    struct touchnode_s*	snext;
+
+} touchnode_t;
+
 //
 // The SECTORS record, at runtime.
 // Stores things/mobjs.
 //
-typedef	struct
+typedef	struct sector_s
 {
     fixed_t	floorheight;
     fixed_t	ceilingheight;
@@ -123,11 +143,34 @@ typedef	struct
     // list of mobjs in sector
     mobj_t*	thinglist;
 
+    // list of blockmap mobjs touching the sector,
+    // whether or not their center is inside it
+    touchnode_t*	touchingthings;
+
     // thinker_t for reversable actions
     void*	specialdata;
 
     int			linecount;
     struct line_s**	lines;	// [linecount] size
+
+    // sectors across two-sided lines, each listed once
+    int			neighborcount;
+    struct sector_s**	neighbors;	// [neighborcount] size
+
+    // lines in lines[] that lead to a neighbor, duplicates and all
+    int			neighborlines;
+
+    // lowest and highest neighboring floors and ceilings,
+    // recalculated on demand if neighborheightsvalid is false
+    boolean		neighborheightsvalid;
+    fixed_t		neighborminfloor;
+    fixed_t		neighbormaxfloor;
+    fixed_t		neighborminceiling;
+    fixed_t		neighbormaxceiling;
+
+    // heights last passed on to the neighbors
+    fixed_t		lastfloorheight;
+    fixed_t		lastceilingheight;
     
 } sector_t;
 
@@ -25,6 +25,7 @@
 
 #include "doomstat.h"
 #include "doomtype.h"
+#include "g_game.h"
 
 #include "sounds.h"
 #include "s_sound.h"
@@ -34,6 +35,7 @@
 #include "m_argv.h"
 
 #include "p_local.h"
+#include "p_saveg.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -77,6 +79,9 @@ typedef struct
 
     int pitch;
 
+    // snapshot number of the origin while the level is being restored
+    int snapshot;
+
 } channel_t;
 
 // The set of channels available
@@ -264,6 +269,63 @@ void S_StopSound(mobj_t *origin)
     }
 }
 
+//
+// S_DetachSounds
+// Let go of the mobjs that sounds are coming from, before the level is
+// restored from a snapshot.  Restoring replaces every mobj, and would
+// stop their sounds otherwise.
+//
+void S_DetachSounds(void)
+{
+    int cnum;
+    channel_t *c;
+
+    for (cnum=0 ; cnum<snd_channels ; cnum++)
+    {
+        c = &channels[cnum];
+        c->snapshot = 0;
+
+        // Anything not numbered is a sector sound origin, which stays.
+        if (c->sfxinfo && c->origin)
+        {
+            c->snapshot = P_SnapshotIndex(c->origin);
+
+            if (c->snapshot > 0)
+            {
+                c->origin = NULL;
+            }
+        }
+    }
+}
+
+//
+// S_ReattachSounds
+// Give the sounds let go of by S_DetachSounds to the mobjs that have
+// replaced their own.
+//
+void S_ReattachSounds(void)
+{
+    int cnum;
+    channel_t *c;
+
+    for (cnum=0 ; cnum<snd_channels ; cnum++)
+    {
+        c = &channels[cnum];
+
+        if (c->sfxinfo && c->snapshot > 0)
+        {
+            c->origin = P_SnapshotMobj(c->snapshot);
+
+            if (c->origin == NULL)
+            {
+                S_StopChannel(cnum);
+            }
+        }
+
+        c->snapshot = 0;
+    }
+}
+
 //
 // S_GetChannel :
 //   If none available, return -1.  Otherwise channel #.
@@ -423,6 +485,15 @@ void S_StartSound(void *origin_p, int sfx_id)
     int cnum;
     int volume;
 
+    // Stay quiet while seeking through a demo, or running the game
+    // ahead of a netgame or again after taking on the host's.
+    // Anything real will be heard once it has been confirmed, and
+    // anything run again was heard the first time.
+    if (G_DemoSeeking() || G_Predicting() || G_Resyncing())
+    {
+        return;
+    }
+
     origin = (mobj_t *) origin_p;
     volume = snd_SfxVolume;
 
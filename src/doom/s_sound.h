@@ -59,6 +59,10 @@ void S_StartSound(void *origin, int sound_id);
 // Stop sound for thing at <origin>
 void S_StopSound(mobj_t *origin);
 
+// Keep sounds playing while the level is restored from a snapshot.
+void S_DetachSounds(void);
+void S_ReattachSounds(void);
+
 
 // Start music using <music_id> from sounds.h
 void S_StartMusic(int music_id);
@@ -0,0 +1,212 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Worker threads.  A small pool of threads that the game can hand
+//     independent pieces of work to.
+//
+
+#include "i_thread.h"
+
+namespace theta
+{
+
+namespace thread
+{
+
+// Never spin up more workers than this, no matter how many cores the
+// machine claims to have.
+static const unsigned int MAX_WORKERS = 7;
+
+// Get the global worker pool instance.
+WorkerPool& WorkerPool::Instance()
+{
+    static WorkerPool singleton;
+    return singleton;
+}
+
+// Start one worker per spare hardware thread.
+WorkerPool::WorkerPool() : job(nullptr), job_count(0), job_next(0),
+    busy(0), generation(0), quit(false)
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    count = count > 1 ? count - 1 : 0;
+    if (count > MAX_WORKERS)
+    {
+        count = MAX_WORKERS;
+    }
+
+    for (unsigned int i = 0;i < count;i++)
+    {
+        this->workers.emplace_back(&WorkerPool::Worker, this);
+    }
+}
+
+// Tell the workers to quit and wait for them to do so.
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->quit = true;
+    }
+    this->work_ready.notify_all();
+
+    for (std::thread& worker : this->workers)
+    {
+        worker.join();
+    }
+}
+
+// Worker thread main loop.
+void WorkerPool::Worker()
+{
+    unsigned int seen = 0;
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    for (;;)
+    {
+        this->work_ready.wait(lock, [&] {
+            return this->quit || this->generation != seen;
+        });
+        if (this->quit)
+        {
+            return;
+        }
+        seen = this->generation;
+
+        lock.unlock();
+        this->RunJobs();
+        lock.lock();
+
+        if (--this->busy == 0)
+        {
+            this->work_done.notify_one();
+        }
+    }
+}
+
+// Pull job indexes off of the current batch until it runs dry.
+void WorkerPool::RunJobs()
+{
+    for (size_t i = this->job_next++;i < this->job_count;i = this->job_next++)
+    {
+        (*this->job)(i);
+    }
+}
+
+// Number of threads that take part in a ParallelFor, including the
+// calling thread.
+size_t WorkerPool::Size() const
+{
+    return this->workers.size() + 1;
+}
+
+// Call func once for every index in [0, count), spread across the
+// pool.  Returns once every call has finished.  Calls may happen in
+// any order, so func must not depend on the results of its siblings.
+void WorkerPool::ParallelFor(size_t count, const WorkFunction& func)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (this->workers.empty() || count == 1)
+    {
+        for (size_t i = 0;i < count;i++)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->job = &func;
+        this->job_count = count;
+        this->job_next = 0;
+        this->busy = this->workers.size();
+        this->generation++;
+    }
+    this->work_ready.notify_all();
+
+    this->RunJobs();
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->work_done.wait(lock, [&] { return this->busy == 0; });
+    this->job = nullptr;
+    this->job_count = 0;
+}
+
+// Start count threads to work through the queue.
+TaskQueue::TaskQueue(unsigned int count) : quit(false)
+{
+    for (unsigned int i = 0;i < count;i++)
+    {
+        this->workers.emplace_back(&TaskQueue::Worker, this);
+    }
+}
+
+// Tell the workers to quit and wait for them to do so.  Tasks still
+// in the queue are thrown away.
+TaskQueue::~TaskQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->quit = true;
+    }
+    this->task_ready.notify_all();
+
+    for (std::thread& worker : this->workers)
+    {
+        worker.join();
+    }
+}
+
+// Worker thread main loop.
+void TaskQueue::Worker()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    for (;;)
+    {
+        this->task_ready.wait(lock, [&] {
+            return this->quit || !this->tasks.empty();
+        });
+        if (this->quit)
+        {
+            return;
+        }
+
+        TaskFunction task = std::move(this->tasks.front());
+        this->tasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+// Queue up a task to be run on one of the workers.
+void TaskQueue::Push(TaskFunction task)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->tasks.push_back(std::move(task));
+    }
+    this->task_ready.notify_one();
+}
+
+}
+
+}
@@ -0,0 +1,89 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Worker threads.  A small pool of threads that the game can hand
+//     independent pieces of work to.
+//
+
+#ifndef __I_THREAD__
+#define __I_THREAD__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace theta
+{
+
+namespace thread
+{
+
+typedef std::function<void(size_t)> WorkFunction;
+
+// A fixed set of worker threads.  The calling thread always takes part
+// in the work it hands out, so a pool with no workers simply runs
+// everything in place.
+class WorkerPool
+{
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    const WorkFunction* job;
+    size_t job_count;
+    std::atomic<size_t> job_next;
+    size_t busy;
+    unsigned int generation;
+    bool quit;
+
+    void Worker();
+    void RunJobs();
+public:
+    static WorkerPool& Instance();
+    WorkerPool();
+    ~WorkerPool();
+    size_t Size() const;
+    void ParallelFor(size_t count, const WorkFunction& func);
+};
+
+typedef std::function<void()> TaskFunction;
+
+// A small set of threads that work through a queue of tasks in the
+// background, for jobs like I/O that the caller does not wait on
+// straight away.  Tasks run in the order they were pushed, but may
+// finish in any order.
+class TaskQueue
+{
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+    std::deque<TaskFunction> tasks;
+    bool quit;
+
+    void Worker();
+public:
+    explicit TaskQueue(unsigned int count);
+    ~TaskQueue();
+    void Push(TaskFunction task);
+};
+
+}
+
+}
+
+#endif
@@ -966,6 +966,28 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_INT(vanilla_demo_limit),
 
+    //!
+    // @game doom
+    //
+    // If non-zero, the line of sight checks that monsters make while
+    // looking for and chasing players are worked out on worker
+    // threads before the monsters think.  Game behavior, and so demo
+    // sync, is unaffected.
+    //
+
+    CONFIG_VARIABLE_INT(parallel_monster_ai),
+
+    //!
+    // @game doom
+    //
+    // If non-zero, savegames are written in a compact format that
+    // only stores the parts of the level that have changed and
+    // compresses the rest.  These savegames can not be loaded by
+    // Vanilla Doom.  Savegames in either format can always be loaded.
+    //
+
+    CONFIG_VARIABLE_INT(compressed_savegames),
+
     //!
     // If non-zero, the game behaves like Vanilla Doom, always assuming
     // an American keyboard mapping.  If this has a value of zero, the
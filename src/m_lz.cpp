@@ -0,0 +1,253 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     A small, fast LZ77 compressor.  Trades compression ratio for
+//     speed, in the same spirit as LZ4.
+//
+//     The compressed data is a run of sequences.  Each one starts
+//     with a token byte, whose top four bits are a count of literal
+//     bytes and whose bottom four bits are a match length less
+//     LZ_MINMATCH.  A count of 15 carries on into following bytes,
+//     each added on, until one is less than 255.  The literal bytes
+//     come next, then a two byte little-endian offset back to the
+//     match.  The last sequence has no match and ends the data.
+//
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "m_lz.h"
+
+namespace theta
+{
+
+#define LZ_MINMATCH   4
+#define LZ_MAXOFFSET  65535
+#define LZ_HASHBITS   14
+
+static uint32_t Read32(const byte *p)
+{
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned int Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASHBITS);
+}
+
+// Write out the overflow of a count that didn't fit in its token.
+
+static byte *WriteCount(byte *op, size_t count)
+{
+    while (count >= 255)
+    {
+        *op++ = 255;
+        count -= 255;
+    }
+
+    *op++ = static_cast<byte>(count);
+    return op;
+}
+
+static byte *WriteSequence(byte *op, const byte *literals, size_t litlen,
+                           size_t offset, size_t matchlen)
+{
+    byte *token = op++;
+    size_t matchcode;
+
+    *token = static_cast<byte>((litlen < 15 ? litlen : 15) << 4);
+    if (litlen >= 15)
+    {
+        op = WriteCount(op, litlen - 15);
+    }
+
+    if (litlen > 0)
+    {
+        memcpy(op, literals, litlen);
+        op += litlen;
+    }
+
+    // The final sequence is only literals.
+    if (matchlen == 0)
+    {
+        return op;
+    }
+
+    *op++ = offset & 0xff;
+    *op++ = (offset >> 8) & 0xff;
+
+    matchcode = matchlen - LZ_MINMATCH;
+    *token |= matchcode < 15 ? matchcode : 15;
+    if (matchcode >= 15)
+    {
+        op = WriteCount(op, matchcode - 15);
+    }
+
+    return op;
+}
+
+size_t M_LZCompressBound(size_t srclen)
+{
+    return srclen + srclen / 255 + 16;
+}
+
+size_t M_LZCompress(const byte *src, size_t srclen, byte *dst)
+{
+    // Position plus one of the last place each hashed sequence was
+    // seen, or zero if it hasn't been.
+    std::vector<uint32_t> table(1 << LZ_HASHBITS, 0);
+    const byte *end = src + srclen;
+    const byte *ip = src;
+    const byte *anchor = src;
+    const byte *ref;
+    byte *op = dst;
+    uint32_t sequence;
+    unsigned int h;
+    size_t len;
+
+    while (ip + LZ_MINMATCH <= end)
+    {
+        sequence = Read32(ip);
+        h = Hash(sequence);
+        ref = table[h] ? src + table[h] - 1 : NULL;
+        table[h] = static_cast<uint32_t>(ip - src + 1);
+
+        if (ref == NULL || ip - ref > LZ_MAXOFFSET || Read32(ref) != sequence)
+        {
+            ++ip;
+            continue;
+        }
+
+        len = LZ_MINMATCH;
+        while (ip + len < end && ip[len] == ref[len])
+        {
+            ++len;
+        }
+
+        op = WriteSequence(op, anchor, ip - anchor, ip - ref, len);
+        ip += len;
+        anchor = ip;
+    }
+
+    op = WriteSequence(op, anchor, end - anchor, 0, 0);
+
+    return op - dst;
+}
+
+// Read the overflow of a count that didn't fit in its token.
+
+static boolean ReadCount(const byte **ip, const byte *ipend, size_t *count)
+{
+    byte b;
+
+    do
+    {
+        if (*ip >= ipend)
+        {
+            return false;
+        }
+
+        b = *(*ip)++;
+        *count += b;
+    } while (b == 255);
+
+    return true;
+}
+
+boolean M_LZDecompress(const byte *src, size_t srclen,
+                       byte *dst, size_t dstlen)
+{
+    const byte *ip = src;
+    const byte *ipend = src + srclen;
+    byte *op = dst;
+    byte *opend = dst + dstlen;
+    const byte *match;
+    size_t offset;
+    size_t len;
+    byte token;
+
+    for (;;)
+    {
+        if (ip >= ipend)
+        {
+            return false;
+        }
+
+        token = *ip++;
+
+        len = token >> 4;
+        if (len == 15 && !ReadCount(&ip, ipend, &len))
+        {
+            return false;
+        }
+
+        if (len > static_cast<size_t>(ipend - ip)
+         || len > static_cast<size_t>(opend - op))
+        {
+            return false;
+        }
+
+        if (len > 0)
+        {
+            memcpy(op, ip, len);
+            op += len;
+            ip += len;
+        }
+
+        if (ip == ipend)
+        {
+            return op == opend;
+        }
+
+        if (ipend - ip < 2)
+        {
+            return false;
+        }
+
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > static_cast<size_t>(op - dst))
+        {
+            return false;
+        }
+
+        len = token & 15;
+        if (len == 15 && !ReadCount(&ip, ipend, &len))
+        {
+            return false;
+        }
+        len += LZ_MINMATCH;
+
+        if (len > static_cast<size_t>(opend - op))
+        {
+            return false;
+        }
+
+        // Matches can overlap what they are copying, so this has to
+        // go a byte at a time.
+        match = op - offset;
+        while (len-- > 0)
+        {
+            *op++ = *match++;
+        }
+    }
+}
+
+}
@@ -0,0 +1,43 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     A small, fast LZ77 compressor.  Trades compression ratio for
+//     speed, in the same spirit as LZ4.
+//
+
+#ifndef __M_LZ__
+#define __M_LZ__
+
+#include <stddef.h>
+
+#include "doomtype.h"
+
+namespace theta
+{
+
+// Largest possible size of srclen bytes once compressed.
+size_t M_LZCompressBound(size_t srclen);
+
+// Compress srclen bytes of src into dst, which must have room for
+// M_LZCompressBound(srclen) bytes.  Returns the compressed size.
+size_t M_LZCompress(const byte *src, size_t srclen, byte *dst);
+
+// Decompress srclen bytes of src into dst, which must be exactly the
+// size of the original data.  Returns false if src is corrupt.
+boolean M_LZDecompress(const byte *src, size_t srclen,
+                       byte *dst, size_t dstlen);
+
+}
+
+#endif
@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "config.h"
 #include "doomtype.h"
 #include "deh_main.h"
@@ -35,6 +37,7 @@
 #include "net_io.h"
 #include "net_packet.h"
 #include "net_server.h"
+#include "net_snapshot.h"
 #include "net_structrw.h"
 #include "w_checksum.h"
 #include "w_wad.h"
@@ -165,6 +168,27 @@ unsigned int net_local_is_freedoom;
 
 static fixed_t average_latency;
 
+// Measured quality of the link to the server
+
+static net_linkstats_t server_link;
+
+// Snapshot of the game being put back together from its packets: the
+// changes it was sent as, the base they are against, which parts have
+// arrived and how many are still to come.
+
+static net_snapshot_t snapshot_recv;
+static unsigned int snapshot_recv_base;
+static std::vector<byte> snapshot_recv_delta;
+static std::vector<byte> snapshot_recv_parts;
+static size_t snapshot_recv_left;
+
+// Snapshots received from the host, by number, and the number of the
+// latest.
+
+static net_snapshot_t snapshots[NET_SNAPSHOT_HISTORY];
+static unsigned int snapshot_latest;
+static std::vector<byte> snapshot_data;
+
 #define NET_CL_ExpandTicNum(b) NET_ExpandTicNum(recvwindow_start, (b))
 
 // Called when we become disconnected from the server
@@ -345,6 +369,7 @@ static void NET_CL_SendGameDataACK(void)
 static void NET_CL_SendTics(int start, int end)
 {
     net_packet_t *packet;
+    net_ticcoder_t coder;
     int i;
 
     if (!net_client_connected)
@@ -371,16 +396,21 @@ static void NET_CL_SendTics(int start, int end)
 
     // Add the tics.
 
+    NET_BeginTiccmds(&coder, packet, client_connection.protocol,
+                     settings.lowres_turn);
+
     for (i=start; i<=end; ++i)
     {
         net_server_send_t *sendobj;
 
         sendobj = &send_queue[i % BACKUPTICS];
 
-        NET_WriteInt16(packet, average_latency / FRACUNIT);
+        NET_WriteTiccmdLatency(&coder, average_latency / FRACUNIT);
 
-        NET_WriteTiccmdDiff(packet, &sendobj->cmd, settings.lowres_turn);
+        NET_WriteTiccmdDiff(&coder, 0, &sendobj->cmd);
     }
+
+    NET_EndTiccmds(&coder);
     
     // Send the packet
 
@@ -419,7 +449,11 @@ void NET_CL_SendTiccmd(ticcmd_t *ticcmd, int maketic)
 
     // Send to server.
 
-    starttic = maketic - settings.extratics;
+    // Send it along with as many earlier tics as the link needs to be
+    // sure of getting them there.  Loss is only measured on the way
+    // here, but is usually much the same both ways.
+
+    starttic = maketic - NET_Link_ExtraTics(&server_link, settings.extratics);
     endtic = maketic;
 
     if (starttic < 0)
@@ -521,6 +555,8 @@ static void NET_CL_ParseLaunch(net_packet_t *packet)
 
 static void NET_CL_ParseGameStart(net_packet_t *packet)
 {
+    int i;
+
     if (!NET_ReadSettings(packet, &settings))
     {
         return;
@@ -558,6 +594,18 @@ static void NET_CL_ParseGameStart(net_packet_t *packet)
     // Clear the send queue
 
     memset(&send_queue, 0x00, sizeof(send_queue));
+
+    NET_Link_Init(&server_link);
+
+    // Snapshots are numbered from the start of the game.
+
+    for (i = 0; i < NET_SNAPSHOT_HISTORY; ++i)
+    {
+        snapshots[i].seq = 0;
+    }
+
+    snapshot_recv.seq = 0;
+    snapshot_latest = 0;
 }
 
 static void NET_CL_SendResendRequest(int start, int end)
@@ -599,8 +647,10 @@ static void NET_CL_CheckResends(void)
     int i;
     int resend_start, resend_end;
     unsigned int nowtime;
+    unsigned int timeout;
 
     nowtime = I_GetTimeMS();
+    timeout = NET_Link_ResendTimeout(&server_link);
 
     resend_start = -1;
     resend_end = -1;
@@ -613,11 +663,11 @@ static void NET_CL_CheckResends(void)
         recvobj = &recvwindow[i];
 
         // if need_resend is true, this tic needs another retransmit
-        // request (300ms timeout)
+        // request (timeout depends on the round trip time)
 
         need_resend = !recvobj->active
                    && recvobj->resend_time != 0
-                   && nowtime > recvobj->resend_time + 300;
+                   && nowtime > recvobj->resend_time + timeout;
 
         if (need_resend)
         {
@@ -663,12 +713,38 @@ static void NET_CL_CheckResends(void)
 }
 
 
+// Update the link statistics for a tic received for the first time.
+// Anything but the newest tic in a packet should have come in an
+// earlier one, which must have been lost.  The round trip is timed
+// from sending our own ticcmd for the tic, so it includes however
+// long the server waited for the other players; either way, it is
+// how long a tic takes to come back.
+
+static void NET_CL_TicReceived(net_server_recv_t *recvobj, unsigned int seq,
+                               boolean redundant, unsigned int nowtime)
+{
+    net_server_send_t *sendobj;
+    boolean lost;
+
+    lost = redundant || recvobj->resend_time != 0;
+
+    NET_Link_TicReceived(&server_link, lost);
+
+    sendobj = &send_queue[seq % BACKUPTICS];
+
+    if (!lost && sendobj->active && sendobj->seq == seq)
+    {
+        NET_Link_RoundTrip(&server_link, nowtime - sendobj->time);
+    }
+}
+
 // Parsing of NET_PACKET_TYPE_GAMEDATA packets
 // (packets containing the actual ticcmd data)
 
 static void NET_CL_ParseGameData(net_packet_t *packet)
 {
     net_server_recv_t *recvobj;
+    net_ticcoder_t coder;
     unsigned int seq, num_tics;
     unsigned int nowtime;
     int resend_start, resend_end;
@@ -698,13 +774,16 @@ static void NET_CL_ParseGameData(net_packet_t *packet)
 
     seq = NET_CL_ExpandTicNum(seq);
 
+    NET_BeginTiccmds(&coder, packet, client_connection.protocol,
+                     settings.lowres_turn);
+
     for (i=0; i<num_tics; ++i)
     {
         net_full_ticcmd_t cmd;
 
         index = seq - recvwindow_start + i;
 
-        if (!NET_ReadFullTiccmd(packet, &cmd, settings.lowres_turn))
+        if (!NET_ReadFullTiccmd(&coder, &cmd))
         {
             return;
         }
@@ -720,6 +799,11 @@ static void NET_CL_ParseGameData(net_packet_t *packet)
         
         recvobj = &recvwindow[index];
 
+        if (!recvobj->active)
+        {
+            NET_CL_TicReceived(recvobj, seq + i, i + 1 < num_tics, nowtime);
+        }
+
         recvobj->active = true;
         recvobj->cmd = cmd;
     }
@@ -826,6 +910,163 @@ static void NET_CL_ParseResendRequest(net_packet_t *packet)
     }
 }
 
+static void NET_CL_SendSnapshotACK(unsigned int seq)
+{
+    net_packet_t *packet;
+
+    packet = NET_NewPacket(10);
+    NET_WriteInt16(packet, NET_PACKET_TYPE_SNAPSHOT_ACK);
+    NET_WriteInt32(packet, seq);
+    NET_Conn_SendPacket(&client_connection, packet);
+    NET_FreePacket(packet);
+}
+
+// A snapshot has been put back together.  Apply the changes to the
+// base they were sent against, and keep it if it comes out as the host
+// had it.  Otherwise, remind the server which we have, so that the
+// next is sent against that.
+
+static void NET_CL_SnapshotReceived(void)
+{
+    net_snapshot_t *base = NULL;
+    net_snapshot_t *snapshot;
+    sha1_context_t context;
+    sha1_digest_t digest;
+    boolean ok;
+
+    if (snapshot_recv_base != 0)
+    {
+        base = &snapshots[snapshot_recv_base % NET_SNAPSHOT_HISTORY];
+
+        if (base->seq != snapshot_recv_base)
+        {
+            base = NULL;
+        }
+    }
+
+    if (snapshot_recv_base != 0 && base == NULL)
+    {
+        ok = false;
+    }
+    else if (base != NULL)
+    {
+        ok = NET_DecodeSnapshot(&snapshot_data,
+                                base->data.data(), base->data.size(),
+                                snapshot_recv_delta.data(),
+                                snapshot_recv_delta.size());
+    }
+    else
+    {
+        ok = NET_DecodeSnapshot(&snapshot_data, NULL, 0,
+                                snapshot_recv_delta.data(),
+                                snapshot_recv_delta.size());
+    }
+
+    if (ok)
+    {
+        SHA1_Init(&context);
+        SHA1_Update(&context, snapshot_data.data(), snapshot_data.size());
+        SHA1_Final(digest, &context);
+
+        ok = !memcmp(digest, snapshot_recv.digest, sizeof(sha1_digest_t));
+    }
+
+    if (!ok)
+    {
+        if (snapshot_latest != 0)
+        {
+            NET_CL_SendSnapshotACK(snapshot_latest);
+        }
+
+        return;
+    }
+
+    snapshot = &snapshots[snapshot_recv.seq % NET_SNAPSHOT_HISTORY];
+    snapshot->seq = snapshot_recv.seq;
+    snapshot->tic = snapshot_recv.tic;
+    memcpy(snapshot->digest, digest, sizeof(sha1_digest_t));
+    snapshot->data.swap(snapshot_data);
+
+    snapshot_latest = snapshot->seq;
+
+    NET_CL_SendSnapshotACK(snapshot_latest);
+}
+
+// Part of a snapshot of the game, sent by the host
+
+static void NET_CL_ParseSnapshot(net_packet_t *packet)
+{
+    unsigned int seq, base, tic;
+    unsigned int total, offset, len;
+    sha1_digest_t digest;
+    unsigned int part;
+
+    if (!NET_ReadInt32(packet, &seq)
+     || !NET_ReadInt32(packet, &base)
+     || !NET_ReadInt32(packet, &tic)
+     || !NET_ReadSHA1Sum(packet, digest)
+     || !NET_ReadInt32(packet, &total)
+     || !NET_ReadInt32(packet, &offset)
+     || !NET_ReadInt16(packet, &len))
+    {
+        return;
+    }
+
+    if (client_state != CLIENT_STATE_IN_GAME || seq <= snapshot_latest)
+    {
+        return;
+    }
+
+    // Every part but the last is full.
+
+    if (total == 0 || total > NET_SNAPSHOT_MAX
+     || offset >= total || offset % NET_SNAPSHOT_FRAGMENT != 0
+     || len != std::min(total - offset, (unsigned int) NET_SNAPSHOT_FRAGMENT))
+    {
+        return;
+    }
+
+    // A newer snapshot takes the place of one still coming in.
+
+    if (seq != snapshot_recv.seq)
+    {
+        if (seq < snapshot_recv.seq)
+        {
+            return;
+        }
+
+        snapshot_recv.seq = seq;
+        snapshot_recv.tic = tic;
+        memcpy(snapshot_recv.digest, digest, sizeof(sha1_digest_t));
+        snapshot_recv_base = base;
+        snapshot_recv_delta.resize(total);
+        snapshot_recv_parts.assign(
+            (total + NET_SNAPSHOT_FRAGMENT - 1) / NET_SNAPSHOT_FRAGMENT, 0);
+        snapshot_recv_left = snapshot_recv_parts.size();
+    }
+    else if (base != snapshot_recv_base
+          || total != snapshot_recv_delta.size())
+    {
+        return;
+    }
+
+    part = offset / NET_SNAPSHOT_FRAGMENT;
+
+    if (snapshot_recv_parts[part]
+     || !NET_ReadBytes(packet, &snapshot_recv_delta[offset], len))
+    {
+        return;
+    }
+
+    snapshot_recv_parts[part] = 1;
+    --snapshot_recv_left;
+
+    if (snapshot_recv_left == 0)
+    {
+        NET_CL_SnapshotReceived();
+    }
+}
+
 // Console message that the server wants the client to print
 
 static void NET_CL_ParseConsoleMessage(net_packet_t *packet)
@@ -889,6 +1130,10 @@ static void NET_CL_ParsePacket(net_packet_t *packet)
                 NET_CL_ParseConsoleMessage(packet);
                 break;
 
+            case NET_PACKET_TYPE_SNAPSHOT:
+                NET_CL_ParseSnapshot(packet);
+                break;
+
             default:
                 break;
         }
@@ -916,11 +1161,8 @@ void NET_CL_Run(void)
         {
             NET_CL_ParsePacket(packet);
         }
-        else
-        {
-            NET_FreeAddress(addr);
-        }
 
+        NET_FreeAddress(addr);
         NET_FreePacket(packet);
     }
 
@@ -1059,6 +1301,37 @@ boolean NET_CL_Connect(net_addr_t *addr, net_connect_data_t *data)
 
 // read game settings received from server
 
+// Get the statistics for the link to the server, and the number of
+// extra tics being sent over it.  Returns false if not in a game.
+
+boolean NET_CL_GetLinkStats(net_linkstats_t *stats, int *extratics)
+{
+    if (!net_client_connected || client_state != CLIENT_STATE_IN_GAME)
+    {
+        return false;
+    }
+
+    *stats = server_link;
+    *extratics = NET_Link_ExtraTics(&server_link, settings.extratics);
+
+    return true;
+}
+
+// Get the latest snapshot of the game received from the host, or NULL
+// if there has not been one.  It is only good until the client next
+// runs.
+
+const net_snapshot_t *NET_CL_LatestSnapshot(void)
+{
+    if (!net_client_connected || client_state != CLIENT_STATE_IN_GAME
+     || snapshot_latest == 0)
+    {
+        return NULL;
+    }
+
+    return &snapshots[snapshot_latest % NET_SNAPSHOT_HISTORY];
+}
+
 boolean NET_CL_GetSettings(net_gamesettings_t *_settings)
 {
     if (client_state != CLIENT_STATE_IN_GAME)
@@ -20,7 +20,9 @@
 #include "doomtype.h"
 #include "d_ticcmd.h"
 #include "sha1.h"
+#include "net_common.h"
 #include "net_defs.h"
+#include "net_snapshot.h"
 
 namespace theta
 {
@@ -33,6 +35,8 @@ void NET_CL_LaunchGame(void);
 void NET_CL_StartGame(net_gamesettings_t *settings);
 void NET_CL_SendTiccmd(ticcmd_t *ticcmd, int maketic);
 boolean NET_CL_GetSettings(net_gamesettings_t *_settings);
+boolean NET_CL_GetLinkStats(net_linkstats_t *stats, int *extratics);
+const net_snapshot_t *NET_CL_LatestSnapshot(void);
 void NET_Init(void);
 
 void NET_BindVariables(void);
@@ -14,6 +14,7 @@
 // Common code shared between the client and server
 //
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -390,6 +391,62 @@ void NET_Conn_Run(net_connection_t *conn)
     }
 }
 
+// Time in ms from nowtime until NET_Conn_Run next has something to do
+// for this connection, or -1 if it is only waiting on packets.
+
+static int NextTimeout(int timeout, int deadline, int nowtime)
+{
+    int remaining = deadline - nowtime;
+
+    if (remaining < 0)
+    {
+        remaining = 0;
+    }
+
+    return timeout < 0 || remaining < timeout ? remaining : timeout;
+}
+
+int NET_Conn_Timeout(net_connection_t *conn, int nowtime)
+{
+    int timeout = -1;
+
+    if (conn->state == NET_CONN_STATE_CONNECTED)
+    {
+        timeout = NextTimeout(timeout,
+            conn->keepalive_recv_time + CONNECTION_TIMEOUT_LEN * 1000 + 1,
+            nowtime);
+        timeout = NextTimeout(timeout,
+            conn->keepalive_send_time + KEEPALIVE_PERIOD * 1000 + 1,
+            nowtime);
+
+        if (conn->reliable_packets != NULL)
+        {
+            if (conn->reliable_packets->last_send_time < 0)
+            {
+                return 0;
+            }
+
+            timeout = NextTimeout(timeout,
+                conn->reliable_packets->last_send_time + 1001, nowtime);
+        }
+    }
+    else if (conn->state == NET_CONN_STATE_DISCONNECTING)
+    {
+        if (conn->last_send_time < 0)
+        {
+            return 0;
+        }
+
+        timeout = NextTimeout(timeout, conn->last_send_time + 1001, nowtime);
+    }
+    else if (conn->state == NET_CONN_STATE_DISCONNECTED_SLEEP)
+    {
+        timeout = NextTimeout(timeout, conn->last_send_time + 5001, nowtime);
+    }
+
+    return timeout;
+}
+
 net_packet_t *NET_Conn_NewReliable(net_connection_t *conn, int packet_type)
 {
     net_packet_t *packet;
@@ -429,6 +486,126 @@ net_packet_t *NET_Conn_NewReliable(net_connection_t *conn, int packet_type)
     return packet;
 }
 
+//
+// Link statistics
+//
+
+// Resend timeout to use until the round trip time is known, and the
+// limits on it once it is.
+
+#define LINK_DEFAULT_RESEND 300
+#define LINK_MIN_RESEND     50
+#define LINK_MAX_RESEND     1000
+
+// How much each tic counts towards the smoothed loss.
+
+#define LINK_LOSS_WEIGHT    (1.0f / 64)
+
+// Extra tics are added until a tic would only go missing this rarely,
+// up to a limit.
+
+#define LINK_TARGET_LOSS    0.001f
+#define LINK_MAX_EXTRATICS  6
+
+void NET_Link_Init(net_linkstats_t *link)
+{
+    link->rtt = -1;
+    link->rttvar = 0;
+    link->loss = 0;
+    link->tics = 0;
+    link->lost_tics = 0;
+}
+
+// Add a round trip time sample.
+
+void NET_Link_RoundTrip(net_linkstats_t *link, int rtt)
+{
+    if (rtt < 0)
+    {
+        return;
+    }
+
+    if (link->rtt < 0)
+    {
+        link->rtt = rtt;
+        link->rttvar = rtt / 2;
+    }
+    else
+    {
+        link->rttvar += (abs(link->rtt - rtt) - link->rttvar) / 4;
+        link->rtt += (rtt - link->rtt) / 8;
+    }
+}
+
+// Count a tic received from the peer.  It was lost if it turned up in
+// a resend or as one of the extra tics in a later packet.
+
+void NET_Link_TicReceived(net_linkstats_t *link, boolean lost)
+{
+    ++link->tics;
+
+    if (lost)
+    {
+        ++link->lost_tics;
+    }
+
+    link->loss += ((lost ? 1.0f : 0.0f) - link->loss) * LINK_LOSS_WEIGHT;
+}
+
+// How long to wait for a resend before asking again.
+
+int NET_Link_ResendTimeout(net_linkstats_t *link)
+{
+    int timeout;
+
+    if (link->rtt < 0)
+    {
+        return LINK_DEFAULT_RESEND;
+    }
+
+    timeout = link->rtt + 4 * link->rttvar;
+
+    if (timeout < LINK_MIN_RESEND)
+    {
+        timeout = LINK_MIN_RESEND;
+    }
+    else if (timeout > LINK_MAX_RESEND)
+    {
+        timeout = LINK_MAX_RESEND;
+    }
+
+    return timeout;
+}
+
+// How many earlier tics to send again along with each new one.  A tic
+// only goes missing if every packet carrying it is lost, so with
+// packet loss p and n extra tics that happens p^(n+1) of the time.
+
+int NET_Link_ExtraTics(net_linkstats_t *link, int minimum)
+{
+    int extratics;
+
+    if (link->loss <= 0)
+    {
+        return minimum;
+    }
+    else if (link->loss >= 0.5f)
+    {
+        extratics = LINK_MAX_EXTRATICS;
+    }
+    else
+    {
+        extratics = (int) ceil(log(LINK_TARGET_LOSS) / log(link->loss)) - 1;
+
+        if (extratics > LINK_MAX_EXTRATICS)
+        {
+            extratics = LINK_MAX_EXTRATICS;
+        }
+    }
+
+    return extratics > minimum ? extratics : minimum;
+}
+
 // Used to expand the least significant byte of a tic number into 
 // the full tic number, from the current tic number
 
@@ -85,6 +85,35 @@ typedef struct
 } net_connection_t;
 
 
+// Measured quality of the link to a peer, used to decide how much
+// redundancy to send it and how long to wait before asking it to
+// resend.  Times are in milliseconds.
+
+typedef struct
+{
+    // Smoothed round trip time and its mean deviation (jitter), as
+    // TCP keeps them.  rtt is negative until the first sample.
+
+    int rtt;
+    int rttvar;
+
+    // Smoothed fraction of tics that did not arrive in the packet
+    // first meant to carry them.
+
+    float loss;
+
+    // Totals since the link was set up.
+
+    unsigned int tics;
+    unsigned int lost_tics;
+} net_linkstats_t;
+
+void NET_Link_Init(net_linkstats_t *link);
+void NET_Link_RoundTrip(net_linkstats_t *link, int rtt);
+void NET_Link_TicReceived(net_linkstats_t *link, boolean lost);
+int NET_Link_ResendTimeout(net_linkstats_t *link);
+int NET_Link_ExtraTics(net_linkstats_t *link, int minimum);
+
 void NET_Conn_SendPacket(net_connection_t *conn, net_packet_t *packet);
 void NET_Conn_InitClient(net_connection_t *conn, net_addr_t *addr,
                          net_protocol_t protocol);
@@ -94,6 +123,7 @@ boolean NET_Conn_Packet(net_connection_t *conn, net_packet_t *packet,
                         unsigned int *packet_type);
 void NET_Conn_Disconnect(net_connection_t *conn);
 void NET_Conn_Run(net_connection_t *conn);
+int NET_Conn_Timeout(net_connection_t *conn, int nowtime);
 net_packet_t *NET_Conn_NewReliable(net_connection_t *conn, int packet_type);
 
 // Other miscellaneous common functions
@@ -18,14 +18,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "config.h"
 #include "doomtype.h"
 
 #include "i_system.h"
-#include "i_timer.h"
 
 #include "m_argv.h"
 
 #include "net_defs.h"
+#include "net_native.h"
 #include "net_sdl.h"
 #include "net_server.h"
 
@@ -66,16 +67,54 @@ static void CheckForClientOptions(void)
 
 void NET_DedicatedServer(void)
 {
+    int p;
+
     CheckForClientOptions();
 
     NET_SV_Init();
-    NET_SV_AddModule(&net_sdl_module);
+
+    //!
+    // @category net
+    // @arg <n>
+    //
+    // When running a dedicated server, host up to <n> separate games
+    // at once on the same port.  Each new player joins the first game
+    // that is still waiting for players.
+    //
+
+    p = M_CheckParmWithArgs("-sessions", 1);
+
+    if (p > 0)
+    {
+        NET_SV_SetMaxSessions(atoi(myargv[p + 1]));
+    }
+
+#ifdef HAVE_RECVMMSG
+    //!
+    // @category net
+    //
+    // When running a dedicated server, use SDL_net for networking
+    // instead of sending and receiving packets in batches.
+    //
+
+    if (!M_CheckParm("-sdlnet"))
+    {
+        NET_SV_AddModule(&net_native_module);
+    }
+    else
+#endif
+    {
+        NET_SV_AddModule(&net_sdl_module);
+    }
     NET_SV_RegisterWithMaster();
 
+    // Sleep until a packet arrives or something is due to be resent,
+    // rather than polling.
+
     while (true)
     {
         NET_SV_Run();
-        I_Sleep(10);
+        NET_SV_Wait();
     }
 }
 
@@ -91,6 +91,12 @@ struct _net_module_s
     // Try to resolve a name to an address
 
     net_addr_t *(*ResolveAddress)(const char *addr);
+
+    // Block for up to timeout milliseconds until a packet arrives.
+    // Returns true if a packet may be waiting.  NULL if the module
+    // has nothing to block on.
+
+    boolean (*WaitForPacket)(int timeout);
 };
 
 // net_addr_t
@@ -99,6 +105,12 @@ struct _net_addr_s
 {
     net_module_t *module;
     void *handle;
+
+    // References handed out by the module.  Every one is given back
+    // with NET_FreeAddress, and the module may reclaim the address
+    // once the last has gone.
+
+    int refcount;
 };
 
 // Magic number sent when connecting to check this is a valid client
@@ -125,6 +137,11 @@ typedef enum
     // number in this enum.
     NET_PROTOCOL_CHOCOLATE_DOOM_0,
 
+    // Thanatos protocol.  The same as CHOCOLATE_DOOM_0, except that
+    // ticcmds are bit-packed, with movement sent as the difference from
+    // the last value in the same packet.
+    NET_PROTOCOL_THANATOS_0,
+
     // Add your own protocol here; be sure to add a name for it to the list
     // in net_common.c too.
 
@@ -152,6 +169,8 @@ typedef enum
     NET_PACKET_TYPE_QUERY,
     NET_PACKET_TYPE_QUERY_RESPONSE,
     NET_PACKET_TYPE_LAUNCH,
+    NET_PACKET_TYPE_SNAPSHOT,
+    NET_PACKET_TYPE_SNAPSHOT_ACK,
 } net_packet_type_t;
 
 typedef enum
@@ -19,6 +19,7 @@
 #include <stdio.h>
 
 #include "i_system.h"
+#include "i_timer.h"
 #include "net_defs.h"
 #include "net_io.h"
 #include "z_zone.h"
@@ -111,18 +112,46 @@ boolean NET_RecvPacket(net_context_t *context,
     return false;
 }
 
+// Block for up to timeout milliseconds until a packet arrives.  Only a
+// context with a single module that can block really sleeps on its
+// socket; anything else polls every millisecond so that no module is
+// left waiting.
+
+boolean NET_WaitForPacket(net_context_t *context, int timeout)
+{
+    if (timeout <= 0)
+    {
+        return true;
+    }
+
+    if (context->num_modules == 1
+     && context->modules[0]->WaitForPacket != NULL)
+    {
+        return context->modules[0]->WaitForPacket(timeout);
+    }
+
+    I_Sleep(1);
+
+    return true;
+}
+
 // Note: this prints into a static buffer, calling again overwrites
-// the first result
+// the first result.  Each thread has its own buffer.
 
 char *NET_AddrToString(net_addr_t *addr)
 {
-    static char buf[128];
+    static thread_local char buf[128];
 
     addr->module->AddrToString(addr, buf, sizeof(buf) - 1);
 
     return buf;
 }
 
+void NET_ReferenceAddress(net_addr_t *addr)
+{
+    ++addr->refcount;
+}
+
 void NET_FreeAddress(net_addr_t *addr)
 {
     addr->module->FreeAddress(addr);
@@ -31,7 +31,9 @@ void NET_SendPacket(net_addr_t *addr, net_packet_t *packet);
 void NET_SendBroadcast(net_context_t *context, net_packet_t *packet);
 boolean NET_RecvPacket(net_context_t *context, net_addr_t **addr, 
                        net_packet_t **packet);
+boolean NET_WaitForPacket(net_context_t *context, int timeout);
 char *NET_AddrToString(net_addr_t *addr);
+void NET_ReferenceAddress(net_addr_t *addr);
 void NET_FreeAddress(net_addr_t *addr);
 net_addr_t *NET_ResolveAddress(net_context_t *context, const char *address);
 
@@ -18,10 +18,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #include "doomtype.h"
 #include "i_system.h"
 #include "m_misc.h"
 #include "net_defs.h"
+#include "net_io.h"
 #include "net_loop.h"
 #include "net_packet.h"
 
@@ -154,6 +160,7 @@ net_module_t net_loop_client_module =
     NET_CL_AddrToString,
     NET_CL_FreeAddress,
     NET_CL_ResolveAddress,
+    NULL,
 };
 
 //-----------------------------------------------------------------------------
@@ -229,6 +236,202 @@ net_module_t net_loop_server_module =
     NET_SV_AddrToString,
     NET_SV_FreeAddress,
     NET_SV_ResolveAddress,
+    NULL,
 };
 
+//-----------------------------------------------------------------------------
+//
+// Loopback network of named peers
+//
+//-----------------------------------------------------------------------------
+
+typedef struct
+{
+    net_addr_t addr;
+    std::string name;
+
+    // Packets sent to this peer by the code under test.
+
+    std::deque<net_packet_t *> inbox;
+} loop_peer_t;
+
+typedef struct
+{
+    net_addr_t *addr;
+    net_packet_t *packet;
+} loop_packet_t;
+
+// The server may send from several threads at once when hosting more
+// than one session, so everything here is done under the lock.
+
+static std::mutex network_mutex;
+static std::unordered_map<std::string, loop_peer_t *> peers;
+
+// Packets sent by peers to the code under test.
+
+static std::deque<loop_packet_t> network_inbox;
+
+static loop_peer_t *NET_Peer_Find(const char *name)
+{
+    loop_peer_t *peer;
+    auto it = peers.find(name);
+
+    if (it != peers.end())
+    {
+        return it->second;
+    }
+
+    peer = new loop_peer_t();
+    peer->addr.module = &net_loop_network_module;
+    peer->addr.handle = peer;
+    peer->addr.refcount = 0;
+    peer->name = name;
+    peers[name] = peer;
+
+    return peer;
+}
+
+static boolean NET_Peer_Init(void)
+{
+    return true;
+}
+
+static void NET_Peer_SendPacket(net_addr_t *addr, net_packet_t *packet)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    if (addr == &net_broadcast_addr)
+    {
+        for (auto &it : peers)
+        {
+            it.second->inbox.push_back(NET_PacketDup(packet));
+        }
+    }
+    else
+    {
+        static_cast<loop_peer_t *>(addr->handle)->inbox.push_back(
+            NET_PacketDup(packet));
+    }
+}
+
+static boolean NET_Peer_RecvPacket(net_addr_t **addr, net_packet_t **packet)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    if (network_inbox.empty())
+    {
+        return false;
+    }
+
+    *addr = network_inbox.front().addr;
+    *packet = network_inbox.front().packet;
+    network_inbox.pop_front();
+
+    ++(*addr)->refcount;
+
+    return true;
+}
+
+static void NET_Peer_AddrToString(net_addr_t *addr, char *buffer,
+                                  int buffer_len)
+{
+    M_StringCopy(buffer, static_cast<loop_peer_t *>(addr->handle)->name.c_str(),
+                 buffer_len);
+}
+
+static void NET_Peer_FreeAddress(net_addr_t *addr)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    if (--addr->refcount < 0)
+    {
+        I_Error("NET_Peer_FreeAddress: '%s' freed more times than it "
+                "was referenced",
+                static_cast<loop_peer_t *>(addr->handle)->name.c_str());
+    }
+}
+
+static net_addr_t *NET_Peer_ResolveAddress(const char *address)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+    loop_peer_t *peer;
+
+    if (address == NULL)
+    {
+        return NULL;
+    }
+
+    peer = NET_Peer_Find(address);
+    ++peer->addr.refcount;
+
+    return &peer->addr;
+}
+
+net_module_t net_loop_network_module =
+{
+    NET_Peer_Init,
+    NET_Peer_Init,
+    NET_Peer_SendPacket,
+    NET_Peer_RecvPacket,
+    NET_Peer_AddrToString,
+    NET_Peer_FreeAddress,
+    NET_Peer_ResolveAddress,
+    NULL,
+};
+
+net_addr_t *NET_Loop_Peer(const char *name)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    return &NET_Peer_Find(name)->addr;
+}
+
+void NET_Loop_SendFrom(net_addr_t *peer, net_packet_t *packet)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    network_inbox.push_back({ peer, NET_PacketDup(packet) });
+}
+
+net_packet_t *NET_Loop_RecvAt(net_addr_t *peer)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+    loop_peer_t *loop_peer = static_cast<loop_peer_t *>(peer->handle);
+    net_packet_t *packet;
+
+    if (loop_peer->inbox.empty())
+    {
+        return NULL;
+    }
+
+    packet = loop_peer->inbox.front();
+    loop_peer->inbox.pop_front();
+
+    return packet;
+}
+
+void NET_Loop_ResetPeers(void)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    for (const loop_packet_t &queued : network_inbox)
+    {
+        NET_FreePacket(queued.packet);
+    }
+
+    network_inbox.clear();
+
+    for (auto &it : peers)
+    {
+        for (net_packet_t *packet : it.second->inbox)
+        {
+            NET_FreePacket(packet);
+        }
+
+        delete it.second;
+    }
+
+    peers.clear();
+}
+
 }
@@ -26,6 +26,33 @@ namespace theta
 extern net_module_t net_loop_client_module;
 extern net_module_t net_loop_server_module;
 
+// Loopback network with any number of named peers, so that test
+// programs can run the server or the query code against many clients
+// or servers in one process.  The code under test uses
+// net_loop_network_module as its only module and resolves peers by
+// name; the test plays the peers with the functions below.  Peers last
+// until NET_Loop_ResetPeers, whatever their reference count.
+
+extern net_module_t net_loop_network_module;
+
+// Find the peer with the given name, creating it if needed.  No
+// reference is taken.
+
+net_addr_t *NET_Loop_Peer(const char *name);
+
+// Send a packet from a peer to the code under test.
+
+void NET_Loop_SendFrom(net_addr_t *peer, net_packet_t *packet);
+
+// Take the next packet sent to a peer, or NULL if there is none.  The
+// caller frees the packet.
+
+net_packet_t *NET_Loop_RecvAt(net_addr_t *peer);
+
+// Throw away every peer and any packets still waiting.
+
+void NET_Loop_ResetPeers(void);
+
 }
 
 #endif /* #ifndef NET_LOOP_H */
@@ -0,0 +1,614 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Networking module using native sockets.  Datagrams are received
+//     and sent in batches with recvmmsg() and sendmmsg(), so a busy
+//     server makes one system call for many packets.
+//
+
+#include "config.h"
+
+#ifdef HAVE_RECVMMSG
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <mutex>
+#include <unordered_map>
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "net_defs.h"
+#include "net_io.h"
+#include "net_native.h"
+#include "net_packet.h"
+#include "z_zone.h"
+
+namespace theta
+{
+
+#define DEFAULT_PORT 2342
+
+// Most sockets to listen on, and most datagrams to move in one call.
+
+#define MAX_SOCKETS 16
+#define BATCH_SIZE 32
+
+// Largest datagram we will receive, the same as the SDL_net module.
+
+#define MAX_DATAGRAM 1500
+
+typedef struct
+{
+    struct mmsghdr msgs[BATCH_SIZE];
+    struct iovec iovecs[BATCH_SIZE];
+    struct sockaddr_in addrs[BATCH_SIZE];
+    byte buffers[BATCH_SIZE][MAX_DATAGRAM];
+    int count;
+} batch_t;
+
+typedef struct
+{
+    int fd;
+
+    // Datagrams from the last recvmmsg(), handed out one at a time.
+
+    batch_t recv;
+    int recv_next;
+
+    // Datagrams waiting to go out in the next sendmmsg().
+
+    batch_t send;
+} socket_t;
+
+typedef struct
+{
+    net_addr_t net_addr;
+    struct sockaddr_in sin;
+
+    // Socket that this address talks to us on.
+
+    socket_t *sock;
+} addrentry_t;
+
+static boolean initted = false;
+static int port = DEFAULT_PORT;
+
+static socket_t *sockets[MAX_SOCKETS];
+static int num_sockets;
+static int recv_socket;
+
+// Server sessions may send from any thread.
+
+static std::mutex send_mutex;
+
+static std::unordered_map<uint64_t, addrentry_t *> addr_table;
+
+static uint64_t NET_Native_AddrKey(const struct sockaddr_in *sin)
+{
+    return (static_cast<uint64_t>(sin->sin_addr.s_addr) << 16)
+         | sin->sin_port;
+}
+
+// Finds an address in the table, adding it if it is not there already.
+// Each call takes a reference to the address.  sock is the socket a
+// packet from the address arrived on, and replies go out through the
+// last one; NULL when resolving, so new addresses use the first.
+
+static net_addr_t *NET_Native_FindAddress(const struct sockaddr_in *sin,
+                                          socket_t *sock)
+{
+    addrentry_t *entry;
+    uint64_t key;
+
+    key = NET_Native_AddrKey(sin);
+
+    auto it = addr_table.find(key);
+
+    if (it != addr_table.end())
+    {
+        if (sock != NULL)
+        {
+            it->second->sock = sock;
+        }
+
+        ++it->second->net_addr.refcount;
+        return &it->second->net_addr;
+    }
+
+    if (sock == NULL)
+    {
+        sock = sockets[0];
+    }
+
+    entry = static_cast<addrentry_t*>(Z_Malloc(sizeof(addrentry_t),
+                                               PU_STATIC, 0));
+
+    entry->sin = *sin;
+    entry->sock = sock;
+    entry->net_addr.handle = entry;
+    entry->net_addr.module = &net_native_module;
+    entry->net_addr.refcount = 1;
+
+    addr_table[key] = entry;
+
+    return &entry->net_addr;
+}
+
+static void NET_Native_FreeAddress(net_addr_t *addr)
+{
+    addrentry_t *entry;
+
+    entry = static_cast<addrentry_t*>(addr->handle);
+
+    auto it = addr_table.find(NET_Native_AddrKey(&entry->sin));
+
+    if (it == addr_table.end() || it->second != entry)
+    {
+        I_Error("NET_Native_FreeAddress: Attempted to remove an unused address!");
+    }
+
+    if (--addr->refcount > 0)
+    {
+        return;
+    }
+
+    addr_table.erase(it);
+    Z_Free(entry);
+}
+
+// Point each message in a batch at its buffer and address.
+
+static void NET_Native_InitBatch(batch_t *batch)
+{
+    int i;
+
+    memset(batch, 0, sizeof(*batch));
+
+    for (i = 0; i < BATCH_SIZE; ++i)
+    {
+        batch->iovecs[i].iov_base = batch->buffers[i];
+        batch->iovecs[i].iov_len = MAX_DATAGRAM;
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+    }
+}
+
+static void NET_Native_OpenSocket(int bind_port)
+{
+    struct sockaddr_in sin;
+    socket_t *sock;
+    int enable;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+    if (fd < 0)
+    {
+        I_Error("NET_Native_OpenSocket: Unable to open a socket!");
+    }
+
+    enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(bind_port);
+
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&sin), sizeof(sin)) < 0)
+    {
+        I_Error("NET_Native_OpenSocket: Unable to bind to port %i", bind_port);
+    }
+
+    sock = static_cast<socket_t*>(Z_Malloc(sizeof(socket_t), PU_STATIC, 0));
+    sock->fd = fd;
+    sock->recv_next = 0;
+    NET_Native_InitBatch(&sock->recv);
+    NET_Native_InitBatch(&sock->send);
+
+    sockets[num_sockets] = sock;
+    ++num_sockets;
+}
+
+static boolean NET_Native_InitClient(void)
+{
+    int p;
+
+    if (initted)
+        return true;
+
+    p = M_CheckParmWithArgs("-port", 1);
+    if (p > 0)
+        port = atoi(myargv[p+1]);
+
+    NET_Native_OpenSocket(0);
+
+    initted = true;
+
+    return true;
+}
+
+static boolean NET_Native_InitServer(void)
+{
+    int count;
+    int p;
+    int i;
+
+    if (initted)
+        return true;
+
+    p = M_CheckParmWithArgs("-port", 1);
+    if (p > 0)
+        port = atoi(myargv[p+1]);
+
+    //!
+    // @category net
+    // @arg <n>
+    //
+    // When running a dedicated server, listen on <n> consecutive UDP
+    // ports, starting at the one given with -port.
+    //
+
+    count = 1;
+    p = M_CheckParmWithArgs("-ports", 1);
+    if (p > 0)
+        count = atoi(myargv[p+1]);
+
+    if (count < 1 || count > MAX_SOCKETS)
+    {
+        I_Error("NET_Native_InitServer: Can only listen on 1 to %i ports",
+                MAX_SOCKETS);
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        NET_Native_OpenSocket(port + i);
+    }
+
+    initted = true;
+
+    return true;
+}
+
+// Send everything queued up on a socket.  Must hold send_mutex.
+
+static void NET_Native_FlushSocket(socket_t *sock)
+{
+    batch_t *batch;
+    int sent;
+    int result;
+
+    batch = &sock->send;
+    sent = 0;
+
+    while (sent < batch->count)
+    {
+        result = sendmmsg(sock->fd, batch->msgs + sent,
+                          batch->count - sent, 0);
+
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            // Out of buffer space.  These are datagrams, so just drop
+            // the rest as if they were lost on the way.
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+            {
+                break;
+            }
+
+            I_Error("NET_Native_FlushSocket: Error transmitting packets: %s",
+                    strerror(errno));
+        }
+
+        sent += result;
+    }
+
+    batch->count = 0;
+}
+
+static void NET_Native_Flush(void)
+{
+    std::lock_guard<std::mutex> lock(send_mutex);
+    int i;
+
+    for (i = 0; i < num_sockets; ++i)
+    {
+        if (sockets[i]->send.count > 0)
+        {
+            NET_Native_FlushSocket(sockets[i]);
+        }
+    }
+}
+
+// Packets are queued up and go out together when the queue fills, just
+// before we next look for packets, or before we go to sleep.
+
+static void NET_Native_SendPacket(net_addr_t *addr, net_packet_t *packet)
+{
+    struct sockaddr_in sin;
+    socket_t *sock;
+    batch_t *batch;
+    int i;
+
+    if (addr == &net_broadcast_addr)
+    {
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+        sin.sin_port = htons(port);
+        sock = sockets[0];
+    }
+    else
+    {
+        addrentry_t *entry = static_cast<addrentry_t*>(addr->handle);
+
+        sin = entry->sin;
+        sock = entry->sock;
+    }
+
+    // Too large to fit a batch buffer; send it on its own.
+
+    if (packet->len > MAX_DATAGRAM)
+    {
+        sendto(sock->fd, packet->data, packet->len, 0,
+               reinterpret_cast<struct sockaddr *>(&sin), sizeof(sin));
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(send_mutex);
+
+    batch = &sock->send;
+
+    if (batch->count == BATCH_SIZE)
+    {
+        NET_Native_FlushSocket(sock);
+    }
+
+    i = batch->count;
+    memcpy(batch->buffers[i], packet->data, packet->len);
+    batch->iovecs[i].iov_len = packet->len;
+    batch->addrs[i] = sin;
+    batch->msgs[i].msg_hdr.msg_namelen = sizeof(sin);
+    ++batch->count;
+}
+
+// Read another batch of datagrams from a socket.
+
+static void NET_Native_FillSocket(socket_t *sock)
+{
+    batch_t *batch;
+    int result;
+    int i;
+
+    batch = &sock->recv;
+
+    for (i = 0; i < BATCH_SIZE; ++i)
+    {
+        batch->iovecs[i].iov_len = MAX_DATAGRAM;
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+    }
+
+    do
+    {
+        result = recvmmsg(sock->fd, batch->msgs, BATCH_SIZE,
+                          MSG_DONTWAIT, NULL);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK
+         && errno != ECONNREFUSED)
+        {
+            I_Error("NET_Native_FillSocket: Error receiving packets: %s",
+                    strerror(errno));
+        }
+
+        result = 0;
+    }
+
+    batch->count = result;
+    sock->recv_next = 0;
+}
+
+static boolean NET_Native_RecvPacket(net_addr_t **addr, net_packet_t **packet)
+{
+    socket_t *sock;
+    batch_t *batch;
+    unsigned int len;
+    int tries;
+    int i;
+
+    for (tries = 0; tries < num_sockets; ++tries)
+    {
+        sock = sockets[recv_socket];
+        batch = &sock->recv;
+
+        if (sock->recv_next >= batch->count)
+        {
+            // Out of datagrams from the last batch.  Send any replies
+            // to them before reading more.
+
+            NET_Native_Flush();
+            NET_Native_FillSocket(sock);
+        }
+
+        if (sock->recv_next < batch->count)
+        {
+            i = sock->recv_next;
+            ++sock->recv_next;
+
+            len = batch->msgs[i].msg_len;
+
+            *packet = NET_NewPacket(len);
+            memcpy((*packet)->data, batch->buffers[i], len);
+            (*packet)->len = len;
+
+            *addr = NET_Native_FindAddress(&batch->addrs[i], sock);
+
+            return true;
+        }
+
+        recv_socket = (recv_socket + 1) % num_sockets;
+    }
+
+    return false;
+}
+
+static void NET_Native_AddrToString(net_addr_t *addr, char *buffer, int buffer_len)
+{
+    addrentry_t *entry;
+    uint32_t host;
+    uint16_t addr_port;
+
+    entry = static_cast<addrentry_t*>(addr->handle);
+    host = ntohl(entry->sin.sin_addr.s_addr);
+    addr_port = ntohs(entry->sin.sin_port);
+
+    M_snprintf(buffer, buffer_len, "%i.%i.%i.%i",
+               (host >> 24) & 0xff, (host >> 16) & 0xff,
+               (host >> 8) & 0xff, host & 0xff);
+
+    // As with the SDL_net module, only show the port if it is not the
+    // default.
+    if (addr_port != DEFAULT_PORT)
+    {
+        char portbuf[10];
+        M_snprintf(portbuf, sizeof(portbuf), ":%i", addr_port);
+        M_StringConcat(buffer, portbuf, buffer_len);
+    }
+}
+
+static net_addr_t *NET_Native_ResolveAddress(const char *address)
+{
+    struct addrinfo hints;
+    struct addrinfo *result;
+    struct sockaddr_in sin;
+    char *addr_hostname;
+    int addr_port;
+    const char *colon;
+    int error;
+
+    if (address == NULL)
+    {
+        return NULL;
+    }
+
+    addr_hostname = M_StringDuplicate(address);
+    colon = strchr(address, ':');
+
+    if (colon != NULL)
+    {
+        addr_hostname[colon - address] = '\0';
+        addr_port = atoi(colon + 1);
+    }
+    else
+    {
+        addr_port = port;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    error = getaddrinfo(addr_hostname, NULL, &hints, &result);
+
+    free(addr_hostname);
+
+    if (error != 0 || result == NULL)
+    {
+        // unable to resolve
+
+        return NULL;
+    }
+
+    memcpy(&sin, result->ai_addr, sizeof(sin));
+    sin.sin_port = htons(addr_port);
+    freeaddrinfo(result);
+
+    return NET_Native_FindAddress(&sin, NULL);
+}
+
+// Send anything still queued, then sleep until one of our sockets is
+// readable.
+
+static boolean NET_Native_WaitForPacket(int timeout)
+{
+    struct pollfd fds[MAX_SOCKETS];
+    int result;
+    int i;
+
+    NET_Native_Flush();
+
+    for (i = 0; i < num_sockets; ++i)
+    {
+        // Still working through the last batch?
+
+        if (sockets[i]->recv_next < sockets[i]->recv.count)
+        {
+            return true;
+        }
+
+        fds[i].fd = sockets[i]->fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    result = poll(fds, num_sockets, timeout);
+
+    if (result < 0)
+    {
+        // Most likely interrupted by a signal; let the caller look
+        // for packets anyway.
+
+        return true;
+    }
+
+    return result > 0;
+}
+
+// Complete module
+
+net_module_t net_native_module =
+{
+    NET_Native_InitClient,
+    NET_Native_InitServer,
+    NET_Native_SendPacket,
+    NET_Native_RecvPacket,
+    NET_Native_AddrToString,
+    NET_Native_FreeAddress,
+    NET_Native_ResolveAddress,
+    NET_Native_WaitForPacket,
+};
+
+}
+
+#endif /* #ifdef HAVE_RECVMMSG */
@@ -0,0 +1,31 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Networking module using native sockets, for systems that can
+//     send and receive datagrams in batches.
+//
+
+#ifndef NET_NATIVE_H
+#define NET_NATIVE_H
+
+#include "net_defs.h"
+
+namespace theta
+{
+
+extern net_module_t net_native_module;
+
+}
+
+#endif /* #ifndef NET_NATIVE_H */
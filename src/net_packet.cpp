@@ -17,6 +17,10 @@
 
 #include <ctype.h>
 #include <string.h>
+
+#include <atomic>
+#include <mutex>
+
 #include "m_misc.h"
 #include "net_packet.h"
 #include "z_zone.h"
@@ -24,24 +28,77 @@
 namespace theta
 {
 
-static int total_packet_memory = 0;
+// Packets are created on every thread running a server session.
+
+static std::atomic<int> total_packet_memory(0);
+
+// Freed packets are kept to be handed out again, so that a busy server
+// is not going to the zone twice for every packet it sends or receives.
+// Packets that grew larger than a datagram are not worth keeping.
+
+#define PACKET_POOL_SIZE 256
+#define MAX_POOLED_PACKET 2048
+
+static net_packet_t *packet_pool[PACKET_POOL_SIZE];
+static int packet_pool_count = 0;
+static std::mutex packet_pool_mutex;
+
+static net_packet_t *NET_PooledPacket(void)
+{
+    std::lock_guard<std::mutex> lock(packet_pool_mutex);
+
+    if (packet_pool_count == 0)
+    {
+        return NULL;
+    }
+
+    return packet_pool[--packet_pool_count];
+}
+
+static boolean NET_PoolPacket(net_packet_t *packet)
+{
+    std::lock_guard<std::mutex> lock(packet_pool_mutex);
+
+    if (packet_pool_count == PACKET_POOL_SIZE
+     || packet->alloced > MAX_POOLED_PACKET)
+    {
+        return false;
+    }
+
+    packet_pool[packet_pool_count++] = packet;
+
+    return true;
+}
 
 net_packet_t *NET_NewPacket(int initial_size)
 {
     net_packet_t *packet;
 
-    packet = (net_packet_t *) Z_Malloc(sizeof(net_packet_t), PU_STATIC, 0);
-    
     if (initial_size == 0)
         initial_size = 256;
 
-    packet->alloced = initial_size;
-    packet->data = static_cast<byte*>(Z_Malloc(initial_size, PU_STATIC, 0));
+    packet = NET_PooledPacket();
+
+    if (packet == NULL)
+    {
+        packet = (net_packet_t *) Z_Malloc(sizeof(net_packet_t), PU_STATIC, 0);
+        packet->alloced = initial_size;
+        packet->data = static_cast<byte*>(Z_Malloc(initial_size, PU_STATIC, 0));
+
+        total_packet_memory += sizeof(net_packet_t) + initial_size;
+    }
+    else if (packet->alloced < static_cast<size_t>(initial_size))
+    {
+        total_packet_memory += initial_size - packet->alloced;
+
+        Z_Free(packet->data);
+        packet->alloced = initial_size;
+        packet->data = static_cast<byte*>(Z_Malloc(initial_size, PU_STATIC, 0));
+    }
+
     packet->len = 0;
     packet->pos = 0;
 
-    total_packet_memory += sizeof(net_packet_t) + initial_size;
-
     //printf("total packet memory: %i bytes\n", total_packet_memory);
     //printf("%p: allocated\n", packet);
 
@@ -64,7 +121,12 @@ net_packet_t *NET_PacketDup(net_packet_t *packet)
 void NET_FreePacket(net_packet_t *packet)
 {
     //printf("%p: destroyed\n", packet);
-    
+
+    if (NET_PoolPacket(packet))
+    {
+        return;
+    }
+
     total_packet_memory -= sizeof(net_packet_t) + packet->alloced;
     Z_Free(packet->data);
     Z_Free(packet);
@@ -326,6 +388,187 @@ void NET_WriteString(net_packet_t *packet, const char *string)
     packet->len += string_size;
 }
 
+// Read len bytes from the packet into buf, returning true if read
+// successfully
+
+boolean NET_ReadBytes(net_packet_t *packet, byte *buf, size_t len)
+{
+    if (packet->pos + len > packet->len)
+        return false;
+
+    memcpy(buf, packet->data + packet->pos, len);
+    packet->pos += len;
+
+    return true;
+}
+
+void NET_WriteBytes(net_packet_t *packet, const byte *buf, size_t len)
+{
+    while (packet->len + len > packet->alloced)
+    {
+        NET_IncreasePacket(packet);
+    }
+
+    memcpy(packet->data + packet->len, buf, len);
+    packet->len += len;
+}
+
+//
+// Bit streams
+//
+
+// The most bits that can be read or written in one go, and the
+// largest value the variable-length functions can code.
+
+#define MAX_BITS 24
+#define MAX_VARBITS ((1u << (MAX_BITS - 1)) - 1)
+#define MAX_SVARBITS ((signed int) (MAX_VARBITS >> 1))
+
+void NET_BeginBits(net_bitstream_t *bits, net_packet_t *packet)
+{
+    bits->packet = packet;
+    bits->buffer = 0;
+    bits->count = 0;
+}
+
+// Write out any bits left over, padding the last byte with zeros.
+
+void NET_FlushBits(net_bitstream_t *bits)
+{
+    if (bits->count > 0)
+    {
+        NET_WriteInt8(bits->packet, (bits->buffer << (8 - bits->count)) & 0xff);
+    }
+
+    bits->buffer = 0;
+    bits->count = 0;
+}
+
+// Read up to MAX_BITS bits, returning true if read successfully
+
+boolean NET_ReadBits(net_bitstream_t *bits, unsigned int *data, int count)
+{
+    unsigned int b;
+
+    while (bits->count < count)
+    {
+        if (!NET_ReadInt8(bits->packet, &b))
+            return false;
+
+        bits->buffer = (bits->buffer << 8) | b;
+        bits->count += 8;
+    }
+
+    bits->count -= count;
+    *data = (bits->buffer >> bits->count) & ((1u << count) - 1);
+    bits->buffer &= (1u << bits->count) - 1;
+
+    return true;
+}
+
+// Variable-length values are Exp-Golomb coded: one more than the value
+// is written in binary, after as many zero bits as it has bits after
+// the first.  Small values take few bits: 0 takes one, 1 and 2 take
+// three, 3 to 6 take five.
+
+boolean NET_ReadVarBits(net_bitstream_t *bits, unsigned int *data)
+{
+    unsigned int bit;
+    unsigned int value;
+    int zeros;
+
+    zeros = 0;
+
+    for (;;)
+    {
+        if (!NET_ReadBits(bits, &bit, 1))
+            return false;
+
+        if (bit)
+            break;
+
+        if (++zeros >= MAX_BITS)
+            return false;
+    }
+
+    if (!NET_ReadBits(bits, &value, zeros))
+        return false;
+
+    *data = ((1u << zeros) | value) - 1;
+
+    return true;
+}
+
+// Signed values are interleaved with the unsigned ones, so that small
+// values either side of zero stay small: 0, -1, 1, -2, 2, ...
+
+boolean NET_ReadSVarBits(net_bitstream_t *bits, signed int *data)
+{
+    unsigned int value;
+
+    if (!NET_ReadVarBits(bits, &value))
+        return false;
+
+    *data = (value & 1) ? -(signed int) (value >> 1) - 1
+                        : (signed int) (value >> 1);
+
+    return true;
+}
+
+void NET_WriteBits(net_bitstream_t *bits, unsigned int i, int count)
+{
+    bits->buffer = (bits->buffer << count) | (i & ((1u << count) - 1));
+    bits->count += count;
+
+    while (bits->count >= 8)
+    {
+        bits->count -= 8;
+        NET_WriteInt8(bits->packet, (bits->buffer >> bits->count) & 0xff);
+    }
+
+    bits->buffer &= (1u << bits->count) - 1;
+}
+
+void NET_WriteVarBits(net_bitstream_t *bits, unsigned int i)
+{
+    int zeros;
+
+    if (i > MAX_VARBITS)
+    {
+        i = MAX_VARBITS;
+    }
+
+    ++i;
+
+    for (zeros = 0; (i >> zeros) > 1; ++zeros);
+
+    NET_WriteBits(bits, 0, zeros);
+    NET_WriteBits(bits, i, zeros + 1);
+}
+
+// Signed values past what can be coded saturate, keeping their sign.
+
+void NET_WriteSVarBits(net_bitstream_t *bits, signed int i)
+{
+    if (i > MAX_SVARBITS)
+    {
+        i = MAX_SVARBITS;
+    }
+    else if (i < -MAX_SVARBITS - 1)
+    {
+        i = -MAX_SVARBITS - 1;
+    }
+
+    if (i < 0)
+    {
+        NET_WriteVarBits(bits, ((unsigned int) (-(i + 1)) << 1) | 1);
+    }
+    else
+    {
+        NET_WriteVarBits(bits, (unsigned int) i << 1);
+    }
+}
+
 }
 
 
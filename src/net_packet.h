@@ -37,12 +37,37 @@ boolean NET_ReadSInt32(net_packet_t *packet, signed int *data);
 
 char *NET_ReadString(net_packet_t *packet);
 char *NET_ReadSafeString(net_packet_t *packet);
+boolean NET_ReadBytes(net_packet_t *packet, byte *buf, size_t len);
 
 void NET_WriteInt8(net_packet_t *packet, unsigned int i);
 void NET_WriteInt16(net_packet_t *packet, unsigned int i);
 void NET_WriteInt32(net_packet_t *packet, unsigned int i);
 
 void NET_WriteString(net_packet_t *packet, const char *string);
+void NET_WriteBytes(net_packet_t *packet, const byte *buf, size_t len);
+
+// Reading and writing a packet a bit at a time.  Bits are packed into
+// whole bytes of the packet, most significant first.  A run of bits
+// being written must end with NET_FlushBits before anything else is
+// written to the packet.
+
+typedef struct
+{
+    net_packet_t *packet;
+    unsigned int buffer;
+    int count;
+} net_bitstream_t;
+
+void NET_BeginBits(net_bitstream_t *bits, net_packet_t *packet);
+void NET_FlushBits(net_bitstream_t *bits);
+
+boolean NET_ReadBits(net_bitstream_t *bits, unsigned int *data, int count);
+boolean NET_ReadVarBits(net_bitstream_t *bits, unsigned int *data);
+boolean NET_ReadSVarBits(net_bitstream_t *bits, signed int *data);
+
+void NET_WriteBits(net_bitstream_t *bits, unsigned int i, int count);
+void NET_WriteVarBits(net_bitstream_t *bits, unsigned int i);
+void NET_WriteSVarBits(net_bitstream_t *bits, signed int i);
 
 }
 
@@ -20,8 +20,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <unordered_map>
+
 #include "i_system.h"
 #include "i_timer.h"
+#include "m_argv.h"
 #include "m_misc.h"
 
 #include "net_common.h"
@@ -39,9 +42,18 @@ namespace theta
 
 #define MASTER_SERVER_ADDRESS "master.chocolate-doom.org:2342"
 
-// Time to wait for a response before declaring a timeout.
+// Time to wait for a response before declaring a timeout.  Once some
+// servers have responded, the first query to a server is only given
+// twice the slowest response so far, but never less than
+// QUERY_MIN_TIMEOUT_MS.  Queries sent again always get the full time.
 
 #define QUERY_TIMEOUT_SECS 2
+#define QUERY_MIN_TIMEOUT_MS 250
+
+// Number of servers to wait for responses from at once, unless
+// changed with -maxqueries.
+
+#define QUERY_DEFAULT_IN_FLIGHT 16
 
 // Time to wait for secure demo signatures before declaring a timeout.
 
@@ -73,6 +85,7 @@ typedef struct
     net_addr_t *addr;
     net_querydata_t data;
     unsigned int ping_time;
+    unsigned int first_query_time;
     unsigned int query_time;
     unsigned int query_attempts;
     boolean printed;
@@ -82,12 +95,22 @@ static boolean registered_with_master = false;
 static boolean got_master_response = false;
 
 static net_context_t *query_context;
+static net_module_t *query_module = &net_sdl_module;
 static query_target_t *targets;
 static int num_targets;
 
+// Index into targets, by address.
+
+static std::unordered_map<net_addr_t *, int> target_lookup;
+
+// Slowest round trip of the servers that have responded so far, or -1
+// if none have.
+
+static int max_rtt;
+static int max_in_flight = QUERY_DEFAULT_IN_FLIGHT;
+
 static boolean query_loop_running = false;
 static boolean printed_header = false;
-static int last_query_time = 0;
 
 static char *securedemo_start_message = NULL;
 
@@ -185,19 +208,17 @@ static void NET_Query_SendMasterQuery(net_addr_t *addr)
 }
 
 // Given the specified address, find the target associated.  If no
-// target is found, and 'create' is true, a new target is created.
+// target is found, and 'create' is true, a new target is created,
+// holding its own reference to the address.
 
 static query_target_t *GetTargetForAddr(net_addr_t *addr, boolean create)
 {
     query_target_t *target;
-    int i;
+    auto it = target_lookup.find(addr);
 
-    for (i=0; i<num_targets; ++i)
+    if (it != target_lookup.end())
     {
-        if (targets[i].addr == addr)
-        {
-            return &targets[i];
-        }
+        return &targets[it->second];
     }
 
     if (!create)
@@ -213,6 +234,13 @@ static query_target_t *GetTargetForAddr(net_addr_t *addr, boolean create)
     target->printed = false;
     target->query_attempts = 0;
     target->addr = addr;
+    target_lookup[addr] = num_targets;
+
+    if (addr != NULL)
+    {
+        NET_ReferenceAddress(addr);
+    }
+
     ++num_targets;
 
     return target;
@@ -246,6 +274,7 @@ static void NET_Query_ParseResponse(net_addr_t *addr, net_packet_t *packet,
     unsigned int packet_type;
     net_querydata_t querydata;
     query_target_t *target;
+    unsigned int query_time;
 
     // Read the header
 
@@ -285,11 +314,14 @@ static void NET_Query_ParseResponse(net_addr_t *addr, net_packet_t *packet,
             return;
         }
 
-        // Create new target.
+        // Create new target.  This may move the targets list, so the
+        // broadcast target cannot be used after.
 
+        query_time = broadcast_target->query_time;
         target = GetTargetForAddr(addr, true);
         target->state = QUERY_TARGET_QUERIED;
-        target->query_time = broadcast_target->query_time;
+        target->first_query_time = query_time;
+        target->query_time = query_time;
     }
 
     if (target->state != QUERY_TARGET_RESPONDED)
@@ -297,9 +329,16 @@ static void NET_Query_ParseResponse(net_addr_t *addr, net_packet_t *packet,
         target->state = QUERY_TARGET_RESPONDED;
         memcpy(&target->data, &querydata, sizeof(net_querydata_t));
 
-        // Calculate RTT.
+        // Calculate RTT.  A response to a query sent again may well be
+        // a late answer to the first, so it is timed from the first.
 
-        target->ping_time = I_GetTimeMS() - target->query_time;
+        target->ping_time = I_GetTimeMS() - target->first_query_time;
+
+        if (target->type == QUERY_TARGET_SERVER
+         && (int) target->ping_time > max_rtt)
+        {
+            max_rtt = target->ping_time;
+        }
 
         // Invoke callback to signal that we have a new address.
 
@@ -345,6 +384,7 @@ static void NET_Query_ParseMasterResponse(net_addr_t *master_addr,
         if (addr != NULL)
         {
             GetTargetForAddr(addr, true);
+            NET_FreeAddress(addr);
         }
     }
 
@@ -380,71 +420,109 @@ static void NET_Query_GetResponse(net_query_callback_t callback,
     net_addr_t *addr;
     net_packet_t *packet;
 
-    if (NET_RecvPacket(query_context, &addr, &packet))
+    // Handle everything that has arrived, so that responses are passed
+    // on as soon as they come in.
+
+    while (NET_RecvPacket(query_context, &addr, &packet))
     {
         NET_Query_ParsePacket(addr, packet, callback, user_data);
+        NET_FreeAddress(addr);
         NET_FreePacket(packet);
     }
 }
 
-// Find a target we have not yet queried and send a query.
+// How long to wait for a response from the given target.
 
-static void SendOneQuery(void)
+static unsigned int QueryTimeout(query_target_t *target)
 {
-    unsigned int now;
-    unsigned int i;
+    int timeout;
 
-    now = I_GetTimeMS();
+    // The master and broadcast queries are nothing like the servers
+    // that have answered so far.  A server that missed a short timeout
+    // may just be further away than the rest.
+
+    if (target->type != QUERY_TARGET_SERVER || max_rtt < 0
+     || target->query_attempts > 1)
+    {
+        return QUERY_TIMEOUT_SECS * 1000;
+    }
 
-    // Rate limit - only send one query every 50ms.
+    timeout = 2 * max_rtt;
 
-    if (now - last_query_time < 50)
+    if (timeout < QUERY_MIN_TIMEOUT_MS)
     {
-        return;
+        timeout = QUERY_MIN_TIMEOUT_MS;
     }
+    else if (timeout > QUERY_TIMEOUT_SECS * 1000)
+    {
+        timeout = QUERY_TIMEOUT_SECS * 1000;
+    }
+
+    return timeout;
+}
+
+// Send queries to targets we have not yet queried, or whose last query
+// timed out, until max_in_flight are waiting for a response.
+
+static void SendQueries(void)
+{
+    unsigned int now;
+    int in_flight;
+    int i;
+
+    now = I_GetTimeMS();
+    in_flight = 0;
 
     for (i = 0; i < num_targets; ++i)
     {
-        // Not queried yet?
-        // Or last query timed out without a response?
-
-        if (targets[i].state == QUERY_TARGET_QUEUED
-         || (targets[i].state == QUERY_TARGET_QUERIED
-             && now - targets[i].query_time > QUERY_TIMEOUT_SECS * 1000))
+        if (targets[i].state == QUERY_TARGET_QUERIED
+         && now - targets[i].query_time <= QueryTimeout(&targets[i]))
         {
-            break;
+            ++in_flight;
         }
     }
 
-    if (i >= num_targets)
+    for (i = 0; i < num_targets && in_flight < max_in_flight; ++i)
     {
-        return;
-    }
+        // Not queried yet?
+        // Or last query timed out without a response?
 
-    // Found a target to query.  Send a query; how to do this depends on
-    // the target type.
+        if (targets[i].state != QUERY_TARGET_QUEUED
+         && (targets[i].state != QUERY_TARGET_QUERIED
+             || now - targets[i].query_time <= QueryTimeout(&targets[i])))
+        {
+            continue;
+        }
 
-    switch (targets[i].type)
-    {
-        case QUERY_TARGET_SERVER:
-            NET_Query_SendQuery(targets[i].addr);
-            break;
+        // Found a target to query.  Send a query; how to do this depends
+        // on the target type.
 
-        case QUERY_TARGET_BROADCAST:
-            NET_Query_SendQuery(NULL);
-            break;
+        switch (targets[i].type)
+        {
+            case QUERY_TARGET_SERVER:
+                NET_Query_SendQuery(targets[i].addr);
+                break;
 
-        case QUERY_TARGET_MASTER:
-            NET_Query_SendMasterQuery(targets[i].addr);
-            break;
-    }
+            case QUERY_TARGET_BROADCAST:
+                NET_Query_SendQuery(NULL);
+                break;
+
+            case QUERY_TARGET_MASTER:
+                NET_Query_SendMasterQuery(targets[i].addr);
+                break;
+        }
 
-    //printf("Queried %s\n", NET_AddrToString(targets[i].addr));
-    targets[i].state = QUERY_TARGET_QUERIED;
-    targets[i].query_time = now;
-    ++targets[i].query_attempts;
+        //printf("Queried %s\n", NET_AddrToString(targets[i].addr));
+        if (targets[i].query_attempts == 0)
+        {
+            targets[i].first_query_time = now;
+        }
 
-    last_query_time = now;
+        targets[i].state = QUERY_TARGET_QUERIED;
+        targets[i].query_time = now;
+        ++targets[i].query_attempts;
+        ++in_flight;
+    }
 }
 
 // Time out servers that have been queried and not responded.
@@ -470,7 +548,7 @@ static void CheckTargetTimeouts(void)
 
         if (targets[i].state == QUERY_TARGET_QUERIED
          && targets[i].query_attempts >= QUERY_MAX_ATTEMPTS
-         && now - targets[i].query_time > QUERY_TIMEOUT_SECS * 1000)
+         && now - targets[i].query_time > QueryTimeout(&targets[i]))
         {
             targets[i].state = QUERY_TARGET_NO_RESPONSE;
 
@@ -502,7 +580,8 @@ static boolean AllTargetsDone(void)
 }
 
 // Polling function, invoked periodically to send queries and
-// interpret new responses received from remote servers.
+// interpret new responses received from remote servers.  It never
+// blocks: the callback is invoked for each server as it responds.
 // Returns zero when the query sequence has completed and all targets
 // have returned responses or timed out.
 
@@ -510,11 +589,11 @@ int NET_Query_Poll(net_query_callback_t callback, void *user_data)
 {
     CheckTargetTimeouts();
 
-    // Send a query.  This will only send a single query at once.
+    // Keep up to max_in_flight queries waiting for a response.
 
-    SendOneQuery();
+    SendQueries();
 
-    // Check for a response
+    // Check for responses
 
     NET_Query_GetResponse(callback, user_data);
 
@@ -543,18 +622,60 @@ static void NET_Query_QueryLoop(net_query_callback_t callback, void *user_data)
     }
 }
 
+// Send queries through the given module instead of SDL_net.  Only
+// takes effect if no query has been made yet.
+
+void NET_Query_UseModule(net_module_t *module)
+{
+    query_module = module;
+}
+
 void NET_Query_Init(void)
 {
+    int i;
+    int p;
+
     if (query_context == NULL)
     {
         query_context = NET_NewContext();
-        NET_AddModule(query_context, &net_sdl_module);
-        net_sdl_module.InitClient();
+        NET_AddModule(query_context, query_module);
+        query_module->InitClient();
+    }
+
+    for (i = 0; i < num_targets; ++i)
+    {
+        if (targets[i].addr != NULL)
+        {
+            NET_FreeAddress(targets[i].addr);
+        }
     }
 
     free(targets);
     targets = NULL;
     num_targets = 0;
+    target_lookup.clear();
+
+    max_rtt = -1;
+
+    //!
+    // @category net
+    // @arg <n>
+    //
+    // When searching for servers, wait for responses from up to <n>
+    // servers at once.  The default is 16.
+    //
+
+    p = M_CheckParmWithArgs("-maxqueries", 1);
+
+    if (p > 0)
+    {
+        max_in_flight = atoi(myargv[p + 1]);
+
+        if (max_in_flight < 1)
+        {
+            max_in_flight = 1;
+        }
+    }
 
     printed_header = false;
 }
@@ -639,6 +760,7 @@ int NET_StartMasterQuery(void)
 
     target = GetTargetForAddr(master, true);
     target->type = QUERY_TARGET_MASTER;
+    NET_FreeAddress(master);
 
     return 1;
 }
@@ -786,6 +908,7 @@ void NET_QueryAddress(char *addr_str)
     // Add the address to the list of targets.
 
     target = GetTargetForAddr(addr, true);
+    NET_FreeAddress(addr);
 
     printf("\nQuerying '%s'...\n", addr_str);
 
@@ -823,8 +946,11 @@ net_addr_t *NET_FindLANServer(void)
 
     responder = FindFirstResponder();
 
+    // The caller gets its own reference.
+
     if (responder != NULL)
     {
+        NET_ReferenceAddress(responder->addr);
         return responder->addr;
     }
     else
@@ -841,6 +967,7 @@ static net_packet_t *BlockForPacket(net_addr_t *addr, unsigned int packet_type,
 {
     net_packet_t *packet;
     net_addr_t *packet_src;
+    boolean from_addr;
     unsigned int read_packet_type;
     unsigned int start_time;
 
@@ -854,7 +981,10 @@ static net_packet_t *BlockForPacket(net_addr_t *addr, unsigned int packet_type,
             continue;
         }
 
-        if (packet_src == addr
+        from_addr = packet_src == addr;
+        NET_FreeAddress(packet_src);
+
+        if (from_addr
          && NET_ReadInt16(packet, &read_packet_type)
          && packet_type == read_packet_type)
         {
@@ -37,6 +37,7 @@ extern void NET_QueryAddress(char *addr);
 extern net_addr_t *NET_FindLANServer(void);
 
 extern int NET_Query_Poll(net_query_callback_t callback, void *user_data);
+extern void NET_Query_UseModule(net_module_t *module);
 
 extern net_addr_t *NET_Query_ResolveMaster(net_context_t *context);
 extern void NET_Query_AddToMaster(net_addr_t *master_addr);
@@ -19,6 +19,8 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <unordered_map>
+
 #include "doomtype.h"
 #include "i_system.h"
 #include "m_argv.h"
@@ -44,6 +46,7 @@ static boolean initted = false;
 static int port = DEFAULT_PORT;
 static UDPsocket udpsocket;
 static UDPpacket *recvpacket;
+static SDLNet_SocketSet socketset;
 
 typedef struct
 {
@@ -51,108 +54,71 @@ typedef struct
     IPaddress sdl_addr;
 } addrpair_t;
 
-static addrpair_t **addr_table;
-static int addr_table_size = -1;
-
-// Initializes the address table
-
-static void NET_SDL_InitAddrTable(void)
-{
-    addr_table_size = 16;
+// Every address we know about, keyed on host and port.
 
-    addr_table = static_cast<addrpair_t**>(Z_Malloc(sizeof(addrpair_t *) * addr_table_size,
-                          PU_STATIC, 0));
-    memset(addr_table, 0, sizeof(addrpair_t *) * addr_table_size);
-}
+static std::unordered_map<uint64_t, addrpair_t *> addr_table;
 
-static boolean AddressesEqual(IPaddress *a, IPaddress *b)
+static uint64_t NET_SDL_AddrKey(const IPaddress *addr)
 {
-    return a->host == b->host
-        && a->port == b->port;
+    return (static_cast<uint64_t>(addr->host) << 16) | addr->port;
 }
 
-// Finds an address by searching the table.  If the address is not found,
-// it is added to the table.
+// Finds an address in the table, adding it if it is not there already.
+// Each call takes a reference to the address, which is released with
+// NET_FreeAddress.
 
 static net_addr_t *NET_SDL_FindAddress(IPaddress *addr)
 {
     addrpair_t *new_entry;
-    int empty_entry = -1;
-    int i;
+    uint64_t key;
 
-    if (addr_table_size < 0)
-    {
-        NET_SDL_InitAddrTable();
-    }
+    key = NET_SDL_AddrKey(addr);
 
-    for (i=0; i<addr_table_size; ++i)
-    {
-        if (addr_table[i] != NULL
-         && AddressesEqual(addr, &addr_table[i]->sdl_addr))
-        {
-            return &addr_table[i]->net_addr;
-        }
+    auto it = addr_table.find(key);
 
-        if (empty_entry < 0 && addr_table[i] == NULL)
-            empty_entry = i;
+    if (it != addr_table.end())
+    {
+        ++it->second->net_addr.refcount;
+        return &it->second->net_addr;
     }
 
     // Was not found in list.  We need to add it.
 
-    // Is there any space in the table? If not, increase the table size
-
-    if (empty_entry < 0)
-    {
-        addrpair_t **new_addr_table;
-        int new_addr_table_size;
-
-        // after reallocing, we will add this in as the first entry
-        // in the new block of memory
-
-        empty_entry = addr_table_size;
-        
-        // allocate a new array twice the size, init to 0 and copy 
-        // the existing table in.  replace the old table.
-
-        new_addr_table_size = addr_table_size * 2;
-        new_addr_table = static_cast<addrpair_t**>(Z_Malloc(sizeof(addrpair_t *) * new_addr_table_size,
-                                  PU_STATIC, 0));
-        memset(new_addr_table, 0, sizeof(addrpair_t *) * new_addr_table_size);
-        memcpy(new_addr_table, addr_table, 
-               sizeof(addrpair_t *) * addr_table_size);
-        Z_Free(addr_table);
-        addr_table = new_addr_table;
-        addr_table_size = new_addr_table_size;
-    }
-
-    // Add a new entry
-    
     new_entry = static_cast<addrpair_t*>(Z_Malloc(sizeof(addrpair_t), PU_STATIC, 0));
 
     new_entry->sdl_addr = *addr;
     new_entry->net_addr.handle = &new_entry->sdl_addr;
     new_entry->net_addr.module = &net_sdl_module;
+    new_entry->net_addr.refcount = 1;
 
-    addr_table[empty_entry] = new_entry;
+    addr_table[key] = new_entry;
 
     return &new_entry->net_addr;
 }
 
+// Drop a reference to an address, removing it from the table once the
+// last one is gone.
+
 static void NET_SDL_FreeAddress(net_addr_t *addr)
 {
-    int i;
-    
-    for (i=0; i<addr_table_size; ++i)
+    IPaddress *ip;
+
+    ip = (IPaddress *) addr->handle;
+
+    auto it = addr_table.find(NET_SDL_AddrKey(ip));
+
+    if (it == addr_table.end() || &it->second->net_addr != addr)
     {
-        if (addr == &addr_table[i]->net_addr)
-        {
-            Z_Free(addr_table[i]);
-            addr_table[i] = NULL;
-            return;
-        }
+        I_Error("NET_SDL_FreeAddress: Attempted to remove an unused address!");
+    }
+
+    if (--addr->refcount > 0)
+    {
+        return;
     }
 
-    I_Error("NET_SDL_FreeAddress: Attempted to remove an unused address!");
+    Z_Free(it->second);
+    addr_table.erase(it);
 }
 
 static boolean NET_SDL_InitClient(void)
@@ -182,7 +148,10 @@ static boolean NET_SDL_InitClient(void)
     {
         I_Error("NET_SDL_InitClient: Unable to open a socket!");
     }
-    
+
+    socketset = SDLNet_AllocSocketSet(1);
+    SDLNet_UDP_AddSocket(socketset, udpsocket);
+
     recvpacket = SDLNet_AllocPacket(1500);
 
 #ifdef DROP_PACKETS
@@ -214,6 +183,9 @@ static boolean NET_SDL_InitServer(void)
         I_Error("NET_SDL_InitServer: Unable to bind to port %i", port);
     }
 
+    socketset = SDLNet_AllocSocketSet(1);
+    SDLNet_UDP_AddSocket(socketset, udpsocket);
+
     recvpacket = SDLNet_AllocPacket(1500);
 #ifdef DROP_PACKETS
     srand(time(NULL));
@@ -302,6 +274,26 @@ static boolean NET_SDL_RecvPacket(net_addr_t **addr, net_packet_t **packet)
     return true;
 }
 
+// Sleep until our socket is readable.  There is only the one socket,
+// so select() underneath SDLNet_CheckSockets costs no more than poll().
+
+static boolean NET_SDL_WaitForPacket(int timeout)
+{
+    int result;
+
+    result = SDLNet_CheckSockets(socketset, timeout);
+
+    if (result < 0)
+    {
+        // Most likely interrupted by a signal; let the caller look
+        // for packets anyway.
+
+        return true;
+    }
+
+    return result > 0;
+}
+
 void NET_SDL_AddrToString(net_addr_t *addr, char *buffer, int buffer_len)
 {
     IPaddress *ip;
@@ -380,6 +372,7 @@ net_module_t net_sdl_module =
     NET_SDL_AddrToString,
     NET_SDL_FreeAddress,
     NET_SDL_ResolveAddress,
+    NET_SDL_WaitForPacket,
 };
 
 }
@@ -19,11 +19,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 #include "config.h"
 
 #include "doomtype.h"
 #include "d_mode.h"
 #include "i_system.h"
+#include "i_thread.h"
 #include "i_timer.h"
 #include "m_argv.h"
 #include "m_misc.h"
@@ -37,6 +42,7 @@
 #include "net_query.h"
 #include "net_server.h"
 #include "net_sdl.h"
+#include "net_snapshot.h"
 #include "net_structrw.h"
 
 namespace theta
@@ -50,6 +56,17 @@ namespace theta
 
 #define MASTER_RESOLVE_PERIOD 8 * 60 * 60 /* 8 hours */
 
+// Queries each address may send in a burst, and how many more it is
+// allowed each second after that.
+
+#define QUERY_BURST 4
+#define QUERY_RATE  2
+
+// Most addresses to keep track of queries from.  Queries from new
+// addresses are dropped while the table is full.
+
+#define MAX_QUERY_SOURCES 1024
+
 typedef enum
 {
     // waiting for the game to be "launched" (key player to press the start
@@ -104,6 +121,15 @@ typedef struct
 
     unsigned int acknowledged;
 
+    // Time each tic in the send queue was first sent, or -1 if it has
+    // been resent since, which leaves nothing to time.
+
+    int sendtime[BACKUPTICS];
+
+    // Measured quality of the link to the client
+
+    net_linkstats_t link;
+
     // Value of max_players specified by the client on connect.
 
     int max_players;
@@ -125,6 +151,11 @@ typedef struct
 
     int player_class;
 
+    // Latest snapshot of the game the client has acknowledged, that
+    // the next is sent as changes against.
+
+    unsigned int snapshot_acked;
+
 } net_client_t;
 
 // structure used for the recv window
@@ -148,14 +179,94 @@ typedef struct
     net_ticdiff_t diff;
 } net_client_recv_t;
 
-static net_server_state_t server_state;
+// a packet waiting to be handled by a session
+
+typedef struct
+{
+    net_addr_t *addr;
+    net_packet_t *packet;
+} net_queued_packet_t;
+
+// Token bucket limiting the queries from one address.  Tokens are kept
+// in thousandths, so that one comes back every 1000 / QUERY_RATE ms.
+
+typedef struct
+{
+    int tokens;
+    unsigned int time;
+} net_querybucket_t;
+
+// Everything belonging to a single game.  Normally the server runs just
+// the one session, but a dedicated server started with -sessions runs
+// several side by side on the same sockets.
+
+typedef struct
+{
+    net_server_state_t server_state;
+    net_client_t clients[MAXNETNODES];
+    net_client_t *sv_players[NET_MAXPLAYERS];
+    unsigned int sv_gamemode;
+    unsigned int sv_gamemission;
+    net_gamesettings_t sv_settings;
+
+    // receive window
+
+    unsigned int recvwindow_start;
+    net_client_recv_t recvwindow[BACKUPTICS][NET_MAXPLAYERS];
+
+    // Active clients, by address.
+
+    std::unordered_map<net_addr_t *, net_client_t *> client_lookup;
+
+    // Response to the last query, and what it was built from.  It is
+    // sent again as it is until any of these change.
+
+    net_packet_t *query_response;
+    net_querydata_t query_data;
+
+    // Packets the host has routed to this session, and references to
+    // addresses this session has taken and given back, for the host to
+    // apply afterwards.
+
+    std::vector<net_queued_packet_t> inbox;
+    std::vector<net_addr_t *> referenced;
+    std::vector<net_addr_t *> released;
+
+    // Newcomers routed here since the session last ran, and the player
+    // limit asked for by the first of them.
+
+    int joining;
+    int joining_max_players;
+
+    // Snapshots of the game published by the host, by number, and the
+    // number of the latest.
+
+    net_snapshot_t snapshots[NET_SNAPSHOT_HISTORY];
+    unsigned int snapshot_seq;
+} net_session_t;
+
 static boolean server_initialized = false;
-static net_client_t clients[MAXNETNODES];
-static net_client_t *sv_players[NET_MAXPLAYERS];
 static net_context_t *server_context;
-static unsigned int sv_gamemode;
-static unsigned int sv_gamemission;
-static net_gamesettings_t sv_settings;
+
+// All sessions, and the one being run on this thread.
+
+static std::vector<net_session_t *> sessions;
+static thread_local net_session_t *sv;
+
+// Most sessions to run at once.  With more than one, packets are
+// routed to sessions by the address they came from.
+
+static int max_sessions = 1;
+static std::unordered_map<net_addr_t *, net_session_t *> session_routes;
+
+// Description of the server sent in response to queries.
+
+static const char *server_description;
+
+// Query rate limits, by address.  Each holds a reference to its address.
+
+static std::unordered_map<net_addr_t *, net_querybucket_t> query_buckets;
+static unsigned int query_prune_time;
 
 // For registration with master server:
 
@@ -163,12 +274,7 @@ static net_addr_t *master_server = NULL;
 static unsigned int master_refresh_time;
 static unsigned int master_resolve_time;
 
-// receive window
-
-static unsigned int recvwindow_start;
-static net_client_recv_t recvwindow[BACKUPTICS][NET_MAXPLAYERS];
-
-#define NET_SV_ExpandTicNum(b) NET_ExpandTicNum(recvwindow_start, (b))
+#define NET_SV_ExpandTicNum(b) NET_ExpandTicNum(sv->recvwindow_start, (b))
 
 static void NET_SV_DisconnectClient(net_client_t *client)
 {
@@ -219,9 +325,9 @@ static void NET_SV_BroadcastMessage(const char *s, ...)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
-            NET_SV_SendConsoleMessage(&clients[i], buf);
+            NET_SV_SendConsoleMessage(&sv->clients[i], buf);
         }
     }
 
@@ -240,24 +346,24 @@ static void NET_SV_AssignPlayers(void)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
-            if (!clients[i].drone)
+            if (!sv->clients[i].drone)
             {
-                sv_players[pl] = &clients[i];
-                sv_players[pl]->player_number = pl;
+                sv->sv_players[pl] = &sv->clients[i];
+                sv->sv_players[pl]->player_number = pl;
                 ++pl;
             }
             else
             {
-                clients[i].player_number = -1;
+                sv->clients[i].player_number = -1;
             }
         }
     }
 
     for (; pl<NET_MAXPLAYERS; ++pl)
     {
-        sv_players[pl] = NULL;
+        sv->sv_players[pl] = NULL;
     }
 }
 
@@ -272,7 +378,7 @@ static int NET_SV_NumPlayers(void)
 
     for (i=0; i<NET_MAXPLAYERS; ++i)
     {
-        if (sv_players[i] != NULL && ClientConnected(sv_players[i]))
+        if (sv->sv_players[i] != NULL && ClientConnected(sv->sv_players[i]))
         {
             result += 1;
         }
@@ -290,8 +396,8 @@ static int NET_SV_NumReadyPlayers(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i])
-         && !clients[i].drone && clients[i].ready)
+        if (ClientConnected(&sv->clients[i])
+         && !sv->clients[i].drone && sv->clients[i].ready)
         {
             ++result;
         }
@@ -308,9 +414,9 @@ static int NET_SV_MaxPlayers(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
-            return clients[i].max_players;
+            return sv->clients[i].max_players;
         }
     }
 
@@ -328,7 +434,7 @@ static int NET_SV_NumDrones(void)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]) && clients[i].drone)
+        if (ClientConnected(&sv->clients[i]) && sv->clients[i].drone)
         {
             result += 1;
         }
@@ -348,7 +454,7 @@ static int NET_SV_NumClients(void)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
             ++count;
         }
@@ -372,14 +478,14 @@ static net_client_t *NET_SV_Controller(void)
     {
         // Can't be controller?
 
-        if (!ClientConnected(&clients[i]) || clients[i].drone)
+        if (!ClientConnected(&sv->clients[i]) || sv->clients[i].drone)
         {
             continue;
         }
 
-        if (best == NULL || clients[i].connect_time < best->connect_time)
+        if (best == NULL || sv->clients[i].connect_time < best->connect_time)
         {
-            best = &clients[i];
+            best = &sv->clients[i];
         }
     }
 
@@ -424,10 +530,10 @@ static void NET_SV_SendWaitingData(net_client_t *client)
     for (i = 0; i < wait_data.num_players; ++i)
     {
         M_StringCopy(wait_data.player_names[i],
-                     sv_players[i]->name,
+                     sv->sv_players[i]->name,
                      MAXPLAYERNAME);
         M_StringCopy(wait_data.player_addrs[i],
-                     NET_AddrToString(sv_players[i]->addr),
+                     NET_AddrToString(sv->sv_players[i]->addr),
                      MAXPLAYERNAME);
     }
 
@@ -453,11 +559,11 @@ static unsigned int NET_SV_LatestAcknowledged(void)
 
     for (i=0; i<MAXNETNODES; ++i) 
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&sv->clients[i]))
         {
-            if (clients[i].acknowledged < lowtic)
+            if (sv->clients[i].acknowledged < lowtic)
             {
-                lowtic = clients[i].acknowledged;
+                lowtic = sv->clients[i].acknowledged;
             }
         }
     }
@@ -483,7 +589,7 @@ static void NET_SV_AdvanceWindow(void)
 
     // Advance the recv window until it catches up with lowtic
 
-    while (recvwindow_start < lowtic)
+    while (sv->recvwindow_start < lowtic)
     {    
         boolean should_advance;
 
@@ -494,12 +600,13 @@ static void NET_SV_AdvanceWindow(void)
 
         for (i=0; i<NET_MAXPLAYERS; ++i)
         {
-            if (sv_players[i] == NULL || !ClientConnected(sv_players[i]))
+            if (sv->sv_players[i] == NULL
+             || !ClientConnected(sv->sv_players[i]))
             {
                 continue;
             }
 
-            if (!recvwindow[0][i].active)
+            if (!sv->recvwindow[0][i].active)
             {
                 should_advance = false;
                 break;
@@ -517,32 +624,64 @@ static void NET_SV_AdvanceWindow(void)
         
         // Advance the window
 
-        memmove(recvwindow, recvwindow + 1,
-                sizeof(*recvwindow) * (BACKUPTICS - 1));
-        memset(&recvwindow[BACKUPTICS-1], 0, sizeof(*recvwindow));
-        ++recvwindow_start;
+        memmove(sv->recvwindow, sv->recvwindow + 1,
+                sizeof(*sv->recvwindow) * (BACKUPTICS - 1));
+        memset(&sv->recvwindow[BACKUPTICS-1], 0, sizeof(*sv->recvwindow));
+        ++sv->recvwindow_start;
 
         //printf("SV: advanced to %i\n", recvwindow_start);
     }
 }
 
+// Take and give back references to addresses.  When hosting several
+// sessions, only the host touches the address table, once the sessions
+// have run.
+
+static void NET_SV_ReferenceAddress(net_addr_t *addr)
+{
+    if (max_sessions > 1)
+    {
+        sv->referenced.push_back(addr);
+    }
+    else
+    {
+        NET_ReferenceAddress(addr);
+    }
+}
+
+static void NET_SV_ReleaseAddress(net_addr_t *addr)
+{
+    if (max_sessions > 1)
+    {
+        sv->released.push_back(addr);
+    }
+    else
+    {
+        NET_FreeAddress(addr);
+    }
+}
+
 // Given an address, find the corresponding client
 
 static net_client_t *NET_SV_FindClient(net_addr_t *addr)
 {
-    int i;
+    auto it = sv->client_lookup.find(addr);
 
-    for (i=0; i<MAXNETNODES; ++i) 
+    if (it == sv->client_lookup.end())
     {
-        if (clients[i].active && clients[i].addr == addr)
-        {
-            // found the client
-
-            return &clients[i];
-        }
+        return NULL;
     }
 
-    return NULL;
+    return it->second;
+}
+
+// Mark a client as no longer active, and give back its address.
+
+static void NET_SV_DeactivateClient(net_client_t *client)
+{
+    client->active = false;
+    sv->client_lookup.erase(client->addr);
+    NET_SV_ReleaseAddress(client->addr);
 }
 
 // send a rejection packet to a client
@@ -567,6 +706,9 @@ static void NET_SV_InitNewClient(net_client_t *client, net_addr_t *addr,
     client->addr = addr;
     client->last_send_time = -1;
 
+    sv->client_lookup[addr] = client;
+    NET_SV_ReferenceAddress(addr);
+
     // init the ticcmd send queue
 
     client->sendseq = 0;
@@ -577,6 +719,8 @@ static void NET_SV_InitNewClient(net_client_t *client, net_addr_t *addr,
     client->last_gamedata_time = 0;
 
     memset(client->sendqueue, 0xff, sizeof(client->sendqueue));
+    memset(client->sendtime, 0xff, sizeof(client->sendtime));
+    NET_Link_Init(&client->link);
 }
 
 // parse a SYN from a client(initiating a connection)
@@ -660,7 +804,7 @@ static void NET_SV_ParseSYN(net_packet_t *packet, net_client_t *client,
     // At this point we have received a valid SYN.
 
     // Not accepting new connections?
-    if (server_state != SERVER_WAITING_LAUNCH)
+    if (sv->server_state != SERVER_WAITING_LAUNCH)
     {
         NET_SV_SendReject(addr,
                           "Server is not currently accepting connections");
@@ -685,13 +829,14 @@ static void NET_SV_ParseSYN(net_packet_t *packet, net_client_t *client,
     // Adopt the game mode and mission of the first connecting client:
     if (num_players == 0 && !data.drone)
     {
-        sv_gamemode = data.gamemode;
-        sv_gamemission = data.gamemission;
+        sv->sv_gamemode = data.gamemode;
+        sv->sv_gamemission = data.gamemission;
     }
 
     // Check the connecting client is playing the same game as all
     // the other clients
-    if (data.gamemode != sv_gamemode || data.gamemission != sv_gamemission)
+    if (data.gamemode != sv->sv_gamemode
+     || data.gamemission != sv->sv_gamemission)
     {
         NET_SV_SendReject(addr, "You are playing the wrong game!");
         return;
@@ -704,9 +849,9 @@ static void NET_SV_ParseSYN(net_packet_t *packet, net_client_t *client,
 
         for (i=0; i<MAXNETNODES; ++i)
         {
-            if (!clients[i].active)
+            if (!sv->clients[i].active)
             {
-                client = &clients[i];
+                client = &sv->clients[i];
                 break;
             }
         }
@@ -723,7 +868,7 @@ static void NET_SV_ParseSYN(net_packet_t *packet, net_client_t *client,
 
         if (client->connection.state == NET_CONN_STATE_DISCONNECTED)
         {
-            client->active = false;
+            NET_SV_DeactivateClient(client);
         }
     }
 
@@ -771,7 +916,7 @@ static void NET_SV_ParseLaunch(net_packet_t *packet, net_client_t *client)
 
     // Can only launch when we are in the waiting state.
 
-    if (server_state != SERVER_WAITING_LAUNCH)
+    if (sv->server_state != SERVER_WAITING_LAUNCH)
     {
         return;
     }
@@ -783,17 +928,17 @@ static void NET_SV_ParseLaunch(net_packet_t *packet, net_client_t *client)
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (!ClientConnected(&clients[i]))
+        if (!ClientConnected(&sv->clients[i]))
             continue;
 
-        launchpacket = NET_Conn_NewReliable(&clients[i].connection,
+        launchpacket = NET_Conn_NewReliable(&sv->clients[i].connection,
                                             NET_PACKET_TYPE_LAUNCH);
         NET_WriteInt8(launchpacket, num_players);
     }
 
     // Now in launch state.
 
-    server_state = SERVER_WAITING_START;
+    sv->server_state = SERVER_WAITING_START;
 }
 
 // Transition to the in-game state and send all players the start game
@@ -812,29 +957,30 @@ static void StartGame(void)
 
     // Check if anyone is recording a demo and set lowres_turn if so.
 
-    sv_settings.lowres_turn = false;
+    sv->sv_settings.lowres_turn = false;
 
     for (i = 0; i < NET_MAXPLAYERS; ++i)
     {
-        if (sv_players[i] != NULL && sv_players[i]->recording_lowres)
+        if (sv->sv_players[i] != NULL && sv->sv_players[i]->recording_lowres)
         {
-            sv_settings.lowres_turn = true;
+            sv->sv_settings.lowres_turn = true;
         }
     }
 
-    sv_settings.num_players = NET_SV_NumPlayers();
+    sv->sv_settings.num_players = NET_SV_NumPlayers();
 
     // Copy player classes:
 
     for (i = 0; i < NET_MAXPLAYERS; ++i)
     {
-        if (sv_players[i] != NULL)
+        if (sv->sv_players[i] != NULL)
         {
-            sv_settings.player_classes[i] = sv_players[i]->player_class;
+            sv->sv_settings.player_classes[i] =
+                sv->sv_players[i]->player_class;
         }
         else
         {
-            sv_settings.player_classes[i] = 0;
+            sv->sv_settings.player_classes[i] = 0;
         }
     }
 
@@ -844,25 +990,39 @@ static void StartGame(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (!ClientConnected(&clients[i]))
+        if (!ClientConnected(&sv->clients[i]))
             continue;
 
-        clients[i].last_gamedata_time = nowtime;
+        sv->clients[i].last_gamedata_time = nowtime;
 
-        startpacket = NET_Conn_NewReliable(&clients[i].connection,
+        startpacket = NET_Conn_NewReliable(&sv->clients[i].connection,
                                            NET_PACKET_TYPE_GAMESTART);
 
-        sv_settings.consoleplayer = clients[i].player_number;
+        sv->sv_settings.consoleplayer = sv->clients[i].player_number;
 
-        NET_WriteSettings(startpacket, &sv_settings);
+        NET_WriteSettings(startpacket, &sv->sv_settings);
     }
 
     // Change server state
 
-    server_state = SERVER_IN_GAME;
+    sv->server_state = SERVER_IN_GAME;
+
+    memset(sv->recvwindow, 0, sizeof(sv->recvwindow));
+    sv->recvwindow_start = 0;
+
+    // Snapshots are numbered from the start of the game.
+
+    for (i = 0; i < NET_SNAPSHOT_HISTORY; ++i)
+    {
+        sv->snapshots[i].seq = 0;
+    }
+
+    sv->snapshot_seq = 0;
 
-    memset(recvwindow, 0, sizeof(recvwindow));
-    recvwindow_start = 0;
+    for (i = 0; i < MAXNETNODES; ++i)
+    {
+        sv->clients[i].snapshot_acked = 0;
+    }
 }
 
 // Returns true when all nodes have indicated readiness to start the game.
@@ -873,7 +1033,7 @@ static boolean AllNodesReady(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]) && !clients[i].ready)
+        if (ClientConnected(&sv->clients[i]) && !sv->clients[i].ready)
         {
             return false;
         }
@@ -901,9 +1061,9 @@ static void SendAllWaitingData(void)
 
     for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (ClientConnected(&clients[i]) && clients[i].ready)
+        if (ClientConnected(&sv->clients[i]) && sv->clients[i].ready)
         {
-            NET_SV_SendWaitingData(&clients[i]);
+            NET_SV_SendWaitingData(&sv->clients[i]);
         }
     }
 }
@@ -916,7 +1076,7 @@ static void NET_SV_ParseGameStart(net_packet_t *packet, net_client_t *client)
 
     // Can only start a game if we are in the waiting start state.
 
-    if (server_state != SERVER_WAITING_START)
+    if (sv->server_state != SERVER_WAITING_START)
     {
         return;
     }
@@ -933,13 +1093,13 @@ static void NET_SV_ParseGameStart(net_packet_t *packet, net_client_t *client)
         // Check the game settings are valid
 
         if (!NET_ValidGameSettings(
-            static_cast<GameMode_t>(sv_gamemode),
-            static_cast<GameMission_t>(sv_gamemission), &settings))
+            static_cast<GameMode_t>(sv->sv_gamemode),
+            static_cast<GameMission_t>(sv->sv_gamemission), &settings))
         {
             return;
         }
 
-        sv_settings = settings;
+        sv->sv_settings = settings;
     }
 
     client->ready = true;
@@ -980,7 +1140,7 @@ static void NET_SV_SendResendRequest(net_client_t *client, int start, int end)
 
     for (i=start; i<=end; ++i)
     {
-        index = i - recvwindow_start;
+        index = i - sv->recvwindow_start;
 
         if (index >= BACKUPTICS)
         {
@@ -989,7 +1149,7 @@ static void NET_SV_SendResendRequest(net_client_t *client, int start, int end)
             continue;
         }
         
-        recvobj = &recvwindow[index][client->player_number];
+        recvobj = &sv->recvwindow[index][client->player_number];
 
         recvobj->resend_time = nowtime;
     }
@@ -1003,8 +1163,10 @@ static void NET_SV_CheckResends(net_client_t *client)
     int player;
     int resend_start, resend_end;
     unsigned int nowtime;
+    unsigned int timeout;
 
     nowtime = I_GetTimeMS();
+    timeout = NET_Link_ResendTimeout(&client->link);
 
     player = client->player_number;
     resend_start = -1;
@@ -1015,14 +1177,14 @@ static void NET_SV_CheckResends(net_client_t *client)
         net_client_recv_t *recvobj;
         boolean need_resend;
 
-        recvobj = &recvwindow[i][player];
+        recvobj = &sv->recvwindow[i][player];
 
         // if need_resend is true, this tic needs another retransmit
-        // request (300ms timeout)
+        // request (timeout depends on the round trip time)
 
         need_resend = !recvobj->active
                    && recvobj->resend_time != 0
-                   && nowtime > recvobj->resend_time + 300;
+                   && nowtime > recvobj->resend_time + timeout;
 
         if (need_resend)
         {
@@ -1043,8 +1205,8 @@ static void NET_SV_CheckResends(net_client_t *client)
 
                 //printf("SV: resend request timed out: %i-%i\n", resend_start, resend_end);
                 NET_SV_SendResendRequest(client, 
-                                         recvwindow_start + resend_start,
-                                         recvwindow_start + resend_end);
+                                         sv->recvwindow_start + resend_start,
+                                         sv->recvwindow_start + resend_end);
 
                 resend_start = -1;
             }
@@ -1054,8 +1216,33 @@ static void NET_SV_CheckResends(net_client_t *client)
     if (resend_start >= 0)
     {
         NET_SV_SendResendRequest(client, 
-                                 recvwindow_start + resend_start,
-                                 recvwindow_start + resend_end);
+                                 sv->recvwindow_start + resend_start,
+                                 sv->recvwindow_start + resend_end);
+    }
+}
+
+// The client has received everything before ackseq.  If that is news,
+// the time since the last of it was sent is a round trip.
+
+static void NET_SV_Acknowledge(net_client_t *client, unsigned int ackseq,
+                               unsigned int nowtime)
+{
+    unsigned int last;
+    int sendtime;
+
+    if (ackseq <= client->acknowledged)
+    {
+        return;
+    }
+
+    client->acknowledged = ackseq;
+
+    last = ackseq - 1;
+    sendtime = client->sendtime[last % BACKUPTICS];
+
+    if (client->sendqueue[last % BACKUPTICS].seq == last && sendtime >= 0)
+    {
+        NET_Link_RoundTrip(&client->link, nowtime - sendtime);
     }
 }
 
@@ -1064,6 +1251,7 @@ static void NET_SV_CheckResends(net_client_t *client)
 static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
 {
     net_client_recv_t *recvobj;
+    net_ticcoder_t coder;
     unsigned int seq;
     unsigned int ackseq;
     unsigned int num_tics;
@@ -1073,7 +1261,7 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
     int resend_start, resend_end;
     int index;
 
-    if (server_state != SERVER_IN_GAME)
+    if (sv->server_state != SERVER_IN_GAME)
     {
         return;
     }
@@ -1106,18 +1294,21 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
 
     // Sanity checks
 
+    NET_BeginTiccmds(&coder, packet, client->connection.protocol,
+                     sv->sv_settings.lowres_turn);
+
     for (i=0; i<num_tics; ++i)
     {
         net_ticdiff_t diff;
         signed int latency;
 
-        if (!NET_ReadSInt16(packet, &latency)
-         || !NET_ReadTiccmdDiff(packet, &diff, sv_settings.lowres_turn))
+        if (!NET_ReadTiccmdLatency(&coder, &latency)
+         || !NET_ReadTiccmdDiff(&coder, 0, &diff))
         {
             return;
         }
 
-        index = seq + i - recvwindow_start;
+        index = seq + i - sv->recvwindow_start;
 
         if (index < 0 || index >= BACKUPTICS)
         {
@@ -1126,7 +1317,17 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
             continue;
         }
 
-        recvobj = &recvwindow[index][player];
+        recvobj = &sv->recvwindow[index][player];
+
+        // Anything but the newest tic should have come in an earlier
+        // packet, which must have been lost.
+
+        if (!recvobj->active)
+        {
+            NET_Link_TicReceived(&client->link, i + 1 < num_tics
+                                             || recvobj->resend_time != 0);
+        }
+
         recvobj->active = true;
         recvobj->diff = diff;
         recvobj->latency = latency;
@@ -1134,12 +1335,7 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
         client->last_gamedata_time = nowtime;
     }
 
-    // Higher acknowledgement point?
-
-    if (ackseq > client->acknowledged)
-    {
-        client->acknowledged = ackseq;
-    }
+    NET_SV_Acknowledge(client, ackseq, nowtime);
 
     // Has this been received out of sequence, ie. have we not received
     // all tics before the first tic in this packet?  If so, send a 
@@ -1147,7 +1343,7 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
 
     //printf("SV: %p: %i\n", client, seq);
 
-    resend_end = seq - recvwindow_start;
+    resend_end = seq - sv->recvwindow_start;
 
     if (resend_end <= 0)
         return;
@@ -1160,7 +1356,7 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
     
     while (index >= 0)
     {
-        recvobj = &recvwindow[index][player];
+        recvobj = &sv->recvwindow[index][player];
 
         if (recvobj->active)
         {
@@ -1191,8 +1387,8 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
                         seq);
                         */
         NET_SV_SendResendRequest(client, 
-                                 recvwindow_start + resend_start, 
-                                 recvwindow_start + resend_end - 1);
+                                 sv->recvwindow_start + resend_start, 
+                                 sv->recvwindow_start + resend_end - 1);
     }
 }
 
@@ -1200,7 +1396,7 @@ static void NET_SV_ParseGameDataACK(net_packet_t *packet, net_client_t *client)
 {
     unsigned int ackseq;
 
-    if (server_state != SERVER_IN_GAME)
+    if (sv->server_state != SERVER_IN_GAME)
     {
         return;
     }
@@ -1216,18 +1412,14 @@ static void NET_SV_ParseGameDataACK(net_packet_t *packet, net_client_t *client)
 
     ackseq = NET_SV_ExpandTicNum(ackseq);
 
-    // Higher acknowledgement point than we already have?
-
-    if (ackseq > client->acknowledged)
-    {
-        client->acknowledged = ackseq;
-    }
+    NET_SV_Acknowledge(client, ackseq, I_GetTimeMS());
 }
 
 static void NET_SV_SendTics(net_client_t *client, 
                             unsigned int start, unsigned int end)
 {
     net_packet_t *packet;
+    net_ticcoder_t coder;
     unsigned int i;
 
     packet = NET_NewPacket(500);
@@ -1241,6 +1433,9 @@ static void NET_SV_SendTics(net_client_t *client,
 
     // Write the tics
 
+    NET_BeginTiccmds(&coder, packet, client->connection.protocol,
+                     sv->sv_settings.lowres_turn);
+
     for (i=start; i<=end; ++i)
     {
         net_full_ticcmd_t *cmd;
@@ -1254,8 +1449,10 @@ static void NET_SV_SendTics(net_client_t *client,
 
         // Add command
        
-        NET_WriteFullTiccmd(packet, cmd, sv_settings.lowres_turn);
+        NET_WriteFullTiccmd(&coder, cmd);
     }
+
+    NET_EndTiccmds(&coder);
     
     // Send packet
 
@@ -1303,200 +1500,462 @@ static void NET_SV_ParseResendRequest(net_packet_t *packet, net_client_t *client
         }
     }
 
-    // Resend those tics
+    // Resend those tics.  Their acknowledgements could be for either
+    // copy, so they can't be timed.
+
+    for (i=start; i<=last; ++i)
+    {
+        client->sendtime[i % BACKUPTICS] = -1;
+    }
 
     NET_SV_SendTics(client, start, last);
 }
 
-// Send a response back to the client
+// Find a published snapshot by number, if it is still kept.
 
-void NET_SV_SendQueryResponse(net_addr_t *addr)
+static net_snapshot_t *NET_SV_FindSnapshot(unsigned int seq)
 {
-    net_packet_t *reply;
-    net_querydata_t querydata;
-    int p;
-
-    // Version
-
-    querydata.version = PACKAGE_STRING;
-
-    // Server state
-
-    querydata.server_state = server_state;
-
-    // Number of players/maximum players
-
-    querydata.num_players = NET_SV_NumPlayers();
-    querydata.max_players = NET_SV_MaxPlayers();
-
-    // Game mode/mission
-
-    querydata.gamemode = sv_gamemode;
-    querydata.gamemission = sv_gamemission;
-
-    //!
-    // @category net
-    // @arg <name>
-    //
-    // When starting a network server, specify a name for the server.
-    //
+    net_snapshot_t *snapshot;
 
-    p = M_CheckParmWithArgs("-servername", 1);
+    snapshot = &sv->snapshots[seq % NET_SNAPSHOT_HISTORY];
 
-    if (p > 0)
-    {
-        querydata.description = myargv[p + 1];
-    }
-    else
+    if (seq == 0 || snapshot->seq != seq)
     {
-        querydata.description = "Unnamed server";
+        return NULL;
     }
 
-    // Send it and we're done.
-
-    reply = NET_NewPacket(64);
-    NET_WriteInt16(reply, NET_PACKET_TYPE_QUERY_RESPONSE);
-    NET_WriteQueryData(reply, &querydata);
-    NET_SendPacket(addr, reply);
-    NET_FreePacket(reply);
+    return snapshot;
 }
 
-// Process a packet received by the server
-
-static void NET_SV_Packet(net_packet_t *packet, net_addr_t *addr)
+static void NET_SV_ParseSnapshotACK(net_packet_t *packet, net_client_t *client)
 {
-    net_client_t *client;
-    unsigned int packet_type;
-
-    // Response from master server?
+    unsigned int seq;
 
-    if (addr != NULL && addr == master_server)
+    if (sv->server_state != SERVER_IN_GAME
+     || !NET_ReadInt32(packet, &seq))
     {
-        NET_Query_MasterResponse(packet);
         return;
     }
 
-    // Find which client this packet came from
-
-    client = NET_SV_FindClient(addr);
-
-    // Read the packet type
-
-    if (!NET_ReadInt16(packet, &packet_type))
-    {
-        // no packet type
-
-        return;
-    }
+    // Acknowledgements can arrive out of order.
 
-    if (packet_type == NET_PACKET_TYPE_SYN)
-    {
-        NET_SV_ParseSYN(packet, client, addr);
-    }
-    else if (packet_type == NET_PACKET_TYPE_QUERY)
-    {
-        NET_SV_SendQueryResponse(addr);
-    }
-    else if (client == NULL)
-    {
-        // Must come from a valid client; ignore otherwise
-    }
-    else if (NET_Conn_Packet(&client->connection, packet, &packet_type))
-    {
-        // Packet was eaten by the common connection code
-    }
-    else
+    if (seq > client->snapshot_acked && seq <= sv->snapshot_seq)
     {
-        //printf("SV: %s: %i\n", NET_AddrToString(addr), packet_type);
-
-        switch (packet_type)
-        {
-            case NET_PACKET_TYPE_GAMESTART:
-                NET_SV_ParseGameStart(packet, client);
-                break;
-            case NET_PACKET_TYPE_LAUNCH:
-                NET_SV_ParseLaunch(packet, client);
-                break;
-            case NET_PACKET_TYPE_GAMEDATA:
-                NET_SV_ParseGameData(packet, client);
-                break;
-            case NET_PACKET_TYPE_GAMEDATA_ACK:
-                NET_SV_ParseGameDataACK(packet, client);
-                break;
-            case NET_PACKET_TYPE_GAMEDATA_RESEND:
-                NET_SV_ParseResendRequest(packet, client);
-                break;
-            default:
-                // unknown packet type
-
-                break;
-        }
+        client->snapshot_acked = seq;
     }
+}
 
-    // If this address is not in the list of clients, be sure to
-    // free it back.
+// Send a snapshot to a client as changes from base_seq, in as many
+// packets as it takes.  Snapshots are sent once; if any part is lost,
+// the client waits for the next.
 
-    if (NET_SV_FindClient(addr) == NULL)
-    {
-        NET_FreeAddress(addr);
+static void NET_SV_SendSnapshot(net_client_t *client, net_snapshot_t *snapshot,
+                                unsigned int base_seq,
+                                std::vector<byte> *delta)
+{
+    net_packet_t *packet;
+    size_t offset;
+    size_t len;
+
+    for (offset = 0; offset < delta->size(); offset += len)
+    {
+        len = std::min(delta->size() - offset,
+                       static_cast<size_t>(NET_SNAPSHOT_FRAGMENT));
+
+        packet = NET_NewPacket(NET_SNAPSHOT_FRAGMENT + 64);
+        NET_WriteInt16(packet, NET_PACKET_TYPE_SNAPSHOT);
+        NET_WriteInt32(packet, snapshot->seq);
+        NET_WriteInt32(packet, base_seq);
+        NET_WriteInt32(packet, snapshot->tic);
+        NET_WriteSHA1Sum(packet, snapshot->digest);
+        NET_WriteInt32(packet, delta->size());
+        NET_WriteInt32(packet, offset);
+        NET_WriteInt16(packet, len);
+        NET_WriteBytes(packet, delta->data() + offset, len);
+
+        NET_Conn_SendPacket(&client->connection, packet);
+        NET_FreePacket(packet);
     }
 }
 
+// Publish a snapshot of the game taken by the host, and send it to
+// everyone else in the game.  Each client gets it as changes from the
+// latest one they have acknowledged; clients that acknowledged the
+// same one share the work.
 
-static void NET_SV_PumpSendQueue(net_client_t *client)
+void NET_SV_PublishSnapshot(int tic, sha1_digest_t digest,
+                            const byte *data, size_t len)
 {
-    net_full_ticcmd_t cmd;
-    int recv_index;
-    int num_players;
-    int i;
-    int starttic, endtic;
-
-    // If a client has not sent any acknowledgments for a while,
-    // wait until they catch up.
+    net_snapshot_t *snapshot;
+    net_snapshot_t *base;
+    net_client_t *client;
+    std::vector<byte> deltas[NET_SNAPSHOT_HISTORY + 1];
+    unsigned int delta_seqs[NET_SNAPSHOT_HISTORY + 1];
+    int num_deltas;
+    int i, j;
 
-    if (client->sendseq - NET_SV_LatestAcknowledged() > 40)
+    if (!server_initialized)
     {
         return;
     }
-    
-    // Work out the index into the receive window
-   
-    recv_index = client->sendseq - recvwindow_start;
 
-    if (recv_index < 0 || recv_index >= BACKUPTICS)
+    // The host only ever runs the one session.
+
+    sv = sessions.front();
+
+    if (sv->server_state != SERVER_IN_GAME)
     {
         return;
     }
 
-    // Check if we can generate a new entry for the send queue
-    // using the data in recvwindow.
+    ++sv->snapshot_seq;
 
-    num_players = 0;
+    snapshot = &sv->snapshots[sv->snapshot_seq % NET_SNAPSHOT_HISTORY];
+    snapshot->seq = sv->snapshot_seq;
+    snapshot->tic = tic;
+    memcpy(snapshot->digest, digest, sizeof(sha1_digest_t));
+    snapshot->data.assign(data, data + len);
 
-    for (i=0; i<NET_MAXPLAYERS; ++i)
+    num_deltas = 0;
+
+    for (i = 0; i < MAXNETNODES; ++i)
     {
-        if (sv_players[i] == client)
-        {
-            // Client does not rely on itself for data
+        client = &sv->clients[i];
 
-            continue;
-        }
+        // The host's own client has the game already, and clients
+        // from before snapshots would not know what to do with one.
 
-        if (sv_players[i] == NULL || !ClientConnected(sv_players[i]))
+        if (!ClientConnected(client)
+         || client->addr->module == &net_loop_server_module
+         || client->connection.protocol < NET_PROTOCOL_THANATOS_0)
         {
             continue;
         }
 
-        if (!recvwindow[recv_index][i].active)
-        {
-            // We do not have this player's ticcmd, so we cannot
-            // generate a complete command yet.
+        base = NET_SV_FindSnapshot(client->snapshot_acked);
 
-            return;
+        if (base == NULL)
+        {
+            client->snapshot_acked = 0;
         }
 
-        ++num_players;
-    }
+        for (j = 0; j < num_deltas; ++j)
+        {
+            if (delta_seqs[j] == client->snapshot_acked)
+            {
+                break;
+            }
+        }
+
+        if (j == num_deltas)
+        {
+            if (base != NULL)
+            {
+                NET_EncodeSnapshot(&deltas[j], base->data.data(),
+                                   base->data.size(), data, len);
+            }
+            else
+            {
+                NET_EncodeSnapshot(&deltas[j], NULL, 0, data, len);
+            }
+
+            delta_seqs[j] = client->snapshot_acked;
+            ++num_deltas;
+        }
+
+        NET_SV_SendSnapshot(client, snapshot, delta_seqs[j], &deltas[j]);
+    }
+}
+
+// Send a response back to the client.  The response is only built
+// again when something in it has changed.
+
+static void NET_SV_SendQueryResponse(net_addr_t *addr)
+{
+    net_querydata_t querydata;
+
+    // Version
+
+    querydata.version = PACKAGE_STRING;
+
+    // Server state
+
+    querydata.server_state = sv->server_state;
+
+    // Number of players/maximum players
+
+    querydata.num_players = NET_SV_NumPlayers();
+    querydata.max_players = NET_SV_MaxPlayers();
+
+    // Game mode/mission
+
+    querydata.gamemode = sv->sv_gamemode;
+    querydata.gamemission = sv->sv_gamemission;
+
+    querydata.description = server_description;
+
+    if (sv->query_response == NULL
+     || querydata.server_state != sv->query_data.server_state
+     || querydata.num_players != sv->query_data.num_players
+     || querydata.max_players != sv->query_data.max_players
+     || querydata.gamemode != sv->query_data.gamemode
+     || querydata.gamemission != sv->query_data.gamemission)
+    {
+        if (sv->query_response != NULL)
+        {
+            NET_FreePacket(sv->query_response);
+        }
+
+        sv->query_response = NET_NewPacket(64);
+        NET_WriteInt16(sv->query_response, NET_PACKET_TYPE_QUERY_RESPONSE);
+        NET_WriteQueryData(sv->query_response, &querydata);
+        sv->query_data = querydata;
+    }
+
+    // Send it and we're done.
+
+    NET_SendPacket(addr, sv->query_response);
+}
+
+// Forget addresses whose buckets have filled back up; they are no
+// different from an address never seen before.
+
+static void NET_SV_PruneQueryBuckets(unsigned int nowtime)
+{
+    auto it = query_buckets.begin();
+
+    while (it != query_buckets.end())
+    {
+        if (nowtime - it->second.time >= QUERY_BURST * 1000 / QUERY_RATE)
+        {
+            NET_FreeAddress(it->first);
+            it = query_buckets.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    query_prune_time = nowtime;
+}
+
+// Take a token from the bucket for the given address, returning false
+// if it has sent too many queries and this one should be dropped.
+
+static boolean NET_SV_QueryAllowed(net_addr_t *addr)
+{
+    net_querybucket_t *bucket;
+    unsigned int nowtime;
+    unsigned int elapsed;
+
+    nowtime = I_GetTimeMS();
+
+    if (nowtime - query_prune_time >= 1000)
+    {
+        NET_SV_PruneQueryBuckets(nowtime);
+    }
+
+    auto it = query_buckets.find(addr);
+
+    if (it == query_buckets.end())
+    {
+        if (query_buckets.size() >= MAX_QUERY_SOURCES)
+        {
+            return false;
+        }
+
+        NET_ReferenceAddress(addr);
+
+        bucket = &query_buckets[addr];
+        bucket->tokens = QUERY_BURST * 1000;
+        bucket->time = nowtime;
+    }
+    else
+    {
+        bucket = &it->second;
+        elapsed = nowtime - bucket->time;
+
+        if (elapsed > QUERY_BURST * 1000 / QUERY_RATE)
+        {
+            elapsed = QUERY_BURST * 1000 / QUERY_RATE;
+        }
+
+        bucket->tokens += elapsed * QUERY_RATE;
+        bucket->time = nowtime;
+
+        if (bucket->tokens > QUERY_BURST * 1000)
+        {
+            bucket->tokens = QUERY_BURST * 1000;
+        }
+    }
+
+    if (bucket->tokens < 1000)
+    {
+        return false;
+    }
+
+    bucket->tokens -= 1000;
+
+    return true;
+}
+
+// Check a packet as it arrives, before any session looks at it.
+// Returns false if it should be dropped: queries beyond the rate
+// limit, so that a flood of them cannot crowd out the game.
+
+static boolean NET_SV_FilterPacket(net_packet_t *packet, net_addr_t *addr)
+{
+    unsigned int packet_type;
+
+    if (addr == NULL || !NET_ReadInt16(packet, &packet_type))
+    {
+        return true;
+    }
+
+    packet->pos = 0;
+
+    return packet_type != NET_PACKET_TYPE_QUERY || NET_SV_QueryAllowed(addr);
+}
+
+// Process a packet received by the server
+
+static void NET_SV_Packet(net_packet_t *packet, net_addr_t *addr)
+{
+    net_client_t *client;
+    unsigned int packet_type;
+
+    // Response from master server?
+
+    if (addr != NULL && addr == master_server)
+    {
+        NET_Query_MasterResponse(packet);
+        NET_SV_ReleaseAddress(addr);
+        return;
+    }
+
+    // Find which client this packet came from
+
+    client = NET_SV_FindClient(addr);
+
+    // Read the packet type
+
+    if (!NET_ReadInt16(packet, &packet_type))
+    {
+        // no packet type
+
+        NET_SV_ReleaseAddress(addr);
+        return;
+    }
+
+    if (packet_type == NET_PACKET_TYPE_SYN)
+    {
+        NET_SV_ParseSYN(packet, client, addr);
+    }
+    else if (packet_type == NET_PACKET_TYPE_QUERY)
+    {
+        NET_SV_SendQueryResponse(addr);
+    }
+    else if (client == NULL)
+    {
+        // Must come from a valid client; ignore otherwise
+    }
+    else if (NET_Conn_Packet(&client->connection, packet, &packet_type))
+    {
+        // Packet was eaten by the common connection code
+    }
+    else
+    {
+        //printf("SV: %s: %i\n", NET_AddrToString(addr), packet_type);
+
+        switch (packet_type)
+        {
+            case NET_PACKET_TYPE_GAMESTART:
+                NET_SV_ParseGameStart(packet, client);
+                break;
+            case NET_PACKET_TYPE_LAUNCH:
+                NET_SV_ParseLaunch(packet, client);
+                break;
+            case NET_PACKET_TYPE_GAMEDATA:
+                NET_SV_ParseGameData(packet, client);
+                break;
+            case NET_PACKET_TYPE_GAMEDATA_ACK:
+                NET_SV_ParseGameDataACK(packet, client);
+                break;
+            case NET_PACKET_TYPE_GAMEDATA_RESEND:
+                NET_SV_ParseResendRequest(packet, client);
+                break;
+            case NET_PACKET_TYPE_SNAPSHOT_ACK:
+                NET_SV_ParseSnapshotACK(packet, client);
+                break;
+            default:
+                // unknown packet type
+
+                break;
+        }
+    }
+
+    // Give back the reference that came with the packet.  A client
+    // holds its own.
+
+    NET_SV_ReleaseAddress(addr);
+}
+
+
+static void NET_SV_PumpSendQueue(net_client_t *client)
+{
+    net_full_ticcmd_t cmd;
+    int recv_index;
+    int num_players;
+    int i;
+    int starttic, endtic;
+
+    // If a client has not sent any acknowledgments for a while,
+    // wait until they catch up.
+
+    if (client->sendseq - NET_SV_LatestAcknowledged() > 40)
+    {
+        return;
+    }
+    
+    // Work out the index into the receive window
+   
+    recv_index = client->sendseq - sv->recvwindow_start;
+
+    if (recv_index < 0 || recv_index >= BACKUPTICS)
+    {
+        return;
+    }
+
+    // Check if we can generate a new entry for the send queue
+    // using the data in recvwindow.
+
+    num_players = 0;
+
+    for (i=0; i<NET_MAXPLAYERS; ++i)
+    {
+        if (sv->sv_players[i] == client)
+        {
+            // Client does not rely on itself for data
+
+            continue;
+        }
+
+        if (sv->sv_players[i] == NULL || !ClientConnected(sv->sv_players[i]))
+        {
+            continue;
+        }
+
+        if (!sv->recvwindow[recv_index][i].active)
+        {
+            // We do not have this player's ticcmd, so we cannot
+            // generate a complete command yet.
+
+            return;
+        }
+
+        ++num_players;
+    }
 
     // If this is a game with only a single player in it, we might
     // be sending a ticcmd set containing 0 ticcmds. This is fine;
@@ -1504,7 +1963,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     // and never stopping. Don't let the server get too far ahead
     // of the client.
 
-    if (num_players == 0 && client->sendseq > recvwindow_start + 10)
+    if (num_players == 0 && client->sendseq > sv->recvwindow_start + 10)
     {
         return;
     }
@@ -1523,7 +1982,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     {
         net_client_recv_t *recvobj;
 
-        if (sv_players[i] == client)
+        if (sv->sv_players[i] == client)
         {
             // Not the player we are sending to
 
@@ -1531,7 +1990,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
             continue;
         }
         
-        if (sv_players[i] == NULL || !recvwindow[recv_index][i].active)
+        if (sv->sv_players[i] == NULL || !sv->recvwindow[recv_index][i].active)
         {
             cmd.playeringame[i] = false;
             continue;
@@ -1539,7 +1998,7 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
 
         cmd.playeringame[i] = true;
 
-        recvobj = &recvwindow[recv_index][i];
+        recvobj = &sv->recvwindow[recv_index][i];
 
         cmd.cmds[i] = recvobj->diff;
 
@@ -1552,10 +2011,13 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     // Add into the queue
 
     client->sendqueue[client->sendseq % BACKUPTICS] = cmd;
+    client->sendtime[client->sendseq % BACKUPTICS] = I_GetTimeMS();
 
-    // Transmit the new tic to the client
+    // Transmit the new tic to the client, along with as many earlier
+    // ones as the link needs to be sure of getting them there.
 
-    starttic = client->sendseq - sv_settings.extratics;
+    starttic = client->sendseq
+             - NET_Link_ExtraTics(&client->link, sv->sv_settings.extratics);
     endtic = client->sendseq;
 
     if (starttic < 0)
@@ -1596,15 +2058,15 @@ void NET_SV_CheckDeadlock(net_client_t *client)
 
         for (i=0; i<BACKUPTICS; ++i)
         {
-            if (!recvwindow[client->player_number][i].active)
+            if (!sv->recvwindow[client->player_number][i].active)
             {
                 //printf("Possible deadlock: Sending resend request\n");
 
                 // Found a tic we haven't received.  Send a resend request.
 
                 NET_SV_SendResendRequest(client,
-                                         recvwindow_start + i,
-                                         recvwindow_start + i + 5);
+                                         sv->recvwindow_start + i,
+                                         sv->recvwindow_start + i + 5);
 
                 client->last_gamedata_time = nowtime;
                 break;
@@ -1620,14 +2082,14 @@ static void NET_SV_GameEnded(void)
 {
     int i;
 
-    server_state = SERVER_WAITING_LAUNCH;
-    sv_gamemode = indetermined;
+    sv->server_state = SERVER_WAITING_LAUNCH;
+    sv->sv_gamemode = indetermined;
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (clients[i].active)
+        if (sv->clients[i].active)
         {
-            NET_SV_DisconnectClient(&clients[i]);
+            NET_SV_DisconnectClient(&sv->clients[i]);
         }
     }
 }
@@ -1651,12 +2113,12 @@ static void NET_SV_RunClient(net_client_t *client)
 
     if (client->connection.state == NET_CONN_STATE_DISCONNECTED)
     {
-        client->active = false;
+        NET_SV_DeactivateClient(client);
 
         // If we were about to start a game, any player disconnecting
         // should cause an abort.
 
-        if (server_state == SERVER_WAITING_START && !client->drone)
+        if (sv->server_state == SERVER_WAITING_START && !client->drone)
         {
             NET_SV_BroadcastMessage("Game startup aborted because "
                                     "player '%s' disconnected.",
@@ -1665,7 +2127,6 @@ static void NET_SV_RunClient(net_client_t *client)
         }
 
         free(client->name);
-        NET_FreeAddress(client->addr);
 
         // Are there any clients left connected?  If not, return the
         // server to the waiting-for-players state.
@@ -1685,7 +2146,7 @@ static void NET_SV_RunClient(net_client_t *client)
         return;
     }
 
-    if (server_state == SERVER_WAITING_LAUNCH)
+    if (sv->server_state == SERVER_WAITING_LAUNCH)
     {
         // Waiting for the game to start
 
@@ -1699,7 +2160,7 @@ static void NET_SV_RunClient(net_client_t *client)
         }
     }
 
-    if (server_state == SERVER_IN_GAME)
+    if (sv->server_state == SERVER_IN_GAME)
     {
         NET_SV_PumpSendQueue(client);
         NET_SV_CheckDeadlock(client);
@@ -1714,42 +2175,74 @@ void NET_SV_AddModule(net_module_t *module)
     NET_AddModule(server_context, module);
 }
 
-// Initialize server and wait for connections
+// Start a new session, waiting for players to connect
 
-void NET_SV_Init(void)
+static net_session_t *NET_SV_NewSession(void)
 {
-    int i;
-
-    // initialize send/receive context
-
-    server_context = NET_NewContext();
+    net_session_t *session;
 
     // no clients yet
-   
-    for (i=0; i<MAXNETNODES; ++i) 
-    {
-        clients[i].active = false;
-    }
 
-    NET_SV_AssignPlayers();
+    session = new net_session_t();
+    session->server_state = SERVER_WAITING_LAUNCH;
+    session->sv_gamemode = indetermined;
 
-    server_state = SERVER_WAITING_LAUNCH;
-    sv_gamemode = indetermined;
-    server_initialized = true;
+    sessions.push_back(session);
+
+    return session;
 }
 
-static void UpdateMasterServer(void)
+// Initialize server and wait for connections
+
+void NET_SV_Init(void)
 {
-    unsigned int now;
+    // initialize send/receive context
 
-    now = I_GetTimeMS();
+    int p;
 
-    // The address of the master server can change. Periodically
-    // re-resolve the master server to update.
+    server_context = NET_NewContext();
 
-    if (now - master_resolve_time > MASTER_RESOLVE_PERIOD * 1000)
-    {
-        net_addr_t *new_addr;
+    //!
+    // @category net
+    // @arg <name>
+    //
+    // When starting a network server, specify a name for the server.
+    //
+
+    p = M_CheckParmWithArgs("-servername", 1);
+
+    if (p > 0)
+    {
+        server_description = myargv[p + 1];
+    }
+    else
+    {
+        server_description = "Unnamed server";
+    }
+
+    sv = NET_SV_NewSession();
+    NET_SV_AssignPlayers();
+
+    server_initialized = true;
+}
+
+void NET_SV_SetMaxSessions(int count)
+{
+    max_sessions = count > 1 ? count : 1;
+}
+
+static void UpdateMasterServer(void)
+{
+    unsigned int now;
+
+    now = I_GetTimeMS();
+
+    // The address of the master server can change. Periodically
+    // re-resolve the master server to update.
+
+    if (now - master_resolve_time > MASTER_RESOLVE_PERIOD * 1000)
+    {
+        net_addr_t *new_addr;
 
         new_addr = NET_Query_ResolveMaster(server_context);
 
@@ -1760,6 +2253,10 @@ static void UpdateMasterServer(void)
             NET_FreeAddress(master_server);
             master_server = new_addr;
         }
+        else if (new_addr != NULL)
+        {
+            NET_FreeAddress(new_addr);
+        }
 
         master_resolve_time = now;
     }
@@ -1801,43 +2298,33 @@ void NET_SV_RegisterWithMaster(void)
     }
 }
 
-// Run server code to check for new packets/send packets as the server
-// requires
+// Run the current session: handle any packets routed to it, then check
+// for packets that need to be sent.
 
-void NET_SV_Run(void)
+static void NET_SV_RunSession(void)
 {
-    net_addr_t *addr;
-    net_packet_t *packet;
     int i;
 
-    if (!server_initialized)
-    {
-        return;
-    }
-
-    while (NET_RecvPacket(server_context, &addr, &packet))
+    for (const net_queued_packet_t &queued : sv->inbox)
     {
-        NET_SV_Packet(packet, addr);
-        NET_FreePacket(packet);
+        NET_SV_Packet(queued.packet, queued.addr);
+        NET_FreePacket(queued.packet);
     }
 
-    if (master_server != NULL)
-    {
-        UpdateMasterServer();
-    }
+    sv->inbox.clear();
 
     // "Run" any clients that may have things to do, independent of responses
     // to received packets
 
     for (i=0; i<MAXNETNODES; ++i)
     {
-        if (clients[i].active)
+        if (sv->clients[i].active)
         {
-            NET_SV_RunClient(&clients[i]);
+            NET_SV_RunClient(&sv->clients[i]);
         }
     }
 
-    switch (server_state)
+    switch (sv->server_state)
     {
         case SERVER_WAITING_LAUNCH:
             break;
@@ -1851,15 +2338,448 @@ void NET_SV_Run(void)
 
             for (i = 0; i < NET_MAXPLAYERS; ++i)
             {
-                if (sv_players[i] != NULL && ClientConnected(sv_players[i]))
+                if (sv->sv_players[i] != NULL
+                 && ClientConnected(sv->sv_players[i]))
                 {
-                    NET_SV_CheckResends(sv_players[i]);
+                    NET_SV_CheckResends(sv->sv_players[i]);
                 }
             }
             break;
     }
 }
 
+// Returns true if the current session has room for another player,
+// counting the newcomers already on their way to it.
+
+static boolean NET_SV_SessionHasRoom(net_connect_data_t *data)
+{
+    int max_players;
+
+    if (sv->server_state != SERVER_WAITING_LAUNCH)
+    {
+        return false;
+    }
+
+    NET_SV_AssignPlayers();
+
+    // The first client to connect sets the player limit.
+
+    if (NET_SV_NumClients() > 0)
+    {
+        max_players = NET_SV_MaxPlayers();
+    }
+    else if (sv->joining > 0)
+    {
+        max_players = sv->joining_max_players;
+    }
+    else
+    {
+        max_players = data->max_players;
+    }
+
+    return NET_SV_NumPlayers() + sv->joining < max_players
+        && NET_SV_NumClients() + sv->joining < MAXNETNODES;
+}
+
+// Find a session for a newcomer to join: the first one still waiting
+// for players, or a new one if we are allowed more.  If everything is
+// full the first session turns them away.
+
+static net_session_t *NET_SV_LobbySession(net_connect_data_t *data)
+{
+    for (net_session_t *session : sessions)
+    {
+        sv = session;
+
+        if (NET_SV_SessionHasRoom(data))
+        {
+            return session;
+        }
+    }
+
+    if (static_cast<int>(sessions.size()) < max_sessions)
+    {
+        return NET_SV_NewSession();
+    }
+
+    return sessions.front();
+}
+
+// Read the connect data from a SYN, leaving the packet to be read
+// again in full by the session.
+
+static boolean NET_SV_PeekConnectData(net_packet_t *packet,
+                                      net_connect_data_t *data)
+{
+    unsigned int magic;
+    boolean result;
+
+    result = NET_ReadInt32(packet, &magic)
+          && magic == NET_MAGIC_NUMBER
+          && NET_ReadString(packet) != NULL
+          && NET_ReadProtocolList(packet) != NET_PROTOCOL_UNKNOWN
+          && NET_ReadConnectData(packet, data)
+          && data->max_players > 0
+          && data->max_players <= NET_MAXPLAYERS;
+
+    packet->pos = 0;
+
+    return result;
+}
+
+// Queue a packet for the session that its sender belongs to.
+
+static void NET_SV_RoutePacket(net_packet_t *packet, net_addr_t *addr)
+{
+    net_session_t *session;
+    net_connect_data_t data;
+    unsigned int packet_type;
+    auto it = session_routes.find(addr);
+
+    if (it != session_routes.end())
+    {
+        session = it->second;
+    }
+    else
+    {
+        // Only connection requests and queries come from addresses
+        // that no session knows about yet.
+
+        if (!NET_ReadInt16(packet, &packet_type)
+         || (packet_type != NET_PACKET_TYPE_SYN
+          && packet_type != NET_PACKET_TYPE_QUERY))
+        {
+            NET_FreePacket(packet);
+            NET_FreeAddress(addr);
+            return;
+        }
+
+        // Newcomers that arrive together are spread over the lobbies
+        // as they would have been had they arrived one at a time.  A
+        // SYN that makes no sense goes anywhere, to be turned away.
+
+        if (packet_type == NET_PACKET_TYPE_SYN
+         && NET_SV_PeekConnectData(packet, &data))
+        {
+            session = NET_SV_LobbySession(&data);
+
+            if (session->joining == 0)
+            {
+                session->joining_max_players = data.max_players;
+            }
+
+            ++session->joining;
+        }
+        else
+        {
+            data.max_players = NET_MAXPLAYERS;
+            session = NET_SV_LobbySession(&data);
+        }
+
+        packet->pos = 0;
+        session_routes[addr] = session;
+    }
+
+    session->inbox.push_back({ addr, packet });
+}
+
+// Apply the address references a session took and gave back while it
+// ran.  Addresses that are no longer one of its clients stop being
+// routed to it.
+
+static void NET_SV_ApplyReferences(net_session_t *session)
+{
+    sv = session;
+
+    for (net_addr_t *addr : sv->referenced)
+    {
+        NET_ReferenceAddress(addr);
+    }
+
+    for (net_addr_t *addr : sv->released)
+    {
+        if (NET_SV_FindClient(addr) == NULL)
+        {
+            session_routes.erase(addr);
+        }
+
+        NET_FreeAddress(addr);
+    }
+
+    sv->referenced.clear();
+    sv->released.clear();
+    sv->joining = 0;
+}
+
+// Returns true if nobody is connected to the current session.
+
+static boolean NET_SV_SessionIdle(void)
+{
+    int i;
+
+    if (sv->server_state != SERVER_WAITING_LAUNCH)
+    {
+        return false;
+    }
+
+    for (i=0; i<MAXNETNODES; ++i)
+    {
+        if (sv->clients[i].active)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Close sessions that everyone has left, keeping one open for
+// new players to join.
+
+static void NET_SV_ReapSessions(void)
+{
+    size_t i;
+
+    i = 0;
+
+    while (i < sessions.size() && sessions.size() > 1)
+    {
+        sv = sessions[i];
+
+        if (NET_SV_SessionIdle())
+        {
+            if (sv->query_response != NULL)
+            {
+                NET_FreePacket(sv->query_response);
+            }
+
+            delete sv;
+            sessions.erase(sessions.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+// Run every session at once: read all waiting packets and hand them
+// out to their sessions, then run the sessions across the worker
+// threads.  Only this thread receives packets or frees addresses.
+
+static void NET_SV_RunHost(void)
+{
+    net_addr_t *addr;
+    net_packet_t *packet;
+
+    while (NET_RecvPacket(server_context, &addr, &packet))
+    {
+        if (addr != NULL && addr == master_server)
+        {
+            NET_Query_MasterResponse(packet);
+            NET_FreeAddress(addr);
+            NET_FreePacket(packet);
+            continue;
+        }
+
+        if (!NET_SV_FilterPacket(packet, addr))
+        {
+            NET_FreeAddress(addr);
+            NET_FreePacket(packet);
+            continue;
+        }
+
+        NET_SV_RoutePacket(packet, addr);
+    }
+
+    thread::WorkerPool::Instance().ParallelFor(sessions.size(),
+                                               [](size_t i) {
+        sv = sessions[i];
+        NET_SV_RunSession();
+    });
+
+    for (net_session_t *session : sessions)
+    {
+        NET_SV_ApplyReferences(session);
+    }
+
+    NET_SV_ReapSessions();
+}
+
+// Run server code to check for new packets/send packets as the server
+// requires
+
+void NET_SV_Run(void)
+{
+    net_addr_t *addr;
+    net_packet_t *packet;
+
+    if (!server_initialized)
+    {
+        return;
+    }
+
+    if (max_sessions > 1)
+    {
+        NET_SV_RunHost();
+    }
+    else
+    {
+        sv = sessions.front();
+
+        while (NET_RecvPacket(server_context, &addr, &packet))
+        {
+            if (NET_SV_FilterPacket(packet, addr))
+            {
+                NET_SV_Packet(packet, addr);
+            }
+            else
+            {
+                NET_FreeAddress(addr);
+            }
+
+            NET_FreePacket(packet);
+        }
+
+        NET_SV_RunSession();
+    }
+
+    if (master_server != NULL)
+    {
+        UpdateMasterServer();
+    }
+}
+
+// Longest time to go without running the server, in ms.
+
+#define MAX_WAIT_TIME 1000
+
+// How often to look for a deadlock again once one is suspected but
+// there is no resend to ask for, in ms.
+
+#define DEADLOCK_RECHECK_TIME 10
+
+static int EarlierTimeout(int timeout, int remaining)
+{
+    if (remaining < 0)
+    {
+        remaining = 0;
+    }
+
+    return remaining < timeout ? remaining : timeout;
+}
+
+// Work out how long the current session can be left alone if no
+// packets arrive, from the times at which it next sends keepalives,
+// resend requests, waiting data and so on.
+
+static int NET_SV_SessionTimeout(int nowtime, int timeout)
+{
+    net_client_t *client;
+    int remaining;
+    int resend;
+    int i, j;
+
+    for (i=0; i<MAXNETNODES; ++i)
+    {
+        client = &sv->clients[i];
+
+        if (!client->active)
+        {
+            continue;
+        }
+
+        remaining = NET_Conn_Timeout(&client->connection, nowtime);
+
+        if (remaining >= 0)
+        {
+            timeout = EarlierTimeout(timeout, remaining);
+        }
+
+        if (!ClientConnected(client))
+        {
+            continue;
+        }
+
+        if (sv->server_state == SERVER_WAITING_LAUNCH)
+        {
+            if (client->last_send_time < 0)
+            {
+                return 0;
+            }
+
+            timeout = EarlierTimeout(timeout,
+                client->last_send_time + 1001 - nowtime);
+        }
+        else if (sv->server_state == SERVER_IN_GAME && !client->drone)
+        {
+            remaining = client->last_gamedata_time + 1001 - nowtime;
+
+            if (remaining < 0)
+            {
+                remaining = DEADLOCK_RECHECK_TIME;
+            }
+
+            timeout = EarlierTimeout(timeout, remaining);
+            resend = NET_Link_ResendTimeout(&client->link);
+
+            for (j=0; j<BACKUPTICS; ++j)
+            {
+                net_client_recv_t *recvobj;
+
+                recvobj = &sv->recvwindow[j][client->player_number];
+
+                if (!recvobj->active && recvobj->resend_time != 0)
+                {
+                    timeout = EarlierTimeout(timeout,
+                        static_cast<int>(recvobj->resend_time + resend
+                                       + 1 - nowtime));
+                }
+            }
+        }
+    }
+
+    return timeout;
+}
+
+// Work out how long NET_SV_Run can be left alone if no packets arrive.
+
+static int NET_SV_Timeout(void)
+{
+    int nowtime;
+    int timeout;
+
+    nowtime = I_GetTimeMS();
+    timeout = MAX_WAIT_TIME;
+
+    for (net_session_t *session : sessions)
+    {
+        sv = session;
+        timeout = NET_SV_SessionTimeout(nowtime, timeout);
+    }
+
+    if (master_server != NULL)
+    {
+        timeout = EarlierTimeout(timeout, static_cast<int>(
+            master_refresh_time + MASTER_REFRESH_PERIOD * 1000 + 1 - nowtime));
+        timeout = EarlierTimeout(timeout, static_cast<int>(
+            master_resolve_time + MASTER_RESOLVE_PERIOD * 1000 + 1 - nowtime));
+    }
+
+    return timeout;
+}
+
+void NET_SV_Wait(void)
+{
+    if (!server_initialized)
+    {
+        I_Sleep(MAX_WAIT_TIME);
+        return;
+    }
+
+    NET_WaitForPacket(server_context, NET_SV_Timeout());
+}
+
 void NET_SV_Shutdown(void)
 {
     int i;
@@ -1875,11 +2795,14 @@ void NET_SV_Shutdown(void)
 
     // Disconnect all clients
     
-    for (i=0; i<MAXNETNODES; ++i)
+    for (net_session_t *session : sessions)
     {
-        if (clients[i].active)
+        for (i=0; i<MAXNETNODES; ++i)
         {
-            NET_SV_DisconnectClient(&clients[i]);
+            if (session->clients[i].active)
+            {
+                NET_SV_DisconnectClient(&session->clients[i]);
+            }
         }
     }
 
@@ -1894,11 +2817,14 @@ void NET_SV_Shutdown(void)
 
         running = false;
 
-        for (i=0; i<MAXNETNODES; ++i)
+        for (net_session_t *session : sessions)
         {
-            if (clients[i].active)
+            for (i=0; i<MAXNETNODES; ++i)
             {
-                running = true;
+                if (session->clients[i].active)
+                {
+                    running = true;
+                }
             }
         }
 
@@ -17,6 +17,9 @@
 #ifndef NET_SERVER_H
 #define NET_SERVER_H
 
+#include "doomtype.h"
+#include "sha1.h"
+
 namespace theta
 {
 
@@ -24,10 +27,20 @@ namespace theta
 
 void NET_SV_Init(void);
 
+// Host up to count independent games at once, routing each packet to
+// the game its sender is in.  Only useful for a dedicated server.
+
+void NET_SV_SetMaxSessions(int count);
+
 // run server: check for new packets received etc.
 
 void NET_SV_Run(void);
 
+// Block until a packet arrives or it is time to run the server again,
+// whichever comes first
+
+void NET_SV_Wait(void);
+
 // Shut down the server
 // Blocks until all clients disconnect, or until a 5 second timeout
 
@@ -41,6 +54,13 @@ void NET_SV_AddModule(net_module_t *module);
 
 void NET_SV_RegisterWithMaster(void);
 
+// Send a snapshot of the game, taken by the host at the given tic, to
+// the other players.  Only the host of a netgame, running the server
+// alongside its game, has a game to take snapshots of.
+
+void NET_SV_PublishSnapshot(int tic, sha1_digest_t digest,
+                            const byte *data, size_t len);
+
 }
 
 #endif /* #ifndef NET_SERVER_H */
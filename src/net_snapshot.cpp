@@ -0,0 +1,318 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Coding of one snapshot as changes from another.
+//
+//     A snapshot changes a little from one second to the next: things
+//     move and fields change in place, but things are also added and
+//     removed, which shifts everything after them.  The changes are
+//     coded as runs of new bytes and runs copied from anywhere in the
+//     base, so that a shifted run costs no more than one in place.
+//
+//     The coding starts with the length of the snapshot, then
+//     alternates between a run of new bytes (length, then the bytes)
+//     and a copy (length, then where from) until it is all there.
+//     Copies say where they come from as the distance from where the
+//     last copy left off, plus the new bytes since, so that a copy
+//     from the same place as before is a single zero.  Lengths and
+//     distances are variable-length integers.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "net_snapshot.h"
+
+namespace theta
+{
+
+// Runs of the base are found by looking up blocks of this many bytes,
+// taken at every multiple of the size.  A copy found that way is
+// always at least this long.
+
+#define BLOCK_SIZE 8
+
+// Shortest copy worth making from where the last left off.
+
+#define MIN_COPY 4
+
+static void WriteVarint(std::vector<byte> *out, size_t value)
+{
+    while (value >= 0x80)
+    {
+        out->push_back(static_cast<byte>(value | 0x80));
+        value >>= 7;
+    }
+
+    out->push_back(static_cast<byte>(value));
+}
+
+static void WriteSVarint(std::vector<byte> *out, ptrdiff_t value)
+{
+    // Zigzag, so that small distances either way stay small.
+
+    if (value < 0)
+    {
+        WriteVarint(out, (static_cast<size_t>(-(value + 1)) << 1) | 1);
+    }
+    else
+    {
+        WriteVarint(out, static_cast<size_t>(value) << 1);
+    }
+}
+
+static boolean ReadVarint(const byte **p, const byte *end, size_t *value)
+{
+    int shift;
+
+    *value = 0;
+
+    for (shift = 0; shift < 64; shift += 7)
+    {
+        if (*p >= end)
+        {
+            return false;
+        }
+
+        *value |= static_cast<size_t>(**p & 0x7f) << shift;
+
+        if ((*(*p)++ & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static boolean ReadSVarint(const byte **p, const byte *end, ptrdiff_t *value)
+{
+    size_t zigzag;
+
+    if (!ReadVarint(p, end, &zigzag))
+    {
+        return false;
+    }
+
+    if (zigzag & 1)
+    {
+        *value = -static_cast<ptrdiff_t>(zigzag >> 1) - 1;
+    }
+    else
+    {
+        *value = static_cast<ptrdiff_t>(zigzag >> 1);
+    }
+
+    return true;
+}
+
+static unsigned int HashBlock(const byte *p, int bits)
+{
+    uint64_t key;
+
+    memcpy(&key, p, sizeof(key));
+
+    return static_cast<unsigned int>(
+        (key * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - bits));
+}
+
+// Number of bytes from the start of a and b that are the same, up to
+// len.
+
+static size_t MatchLength(const byte *a, const byte *b, size_t len)
+{
+    size_t i = 0;
+
+    while (i + sizeof(uint64_t) <= len
+        && !memcmp(a + i, b + i, sizeof(uint64_t)))
+    {
+        i += sizeof(uint64_t);
+    }
+
+    while (i < len && a[i] == b[i])
+    {
+        ++i;
+    }
+
+    return i;
+}
+
+void NET_EncodeSnapshot(std::vector<byte> *delta,
+                        const byte *base, size_t base_len,
+                        const byte *data, size_t len)
+{
+    std::vector<int> blocks;
+    int bits;
+    size_t i, lit_start;
+    size_t expect, src, match;
+    size_t p;
+
+    delta->clear();
+    WriteVarint(delta, len);
+
+    // Index the blocks of the base.  Where a block turns up more than
+    // once, the first is kept.
+
+    bits = 8;
+
+    while ((static_cast<size_t>(1) << bits) < base_len / BLOCK_SIZE * 2)
+    {
+        ++bits;
+    }
+
+    blocks.assign(static_cast<size_t>(1) << bits, -1);
+
+    for (p = 0; p + BLOCK_SIZE <= base_len; p += BLOCK_SIZE)
+    {
+        int *block = &blocks[HashBlock(base + p, bits)];
+
+        if (*block < 0)
+        {
+            *block = static_cast<int>(p);
+        }
+    }
+
+    i = 0;
+    lit_start = 0;
+    expect = 0;
+
+    while (i < len)
+    {
+        // Carry on from where the last copy left off if we can, or
+        // else look for the next block somewhere else in the base.
+
+        match = 0;
+        src = expect;
+
+        if (expect < base_len)
+        {
+            match = MatchLength(data + i, base + expect,
+                                std::min(len - i, base_len - expect));
+
+            if (match < MIN_COPY && i + match < len)
+            {
+                match = 0;
+            }
+        }
+
+        if (match == 0 && i + BLOCK_SIZE <= len)
+        {
+            int block = blocks[HashBlock(data + i, bits)];
+
+            if (block >= 0)
+            {
+                src = block;
+                match = MatchLength(data + i, base + src,
+                                    std::min(len - i, base_len - src));
+
+                if (match < BLOCK_SIZE)
+                {
+                    match = 0;
+                }
+            }
+        }
+
+        if (match == 0)
+        {
+            ++i;
+            ++expect;
+            continue;
+        }
+
+        WriteVarint(delta, i - lit_start);
+        delta->insert(delta->end(), data + lit_start, data + i);
+        WriteVarint(delta, match);
+        WriteSVarint(delta, static_cast<ptrdiff_t>(src)
+                          - static_cast<ptrdiff_t>(expect));
+
+        i += match;
+        lit_start = i;
+        expect = src + match;
+    }
+
+    if (lit_start < len)
+    {
+        WriteVarint(delta, len - lit_start);
+        delta->insert(delta->end(), data + lit_start, data + len);
+    }
+}
+
+boolean NET_DecodeSnapshot(std::vector<byte> *data,
+                           const byte *base, size_t base_len,
+                           const byte *delta, size_t delta_len)
+{
+    const byte *p = delta;
+    const byte *end = delta + delta_len;
+    size_t len, run;
+    size_t expect;
+    ptrdiff_t distance;
+
+    data->clear();
+
+    if (!ReadVarint(&p, end, &len) || len > NET_SNAPSHOT_MAX)
+    {
+        return false;
+    }
+
+    data->reserve(len);
+    expect = 0;
+
+    while (data->size() < len)
+    {
+        // New bytes
+
+        if (!ReadVarint(&p, end, &run)
+         || run > len - data->size()
+         || run > static_cast<size_t>(end - p))
+        {
+            return false;
+        }
+
+        data->insert(data->end(), p, p + run);
+        p += run;
+        expect += run;
+
+        if (data->size() == len)
+        {
+            break;
+        }
+
+        // Copy from the base
+
+        if (!ReadVarint(&p, end, &run)
+         || !ReadSVarint(&p, end, &distance)
+         || run == 0 || run > len - data->size())
+        {
+            return false;
+        }
+
+        if ((distance < 0 && static_cast<size_t>(-distance) > expect)
+         || expect + distance > base_len
+         || run > base_len - (expect + distance))
+        {
+            return false;
+        }
+
+        expect += distance;
+        data->insert(data->end(), base + expect, base + expect + run);
+        expect += run;
+    }
+
+    return p == end;
+}
+
+}
@@ -0,0 +1,73 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Game snapshots sent by the host of a netgame, and the coding of
+//     one snapshot as changes from another.
+//
+
+#ifndef NET_SNAPSHOT_H
+#define NET_SNAPSHOT_H
+
+#include <vector>
+
+#include "doomtype.h"
+#include "sha1.h"
+
+namespace theta
+{
+
+// Snapshots kept by each end for later ones to be sent as changes
+// against.
+
+#define NET_SNAPSHOT_HISTORY 8
+
+// Most bytes of a snapshot sent in each packet.
+
+#define NET_SNAPSHOT_FRAGMENT 1024
+
+// Largest snapshot that will be put back together.
+
+#define NET_SNAPSHOT_MAX (16 * 1024 * 1024)
+
+typedef struct
+{
+    // Number of the snapshot, counting from 1 at the start of the
+    // game.  0 means none.
+
+    unsigned int seq;
+
+    // The game tic it was taken at.
+
+    int tic;
+
+    sha1_digest_t digest;
+    std::vector<byte> data;
+} net_snapshot_t;
+
+// Code data as changes from base, which may be empty.
+
+void NET_EncodeSnapshot(std::vector<byte> *delta,
+                        const byte *base, size_t base_len,
+                        const byte *data, size_t len);
+
+// Apply changes coded by NET_EncodeSnapshot to the same base.  Returns
+// false if the changes are not valid against it.
+
+boolean NET_DecodeSnapshot(std::vector<byte> *data,
+                           const byte *base, size_t base_len,
+                           const byte *delta, size_t delta_len);
+
+}
+
+#endif /* #ifndef NET_SNAPSHOT_H */
@@ -35,6 +35,7 @@ static struct
     const char *name;
 } protocol_names[] = {
     {NET_PROTOCOL_CHOCOLATE_DOOM_0, "CHOCOLATE_DOOM_0"},
+    {NET_PROTOCOL_THANATOS_0, "THANATOS_0"},
 };
 
 void NET_WriteConnectData(net_packet_t *packet, net_connect_data_t *data)
@@ -174,8 +175,51 @@ void NET_WriteQueryData(net_packet_t *packet, net_querydata_t *query)
     NET_WriteProtocolList(packet);
 }
 
-void NET_WriteTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff,
-                         boolean lowres_turn)
+//
+// Ticcmds
+//
+// Ticcmds are written through a net_ticcoder_t, which covers all of the
+// ticcmds in one packet.  Under the original protocol each diff is a
+// header byte followed by the changed fields, whole bytes each.  Under
+// the packed protocols the diff is a bit stream: one bit if anything
+// changed at all, the flags for the common fields, then the rare flags
+// only if there are any.  Movement, turning and latency are coded as the
+// difference from the last value coded for that player in the same
+// packet, so a player holding a key costs a bit or two per tic rather
+// than a byte.  The prediction restarts with every packet, so a lost
+// packet never throws off the ones after it.
+//
+
+// Flags for the fields that change from tic to tic, and the ones that
+// rarely do.
+
+#define TICDIFF_COMMON (NET_TICDIFF_FORWARD | NET_TICDIFF_SIDE \
+                      | NET_TICDIFF_TURN | NET_TICDIFF_BUTTONS)
+#define TICDIFF_RARE   (NET_TICDIFF_CONSISTANCY | NET_TICDIFF_CHATCHAR \
+                      | NET_TICDIFF_RAVEN | NET_TICDIFF_STRIFE)
+
+void NET_BeginTiccmds(net_ticcoder_t *coder, net_packet_t *packet,
+                      net_protocol_t protocol, boolean lowres_turn)
+{
+    coder->packet = packet;
+    coder->packed = protocol != NET_PROTOCOL_CHOCOLATE_DOOM_0;
+    coder->lowres_turn = lowres_turn;
+    coder->latency = 0;
+    memset(coder->last, 0, sizeof(coder->last));
+
+    NET_BeginBits(&coder->bits, packet);
+}
+
+void NET_EndTiccmds(net_ticcoder_t *coder)
+{
+    if (coder->packed)
+    {
+        NET_FlushBits(&coder->bits);
+    }
+}
+
+static void NET_WritePlainTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff,
+                                     boolean lowres_turn)
 {
     // Header
 
@@ -216,8 +260,9 @@ void NET_WriteTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff,
     }
 }
 
-boolean NET_ReadTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff,
-                           boolean lowres_turn)
+static boolean NET_ReadPlainTiccmdDiff(net_packet_t *packet,
+                                       net_ticdiff_t *diff,
+                                       boolean lowres_turn)
 {
     unsigned int val;
     signed int sval;
@@ -305,6 +350,243 @@ boolean NET_ReadTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff,
     return true;
 }
 
+static void NET_WritePackedTiccmdDiff(net_ticcoder_t *coder, int player,
+                                      net_ticdiff_t *diff)
+{
+    net_bitstream_t *bits = &coder->bits;
+    ticcmd_t *last = &coder->last[player];
+    signed int turn;
+
+    NET_WriteBits(bits, diff->diff != 0, 1);
+
+    if (diff->diff == 0)
+    {
+        return;
+    }
+
+    NET_WriteBits(bits, diff->diff & TICDIFF_COMMON, 4);
+    NET_WriteBits(bits, (diff->diff & TICDIFF_RARE) != 0, 1);
+
+    if (diff->diff & TICDIFF_RARE)
+    {
+        NET_WriteBits(bits, (diff->diff & TICDIFF_RARE) >> 4, 4);
+    }
+
+    if (diff->diff & NET_TICDIFF_FORWARD)
+    {
+        NET_WriteSVarBits(bits, diff->cmd.forwardmove - last->forwardmove);
+        last->forwardmove = diff->cmd.forwardmove;
+    }
+    if (diff->diff & NET_TICDIFF_SIDE)
+    {
+        NET_WriteSVarBits(bits, diff->cmd.sidemove - last->sidemove);
+        last->sidemove = diff->cmd.sidemove;
+    }
+    if (diff->diff & NET_TICDIFF_TURN)
+    {
+        // Low resolution turning is predicted in the units it is sent
+        // in.  Full resolution wraps around, like the angle it turns.
+
+        if (coder->lowres_turn)
+        {
+            turn = diff->cmd.angleturn / 256;
+            NET_WriteSVarBits(bits, turn - last->angleturn);
+            last->angleturn = turn;
+        }
+        else
+        {
+            turn = (short) (diff->cmd.angleturn - last->angleturn);
+            NET_WriteSVarBits(bits, turn);
+            last->angleturn = diff->cmd.angleturn;
+        }
+    }
+    if (diff->diff & NET_TICDIFF_BUTTONS)
+        NET_WriteBits(bits, diff->cmd.buttons, 8);
+    if (diff->diff & NET_TICDIFF_CONSISTANCY)
+        NET_WriteBits(bits, diff->cmd.consistancy, 8);
+    if (diff->diff & NET_TICDIFF_CHATCHAR)
+        NET_WriteBits(bits, diff->cmd.chatchar, 8);
+    if (diff->diff & NET_TICDIFF_RAVEN)
+    {
+        NET_WriteBits(bits, diff->cmd.lookfly, 8);
+        NET_WriteBits(bits, diff->cmd.arti, 8);
+    }
+    if (diff->diff & NET_TICDIFF_STRIFE)
+    {
+        NET_WriteBits(bits, diff->cmd.buttons2, 8);
+        NET_WriteBits(bits, diff->cmd.inventory, 16);
+    }
+}
+
+static boolean NET_ReadPackedTiccmdDiff(net_ticcoder_t *coder, int player,
+                                        net_ticdiff_t *diff)
+{
+    net_bitstream_t *bits = &coder->bits;
+    ticcmd_t *last = &coder->last[player];
+    unsigned int val;
+    signed int sval;
+
+    // Read header
+
+    if (!NET_ReadBits(bits, &val, 1))
+        return false;
+
+    diff->diff = 0;
+
+    if (!val)
+        return true;
+
+    if (!NET_ReadBits(bits, &diff->diff, 4)
+     || !NET_ReadBits(bits, &val, 1))
+        return false;
+
+    if (val)
+    {
+        if (!NET_ReadBits(bits, &val, 4))
+            return false;
+        diff->diff |= val << 4;
+    }
+
+    // Read fields
+
+    if (diff->diff & NET_TICDIFF_FORWARD)
+    {
+        if (!NET_ReadSVarBits(bits, &sval))
+            return false;
+        last->forwardmove += sval;
+        diff->cmd.forwardmove = last->forwardmove;
+    }
+
+    if (diff->diff & NET_TICDIFF_SIDE)
+    {
+        if (!NET_ReadSVarBits(bits, &sval))
+            return false;
+        last->sidemove += sval;
+        diff->cmd.sidemove = last->sidemove;
+    }
+
+    if (diff->diff & NET_TICDIFF_TURN)
+    {
+        if (!NET_ReadSVarBits(bits, &sval))
+            return false;
+        last->angleturn += sval;
+
+        if (coder->lowres_turn)
+        {
+            diff->cmd.angleturn = last->angleturn * 256;
+        }
+        else
+        {
+            diff->cmd.angleturn = last->angleturn;
+        }
+    }
+
+    if (diff->diff & NET_TICDIFF_BUTTONS)
+    {
+        if (!NET_ReadBits(bits, &val, 8))
+            return false;
+        diff->cmd.buttons = val;
+    }
+
+    if (diff->diff & NET_TICDIFF_CONSISTANCY)
+    {
+        if (!NET_ReadBits(bits, &val, 8))
+            return false;
+        diff->cmd.consistancy = val;
+    }
+
+    if (diff->diff & NET_TICDIFF_CHATCHAR)
+    {
+        if (!NET_ReadBits(bits, &val, 8))
+            return false;
+        diff->cmd.chatchar = val;
+    }
+
+    if (diff->diff & NET_TICDIFF_RAVEN)
+    {
+        if (!NET_ReadBits(bits, &val, 8))
+            return false;
+        diff->cmd.lookfly = val;
+
+        if (!NET_ReadBits(bits, &val, 8))
+            return false;
+        diff->cmd.arti = val;
+    }
+
+    if (diff->diff & NET_TICDIFF_STRIFE)
+    {
+        if (!NET_ReadBits(bits, &val, 8))
+            return false;
+        diff->cmd.buttons2 = val;
+
+        if (!NET_ReadBits(bits, &val, 16))
+            return false;
+        diff->cmd.inventory = val;
+    }
+
+    return true;
+}
+
+void NET_WriteTiccmdDiff(net_ticcoder_t *coder, int player,
+                         net_ticdiff_t *diff)
+{
+    if (coder->packed)
+    {
+        NET_WritePackedTiccmdDiff(coder, player, diff);
+    }
+    else
+    {
+        NET_WritePlainTiccmdDiff(coder->packet, diff, coder->lowres_turn);
+    }
+}
+
+boolean NET_ReadTiccmdDiff(net_ticcoder_t *coder, int player,
+                           net_ticdiff_t *diff)
+{
+    if (coder->packed)
+    {
+        return NET_ReadPackedTiccmdDiff(coder, player, diff);
+    }
+    else
+    {
+        return NET_ReadPlainTiccmdDiff(coder->packet, diff,
+                                       coder->lowres_turn);
+    }
+}
+
+void NET_WriteTiccmdLatency(net_ticcoder_t *coder, signed int latency)
+{
+    if (coder->packed)
+    {
+        NET_WriteSVarBits(&coder->bits, latency - coder->latency);
+        coder->latency = latency;
+    }
+    else
+    {
+        NET_WriteInt16(coder->packet, latency);
+    }
+}
+
+boolean NET_ReadTiccmdLatency(net_ticcoder_t *coder, signed int *latency)
+{
+    signed int delta;
+
+    if (!coder->packed)
+    {
+        return NET_ReadSInt16(coder->packet, latency);
+    }
+
+    if (!NET_ReadSVarBits(&coder->bits, &delta))
+    {
+        return false;
+    }
+
+    coder->latency += delta;
+    *latency = coder->latency;
+
+    return true;
+}
+
 void NET_TiccmdDiff(ticcmd_t *tic1, ticcmd_t *tic2, net_ticdiff_t *diff)
 {
     diff->diff = 0;
@@ -385,21 +667,31 @@ void NET_TiccmdPatch(ticcmd_t *src, net_ticdiff_t *diff, ticcmd_t *dest)
 // net_full_ticcmd_t
 // 
 
-boolean NET_ReadFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean lowres_turn)
+boolean NET_ReadFullTiccmd(net_ticcoder_t *coder, net_full_ticcmd_t *cmd)
 {
     unsigned int bitfield;
+    boolean result;
     int i;
 
     // Latency
 
-    if (!NET_ReadSInt16(packet, &cmd->latency))
+    if (!NET_ReadTiccmdLatency(coder, &cmd->latency))
     {
         return false;
     }
 
     // Regenerate playeringame from the "header" bitfield
 
-    if (!NET_ReadInt8(packet, &bitfield))
+    if (coder->packed)
+    {
+        result = NET_ReadBits(&coder->bits, &bitfield, NET_MAXPLAYERS);
+    }
+    else
+    {
+        result = NET_ReadInt8(coder->packet, &bitfield);
+    }
+
+    if (!result)
     {
         return false;
     }
@@ -415,7 +707,7 @@ boolean NET_ReadFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean
     {
         if (cmd->playeringame[i])
         {
-            if (!NET_ReadTiccmdDiff(packet, &cmd->cmds[i], lowres_turn))
+            if (!NET_ReadTiccmdDiff(coder, i, &cmd->cmds[i]))
             {
                 return false;
             }
@@ -425,14 +717,14 @@ boolean NET_ReadFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean
     return true;
 }
 
-void NET_WriteFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean lowres_turn)
+void NET_WriteFullTiccmd(net_ticcoder_t *coder, net_full_ticcmd_t *cmd)
 {
     unsigned int bitfield;
     int i;
 
     // Write the latency
 
-    NET_WriteInt16(packet, cmd->latency);
+    NET_WriteTiccmdLatency(coder, cmd->latency);
 
     // Write "header" byte indicating which players are active
     // in this ticcmd
@@ -447,7 +739,14 @@ void NET_WriteFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean l
         }
     }
     
-    NET_WriteInt8(packet, bitfield);
+    if (coder->packed)
+    {
+        NET_WriteBits(&coder->bits, bitfield, NET_MAXPLAYERS);
+    }
+    else
+    {
+        NET_WriteInt8(coder->packet, bitfield);
+    }
 
     // Write player ticcmds
 
@@ -455,7 +754,7 @@ void NET_WriteFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean l
     {
         if (cmd->playeringame[i])
         {
-            NET_WriteTiccmdDiff(packet, &cmd->cmds[i], lowres_turn);
+            NET_WriteTiccmdDiff(coder, i, &cmd->cmds[i]);
         }
     }
 }
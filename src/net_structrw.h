@@ -32,13 +32,36 @@ extern boolean NET_ReadSettings(net_packet_t *packet, net_gamesettings_t *settin
 extern void NET_WriteQueryData(net_packet_t *packet, net_querydata_t *querydata);
 extern boolean NET_ReadQueryData(net_packet_t *packet, net_querydata_t *querydata);
 
-extern void NET_WriteTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff, boolean lowres_turn);
-extern boolean NET_ReadTiccmdDiff(net_packet_t *packet, net_ticdiff_t *diff, boolean lowres_turn);
+// State for reading or writing the ticcmds in one packet.  How they
+// are coded depends on the protocol in use on the connection; the
+// ticcmds must be the last thing in the packet.
+
+typedef struct
+{
+    net_packet_t *packet;
+    boolean packed;
+    boolean lowres_turn;
+    net_bitstream_t bits;
+
+    // Last values coded in this packet, that the next are predicted from.
+    signed int latency;
+    ticcmd_t last[NET_MAXPLAYERS];
+} net_ticcoder_t;
+
+void NET_BeginTiccmds(net_ticcoder_t *coder, net_packet_t *packet,
+                      net_protocol_t protocol, boolean lowres_turn);
+void NET_EndTiccmds(net_ticcoder_t *coder);
+
+extern void NET_WriteTiccmdDiff(net_ticcoder_t *coder, int player, net_ticdiff_t *diff);
+extern boolean NET_ReadTiccmdDiff(net_ticcoder_t *coder, int player, net_ticdiff_t *diff);
 extern void NET_TiccmdDiff(ticcmd_t *tic1, ticcmd_t *tic2, net_ticdiff_t *diff);
 extern void NET_TiccmdPatch(ticcmd_t *src, net_ticdiff_t *diff, ticcmd_t *dest);
 
-boolean NET_ReadFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean lowres_turn);
-void NET_WriteFullTiccmd(net_packet_t *packet, net_full_ticcmd_t *cmd, boolean lowres_turn);
+void NET_WriteTiccmdLatency(net_ticcoder_t *coder, signed int latency);
+boolean NET_ReadTiccmdLatency(net_ticcoder_t *coder, signed int *latency);
+
+boolean NET_ReadFullTiccmd(net_ticcoder_t *coder, net_full_ticcmd_t *cmd);
+void NET_WriteFullTiccmd(net_ticcoder_t *coder, net_full_ticcmd_t *cmd);
 
 boolean NET_ReadSHA1Sum(net_packet_t *packet, sha1_digest_t digest);
 void NET_WriteSHA1Sum(net_packet_t *packet, sha1_digest_t digest);
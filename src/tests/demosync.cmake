@@ -0,0 +1,33 @@
+# Play a demo with -timedemo twice, with parallel_monster_ai off and
+# on, and check that both runs end in the same state.  Run with cmake -P,
+# with GAME, IWAD, DEMO and WORKDIR set.
+
+foreach(PARALLEL 0 1)
+    set(PREFIX "${WORKDIR}/demosync-${DEMO}-${PARALLEL}")
+
+    file(WRITE "${PREFIX}-extra.cfg" "parallel_monster_ai ${PARALLEL}\n")
+    file(REMOVE "${PREFIX}.state")
+
+    # -timedemo always ends with an error giving the timing, so the
+    # exit status says nothing.
+
+    execute_process(COMMAND "${GAME}" -iwad "${IWAD}" -timedemo "${DEMO}"
+        -nodraw -nosound -nomusic -nogui
+        -config "${PREFIX}.cfg" -extraconfig "${PREFIX}-extra.cfg"
+        -demostate "${PREFIX}.state"
+        OUTPUT_VARIABLE OUTPUT ERROR_VARIABLE OUTPUT)
+
+    if(NOT EXISTS "${PREFIX}.state")
+        message(FATAL_ERROR "${DEMO} did not play to the end with "
+                            "parallel_monster_ai ${PARALLEL}:\n${OUTPUT}")
+    endif()
+
+    file(READ "${PREFIX}.state" STATE_${PARALLEL})
+endforeach()
+
+if(NOT STATE_0 STREQUAL STATE_1)
+    message(FATAL_ERROR "${DEMO} went out of sync with parallel_monster_ai:\n"
+                        "off:\n${STATE_0}on:\n${STATE_1}")
+endif()
+
+message(STATUS "${DEMO} stayed in sync:\n${STATE_0}")
@@ -0,0 +1,67 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Checks shared by the test programs.  Each test is a standalone
+//     program that exits non-zero if any check failed.
+//
+
+#ifndef __T_TEST__
+#define __T_TEST__
+
+#include <stdio.h>
+
+#include "m_argv.h"
+
+namespace theta
+{
+
+static int test_failures;
+
+static inline void T_Check2(bool ok, const char *expr,
+                            const char *file, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s:%i: check failed: %s\n", file, line, expr);
+        ++test_failures;
+    }
+}
+
+#define T_Check(cond)                                          \
+    T_Check2(!!(cond), #cond, __FILE__, __LINE__)
+
+// Hand the command line to m_argv, so that the code under test can
+// read its usual parameters.
+
+static inline void T_Init(int argc, char **argv)
+{
+    myargc = argc;
+    myargv = argv;
+}
+
+static inline int T_Finish(const char *name)
+{
+    if (test_failures > 0)
+    {
+        printf("%s: %i checks failed\n", name, test_failures);
+        return 1;
+    }
+
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+}
+
+#endif
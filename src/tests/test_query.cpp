@@ -0,0 +1,416 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Server browser test.  The query code searches for games through
+//     a fake master server and fake game servers on the loopback
+//     network, some of which are slow to answer or never answer.
+//
+
+#include <string.h>
+
+#include "config.h"
+#include "doomtype.h"
+#include "d_mode.h"
+#include "i_timer.h"
+#include "m_misc.h"
+#include "net_defs.h"
+#include "net_loop.h"
+#include "net_packet.h"
+#include "net_query.h"
+#include "net_structrw.h"
+#include "z_zone.h"
+
+#include "t_test.h"
+
+namespace theta
+{
+
+// As resolved by NET_Query_ResolveMaster.
+
+#define MASTER_NAME "master.chocolate-doom.org:2342"
+
+#define NUM_SERVERS 24
+#define MAX_QUERIES 4
+
+// One server takes longer to answer than the query code first waits,
+// and one never answers at all.
+
+#define SLOW_SERVER 5
+#define SLOW_DELAY 600
+#define DEAD_SERVER 9
+
+// Queries sent to a server before it is given up on.
+
+#define MAX_ATTEMPTS 3
+
+// Give up on the test if the search takes longer than this.
+
+#define TEST_TIMEOUT 15000
+
+typedef struct
+{
+    net_addr_t *addr;
+    char name[16];
+
+    // Queries received and answered, and when the first was received.
+
+    int queries;
+    int answered;
+    int first_query_time;
+
+    // Callbacks made for this server, and what they said.
+
+    int responses;
+    unsigned int ping_time;
+    boolean description_ok;
+} fake_server_t;
+
+static fake_server_t servers[NUM_SERVERS];
+static net_addr_t *master;
+
+// Number of servers queried when the first response was passed on.
+
+static int queried_at_first_response = -1;
+
+static fake_server_t *FindServer(net_addr_t *addr)
+{
+    int i;
+
+    for (i = 0; i < NUM_SERVERS; ++i)
+    {
+        if (servers[i].addr == addr)
+        {
+            return &servers[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int NumQueried(void)
+{
+    int result = 0;
+    int i;
+
+    for (i = 0; i < NUM_SERVERS; ++i)
+    {
+        if (servers[i].queries > 0)
+        {
+            ++result;
+        }
+    }
+
+    return result;
+}
+
+static void QueryCallback(net_addr_t *addr, net_querydata_t *data,
+                          unsigned int ping_time, void *user_data)
+{
+    fake_server_t *server = FindServer(addr);
+
+    T_Check(server != NULL);
+
+    if (server == NULL)
+    {
+        return;
+    }
+
+    if (queried_at_first_response < 0)
+    {
+        queried_at_first_response = NumQueried();
+    }
+
+    ++server->responses;
+    server->ping_time = ping_time;
+    server->description_ok = !strcmp(data->description, server->name);
+}
+
+static void SendQueryResponse(fake_server_t *server)
+{
+    net_querydata_t querydata;
+    net_packet_t *packet;
+
+    querydata.version = PACKAGE_STRING;
+    querydata.server_state = 0;
+    querydata.num_players = 1;
+    querydata.max_players = 4;
+    querydata.gamemode = registered;
+    querydata.gamemission = doom;
+    querydata.description = server->name;
+
+    packet = NET_NewPacket(64);
+    NET_WriteInt16(packet, NET_PACKET_TYPE_QUERY_RESPONSE);
+    NET_WriteQueryData(packet, &querydata);
+    NET_Loop_SendFrom(server->addr, packet);
+    NET_FreePacket(packet);
+
+    ++server->answered;
+}
+
+// Answer a query to the master with the list of servers.
+
+static boolean RunMaster(void)
+{
+    net_packet_t *packet;
+    unsigned int packet_type;
+    boolean result = false;
+    int i;
+
+    while ((packet = NET_Loop_RecvAt(master)) != NULL)
+    {
+        if (NET_ReadInt16(packet, &packet_type)
+         && packet_type == NET_MASTER_PACKET_TYPE_QUERY)
+        {
+            NET_FreePacket(packet);
+
+            packet = NET_NewPacket(256);
+            NET_WriteInt16(packet, NET_MASTER_PACKET_TYPE_QUERY_RESPONSE);
+
+            for (i = 0; i < NUM_SERVERS; ++i)
+            {
+                NET_WriteString(packet, servers[i].name);
+            }
+
+            NET_Loop_SendFrom(master, packet);
+            result = true;
+        }
+
+        NET_FreePacket(packet);
+    }
+
+    return result;
+}
+
+static void RunServer(fake_server_t *server, int nowtime)
+{
+    net_packet_t *packet;
+    unsigned int packet_type;
+
+    while ((packet = NET_Loop_RecvAt(server->addr)) != NULL)
+    {
+        if (NET_ReadInt16(packet, &packet_type)
+         && packet_type == NET_PACKET_TYPE_QUERY)
+        {
+            if (server->queries == 0)
+            {
+                server->first_query_time = nowtime;
+            }
+
+            ++server->queries;
+
+            if (server != &servers[SLOW_SERVER]
+             && server != &servers[DEAD_SERVER])
+            {
+                SendQueryResponse(server);
+            }
+        }
+
+        NET_FreePacket(packet);
+    }
+
+    // The slow server answers once, well after its first query.
+
+    if (server == &servers[SLOW_SERVER] && server->queries > 0
+     && server->answered == 0
+     && nowtime - server->first_query_time >= SLOW_DELAY)
+    {
+        SendQueryResponse(server);
+    }
+}
+
+static void TestMasterQuery(void)
+{
+    int start_time;
+    int nowtime;
+    boolean running;
+    int i;
+
+    T_Check(NET_StartMasterQuery());
+
+    master = NET_Loop_Peer(MASTER_NAME);
+
+    // The master is asked first, and nothing else happens until it
+    // has answered.
+
+    T_Check(NET_Query_Poll(QueryCallback, NULL));
+    T_Check(RunMaster());
+
+    // The master's answer is read at the end of a poll, and the
+    // servers it listed are queried at the start of the next.  Only
+    // as many as are allowed at once are sent before anyone answers.
+
+    NET_Query_Poll(QueryCallback, NULL);
+    T_Check(NET_Query_Poll(QueryCallback, NULL));
+
+    start_time = I_GetTimeMS();
+
+    for (i = 0; i < NUM_SERVERS; ++i)
+    {
+        RunServer(&servers[i], start_time);
+    }
+
+    T_Check(NumQueried() == MAX_QUERIES);
+
+    // Run the search to the end.
+
+    running = true;
+
+    while (running)
+    {
+        nowtime = I_GetTimeMS();
+
+        if (nowtime - start_time > TEST_TIMEOUT)
+        {
+            T_Check(!"search finished in time");
+            break;
+        }
+
+        running = NET_Query_Poll(QueryCallback, NULL) != 0;
+
+        for (i = 0; i < NUM_SERVERS; ++i)
+        {
+            RunServer(&servers[i], nowtime);
+        }
+
+        I_Sleep(1);
+    }
+
+    // Responses were passed on as they came in, before all of the
+    // servers had even been queried.
+
+    T_Check(queried_at_first_response > 0);
+    T_Check(queried_at_first_response < NUM_SERVERS);
+
+    for (i = 0; i < NUM_SERVERS; ++i)
+    {
+        fake_server_t *server = &servers[i];
+
+        if (i == DEAD_SERVER)
+        {
+            T_Check(server->responses == 0);
+            T_Check(server->queries == MAX_ATTEMPTS);
+            continue;
+        }
+
+        T_Check(server->responses == 1);
+        T_Check(server->description_ok);
+
+        if (i == SLOW_SERVER)
+        {
+            // The first query timed out quickly, since every other
+            // server answered at once, but the answer still counts
+            // and is timed from the first query.
+
+            T_Check(server->queries >= 2);
+            T_Check(server->ping_time >= SLOW_DELAY);
+        }
+        else
+        {
+            T_Check(server->queries == 1);
+            T_Check(server->ping_time < SLOW_DELAY);
+        }
+    }
+}
+
+// Search the LAN, right after the master search.  Only the first few
+// servers answer the broadcast.
+
+#define LAN_SERVERS 3
+#define LAN_TIME 300
+
+static void TestLANQuery(void)
+{
+    net_packet_t *packet;
+    int start_time;
+    int i;
+
+    for (i = 0; i < NUM_SERVERS; ++i)
+    {
+        servers[i].responses = 0;
+    }
+
+    T_Check(NET_StartLANQuery());
+
+    // Starting a new search gives back the addresses from the last.
+
+    T_Check(master->refcount == 0);
+
+    for (i = 0; i < NUM_SERVERS; ++i)
+    {
+        T_Check(servers[i].addr->refcount == 0);
+    }
+
+    start_time = I_GetTimeMS();
+
+    while (I_GetTimeMS() - start_time < LAN_TIME)
+    {
+        NET_Query_Poll(QueryCallback, NULL);
+
+        for (i = 0; i < NUM_SERVERS; ++i)
+        {
+            while ((packet = NET_Loop_RecvAt(servers[i].addr)) != NULL)
+            {
+                if (i < LAN_SERVERS)
+                {
+                    SendQueryResponse(&servers[i]);
+                }
+
+                NET_FreePacket(packet);
+            }
+        }
+
+        while ((packet = NET_Loop_RecvAt(master)) != NULL)
+        {
+            NET_FreePacket(packet);
+        }
+
+        I_Sleep(1);
+    }
+
+    for (i = 0; i < NUM_SERVERS; ++i)
+    {
+        T_Check(servers[i].responses == (i < LAN_SERVERS ? 1 : 0));
+        T_Check(servers[i].addr->refcount == (i < LAN_SERVERS ? 1 : 0));
+    }
+}
+
+}
+
+using namespace theta;
+
+int main(int argc, char **argv)
+{
+    static char *args[] = { NULL, (char *) "-maxqueries", (char *) "4" };
+    int i;
+
+    args[0] = argv[0];
+    T_Init(arrlen(args), args);
+    Z_Init();
+
+    NET_Query_UseModule(&net_loop_network_module);
+
+    for (i = 0; i < NUM_SERVERS; ++i)
+    {
+        M_snprintf(servers[i].name, sizeof(servers[i].name),
+                   "server%02i", i);
+        servers[i].addr = NET_Loop_Peer(servers[i].name);
+    }
+
+    TestMasterQuery();
+    TestLANQuery();
+
+    NET_Loop_ResetPeers();
+
+    return T_Finish("test_query");
+}
@@ -0,0 +1,573 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Multi-session server load test.  A crowd of fake clients on the
+//     loopback network connect to a server hosting many games at once,
+//     play a few tics and leave.  Each game must only ever see its own
+//     players, and the server must give back every address it took.
+//
+
+#include <string.h>
+
+#include "config.h"
+#include "doomtype.h"
+#include "d_mode.h"
+#include "i_timer.h"
+#include "m_misc.h"
+#include "net_defs.h"
+#include "net_loop.h"
+#include "net_packet.h"
+#include "net_server.h"
+#include "net_structrw.h"
+#include "z_zone.h"
+
+#include "t_test.h"
+
+namespace theta
+{
+
+// Only the dedicated server uses the client code.
+
+void NET_CL_Run(void)
+{
+}
+
+#define NUM_CLIENTS 96
+#define MAX_SESSIONS 64
+
+// As asked for by Doom, so that the server fills a game at a time.
+
+#define MAX_PLAYERS 4
+
+// Tics each player sends before leaving.
+
+#define NUM_TICS 70
+
+// Give up on a round if it takes longer than this.  Leaving takes five
+// seconds, while the server waits in case the goodbye was lost.
+
+#define ROUND_TIMEOUT 20000
+
+typedef enum
+{
+    CLIENT_CONNECTING,
+    CLIENT_WAITING_LAUNCH,
+    CLIENT_WAITING_START,
+    CLIENT_IN_GAME,
+    CLIENT_LEAVING,
+    CLIENT_GONE,
+} client_state_t;
+
+typedef struct
+{
+    net_addr_t *addr;
+    char name[16];
+    client_state_t state;
+    net_protocol_t protocol;
+    unsigned int reliable_recv_seq;
+    int rejects;
+
+    // Who else is waiting in the same game, from the last waiting
+    // data, as client numbers.
+
+    boolean is_controller;
+    int num_players;
+    int players[NET_MAXPLAYERS];
+
+    // Game in progress.
+
+    net_gamesettings_t settings;
+    unsigned int sendtic;
+    unsigned int recvtic;
+    int foreign_tics;
+} fake_client_t;
+
+static fake_client_t clients[NUM_CLIENTS];
+
+static int FindClient(const char *name)
+{
+    int i;
+
+    for (i = 0; i < NUM_CLIENTS; ++i)
+    {
+        if (!strcmp(clients[i].name, name))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void SendSYN(fake_client_t *client)
+{
+    net_connect_data_t data;
+    net_packet_t *packet;
+
+    memset(&data, 0, sizeof(data));
+    data.gamemode = registered;
+    data.gamemission = doom;
+    data.max_players = MAX_PLAYERS;
+
+    packet = NET_NewPacket(64);
+    NET_WriteInt16(packet, NET_PACKET_TYPE_SYN);
+    NET_WriteInt32(packet, NET_MAGIC_NUMBER);
+    NET_WriteString(packet, PACKAGE_STRING);
+    NET_WriteProtocolList(packet);
+    NET_WriteConnectData(packet, &data);
+    NET_WriteString(packet, client->name);
+    NET_Loop_SendFrom(client->addr, packet);
+    NET_FreePacket(packet);
+}
+
+static void SendSimple(fake_client_t *client, unsigned int packet_type)
+{
+    net_packet_t *packet;
+
+    packet = NET_NewPacket(10);
+    NET_WriteInt16(packet, packet_type);
+    NET_Loop_SendFrom(client->addr, packet);
+    NET_FreePacket(packet);
+}
+
+// Everyone is ready to start as soon as the game is launched; the
+// controller picks the settings.
+
+static void SendGameStart(fake_client_t *client)
+{
+    net_gamesettings_t settings;
+    net_packet_t *packet;
+
+    memset(&settings, 0, sizeof(settings));
+    settings.ticdup = 1;
+    settings.episode = 1;
+    settings.map = 1;
+    settings.skill = sk_medium;
+    settings.gameversion = exe_doom_1_9;
+
+    packet = NET_NewPacket(64);
+    NET_WriteInt16(packet, NET_PACKET_TYPE_GAMESTART);
+
+    if (client->is_controller)
+    {
+        NET_WriteSettings(packet, &settings);
+    }
+
+    NET_Loop_SendFrom(client->addr, packet);
+    NET_FreePacket(packet);
+}
+
+// Each player moves forward at a speed that says who they are.
+
+static void SendGameData(fake_client_t *client)
+{
+    net_ticcoder_t coder;
+    net_ticdiff_t diff;
+    net_packet_t *packet;
+    int id = static_cast<int>(client - clients);
+
+    memset(&diff, 0, sizeof(diff));
+    diff.diff = NET_TICDIFF_FORWARD;
+    diff.cmd.forwardmove = static_cast<signed char>(id);
+
+    packet = NET_NewPacket(64);
+    NET_WriteInt16(packet, NET_PACKET_TYPE_GAMEDATA);
+    NET_WriteInt8(packet, client->recvtic & 0xff);
+    NET_WriteInt8(packet, client->sendtic & 0xff);
+    NET_WriteInt8(packet, 1);
+    NET_BeginTiccmds(&coder, packet, client->protocol,
+                     client->settings.lowres_turn);
+    NET_WriteTiccmdLatency(&coder, 0);
+    NET_WriteTiccmdDiff(&coder, 0, &diff);
+    NET_EndTiccmds(&coder);
+    NET_Loop_SendFrom(client->addr, packet);
+    NET_FreePacket(packet);
+
+    ++client->sendtic;
+}
+
+static void SendGameDataACK(fake_client_t *client)
+{
+    net_packet_t *packet;
+
+    packet = NET_NewPacket(10);
+    NET_WriteInt16(packet, NET_PACKET_TYPE_GAMEDATA_ACK);
+    NET_WriteInt8(packet, client->recvtic & 0xff);
+    NET_Loop_SendFrom(client->addr, packet);
+    NET_FreePacket(packet);
+}
+
+// Returns true if the given client number is waiting in the same game.
+
+static boolean SameGame(fake_client_t *client, int id)
+{
+    int i;
+
+    for (i = 0; i < client->num_players; ++i)
+    {
+        if (client->players[i] == id)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void ParseWaitingData(fake_client_t *client, net_packet_t *packet)
+{
+    net_waitdata_t wait_data;
+    int i;
+
+    if (!NET_ReadWaitData(packet, &wait_data))
+    {
+        T_Check(!"waiting data readable");
+        return;
+    }
+
+    client->is_controller = wait_data.is_controller;
+    client->num_players = wait_data.num_players;
+
+    for (i = 0; i < wait_data.num_players; ++i)
+    {
+        client->players[i] = FindClient(wait_data.player_names[i]);
+    }
+}
+
+// Take the tics that come next, and check they only hold commands from
+// players in our own game.
+
+static void ParseGameData(fake_client_t *client, net_packet_t *packet)
+{
+    net_ticcoder_t coder;
+    net_full_ticcmd_t cmd;
+    unsigned int seq;
+    unsigned int num_tics;
+    unsigned int i;
+    int player;
+
+    if (!NET_ReadInt8(packet, &seq) || !NET_ReadInt8(packet, &num_tics))
+    {
+        return;
+    }
+
+    NET_BeginTiccmds(&coder, packet, client->protocol,
+                     client->settings.lowres_turn);
+
+    for (i = 0; i < num_tics; ++i)
+    {
+        if (!NET_ReadFullTiccmd(&coder, &cmd))
+        {
+            T_Check(!"game data readable");
+            return;
+        }
+
+        if (((seq + i) & 0xff) != (client->recvtic & 0xff))
+        {
+            continue;
+        }
+
+        for (player = 0; player < NET_MAXPLAYERS; ++player)
+        {
+            if (cmd.playeringame[player]
+             && !SameGame(client, cmd.cmds[player].cmd.forwardmove))
+            {
+                ++client->foreign_tics;
+            }
+        }
+
+        ++client->recvtic;
+    }
+}
+
+static void RunClient(fake_client_t *client)
+{
+    net_packet_t *packet;
+    net_packet_t *reply;
+    unsigned int packet_type;
+    unsigned int seq;
+
+    while ((packet = NET_Loop_RecvAt(client->addr)) != NULL)
+    {
+        if (!NET_ReadInt16(packet, &packet_type))
+        {
+            NET_FreePacket(packet);
+            continue;
+        }
+
+        // Acknowledge reliable packets, taking each one once and in
+        // order.
+
+        if (packet_type & NET_RELIABLE_PACKET)
+        {
+            packet_type &= ~NET_RELIABLE_PACKET;
+
+            if (!NET_ReadInt8(packet, &seq))
+            {
+                NET_FreePacket(packet);
+                continue;
+            }
+
+            if (seq == (client->reliable_recv_seq & 0xff))
+            {
+                ++client->reliable_recv_seq;
+            }
+            else
+            {
+                packet_type = NET_PACKET_TYPE_KEEPALIVE;
+            }
+
+            reply = NET_NewPacket(10);
+            NET_WriteInt16(reply, NET_PACKET_TYPE_RELIABLE_ACK);
+            NET_WriteInt8(reply, client->reliable_recv_seq & 0xff);
+            NET_Loop_SendFrom(client->addr, reply);
+            NET_FreePacket(reply);
+        }
+
+        switch (packet_type)
+        {
+            case NET_PACKET_TYPE_SYN:
+                if (client->state == CLIENT_CONNECTING
+                 && NET_ReadString(packet) != NULL)
+                {
+                    client->protocol = NET_ReadProtocol(packet);
+                    client->state = CLIENT_WAITING_LAUNCH;
+                }
+                break;
+
+            case NET_PACKET_TYPE_REJECTED:
+                ++client->rejects;
+                break;
+
+            case NET_PACKET_TYPE_WAITING_DATA:
+                ParseWaitingData(client, packet);
+                break;
+
+            case NET_PACKET_TYPE_LAUNCH:
+                client->state = CLIENT_WAITING_START;
+                SendGameStart(client);
+                break;
+
+            case NET_PACKET_TYPE_GAMESTART:
+                if (NET_ReadSettings(packet, &client->settings))
+                {
+                    client->state = CLIENT_IN_GAME;
+                }
+                break;
+
+            case NET_PACKET_TYPE_GAMEDATA:
+                if (client->state == CLIENT_IN_GAME)
+                {
+                    ParseGameData(client, packet);
+                }
+                break;
+
+            case NET_PACKET_TYPE_DISCONNECT_ACK:
+                client->state = CLIENT_GONE;
+                break;
+
+            default:
+                break;
+        }
+
+        NET_FreePacket(packet);
+    }
+
+    // The controller launches the game once it is full, and keeps
+    // asking until it hears that it has been.
+
+    if (client->state == CLIENT_WAITING_LAUNCH && client->is_controller
+     && client->num_players == MAX_PLAYERS)
+    {
+        SendSimple(client, NET_PACKET_TYPE_LAUNCH);
+    }
+
+    if (client->state == CLIENT_IN_GAME)
+    {
+        if (client->sendtic < NUM_TICS)
+        {
+            SendGameData(client);
+        }
+        else
+        {
+            SendGameDataACK(client);
+        }
+
+        if (client->recvtic >= NUM_TICS)
+        {
+            SendSimple(client, NET_PACKET_TYPE_DISCONNECT);
+            client->state = CLIENT_LEAVING;
+        }
+    }
+}
+
+static boolean AllInState(int count, client_state_t state)
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (clients[i].state != state)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static boolean AllReleased(int count)
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (clients[i].addr->refcount != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Check that the players were split into full games that agree on who
+// is in them.
+
+static void CheckGames(int count)
+{
+    int games = 0;
+    int i, j;
+
+    for (i = 0; i < count; ++i)
+    {
+        fake_client_t *client = &clients[i];
+
+        T_Check(client->rejects == 0);
+        T_Check(client->num_players == MAX_PLAYERS);
+        T_Check(client->settings.num_players == MAX_PLAYERS);
+        T_Check(SameGame(client, i));
+
+        for (j = 0; j < client->num_players; ++j)
+        {
+            T_Check(SameGame(&clients[client->players[j]], i));
+        }
+
+        // A client holds the only reference to its address.
+
+        T_Check(client->addr->refcount == 1);
+
+        if (client->settings.consoleplayer == 0)
+        {
+            ++games;
+        }
+    }
+
+    T_Check(games == count / MAX_PLAYERS);
+}
+
+// Everyone connects at once, plays, and leaves.
+
+static void RunRound(int count)
+{
+    int start_time;
+    boolean checked_games;
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        clients[i].state = CLIENT_CONNECTING;
+        clients[i].reliable_recv_seq = 0;
+        clients[i].rejects = 0;
+        clients[i].is_controller = false;
+        clients[i].num_players = 0;
+        clients[i].sendtic = 0;
+        clients[i].recvtic = 0;
+        clients[i].foreign_tics = 0;
+        memset(&clients[i].settings, 0, sizeof(clients[i].settings));
+
+        SendSYN(&clients[i]);
+    }
+
+    start_time = I_GetTimeMS();
+    checked_games = false;
+
+    while (!AllInState(count, CLIENT_GONE) || !AllReleased(count))
+    {
+        if (I_GetTimeMS() - start_time > ROUND_TIMEOUT)
+        {
+            T_Check(!"round finished in time");
+            break;
+        }
+
+        NET_SV_Run();
+
+        if (!checked_games && AllInState(count, CLIENT_IN_GAME))
+        {
+            CheckGames(count);
+            checked_games = true;
+        }
+
+        for (i = 0; i < count; ++i)
+        {
+            RunClient(&clients[i]);
+        }
+
+        I_Sleep(1);
+    }
+
+    T_Check(checked_games);
+
+    for (i = 0; i < count; ++i)
+    {
+        T_Check(clients[i].recvtic == NUM_TICS);
+        T_Check(clients[i].foreign_tics == 0);
+        T_Check(clients[i].addr->refcount == 0);
+    }
+}
+
+}
+
+using namespace theta;
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    T_Init(argc, argv);
+    Z_Init();
+
+    for (i = 0; i < NUM_CLIENTS; ++i)
+    {
+        M_snprintf(clients[i].name, sizeof(clients[i].name),
+                   "client%03i", i);
+        clients[i].addr = NET_Loop_Peer(clients[i].name);
+    }
+
+    NET_SV_Init();
+    NET_SV_SetMaxSessions(MAX_SESSIONS);
+    NET_SV_AddModule(&net_loop_network_module);
+
+    RunRound(NUM_CLIENTS);
+
+    // The games that have ended are closed, and their players can
+    // come back.
+
+    RunRound(MAX_PLAYERS * 2);
+
+    NET_SV_Shutdown();
+    NET_Loop_ResetPeers();
+
+    return T_Finish("test_sessions");
+}
@@ -0,0 +1,307 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Round trip tests for the snapshot delta coding, and a benchmark
+//     of what it costs the host to code a snapshot for each client.
+//     The snapshots are made up: a block of sector data followed by
+//     a record for each thing, with things that move, come and go
+//     much as they do in a level with a fight going on.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "doomtype.h"
+#include "i_timer.h"
+#include "net_snapshot.h"
+
+#include "t_test.h"
+
+namespace theta
+{
+
+// Size of the records in the made-up snapshots, about that of a
+// mobj and a sector in a real one.
+
+#define THING_SIZE 154
+#define SECTOR_SIZE 14
+#define NUM_SECTORS 400
+
+// Things in the level at the start, and per player in the game.
+
+#define LEVEL_THINGS 300
+#define PLAYER_THINGS 10
+
+typedef struct
+{
+    std::vector<byte> sectors;
+    std::vector<std::vector<byte> > things;
+    unsigned int seed;
+} level_t;
+
+static unsigned int NextRandom(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+static void RandomBytes(unsigned int *seed, byte *p, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; ++i)
+    {
+        p[i] = static_cast<byte>(NextRandom(seed));
+    }
+}
+
+static void NewThing(level_t *level, size_t where)
+{
+    std::vector<byte> thing(THING_SIZE);
+
+    RandomBytes(&level->seed, thing.data(), thing.size());
+    level->things.insert(level->things.begin() + where, thing);
+}
+
+static void InitLevel(level_t *level, int players)
+{
+    int i;
+
+    level->seed = 1;
+    level->sectors.resize(NUM_SECTORS * SECTOR_SIZE);
+    RandomBytes(&level->seed, level->sectors.data(), level->sectors.size());
+    level->things.clear();
+
+    for (i = 0; i < LEVEL_THINGS + players * PLAYER_THINGS; ++i)
+    {
+        NewThing(level, level->things.size());
+    }
+}
+
+// Run the made-up level for a tic.  A few things move, which changes
+// their position and state; each player fires, which adds a missile at
+// the end of the list; and missiles and puffs from earlier explode,
+// which takes them out from the middle.  Now and then a door moves.
+
+static void RunLevel(level_t *level, int players)
+{
+    std::vector<byte> *thing;
+    size_t n;
+    int i;
+
+    for (i = 0; i < 20 + players * 2; ++i)
+    {
+        thing = &level->things[NextRandom(&level->seed)
+                               % level->things.size()];
+        RandomBytes(&level->seed, thing->data() + 12, 12);
+        RandomBytes(&level->seed, thing->data() + 80, 8);
+    }
+
+    for (i = 0; i < players; ++i)
+    {
+        if (NextRandom(&level->seed) % 4 == 0)
+        {
+            NewThing(level, level->things.size());
+        }
+
+        if (NextRandom(&level->seed) % 4 == 0
+         && level->things.size() > LEVEL_THINGS)
+        {
+            n = LEVEL_THINGS + NextRandom(&level->seed)
+                             % (level->things.size() - LEVEL_THINGS);
+            level->things.erase(level->things.begin() + n);
+        }
+    }
+
+    if (NextRandom(&level->seed) % 8 == 0)
+    {
+        n = (NextRandom(&level->seed) % NUM_SECTORS) * SECTOR_SIZE;
+        RandomBytes(&level->seed, &level->sectors[n], 4);
+    }
+}
+
+static void TakeSnapshot(level_t *level, std::vector<byte> *snapshot)
+{
+    snapshot->assign(level->sectors.begin(), level->sectors.end());
+
+    for (const std::vector<byte> &thing : level->things)
+    {
+        snapshot->insert(snapshot->end(), thing.begin(), thing.end());
+    }
+}
+
+static boolean RoundTrip(const std::vector<byte> &base,
+                         const std::vector<byte> &data,
+                         std::vector<byte> *delta)
+{
+    std::vector<byte> out;
+
+    NET_EncodeSnapshot(delta, base.data(), base.size(),
+                       data.data(), data.size());
+
+    return NET_DecodeSnapshot(&out, base.data(), base.size(),
+                              delta->data(), delta->size())
+        && out == data;
+}
+
+static void TestCoding(void)
+{
+    std::vector<byte> empty;
+    std::vector<byte> base(5000);
+    std::vector<byte> data;
+    std::vector<byte> delta;
+    std::vector<byte> out;
+    unsigned int seed = 7;
+
+    RandomBytes(&seed, base.data(), base.size());
+
+    // Nothing to nothing, something from nothing and nothing from
+    // something.
+
+    T_Check(RoundTrip(empty, empty, &delta));
+    T_Check(RoundTrip(empty, base, &delta));
+    T_Check(RoundTrip(base, empty, &delta));
+
+    // Unchanged costs next to nothing.
+
+    T_Check(RoundTrip(base, base, &delta));
+    T_Check(delta.size() < 8);
+
+    // So do a change in place and a shift either way.
+
+    data = base;
+    data[2500] ^= 0xff;
+    T_Check(RoundTrip(base, data, &delta));
+    T_Check(delta.size() < 16);
+
+    data.assign(base.begin(), base.begin() + 1000);
+    data.insert(data.end(), base.begin() + 1154, base.end());
+    T_Check(RoundTrip(base, data, &delta));
+    T_Check(delta.size() < 24);
+
+    data.assign(base.begin(), base.begin() + 1000);
+    data.insert(data.end(), 154, 0x55);
+    data.insert(data.end(), base.begin() + 1000, base.end());
+    T_Check(RoundTrip(base, data, &delta));
+    T_Check(delta.size() < 154 + 16);
+
+    // Something else entirely is sent whole.
+
+    data.resize(base.size());
+    RandomBytes(&seed, data.data(), data.size());
+    T_Check(RoundTrip(base, data, &delta));
+    T_Check(delta.size() < data.size() + 16);
+
+    // Changes that are cut short or run past the end of the base are
+    // turned down.
+
+    data = base;
+    data[10] ^= 0xff;
+    NET_EncodeSnapshot(&delta, base.data(), base.size(),
+                       data.data(), data.size());
+    T_Check(!NET_DecodeSnapshot(&out, base.data(), base.size(),
+                                delta.data(), delta.size() - 1));
+    T_Check(!NET_DecodeSnapshot(&out, base.data(), 100,
+                                delta.data(), delta.size()));
+    T_Check(!NET_DecodeSnapshot(&out, NULL, 0, delta.data(), delta.size()));
+}
+
+// Snapshots are taken once a second.  Each client is sent the latest
+// as changes from the last one it acknowledged, which for most is the
+// one before, but some are further behind.
+
+#define SNAPSHOT_INTERVAL TICRATE
+#define NUM_SNAPSHOTS 12
+
+static void Benchmark(int players)
+{
+    level_t level;
+    std::vector<byte> snapshots[NUM_SNAPSHOTS];
+    std::vector<byte> delta;
+    std::vector<byte> out;
+    uint64_t start, elapsed;
+    size_t delta_bytes;
+    size_t base;
+    int deltas;
+    int s, t, c;
+
+    InitLevel(&level, players);
+
+    for (s = 0; s < NUM_SNAPSHOTS; ++s)
+    {
+        for (t = 0; t < SNAPSHOT_INTERVAL; ++t)
+        {
+            RunLevel(&level, players);
+        }
+
+        TakeSnapshot(&level, &snapshots[s]);
+    }
+
+    elapsed = 0;
+    delta_bytes = 0;
+    deltas = 0;
+
+    for (s = 3; s < NUM_SNAPSHOTS; ++s)
+    {
+        for (c = 0; c < players; ++c)
+        {
+            base = s - 1 - (c % 4 == 3 ? 2 : 0);
+
+            start = I_GetPerformanceTime();
+            NET_EncodeSnapshot(&delta, snapshots[base].data(),
+                               snapshots[base].size(),
+                               snapshots[s].data(), snapshots[s].size());
+            elapsed += I_GetPerformanceTime() - start;
+
+            delta_bytes += delta.size();
+            ++deltas;
+
+            T_Check(NET_DecodeSnapshot(&out, snapshots[base].data(),
+                                       snapshots[base].size(),
+                                       delta.data(), delta.size())
+                 && out == snapshots[s]);
+        }
+    }
+
+    // Most of a second's worth of changes is the missiles fired, which
+    // are all new, but even so it is well under the whole.
+
+    T_Check(delta_bytes / deltas < snapshots[NUM_SNAPSHOTS - 1].size() / 2);
+
+    printf("%2i players: %6i byte snapshots, %5i byte deltas, "
+           "%.1f us per client per snapshot, %.2f us per client per tic\n",
+           players, static_cast<int>(snapshots[NUM_SNAPSHOTS - 1].size()),
+           static_cast<int>(delta_bytes / deltas),
+           elapsed * 1e6 / I_GetPerformanceFrequency() / deltas,
+           elapsed * 1e6 / I_GetPerformanceFrequency() / deltas
+               / SNAPSHOT_INTERVAL);
+}
+
+}
+
+using namespace theta;
+
+int main(int argc, char **argv)
+{
+    T_Init(argc, argv);
+
+    TestCoding();
+
+    Benchmark(8);
+    Benchmark(16);
+
+    return T_Finish("test_snapshot");
+}
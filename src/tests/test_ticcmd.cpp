@@ -0,0 +1,304 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Round trip tests for the bit-level packet functions and the
+//     ticcmd encodings of each protocol.
+//
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "net_defs.h"
+#include "net_packet.h"
+#include "net_structrw.h"
+#include "z_zone.h"
+
+#include "t_test.h"
+
+namespace theta
+{
+
+// Largest values the variable-length functions can code; anything
+// beyond saturates.
+
+#define MAX_VARBITS ((1u << 23) - 1)
+#define MAX_SVARBITS ((signed int) (MAX_VARBITS >> 1))
+
+static const unsigned int var_values[] =
+{
+    0, 1, 2, 3, 6, 7, 127, 128, 255, 256, 65535, 65536,
+    MAX_VARBITS - 1, MAX_VARBITS,
+};
+
+static const signed int svar_values[] =
+{
+    0, -1, 1, -2, 2, SCHAR_MIN, SCHAR_MAX, INT16_MIN, INT16_MAX,
+    -65535, 65535, -MAX_SVARBITS - 1, MAX_SVARBITS,
+};
+
+static void TestBits(void)
+{
+    net_packet_t *packet;
+    net_bitstream_t bits;
+    unsigned int val;
+    signed int sval;
+    int count;
+    size_t i;
+
+    packet = NET_NewPacket(64);
+
+    // Every width, all ones then alternating, so that any bit lost
+    // across a byte boundary shows up.
+
+    NET_BeginBits(&bits, packet);
+
+    for (count = 1; count <= 24; ++count)
+    {
+        NET_WriteBits(&bits, 0xffffffff, count);
+        NET_WriteBits(&bits, 0x555555, count);
+    }
+
+    NET_FlushBits(&bits);
+
+    packet->pos = 0;
+    NET_BeginBits(&bits, packet);
+
+    for (count = 1; count <= 24; ++count)
+    {
+        T_Check(NET_ReadBits(&bits, &val, count));
+        T_Check(val == (1u << count) - 1);
+        T_Check(NET_ReadBits(&bits, &val, count));
+        T_Check(val == (0x555555u & ((1u << count) - 1)));
+    }
+
+    // Exp-Golomb and zigzag values, including the largest codable and
+    // values past them, which saturate without changing sign.
+
+    packet->len = packet->pos = 0;
+    NET_BeginBits(&bits, packet);
+
+    for (i = 0; i < arrlen(var_values); ++i)
+    {
+        NET_WriteVarBits(&bits, var_values[i]);
+    }
+
+    NET_WriteVarBits(&bits, MAX_VARBITS + 1);
+    NET_WriteVarBits(&bits, UINT_MAX);
+
+    for (i = 0; i < arrlen(svar_values); ++i)
+    {
+        NET_WriteSVarBits(&bits, svar_values[i]);
+    }
+
+    NET_WriteSVarBits(&bits, MAX_SVARBITS + 1);
+    NET_WriteSVarBits(&bits, INT_MAX);
+    NET_WriteSVarBits(&bits, -MAX_SVARBITS - 2);
+    NET_WriteSVarBits(&bits, INT_MIN);
+    NET_FlushBits(&bits);
+
+    packet->pos = 0;
+    NET_BeginBits(&bits, packet);
+
+    for (i = 0; i < arrlen(var_values); ++i)
+    {
+        T_Check(NET_ReadVarBits(&bits, &val) && val == var_values[i]);
+    }
+
+    T_Check(NET_ReadVarBits(&bits, &val) && val == MAX_VARBITS);
+    T_Check(NET_ReadVarBits(&bits, &val) && val == MAX_VARBITS);
+
+    for (i = 0; i < arrlen(svar_values); ++i)
+    {
+        T_Check(NET_ReadSVarBits(&bits, &sval) && sval == svar_values[i]);
+    }
+
+    T_Check(NET_ReadSVarBits(&bits, &sval) && sval == MAX_SVARBITS);
+    T_Check(NET_ReadSVarBits(&bits, &sval) && sval == MAX_SVARBITS);
+    T_Check(NET_ReadSVarBits(&bits, &sval) && sval == -MAX_SVARBITS - 1);
+    T_Check(NET_ReadSVarBits(&bits, &sval) && sval == -MAX_SVARBITS - 1);
+
+    // Running out of packet, or a run of zeros too long to be a value,
+    // is an error rather than a value.
+
+    T_Check(!NET_ReadBits(&bits, &val, 8));
+
+    packet->len = packet->pos = 0;
+    NET_WriteInt32(packet, 0);
+    NET_WriteInt32(packet, 0);
+    packet->pos = 0;
+    NET_BeginBits(&bits, packet);
+    T_Check(!NET_ReadVarBits(&bits, &val));
+
+    NET_FreePacket(packet);
+}
+
+// Ticcmds, including an empty diff, both ends of every field, and
+// turns that wrap all the way around.
+
+#define NUM_TICS 8
+
+static void MakeTiccmds(net_full_ticcmd_t *cmds)
+{
+    int tic;
+    int i;
+
+    memset(cmds, 0, sizeof(*cmds) * NUM_TICS);
+
+    for (tic = 0; tic < NUM_TICS; ++tic)
+    {
+        net_full_ticcmd_t *cmd = &cmds[tic];
+        boolean high = (tic % 2) != 0;
+
+        cmd->latency = high ? INT16_MAX : INT16_MIN;
+
+        for (i = 0; i < NET_MAXPLAYERS; ++i)
+        {
+            net_ticdiff_t *diff = &cmd->cmds[i];
+
+            // Player 0 never changes; player 3 is out of the game.
+
+            cmd->playeringame[i] = i != 3;
+
+            if (i == 0)
+            {
+                continue;
+            }
+
+            diff->diff = i == 1 ? 0xff : (tic * 37 + i * 11) & 0xff;
+            diff->cmd.forwardmove = high ? SCHAR_MAX : SCHAR_MIN;
+            diff->cmd.sidemove = high ? SCHAR_MIN : SCHAR_MAX;
+            diff->cmd.angleturn = high ? INT16_MAX : INT16_MIN;
+            diff->cmd.buttons = (tic * 73 + i) & 0xff;
+            diff->cmd.consistancy = high ? 0xff : 0;
+            diff->cmd.chatchar = high ? 0 : 0xff;
+            diff->cmd.lookfly = high ? 0xff : 0;
+            diff->cmd.arti = high ? 0 : 0xff;
+            diff->cmd.buttons2 = high ? 0xff : 0;
+            diff->cmd.inventory = high ? 0xffff : 0;
+        }
+
+        // Every buttons value, for one player.
+
+        cmd->cmds[2].diff |= NET_TICDIFF_BUTTONS;
+    }
+}
+
+static void CheckTiccmd(net_full_ticcmd_t *in, net_full_ticcmd_t *out,
+                        boolean lowres_turn)
+{
+    int i;
+
+    T_Check(out->latency == in->latency);
+
+    for (i = 0; i < NET_MAXPLAYERS; ++i)
+    {
+        ticcmd_t *a = &in->cmds[i].cmd;
+        ticcmd_t *b = &out->cmds[i].cmd;
+        unsigned int diff = in->cmds[i].diff;
+        short turn;
+
+        T_Check(out->playeringame[i] == in->playeringame[i]);
+
+        if (!in->playeringame[i])
+        {
+            continue;
+        }
+
+        T_Check(out->cmds[i].diff == diff);
+
+        turn = lowres_turn ? (a->angleturn / 256) * 256 : a->angleturn;
+
+        if (diff & NET_TICDIFF_FORWARD)
+            T_Check(b->forwardmove == a->forwardmove);
+        if (diff & NET_TICDIFF_SIDE)
+            T_Check(b->sidemove == a->sidemove);
+        if (diff & NET_TICDIFF_TURN)
+            T_Check(b->angleturn == turn);
+        if (diff & NET_TICDIFF_BUTTONS)
+            T_Check(b->buttons == a->buttons);
+        if (diff & NET_TICDIFF_CONSISTANCY)
+            T_Check(b->consistancy == a->consistancy);
+        if (diff & NET_TICDIFF_CHATCHAR)
+            T_Check(b->chatchar == a->chatchar);
+        if (diff & NET_TICDIFF_RAVEN)
+            T_Check(b->lookfly == a->lookfly && b->arti == a->arti);
+        if (diff & NET_TICDIFF_STRIFE)
+            T_Check(b->buttons2 == a->buttons2
+                 && b->inventory == a->inventory);
+    }
+}
+
+static void TestTiccmds(net_protocol_t protocol, boolean lowres_turn)
+{
+    net_full_ticcmd_t in[NUM_TICS];
+    net_full_ticcmd_t out;
+    net_ticcoder_t coder;
+    net_packet_t *packet;
+    int buttons;
+    int tic;
+
+    MakeTiccmds(in);
+
+    for (buttons = 0; buttons < 256; buttons += NUM_TICS)
+    {
+        for (tic = 0; tic < NUM_TICS; ++tic)
+        {
+            in[tic].cmds[2].cmd.buttons = buttons + tic;
+        }
+
+        packet = NET_NewPacket(64);
+
+        NET_BeginTiccmds(&coder, packet, protocol, lowres_turn);
+
+        for (tic = 0; tic < NUM_TICS; ++tic)
+        {
+            NET_WriteFullTiccmd(&coder, &in[tic]);
+        }
+
+        NET_EndTiccmds(&coder);
+
+        packet->pos = 0;
+        NET_BeginTiccmds(&coder, packet, protocol, lowres_turn);
+
+        for (tic = 0; tic < NUM_TICS; ++tic)
+        {
+            memset(&out, 0, sizeof(out));
+            T_Check(NET_ReadFullTiccmd(&coder, &out));
+            CheckTiccmd(&in[tic], &out, lowres_turn);
+        }
+
+        NET_FreePacket(packet);
+    }
+}
+
+}
+
+using namespace theta;
+
+int main(int argc, char **argv)
+{
+    T_Init(argc, argv);
+    Z_Init();
+
+    TestBits();
+
+    TestTiccmds(NET_PROTOCOL_CHOCOLATE_DOOM_0, false);
+    TestTiccmds(NET_PROTOCOL_CHOCOLATE_DOOM_0, true);
+    TestTiccmds(NET_PROTOCOL_THANATOS_0, false);
+    TestTiccmds(NET_PROTOCOL_THANATOS_0, true);
+
+    return T_Finish("test_ticcmd");
+}
@@ -0,0 +1,261 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Zone allocator stress test.  Several threads allocate, free,
+//     retag and hand blocks to each other while the main thread walks
+//     the heap.  Built against each allocator, and meant to be run
+//     under ThreadSanitizer.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "doomtype.h"
+#include "z_zone.h"
+
+#include "t_test.h"
+
+namespace theta
+{
+
+#define NUM_THREADS 6
+#define NUM_WAVES 3
+#define NUM_STEPS 20000
+
+// Blocks each thread keeps alive at once.
+#define MAX_LIVE 32
+
+typedef struct
+{
+    byte *ptr;
+    int size;
+    byte fill;
+} liveblock_t;
+
+// Blocks passed from one thread to be freed by another.
+static std::mutex exchange_mutex;
+static std::vector<liveblock_t> exchange;
+
+static std::atomic<int> bad_blocks;
+
+static unsigned int NextRandom(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+// Mostly small blocks, spread over the size classes, with the odd
+// large one.
+
+static int RandomSize(unsigned int *seed)
+{
+    if (NextRandom(seed) % 16 == 0)
+    {
+        return 4096 + NextRandom(seed) * 2;
+    }
+
+    return 1 + NextRandom(seed) % 1024;
+}
+
+static void FillBlock(liveblock_t *block)
+{
+    memset(block->ptr, block->fill, block->size);
+}
+
+static void FreeBlock(liveblock_t *block)
+{
+    int i;
+
+    for (i = 0; i < block->size; ++i)
+    {
+        if (block->ptr[i] != block->fill)
+        {
+            ++bad_blocks;
+            break;
+        }
+    }
+
+    Z_Free(block->ptr);
+}
+
+static void StressThread(int id, int wave)
+{
+    liveblock_t live[MAX_LIVE];
+    int num_live = 0;
+    unsigned int seed = id * 7919 + wave;
+    int steps;
+    int i;
+
+    // Owners of purgable blocks are written by whichever thread purges
+    // them, so each one is only ever used for a single block and never
+    // read back.
+    std::vector<void *> owners(NUM_STEPS);
+    int num_owners = 0;
+
+    // Threads exit at different times, so that cached blocks reach the
+    // depot while others are still allocating.
+
+    steps = NUM_STEPS / NUM_THREADS * (id + 1);
+
+    for (i = 0; i < steps; ++i)
+    {
+        unsigned int action = NextRandom(&seed) % 8;
+        liveblock_t block;
+
+        if (num_live == MAX_LIVE && action < 4)
+        {
+            action = 4;
+        }
+
+        switch (action)
+        {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+                block.size = RandomSize(&seed);
+                block.fill = static_cast<byte>(NextRandom(&seed));
+                block.ptr = static_cast<byte *>(
+                    Z_Malloc(block.size, action == 3 ? PU_LEVEL : PU_STATIC,
+                             NULL));
+                FillBlock(&block);
+                live[num_live++] = block;
+                break;
+
+            case 4:
+            case 5:
+                if (num_live > 0)
+                {
+                    int n = NextRandom(&seed) % num_live;
+
+                    FreeBlock(&live[n]);
+                    live[n] = live[--num_live];
+                }
+                break;
+
+            case 6:
+                // Hand a block over, or free one handed over by
+                // someone else.
+
+                if (num_live > 0 && NextRandom(&seed) % 2 == 0)
+                {
+                    std::lock_guard<std::mutex> lock(exchange_mutex);
+                    exchange.push_back(live[--num_live]);
+                }
+                else
+                {
+                    std::unique_lock<std::mutex> lock(exchange_mutex);
+
+                    if (!exchange.empty())
+                    {
+                        block = exchange.back();
+                        exchange.pop_back();
+                        lock.unlock();
+                        FreeBlock(&block);
+                    }
+                }
+                break;
+
+            case 7:
+                // Use a block like a cached lump: static while in use,
+                // then purgable.
+
+                block.size = RandomSize(&seed);
+                block.ptr = static_cast<byte *>(
+                    Z_Malloc(block.size, PU_STATIC, &owners[num_owners]));
+                memset(block.ptr, 0, block.size);
+                Z_ChangeTag(block.ptr, PU_CACHE);
+                ++num_owners;
+                break;
+        }
+    }
+
+    for (i = 0; i < num_live; ++i)
+    {
+        FreeBlock(&live[i]);
+    }
+
+    // The vector goes away with the thread, so nothing may point into
+    // it afterwards.
+
+    Z_FreeTags(PU_PURGELEVEL, PU_CACHE);
+}
+
+static void RunWave(int wave)
+{
+    std::vector<std::thread> threads;
+    std::atomic<int> running(NUM_THREADS);
+    int i;
+
+    for (i = 0; i < NUM_THREADS; ++i)
+    {
+        threads.emplace_back([i, wave, &running]()
+        {
+            StressThread(i, wave);
+            --running;
+        });
+    }
+
+    // Walk the heap from here while the workers run.
+
+    while (running > 0)
+    {
+        Z_CheckHeap();
+        Z_FreeMemory();
+        std::this_thread::yield();
+    }
+
+    for (i = 0; i < NUM_THREADS; ++i)
+    {
+        threads[i].join();
+    }
+}
+
+}
+
+using namespace theta;
+
+int main(int argc, char **argv)
+{
+    int wave;
+
+    T_Init(argc, argv);
+    Z_Init();
+
+    for (wave = 0; wave < NUM_WAVES; ++wave)
+    {
+        RunWave(wave);
+
+        // Whatever is left over was handed off by a thread that has
+        // since exited.
+
+        while (!exchange.empty())
+        {
+            FreeBlock(&exchange.back());
+            exchange.pop_back();
+        }
+
+        Z_CheckHeap();
+        Z_FreeTags(PU_LEVEL, PU_CACHE);
+    }
+
+    T_Check(bad_blocks == 0);
+
+    return T_Finish("test_zone");
+}
@@ -46,6 +46,10 @@ static int loading_disk_yoffs = 0;
 
 // Number of bytes read since the last call to V_DrawDiskIcon().
 static size_t recent_bytes_read = 0;
+
+// Number of writes in progress.  The disk stays up until they are all
+// done.
+static int pending_writes = 0;
 static boolean disk_drawn;
 
 static void CopyRegion(byte *dest, int dest_pitch,
@@ -107,6 +111,19 @@ void V_BeginRead(size_t nbytes)
     recent_bytes_read += nbytes;
 }
 
+// Call these around a write that happens in the background.  Both must
+// be called from the game thread.
+
+void V_BeginWrite(void)
+{
+    ++pending_writes;
+}
+
+void V_EndWrite(void)
+{
+    --pending_writes;
+}
+
 static byte *DiskRegionPointer(void)
 {
     return I_VideoBuffer
@@ -116,7 +133,8 @@ static byte *DiskRegionPointer(void)
 
 void V_DrawDiskIcon(void)
 {
-    if (disk_data != NULL && recent_bytes_read > diskicon_threshold)
+    if (disk_data != NULL
+     && (recent_bytes_read > diskicon_threshold || pending_writes > 0))
     {
         // Save the background behind the disk before we draw it.
         CopyRegion(saved_background, LOADING_DISK_W,
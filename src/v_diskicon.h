@@ -29,6 +29,8 @@ namespace theta
 
 extern void V_EnableLoadingDisk(const char *lump_name, int xoffs, int yoffs);
 extern void V_BeginRead(size_t nbytes);
+extern void V_BeginWrite(void);
+extern void V_EndWrite(void);
 extern void V_DrawDiskIcon(void);
 extern void V_RestoreDiskBackground(void);
 
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "i_system.h"
 #include "m_misc.h"
@@ -89,4 +90,39 @@ void W_Checksum(sha1_digest_t digest)
     SHA1_Final(digest, &sha1_context);
 }
 
+// Checksum of the WAD files themselves, as well as their directory:
+// the path, size and modification time of each file are added in
+// too, so that it changes when a WAD is edited in place.  Used to key
+// caches of data worked out from the WADs.
+
+void W_FilesChecksum(sha1_digest_t digest)
+{
+    sha1_context_t sha1_context;
+    sha1_digest_t directory;
+    struct stat st;
+    int i;
+
+    W_Checksum(directory);
+
+    SHA1_Init(&sha1_context);
+    SHA1_Update(&sha1_context, directory, sizeof(directory));
+
+    // W_Checksum has just listed every file with lumps in it.
+
+    for (i = 0; i < num_open_wadfiles; ++i)
+    {
+        const char *path = open_wadfiles[i]->path;
+
+        SHA1_Update(&sha1_context, (byte *) path, strlen(path));
+        SHA1_UpdateInt32(&sha1_context, open_wadfiles[i]->length);
+
+        if (stat(path, &st) == 0)
+        {
+            SHA1_UpdateInt32(&sha1_context, (unsigned int) st.st_mtime);
+        }
+    }
+
+    SHA1_Final(digest, &sha1_context);
+}
+
 }
@@ -25,6 +25,7 @@ namespace theta
 {
 
 extern void W_Checksum(sha1_digest_t digest);
+extern void W_FilesChecksum(sha1_digest_t digest);
 
 }
 
@@ -54,12 +54,19 @@ wad_file_t *W_OpenFile(char *path)
     wad_file_t *result;
     int i;
 
+    // WAD files are mapped directly into memory with the OS's virtual
+    // memory subsystem where it is available, so that lumps are read
+    // from the mapping instead of being copied into the zone.  This
+    // used to be turned on with -mmap, which is still accepted but
+    // does nothing now that it is the default.
+
     //!
-    // Use the OS's virtual memory subsystem to map WAD files
-    // directly into memory.
+    // Don't map WAD files into memory; read lumps into the zone
+    // instead.  WAD files are mapped by default, so -mmap is no
+    // longer needed.
     //
 
-    if (!M_CheckParm("-mmap"))
+    if (M_CheckParm("-nommap"))
     {
         return stdc_wad_file.OpenFile(path);
     }
@@ -92,4 +99,12 @@ size_t W_Read(wad_file_t *wad, unsigned int offset,
     return wad->file_class->Read(wad, offset, buffer, buffer_len);
 }
 
+void W_Prefetch(wad_file_t *wad, unsigned int offset, size_t len)
+{
+    if (wad->file_class->Prefetch != NULL)
+    {
+        wad->file_class->Prefetch(wad, offset, len);
+    }
+}
+
 }
@@ -40,6 +40,10 @@ typedef struct
     // provided buffer.  Returns the number of bytes read.
     size_t (*Read)(wad_file_t *file, unsigned int offset,
                    void *buffer, size_t buffer_len);
+
+    // Hint that the given range of the file will be read soon.  May
+    // be NULL.
+    void (*Prefetch)(wad_file_t *file, unsigned int offset, size_t len);
 } wad_file_class_t;
 
 struct _wad_file_s
@@ -48,7 +52,8 @@ struct _wad_file_s
     wad_file_class_t *file_class;
 
     // If this is NULL, the file cannot be mapped into memory.  If this
-    // is non-NULL, it is a pointer to the mapped file.
+    // is non-NULL, it is a pointer to the mapped file, which is
+    // read-only.
     byte *mapped;
 
     // Length of the file, in bytes.
@@ -74,6 +79,9 @@ void W_CloseFile(wad_file_t *wad);
 size_t W_Read(wad_file_t *wad, unsigned int offset,
               void *buffer, size_t buffer_len);
 
+
+void W_Prefetch(wad_file_t *wad, unsigned int offset, size_t len);
+
 }
 
 #endif /* #ifndef __W_FILE__ */
@@ -44,32 +44,30 @@ extern wad_file_class_t posix_wad_file;
 static void MapFile(posix_wad_file_t *wad, char *filename)
 {
     void *result;
-    int protection;
-    int flags;
 
-    // Mapped area can be read and written to.  Ideally
-    // this should be read-only, as none of the Doom code should 
-    // change the WAD files after being read.  However, there may
-    // be code lurking in the source that does.
+    wad->wad.mapped = NULL;
 
-    protection = PROT_READ|PROT_WRITE;
+    // mmap() refuses to map nothing.
 
-    // Writes to the mapped area result in private changes that are
-    // *not* written to disk.
+    if (wad->wad.length == 0)
+    {
+        return;
+    }
 
-    flags = MAP_PRIVATE;
+    // Mapped area is read-only.  Nothing in the game writes to lump
+    // data it gets back from W_CacheLumpNum.
 
-    result = mmap(NULL, wad->wad.length,
-                  protection, flags, 
+    result = mmap(NULL, wad->wad.length, PROT_READ, MAP_SHARED,
                   wad->handle, 0);
 
-    wad->wad.mapped = result;
-
-    if (result == NULL)
+    if (result == MAP_FAILED)
     {
         fprintf(stderr, "W_POSIX_OpenFile: Unable to mmap() %s - %s\n",
                         filename, strerror(errno));
+        return;
     }
+
+    wad->wad.mapped = static_cast<byte*>(result);
 }
 
 unsigned int GetFileLength(int handle)
@@ -82,7 +80,7 @@ static wad_file_t *W_POSIX_OpenFile(char *path)
     posix_wad_file_t *result;
     int handle;
 
-    handle = open(path, 0);
+    handle = open(path, O_RDONLY);
 
     if (handle < 0)
     {
@@ -91,7 +89,7 @@ static wad_file_t *W_POSIX_OpenFile(char *path)
 
     // Create a new posix_wad_file_t to hold the file handle.
 
-    result = Z_Malloc(sizeof(posix_wad_file_t), PU_STATIC, 0);
+    result = static_cast<posix_wad_file_t*>(Z_Malloc(sizeof(posix_wad_file_t), PU_STATIC, 0));
     result->wad.file_class = &posix_wad_file;
     result->wad.length = GetFileLength(handle);
     result->wad.path = M_StringDuplicate(path);
@@ -112,14 +110,49 @@ static void W_POSIX_CloseFile(wad_file_t *wad)
 
     // If mapped, unmap it.
 
+    if (posix_wad->wad.mapped != NULL)
+    {
+        munmap(posix_wad->wad.mapped, posix_wad->wad.length);
+    }
+
     // Close the file
   
     close(posix_wad->handle);
     Z_Free(posix_wad);
 }
 
+// Hint that part of the file is about to be needed, so that the
+// kernel can start paging it in.
+
+static void W_POSIX_Prefetch(wad_file_t *wad, unsigned int offset,
+                             size_t len)
+{
+#ifdef MADV_WILLNEED
+    long pagesize;
+    unsigned int start;
+
+    if (wad->mapped == NULL || offset >= wad->length)
+    {
+        return;
+    }
+
+    if (len > wad->length - offset)
+    {
+        len = wad->length - offset;
+    }
+
+    // madvise() wants a page aligned address.
+
+    pagesize = sysconf(_SC_PAGESIZE);
+    start = offset - offset % pagesize;
+
+    madvise(wad->mapped + start, len + (offset - start), MADV_WILLNEED);
+#endif
+}
+
 // Read data from the specified position in the file into the 
-// provided buffer.  Returns the number of bytes read.
+// provided buffer.  Returns the number of bytes read.  Reads are
+// positional, so this is safe to call from more than one thread.
 
 size_t W_POSIX_Read(wad_file_t *wad, unsigned int offset,
                    void *buffer, size_t buffer_len)
@@ -127,23 +160,24 @@ size_t W_POSIX_Read(wad_file_t *wad, unsigned int offset,
     posix_wad_file_t *posix_wad;
     byte *byte_buffer;
     size_t bytes_read;
-    int result;
+    ssize_t result;
 
     posix_wad = (posix_wad_file_t *) wad;
 
-    // Jump to the specified position in the file.
-
-    lseek(posix_wad->handle, offset, SEEK_SET);
-
     // Read into the buffer.
 
     bytes_read = 0;
-    byte_buffer = buffer;
+    byte_buffer = static_cast<byte*>(buffer);
 
     while (buffer_len > 0) {
-        result = read(posix_wad->handle, byte_buffer, buffer_len);
+        result = pread(posix_wad->handle, byte_buffer, buffer_len,
+                       offset + bytes_read);
 
         if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
             perror("W_POSIX_Read");
             break;
         } else if (result == 0) {
@@ -166,6 +200,7 @@ wad_file_class_t posix_wad_file =
     W_POSIX_OpenFile,
     W_POSIX_CloseFile,
     W_POSIX_Read,
+    W_POSIX_Prefetch,
 };
 
 }
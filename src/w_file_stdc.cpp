@@ -18,6 +18,8 @@
 
 #include <stdio.h>
 
+#include <mutex>
+
 #include "m_misc.h"
 #include "w_file.h"
 #include "z_zone.h"
@@ -33,6 +35,11 @@ typedef struct
 
 extern wad_file_class_t stdc_wad_file;
 
+// stdio streams have a single file position, so reads are done one
+// at a time to keep them safe to make from more than one thread.
+
+static std::mutex stdc_read_mutex;
+
 static wad_file_t *W_StdC_OpenFile(char *path)
 {
     stdc_wad_file_t *result;
@@ -78,6 +85,8 @@ size_t W_StdC_Read(wad_file_t *wad, unsigned int offset,
 
     stdc_wad = (stdc_wad_file_t *) wad;
 
+    std::lock_guard<std::mutex> lock(stdc_read_mutex);
+
     // Jump to the specified position in the file.
 
     fseek(stdc_wad->fstream, offset, SEEK_SET);
@@ -95,6 +104,7 @@ wad_file_class_t stdc_wad_file =
     W_StdC_OpenFile,
     W_StdC_CloseFile,
     W_StdC_Read,
+    NULL,
 };
 
 }
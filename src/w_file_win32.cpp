@@ -21,6 +21,7 @@
 #ifdef _WIN32
 
 #include <stdio.h>
+#include <string.h>
 
 #include <windows.h>
 
@@ -51,7 +52,7 @@ static void MapFile(win32_wad_file_t *wad, char *filename)
 {
     wad->handle_map = CreateFileMapping(wad->handle,
                                         NULL,
-                                        PAGE_WRITECOPY,
+                                        PAGE_READONLY,
                                         0,
                                         0,
                                         NULL);
@@ -64,7 +65,7 @@ static void MapFile(win32_wad_file_t *wad, char *filename)
     }
 
     wad->wad.mapped = static_cast<byte*>(MapViewOfFile(wad->handle_map,
-                                    FILE_MAP_COPY,
+                                    FILE_MAP_READ,
                                     0, 0, 0));
 
     if (wad->wad.mapped == NULL)
@@ -157,31 +158,32 @@ static void W_Win32_CloseFile(wad_file_t *wad)
 }
 
 // Read data from the specified position in the file into the 
-// provided buffer.  Returns the number of bytes read.
+// provided buffer.  Returns the number of bytes read.  The position
+// is passed in with the read, so this is safe to call from more than
+// one thread.
 
 size_t W_Win32_Read(wad_file_t *wad, unsigned int offset,
                    void *buffer, size_t buffer_len)
 {
     win32_wad_file_t *win32_wad;
+    OVERLAPPED overlapped;
     DWORD bytes_read;
-    DWORD result;
 
     win32_wad = (win32_wad_file_t *) wad;
 
-    // Jump to the specified position in the file.
-
-    result = SetFilePointer(win32_wad->handle, offset, NULL, FILE_BEGIN);
-
-    if (result == INVALID_SET_FILE_POINTER)
-    {
-        I_Error("W_Win32_Read: Failed to set file pointer to %i",
-                offset);
-    }
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = offset;
 
     // Read into the buffer.
 
-    if (!ReadFile(win32_wad->handle, buffer, buffer_len, &bytes_read, NULL))
+    if (!ReadFile(win32_wad->handle, buffer, buffer_len, &bytes_read,
+                  &overlapped))
     {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+        {
+            return 0;
+        }
+
         I_Error("W_Win32_Read: Error reading from file");
     }
 
@@ -194,6 +196,7 @@ wad_file_class_t win32_wad_file =
     W_Win32_OpenFile,
     W_Win32_CloseFile,
     W_Win32_Read,
+    NULL,
 };
 
 }
@@ -600,6 +600,10 @@ void W_MergeFile(char *filename)
     // Perform the merge
 
     DoMerge();
+
+    // The lump directory has been rearranged under the hash table.
+
+    W_GenerateHashTable();
 }
 
 // Replace lumps in the given list with lumps from the PWAD
@@ -667,6 +671,8 @@ void W_NWTMergeFile(char *filename, int flags)
     // Discard the PWAD
 
     numlumps = old_numlumps;
+
+    W_GenerateHashTable();
 }
 
 // Simulates the NWT -merge command line parameter.  What this does is load
@@ -720,6 +726,8 @@ void W_NWTDashMerge(char *filename)
 
     numlumps = old_numlumps;
 
+    W_GenerateHashTable();
+
     W_CloseFile(wad_file);
 }
 
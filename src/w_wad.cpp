@@ -24,10 +24,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "doomtype.h"
 
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_thread.h"
 #include "i_video.h"
 #include "m_misc.h"
 #include "v_diskicon.h"
@@ -62,8 +68,11 @@ typedef PACKED_STRUCT (
 lumpinfo_t **lumpinfo;
 unsigned int numlumps = 0;
 
-// Hash table for fast lookups
+// Hash table for fast lookups.  Open addressing with linear probing,
+// holding the index of the last lump with each name; its size is
+// always a power of two at least twice numlumps.
 static lumpindex_t *lumphash;
+static unsigned int lumphash_size;
 
 // Variables for the reload hack: filename of the PWAD to reload, and the
 // lumps from WADs before the reload file, so we can resent numlumps and
@@ -73,6 +82,24 @@ static lumpinfo_t *reloadlumps = NULL;
 static char *reloadname = NULL;
 static int reloadlump = -1;
 
+// Lumps being read ahead of time by W_PrefetchLump, from WADs that
+// aren't memory-mapped.  The reads happen on a few I/O threads into
+// buffers of their own, since the zone can only be touched from the
+// main thread; W_ReadLump picks them up from here.
+
+#define PREFETCH_THREADS 4
+
+typedef struct
+{
+    std::vector<byte> data;
+    boolean done;
+    boolean ok;
+} prefetch_t;
+
+static std::mutex prefetch_mutex;
+static std::condition_variable prefetch_done;
+static std::unordered_map<lumpindex_t, prefetch_t> prefetched;
+
 // Hash function used for lump names.
 unsigned int W_LumpNameHash(const char *s)
 {
@@ -90,6 +117,63 @@ unsigned int W_LumpNameHash(const char *s)
     return result;
 }
 
+// Pack a lump name, up to 8 characters, into an integer key.  Letters
+// are uppercased, so two names compare equal ignoring case exactly
+// when their keys do.
+uint64_t W_LumpNameKey(const char *s)
+{
+    uint64_t result = 0;
+    unsigned int i;
+
+    for (i=0; i < 8 && s[i] != '\0'; ++i)
+    {
+        result |= (uint64_t) toupper((unsigned char) s[i]) << (i * 8);
+    }
+
+    return result;
+}
+
+// Slot in lumphash to start looking for a key from.
+static unsigned int LumpKeySlot(uint64_t key)
+{
+    // Fibonacci hashing spreads the bits of the name across the
+    // whole key before taking the top ones.
+
+    return (unsigned int) ((key * 0x9e3779b97f4a7c15ull) >> 32)
+         & (lumphash_size - 1);
+}
+
+// Add a lump to the hash table.  A later lump with the same name
+// as an earlier one replaces it, so that PWADs take precedence.
+static void HashLump(lumpindex_t i)
+{
+    uint64_t key;
+    unsigned int slot;
+    lumpindex_t j;
+
+    key = lumpinfo[i]->key;
+
+    for (slot = LumpKeySlot(key); ; slot = (slot + 1) & (lumphash_size - 1))
+    {
+        j = lumphash[slot];
+
+        if (j == -1)
+        {
+            lumphash[slot] = i;
+            return;
+        }
+
+        if (lumpinfo[j]->key == key)
+        {
+            if (i > j)
+            {
+                lumphash[slot] = i;
+            }
+            return;
+        }
+    }
+}
+
 //
 // LUMP BASED ROUTINES.
 //
@@ -220,6 +304,7 @@ wad_file_t *W_AddFile (char *filename)
         lump_p->size = LONG(filerover->size);
         lump_p->cache = NULL;
         strncpy(lump_p->name, filerover->name, 8);
+        lump_p->key = W_LumpNameKey(lump_p->name);
         lumpinfo[i] = lump_p;
 
         ++filerover;
@@ -227,10 +312,18 @@ wad_file_t *W_AddFile (char *filename)
 
     Z_Free(fileinfo);
 
-    if (lumphash != NULL)
+    // Add the new lumps to the hash table, unless it has got too full
+    // and needs to grow.
+    if (lumphash != NULL && numlumps * 2 <= lumphash_size)
     {
-        Z_Free(lumphash);
-        lumphash = NULL;
+        for (i = startlump; i < numlumps; ++i)
+        {
+            HashLump(i);
+        }
+    }
+    else
+    {
+        W_GenerateHashTable();
     }
 
     // If this is the reload file, we need to save some details about the
@@ -264,20 +357,21 @@ int W_NumLumps (void)
 lumpindex_t W_CheckNumForName(const char* name)
 {
     lumpindex_t i;
+    uint64_t key;
+    unsigned int slot;
+
+    key = W_LumpNameKey(name);
 
     // Do we have a hash table yet?
 
     if (lumphash != NULL)
     {
-        int hash;
-
         // We do! Excellent.
 
-        hash = W_LumpNameHash(name) % numlumps;
-
-        for (i = lumphash[hash]; i != -1; i = lumpinfo[i]->next)
+        for (slot = LumpKeySlot(key); (i = lumphash[slot]) != -1;
+             slot = (slot + 1) & (lumphash_size - 1))
         {
-            if (!strncasecmp(lumpinfo[i]->name, name, 8))
+            if (lumpinfo[i]->key == key)
             {
                 return i;
             }
@@ -291,7 +385,7 @@ lumpindex_t W_CheckNumForName(const char* name)
 
         for (i = numlumps - 1; i >= 0; --i)
         {
-            if (!strncasecmp(lumpinfo[i]->name, name, 8))
+            if (lumpinfo[i]->key == key)
             {
                 return i;
             }
@@ -341,6 +435,35 @@ int W_LumpLength(lumpindex_t lump)
 
 
 
+//
+// ReadPrefetched
+// If the lump has been prefetched, wait for the read to finish and
+// copy it into dest.  Returns false if it wasn't, or the read failed.
+//
+static boolean ReadPrefetched(lumpindex_t lump, void *dest)
+{
+    std::unique_lock<std::mutex> lock(prefetch_mutex);
+    auto it = prefetched.find(lump);
+
+    if (it == prefetched.end())
+    {
+        return false;
+    }
+
+    prefetch_t *p = &it->second;
+    prefetch_done.wait(lock, [&] { return p->done; });
+
+    boolean ok = p->ok;
+    if (ok)
+    {
+        memcpy(dest, p->data.data(), p->data.size());
+    }
+
+    prefetched.erase(it);
+
+    return ok;
+}
+
 //
 // W_ReadLump
 // Loads the lump into the given buffer,
@@ -360,6 +483,11 @@ void W_ReadLump(lumpindex_t lump, void *dest)
 
     V_BeginRead(l->size);
 
+    if (ReadPrefetched(lump, dest))
+    {
+        return;
+    }
+
     c = W_Read(l->wad_file, l->position, dest, l->size);
 
     if (c < l->size)
@@ -472,6 +600,102 @@ void W_ReleaseLumpName(const char *name)
     W_ReleaseLumpNum(W_GetNumForName(name));
 }
 
+// The I/O threads are only started by the first lump that has to be
+// read, so a game that only ever loads mapped WADs never has them.
+
+static thread::TaskQueue *PrefetchThreads(void)
+{
+    static thread::TaskQueue io_threads(PREFETCH_THREADS);
+
+    return &io_threads;
+}
+
+//
+// W_PrefetchLump
+//
+// Start reading a lump in ahead of time.  For memory-mapped WADs this
+// is a hint to the OS to page it in; otherwise the lump is read on an
+// I/O thread, and the next W_ReadLump of it waits for that read to
+// finish rather than starting its own.
+//
+
+void W_PrefetchLump(lumpindex_t lumpnum)
+{
+    lumpinfo_t *lump;
+    prefetch_t *p;
+
+    if ((unsigned)lumpnum >= numlumps)
+    {
+	I_Error ("W_PrefetchLump: %i >= numlumps", lumpnum);
+    }
+
+    lump = lumpinfo[lumpnum];
+
+    if (lump->wad_file->mapped != NULL)
+    {
+        W_Prefetch(lump->wad_file, lump->position, lump->size);
+        return;
+    }
+
+    if (lump->cache != NULL || lump->size <= 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(prefetch_mutex);
+
+        if (prefetched.count(lumpnum) != 0)
+        {
+            return;
+        }
+
+        p = &prefetched[lumpnum];
+        p->done = false;
+        p->ok = false;
+    }
+
+    wad_file_t *wad_file = lump->wad_file;
+    unsigned int position = lump->position;
+    size_t size = lump->size;
+
+    PrefetchThreads()->Push([p, wad_file, position, size] {
+        std::vector<byte> data(size);
+        boolean ok = W_Read(wad_file, position, data.data(), size) == size;
+
+        std::lock_guard<std::mutex> lock(prefetch_mutex);
+        p->data = std::move(data);
+        p->ok = ok;
+        p->done = true;
+        prefetch_done.notify_all();
+    });
+}
+
+//
+// W_DropPrefetchedLumps
+//
+// Wait for any prefetches still in flight and throw away whatever
+// nobody has read yet.
+//
+
+void W_DropPrefetchedLumps(void)
+{
+    std::unique_lock<std::mutex> lock(prefetch_mutex);
+
+    prefetch_done.wait(lock, [] {
+        for (const auto& entry : prefetched)
+        {
+            if (!entry.second.done)
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    prefetched.clear();
+}
+
 #if 0
 
 //
@@ -538,38 +762,42 @@ void W_Profile (void)
 
 #endif
 
-// Generate a hash table for fast lookups
+// Generate a hash table for fast lookups.  W_AddFile keeps it up to
+// date as files are added; anything else that changes the lump
+// directory must call this again.
 
 void W_GenerateHashTable(void)
 {
     lumpindex_t i;
+    unsigned int j;
 
     // Free the old hash table, if there is one:
     if (lumphash != NULL)
     {
         Z_Free(lumphash);
+        lumphash = NULL;
+        lumphash_size = 0;
     }
 
     // Generate hash table
     if (numlumps > 0)
     {
-        lumphash = static_cast<lumpindex_t*>(Z_Malloc(sizeof(lumpindex_t) * numlumps, PU_STATIC, NULL));
+        for (lumphash_size = 16; lumphash_size < numlumps * 2; lumphash_size <<= 1);
 
-        for (i = 0; i < numlumps; ++i)
+        lumphash = static_cast<lumpindex_t*>(Z_Malloc(sizeof(lumpindex_t) * lumphash_size, PU_STATIC, NULL));
+
+        for (j = 0; j < lumphash_size; ++j)
         {
-            lumphash[i] = -1;
+            lumphash[j] = -1;
         }
 
         for (i = 0; i < numlumps; ++i)
         {
-            unsigned int hash;
+            // Names may have been changed since the lump was added.
 
-            hash = W_LumpNameHash(lumpinfo[i]->name) % numlumps;
+            lumpinfo[i]->key = W_LumpNameKey(lumpinfo[i]->name);
 
-            // Hook into the hash table
-
-            lumpinfo[i]->next = lumphash[hash];
-            lumphash[hash] = i;
+            HashLump(i);
         }
     }
 
@@ -592,6 +820,9 @@ void W_Reload(void)
         return;
     }
 
+    // Prefetches may still be reading from the file we're about to close.
+    W_DropPrefetchedLumps();
+
     // We must free any lumps being cached from the PWAD we're about to reload:
     for (i = reloadlump; i < numlumps; ++i)
     {
@@ -604,6 +835,15 @@ void W_Reload(void)
     // Reset numlumps to remove the reload WAD file:
     numlumps = reloadlump;
 
+    // The hash table still points at its lumps, so W_AddFile has to
+    // build a fresh one:
+    if (lumphash != NULL)
+    {
+        Z_Free(lumphash);
+        lumphash = NULL;
+        lumphash_size = 0;
+    }
+
     // Now reload the WAD file.
     filename = reloadname;
 
@@ -615,10 +855,6 @@ void W_Reload(void)
     reloadhandle = NULL;
     W_AddFile(filename);
     free(filename);
-
-    // The WAD directory has changed, so we have to regenerate the
-    // fast lookup hashtable:
-    W_GenerateHashTable();
 }
 
 }
@@ -20,10 +20,14 @@
 #ifndef __W_WAD__
 #define __W_WAD__
 
+#include <stdint.h>
 #include <stdio.h>
 
+#include <gsl/span>
+
 #include "doomtype.h"
 #include "w_file.h"
+#include "z_zone.h"
 
 namespace theta
 {
@@ -47,8 +51,8 @@ struct lumpinfo_s
     int		size;
     void       *cache;
 
-    // Used for hash table lookups
-    lumpindex_t next;
+    // Name as an uppercase key, used for hash table lookups
+    uint64_t	key;
 };
 
 
@@ -70,10 +74,97 @@ void *W_CacheLumpName(const char *name, int tag);
 void W_GenerateHashTable(void);
 
 extern unsigned int W_LumpNameHash(const char *s);
+extern uint64_t W_LumpNameKey(const char *s);
 
 void W_ReleaseLumpNum(lumpindex_t lump);
 void W_ReleaseLumpName(const char *name);
 
+void W_PrefetchLump(lumpindex_t lump);
+void W_DropPrefetchedLumps(void);
+
+//
+// A read-only, typed view of a lump.  For memory-mapped WADs this
+// points straight into the mapping, so nothing is copied; otherwise
+// it holds the lump in the zone cache.  The lump is released when the
+// view goes away.  A view of lump -1 is empty.
+//
+template <typename T>
+class LumpView
+{
+    lumpindex_t lump;
+    const byte *base;
+    size_t length;
+public:
+    explicit LumpView(lumpindex_t lump) : lump(lump), base(nullptr), length(0)
+    {
+        if (lump >= 0)
+        {
+            this->base = static_cast<const byte*>(W_CacheLumpNum(lump, PU_STATIC));
+            this->length = W_LumpLength(lump);
+        }
+    }
+
+    ~LumpView()
+    {
+        if (this->lump >= 0)
+        {
+            W_ReleaseLumpNum(this->lump);
+        }
+    }
+
+    LumpView(const LumpView&) = delete;
+    LumpView& operator=(const LumpView&) = delete;
+
+    // Number of whole records of type T in the lump.
+    size_t Size() const
+    {
+        return this->length / sizeof(T);
+    }
+
+    size_t Bytes() const
+    {
+        return this->length;
+    }
+
+    const T *Data() const
+    {
+        return reinterpret_cast<const T*>(this->base);
+    }
+
+    const T& operator[](size_t i) const
+    {
+        return this->Data()[i];
+    }
+
+    const T *begin() const
+    {
+        return this->Data();
+    }
+
+    const T *end() const
+    {
+        return this->Data() + this->Size();
+    }
+
+    gsl::span<const T> Span() const
+    {
+        return gsl::span<const T>(this->Data(), this->Size());
+    }
+
+    // A record of some other type at a byte offset into the lump, or
+    // nullptr if it would run off the end.
+    template <typename U>
+    const U *At(size_t offset) const
+    {
+        if (offset > this->length || sizeof(U) > this->length - offset)
+        {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const U*>(this->base + offset);
+    }
+};
+
 }
 
 #endif
@@ -23,6 +23,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <mutex>
+
+#include "z_stats.h"
 #include "z_zone.h"
 #include "i_system.h"
 #include "doomtype.h"
@@ -39,6 +42,7 @@ struct memblock_s
     int id; // = ZONEID
     int tag;
     int size;
+    int site; // where it was allocated, for z_stats
     void **user;
     memblock_t *prev;
     memblock_t *next;
@@ -48,6 +52,11 @@ struct memblock_s
  
 static memblock_t *allocated_blocks[PU_NUM_TAGS];
 
+// Held by every entry point, since blocks may be allocated and freed
+// from any thread.  Recursive so that an I_Error raised while it is
+// held can still free blocks on the way out.
+static std::recursive_mutex zone_mutex;
+
 #ifdef TESTING
 
 static int test_malloced = 0;
@@ -139,6 +148,7 @@ void Z_Init (void)
 //
 void Z_Free (void* ptr)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*		block;
 
     block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
@@ -155,6 +165,7 @@ void Z_Free (void* ptr)
         *block->user = NULL;
     }
 
+    Z_StatsFree(block->site, block->tag, block->size);
     Z_RemoveBlock(block);
 
     // Free back to system
@@ -209,6 +220,7 @@ static boolean ClearCache(int size)
 
         next_block = block->prev;
 
+        Z_StatsFree(block->site, block->tag, block->size);
         Z_RemoveBlock(block);
 
         remaining -= block->size;
@@ -231,8 +243,9 @@ static boolean ClearCache(int size)
 // You can pass a NULL user if the tag is < PU_PURGELEVEL.
 //
 
-void *Z_Malloc(int size, int tag, void *user)
+void *Z_Malloc2(int size, int tag, void *user, const char *file, int line)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t *newblock;
     unsigned char *data;
     void *result;
@@ -272,6 +285,7 @@ void *Z_Malloc(int size, int tag, void *user)
     newblock->id = ZONEID;
     newblock->user = static_cast<void**>(user);
     newblock->size = size;
+    newblock->site = Z_StatsAlloc(tag, size, file, line);
 
     Z_InsertBlock(newblock);
 
@@ -294,6 +308,7 @@ void *Z_Malloc(int size, int tag, void *user)
 
 void Z_FreeTags(int lowtag, int hightag)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     int i;
 
     for (i=lowtag; i<= hightag; ++i)
@@ -324,6 +339,7 @@ void Z_FreeTags(int lowtag, int hightag)
 	// This chain is empty now
 
 	allocated_blocks[i] = NULL;
+        Z_StatsFreeTag(i);
     }
 }
 
@@ -411,6 +427,7 @@ void Z_FileDumpHeap(FILE *f)
 //
 void Z_CheckHeap (void)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t *block;
     memblock_t *prev;
     int i;
@@ -445,8 +462,9 @@ void Z_CheckHeap (void)
 // Z_ChangeTag
 //
 
-void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
+void Z_ChangeTag2(void *ptr, int tag, const char *file, int line)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*	block;
 	
     block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
@@ -462,6 +480,7 @@ void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
     // Remove the block from its current list, and rehook it into
     // its new list.
 
+    Z_StatsChangeTag(block->site, block->tag, tag, block->size);
     Z_RemoveBlock(block);
     block->tag = tag;
     Z_InsertBlock(block);
@@ -469,6 +488,7 @@ void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
 
 void Z_ChangeUser(void *ptr, void **user)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*	block;
 
     block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
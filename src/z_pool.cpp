@@ -0,0 +1,981 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Zone memory allocation on top of size-class pools.
+//
+//     Small blocks come from slabs carved into fixed size classes and
+//     are recycled through per-thread freelists.  Ownerless PU_LEVEL
+//     and PU_LEVSPEC blocks - thinkers, mobjs, level geometry - are
+//     bump allocated out of a per-tag arena, so freeing a level resets
+//     the arena instead of walking every block.  Purgable blocks are
+//     kept in least recently used order and evicted once they go over
+//     the cache budget.
+//
+//     Any thread may allocate.  Small blocks are recycled through a
+//     per-thread cache, and the zone lock is only held to splice blocks
+//     in and out of the shared tag lists and arenas.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <mutex>
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "m_argv.h"
+
+#include "z_stats.h"
+#include "z_zone.h"
+
+namespace theta
+{
+
+#define ZONEID	0x1d4a11
+
+// Default budget for purgable blocks, in MiB.
+#define DEFAULT_CACHE_MB 64
+
+// Size of each slab carved up into small blocks, and of each arena chunk.
+#define SLAB_SIZE (256 * 1024)
+#define CHUNK_SIZE (256 * 1024)
+
+#define NUM_SIZE_CLASSES 24
+
+typedef struct memblock_s memblock_t;
+
+// The header is kept 16 byte aligned so that every size class hands
+// out suitably aligned memory.
+struct alignas(16) memblock_s
+{
+    int id; // = ZONEID
+    int tag;
+    int size;
+    int site; // where it was allocated, for z_stats
+    short sizeclass; // -1 if allocated on its own
+    short arena; // -1 if not in an arena
+    void **user;
+    memblock_t *prev;
+    memblock_t *next;
+};
+
+typedef struct arenachunk_s arenachunk_t;
+
+struct alignas(16) arenachunk_s
+{
+    arenachunk_t *next;
+};
+
+typedef struct
+{
+    int tag;
+
+    // Chunks are kept around when the arena is reset, and bump
+    // allocation picks up again from the first one.
+    arenachunk_t *chunks;
+    arenachunk_t *current;
+    byte *pos;
+    byte *end;
+
+    // Blocks freed before the arena is reset.
+    memblock_t *free_blocks[NUM_SIZE_CLASSES];
+
+    // Blocks too big for a size class.
+    memblock_t *large;
+} arena_t;
+
+// Usable bytes in each size class.
+static const int class_sizes[NUM_SIZE_CLASSES] =
+{
+    16,   32,   48,   64,   80,   96,   112,  128,
+    144,  160,  176,  192,  208,  224,  240,  256,
+    384,  512,  768,  1024, 1536, 2048, 3072, 4096,
+};
+
+// Linked list of allocated blocks for each tag type.  Purgable lists
+// are kept most recently used first.
+static memblock_t *allocated_blocks[PU_NUM_TAGS];
+static memblock_t *allocated_tail[PU_NUM_TAGS];
+
+// Past this many blocks of a size class in a thread's cache, freed
+// blocks go back to the shared depot so that a thread which frees more
+// than it allocates doesn't hoard them.
+#define THREAD_CACHE_LIMIT 64
+
+class ThreadCache
+{
+public:
+    // Small blocks freed on this thread, ready to be handed out again.
+    memblock_t *free_blocks[NUM_SIZE_CLASSES];
+    int free_count[NUM_SIZE_CLASSES];
+
+    // Slab currently being carved into small blocks.
+    byte *slab_pos;
+    byte *slab_end;
+
+    ThreadCache();
+    ~ThreadCache();
+};
+
+static thread_local ThreadCache thread_cache;
+
+// Small blocks given back by threads with a full cache, or that exited.
+static memblock_t *depot[NUM_SIZE_CLASSES];
+
+// Held while touching anything shared between threads: the tag lists,
+// the depot, the arenas and the cache accounting.  Purging clears an
+// owner's pointer with this held, so an owner shared between threads
+// must keep its block at a non-purgable tag while using it.
+static std::mutex zone_mutex;
+
+static arena_t arenas[] =
+{
+    { PU_LEVEL },
+    { PU_LEVSPEC },
+};
+
+static const int num_arenas = arrlen(arenas);
+
+// Arena index for each tag, or -1.
+static short tag_arena[PU_NUM_TAGS];
+
+// Bytes held by purgable blocks, and how many we are willing to hold.
+static size_t cache_bytes;
+static size_t cache_budget;
+
+static boolean zero_on_free;
+
+static inline boolean IsPurgable(int tag)
+{
+    return tag >= PU_PURGELEVEL;
+}
+
+ThreadCache::ThreadCache() : slab_pos(NULL), slab_end(NULL)
+{
+    memset(this->free_blocks, 0, sizeof(this->free_blocks));
+    memset(this->free_count, 0, sizeof(this->free_count));
+}
+
+// Hand everything in the cache over to the depot when a thread exits.
+ThreadCache::~ThreadCache()
+{
+    std::lock_guard<std::mutex> lock(zone_mutex);
+
+    for (int i = 0; i < NUM_SIZE_CLASSES; ++i)
+    {
+        while (this->free_blocks[i] != NULL)
+        {
+            memblock_t *block = this->free_blocks[i];
+
+            this->free_blocks[i] = block->next;
+            block->next = depot[i];
+            depot[i] = block;
+        }
+    }
+}
+
+// Smallest size class that fits size bytes, or -1.
+
+static int Z_SizeClass(int size)
+{
+    int i;
+
+    if (size <= 256)
+    {
+        return size <= 16 ? 0 : (size - 1) / 16;
+    }
+
+    for (i = 16; i < NUM_SIZE_CLASSES; ++i)
+    {
+        if (size <= class_sizes[i])
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static inline size_t Z_ClassBytes(int sizeclass)
+{
+    return sizeof(memblock_t) + class_sizes[sizeclass];
+}
+
+// Add a block to the front of the linked list for its tag.
+
+static void Z_InsertBlock(memblock_t *block)
+{
+    block->prev = NULL;
+    block->next = allocated_blocks[block->tag];
+    allocated_blocks[block->tag] = block;
+
+    if (block->next != NULL)
+    {
+        block->next->prev = block;
+    }
+    else
+    {
+        allocated_tail[block->tag] = block;
+    }
+
+    if (IsPurgable(block->tag))
+    {
+        cache_bytes += block->size;
+    }
+}
+
+// Remove a block from its linked list.
+
+static void Z_RemoveBlock(memblock_t *block)
+{
+    if (block->prev == NULL)
+    {
+        allocated_blocks[block->tag] = block->next;
+    }
+    else
+    {
+        block->prev->next = block->next;
+    }
+
+    if (block->next == NULL)
+    {
+        allocated_tail[block->tag] = block->prev;
+    }
+    else
+    {
+        block->next->prev = block->prev;
+    }
+
+    if (IsPurgable(block->tag))
+    {
+        cache_bytes -= block->size;
+    }
+}
+
+// Carve a small block off of the current slab, starting a new slab
+// if the current one is used up.  The tail of the old slab is wasted.
+
+static memblock_t *Z_SlabBlock(int sizeclass)
+{
+    ThreadCache &cache = thread_cache;
+    size_t needed = Z_ClassBytes(sizeclass);
+    memblock_t *block;
+
+    if (cache.slab_pos == NULL
+     || static_cast<size_t>(cache.slab_end - cache.slab_pos) < needed)
+    {
+        byte *slab = static_cast<byte *>(malloc(SLAB_SIZE));
+
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+
+        cache.slab_pos = slab;
+        cache.slab_end = slab + SLAB_SIZE;
+    }
+
+    block = reinterpret_cast<memblock_t *>(cache.slab_pos);
+    cache.slab_pos += needed;
+
+    return block;
+}
+
+// Take a small block from this thread's cache.  Needs no lock.
+
+static memblock_t *Z_CachedBlock(int sizeclass)
+{
+    ThreadCache &cache = thread_cache;
+    memblock_t *block = cache.free_blocks[sizeclass];
+
+    if (block != NULL)
+    {
+        cache.free_blocks[sizeclass] = block->next;
+        cache.free_count[sizeclass]--;
+    }
+
+    return block;
+}
+
+// Get storage for a block outside of any arena once the thread cache
+// has come up empty.  Call with the zone lock held.
+
+static memblock_t *Z_PoolBlock(int size, int sizeclass)
+{
+    memblock_t *block;
+
+    if (sizeclass < 0)
+    {
+        return static_cast<memblock_t *>(malloc(sizeof(memblock_t) + size));
+    }
+
+    block = depot[sizeclass];
+
+    if (block != NULL)
+    {
+        depot[sizeclass] = block->next;
+        return block;
+    }
+
+    return Z_SlabBlock(sizeclass);
+}
+
+// Give the storage of a block outside of any arena back.  Call with
+// the zone lock held.
+
+static void Z_ReleasePoolBlock(memblock_t *block)
+{
+    ThreadCache &cache = thread_cache;
+    int sizeclass = block->sizeclass;
+
+    block->id = 0;
+
+    if (sizeclass < 0)
+    {
+        free(block);
+        return;
+    }
+
+    if (cache.free_count[sizeclass] < THREAD_CACHE_LIMIT)
+    {
+        block->next = cache.free_blocks[sizeclass];
+        cache.free_blocks[sizeclass] = block;
+        cache.free_count[sizeclass]++;
+    }
+    else
+    {
+        block->next = depot[sizeclass];
+        depot[sizeclass] = block;
+    }
+}
+
+// Bump allocate bytes out of an arena, moving on to the next chunk
+// when the current one fills up.
+
+static byte *Z_ArenaCarve(arena_t *arena, size_t bytes)
+{
+    byte *result;
+
+    if (arena->current == NULL || static_cast<size_t>(arena->end - arena->pos) < bytes)
+    {
+        arenachunk_t *next;
+
+        next = arena->current != NULL ? arena->current->next : arena->chunks;
+
+        if (next == NULL)
+        {
+            next = static_cast<arenachunk_t *>(
+                malloc(sizeof(arenachunk_t) + CHUNK_SIZE));
+
+            if (next == NULL)
+            {
+                return NULL;
+            }
+
+            next->next = NULL;
+
+            if (arena->current != NULL)
+            {
+                arena->current->next = next;
+            }
+            else
+            {
+                arena->chunks = next;
+            }
+        }
+
+        arena->current = next;
+        arena->pos = reinterpret_cast<byte *>(next + 1);
+        arena->end = arena->pos + CHUNK_SIZE;
+    }
+
+    result = arena->pos;
+    arena->pos += bytes;
+
+    return result;
+}
+
+// Get storage for a block in an arena.
+
+static memblock_t *Z_ArenaBlock(arena_t *arena, int size, int sizeclass)
+{
+    memblock_t *block;
+
+    if (sizeclass < 0)
+    {
+        block = static_cast<memblock_t *>(malloc(sizeof(memblock_t) + size));
+
+        if (block != NULL)
+        {
+            block->prev = NULL;
+            block->next = arena->large;
+
+            if (arena->large != NULL)
+            {
+                arena->large->prev = block;
+            }
+
+            arena->large = block;
+        }
+
+        return block;
+    }
+
+    block = arena->free_blocks[sizeclass];
+
+    if (block != NULL)
+    {
+        arena->free_blocks[sizeclass] = block->next;
+        return block;
+    }
+
+    return reinterpret_cast<memblock_t *>(
+        Z_ArenaCarve(arena, Z_ClassBytes(sizeclass)));
+}
+
+// Give the storage of an arena block back to its arena.
+
+static void Z_ReleaseArenaBlock(memblock_t *block)
+{
+    arena_t *arena = &arenas[block->arena];
+
+    block->id = 0;
+
+    if (block->sizeclass < 0)
+    {
+        if (block->prev == NULL)
+        {
+            arena->large = block->next;
+        }
+        else
+        {
+            block->prev->next = block->next;
+        }
+
+        if (block->next != NULL)
+        {
+            block->next->prev = block->prev;
+        }
+
+        free(block);
+        return;
+    }
+
+    block->next = arena->free_blocks[block->sizeclass];
+    arena->free_blocks[block->sizeclass] = block;
+}
+
+// Throw away everything allocated out of an arena in one go.  Chunks
+// are kept for the next level.
+
+static void Z_ResetArena(arena_t *arena)
+{
+    memblock_t *block;
+    memblock_t *next;
+
+    for (block = arena->large; block != NULL; block = next)
+    {
+        next = block->next;
+        free(block);
+    }
+
+    arena->large = NULL;
+    arena->current = NULL;
+    arena->pos = arena->end = NULL;
+    memset(arena->free_blocks, 0, sizeof(arena->free_blocks));
+}
+
+// Purge a block, clearing its owner's pointer.
+
+static void Z_PurgeBlock(memblock_t *block)
+{
+    Z_RemoveBlock(block);
+
+    Z_StatsFree(block->site, block->tag, block->size);
+
+    if (block->user != NULL)
+    {
+        *block->user = NULL;
+    }
+
+    Z_ReleasePoolBlock(block);
+}
+
+// Purge least recently used blocks until the cache is holding no more
+// than limit bytes.  PU_CACHE goes before PU_PURGELEVEL.
+//
+// Returns true if any blocks were freed.
+
+static boolean Z_TrimCache(size_t limit)
+{
+    boolean result = false;
+    int tag;
+
+    for (tag = PU_NUM_TAGS - 1; tag >= PU_PURGELEVEL; --tag)
+    {
+        while (cache_bytes > limit && allocated_tail[tag] != NULL)
+        {
+            Z_PurgeBlock(allocated_tail[tag]);
+            result = true;
+        }
+    }
+
+    return result;
+}
+
+//
+// Z_Init
+//
+void Z_Init (void)
+{
+    int i;
+    int p;
+
+    memset(allocated_blocks, 0, sizeof(allocated_blocks));
+    memset(allocated_tail, 0, sizeof(allocated_tail));
+
+    for (i = 0; i < PU_NUM_TAGS; ++i)
+    {
+        tag_arena[i] = -1;
+    }
+
+    for (i = 0; i < num_arenas; ++i)
+    {
+        tag_arena[arenas[i].tag] = i;
+    }
+
+    //!
+    // @arg <mb>
+    //
+    // Specify how much memory cached lumps and other purgable data
+    // may hold on to, in MiB (default 64).  Only used by the pool
+    // zone allocator.
+    //
+
+    p = M_CheckParmWithArgs("-cachemb", 1);
+
+    if (p > 0)
+    {
+        cache_budget = static_cast<size_t>(atoi(myargv[p+1])) * 1024 * 1024;
+    }
+    else
+    {
+        cache_budget = static_cast<size_t>(DEFAULT_CACHE_MB) * 1024 * 1024;
+    }
+
+    // [Deliberately undocumented]
+    // Zone memory debugging flag. If set, memory is zeroed after it is freed
+    // to deliberately break any code that attempts to use it after free.
+    //
+    zero_on_free = M_ParmExists("-zonezero");
+
+    printf("zone memory: Using pool allocator, %u MiB cache budget.\n",
+           static_cast<unsigned int>(cache_budget / (1024 * 1024)));
+}
+
+
+//
+// Z_Free
+//
+void Z_Free (void* ptr)
+{
+    memblock_t*		block;
+
+    block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
+
+    if (block->id != ZONEID)
+    {
+        I_Error ("Z_Free: freed a pointer without ZONEID");
+    }
+
+    if (zero_on_free)
+    {
+        memset(ptr, 0, block->size);
+    }
+
+    std::lock_guard<std::mutex> lock(zone_mutex);
+
+    if (block->user != NULL)
+    {
+        // clear the user's mark
+
+        *block->user = NULL;
+    }
+
+    Z_StatsFree(block->site, block->tag, block->size);
+
+    if (block->arena >= 0)
+    {
+        Z_ReleaseArenaBlock(block);
+    }
+    else
+    {
+        Z_RemoveBlock(block);
+        Z_ReleasePoolBlock(block);
+    }
+}
+
+
+//
+// Z_Malloc
+// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+// Blocks without an owner in an arena tag go into that tag's arena.
+//
+void *Z_Malloc2(int size, int tag, void *user, const char *file, int line)
+{
+    memblock_t *newblock;
+    int sizeclass;
+    int arena;
+    size_t wanted;
+    void *result;
+
+    if (tag < 0 || tag >= PU_NUM_TAGS || tag == PU_FREE)
+    {
+        I_Error("Z_Malloc: attempted to allocate a block with an invalid "
+                "tag: %i", tag);
+    }
+
+    if (user == NULL && IsPurgable(tag))
+    {
+        I_Error ("Z_Malloc: an owner is required for purgable blocks");
+    }
+
+    if (size < 0)
+    {
+        I_Error("Z_Malloc: attempted to allocate %i bytes", size);
+    }
+
+    sizeclass = Z_SizeClass(size);
+    arena = user == NULL ? tag_arena[tag] : -1;
+
+    // Try this thread's cache before taking the lock.
+
+    newblock = NULL;
+
+    if (arena < 0 && sizeclass >= 0)
+    {
+        newblock = Z_CachedBlock(sizeclass);
+    }
+
+    std::unique_lock<std::mutex> lock(zone_mutex);
+
+    // Purgable blocks retagged since the last allocation may have put
+    // the cache over budget; a new purgable block needs room as well.
+
+    wanted = IsPurgable(tag) ? static_cast<size_t>(size) : 0;
+
+    if (cache_bytes + wanted > cache_budget)
+    {
+        Z_TrimCache(cache_budget > wanted ? cache_budget - wanted : 0);
+    }
+
+    while (newblock == NULL)
+    {
+        if (arena >= 0)
+        {
+            newblock = Z_ArenaBlock(&arenas[arena], size, sizeclass);
+        }
+        else
+        {
+            newblock = Z_PoolBlock(size, sizeclass);
+        }
+
+        if (newblock != NULL)
+        {
+            break;
+        }
+
+        // Out of memory; throw away the whole cache and try again.
+
+        if (!Z_TrimCache(0))
+        {
+            lock.unlock();
+            I_Error("Z_Malloc: failed on allocation of %i bytes", size);
+        }
+    }
+
+    newblock->id = ZONEID;
+    newblock->tag = tag;
+    newblock->size = size;
+    newblock->sizeclass = static_cast<short>(sizeclass);
+    newblock->arena = static_cast<short>(arena);
+    newblock->user = static_cast<void **>(user);
+    newblock->site = Z_StatsAlloc(tag, size, file, line);
+
+    if (arena < 0)
+    {
+        Z_InsertBlock(newblock);
+    }
+
+    result = reinterpret_cast<byte *>(newblock) + sizeof(memblock_t);
+
+    if (user != NULL)
+    {
+        *newblock->user = result;
+    }
+
+    return result;
+}
+
+
+//
+// Z_FreeTags
+//
+void Z_FreeTags(int lowtag, int hightag)
+{
+    std::lock_guard<std::mutex> lock(zone_mutex);
+    int i;
+
+    for (i = lowtag; i <= hightag; ++i)
+    {
+        memblock_t *block;
+        memblock_t *next;
+
+        // Blocks with owners are never in an arena, so walk those.
+
+        for (block = allocated_blocks[i]; block != NULL; block = next)
+        {
+            next = block->next;
+
+            if (block->user != NULL)
+            {
+                *block->user = NULL;
+            }
+
+            if (IsPurgable(i))
+            {
+                cache_bytes -= block->size;
+            }
+
+            Z_ReleasePoolBlock(block);
+        }
+
+        allocated_blocks[i] = NULL;
+        allocated_tail[i] = NULL;
+        Z_StatsFreeTag(i);
+
+        // Everything else goes at once.
+
+        if (tag_arena[i] >= 0)
+        {
+            Z_ResetArena(&arenas[tag_arena[i]]);
+        }
+    }
+}
+
+
+//
+// Z_DumpHeap
+//
+void Z_DumpHeap(int lowtag, int hightag)
+{
+    std::lock_guard<std::mutex> lock(zone_mutex);
+    memblock_t *block;
+    int i;
+
+    printf("cache: %u of %u bytes\n",
+           static_cast<unsigned int>(cache_bytes),
+           static_cast<unsigned int>(cache_budget));
+
+    printf("tag range: %i to %i\n", lowtag, hightag);
+
+    for (i = lowtag; i <= hightag; ++i)
+    {
+        if (i < 0 || i >= PU_NUM_TAGS)
+        {
+            continue;
+        }
+
+        zonestat_t stat = Z_TagStats(i);
+
+        printf("tag:%3i    blocks:%7i    bytes:%10u%s\n", i, stat.blocks,
+               static_cast<unsigned int>(stat.bytes),
+               tag_arena[i] >= 0 ? "    (arena)" : "");
+
+        for (block = allocated_blocks[i]; block != NULL; block = block->next)
+        {
+            printf("block:%p    size:%7i    user:%p    tag:%3i\n",
+                   block, block->size, block->user, block->tag);
+        }
+    }
+}
+
+
+//
+// Z_FileDumpHeap
+//
+void Z_FileDumpHeap(FILE *f)
+{
+    std::lock_guard<std::mutex> lock(zone_mutex);
+    memblock_t *block;
+    int i;
+
+    fprintf(f, "cache: %u of %u bytes\n",
+            static_cast<unsigned int>(cache_bytes),
+            static_cast<unsigned int>(cache_budget));
+
+    for (i = 0; i < PU_NUM_TAGS; ++i)
+    {
+        zonestat_t stat = Z_TagStats(i);
+
+        fprintf(f, "tag:%3i    blocks:%7i    bytes:%10u%s\n", i, stat.blocks,
+                static_cast<unsigned int>(stat.bytes),
+                tag_arena[i] >= 0 ? "    (arena)" : "");
+
+        for (block = allocated_blocks[i]; block != NULL; block = block->next)
+        {
+            fprintf(f, "block:%p    size:%7i    user:%p    tag:%3i\n",
+                    block, block->size, block->user, block->tag);
+        }
+    }
+}
+
+
+// Walk the tag lists, returning what is wrong with them or NULL.
+// Call with the zone lock held.
+
+static const char *Z_CheckLists(void)
+{
+    memblock_t *block;
+    size_t cached;
+    int i;
+
+    cached = 0;
+
+    for (i = 0; i < PU_NUM_TAGS; ++i)
+    {
+        memblock_t *prev = NULL;
+
+        for (block = allocated_blocks[i]; block != NULL; block = block->next)
+        {
+            if (block->id != ZONEID)
+                return "block without a ZONEID";
+
+            if (block->tag != i)
+                return "block on the wrong tag list";
+
+            if (block->prev != prev)
+                return "block doesn't have proper back link";
+
+            if (IsPurgable(i))
+                cached += block->size;
+
+            prev = block;
+        }
+
+        if (allocated_tail[i] != prev)
+            return "tag list has the wrong tail";
+    }
+
+    if (cached != cache_bytes)
+        return "cache size is out of step";
+
+    return NULL;
+}
+
+//
+// Z_CheckHeap
+//
+void Z_CheckHeap (void)
+{
+    const char *error;
+
+    {
+        std::lock_guard<std::mutex> lock(zone_mutex);
+        error = Z_CheckLists();
+    }
+
+    if (error != NULL)
+        I_Error ("Z_CheckHeap: %s\n", error);
+}
+
+
+//
+// Z_ChangeTag
+//
+void Z_ChangeTag2(void *ptr, int tag, const char *file, int line)
+{
+    memblock_t*	block;
+
+    block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
+
+    if (block->id != ZONEID)
+        I_Error("%s:%i: Z_ChangeTag: block without a ZONEID!",
+                file, line);
+
+    if (tag >= PU_PURGELEVEL && block->user == NULL)
+        I_Error("%s:%i: Z_ChangeTag: an owner is required "
+                "for purgable blocks", file, line);
+
+    if (block->arena >= 0)
+    {
+        // Arena blocks live and die with their arena.
+
+        if (tag != block->tag)
+            I_Error("%s:%i: Z_ChangeTag: can't retag an ownerless "
+                    "level block", file, line);
+
+        return;
+    }
+
+    // Moving to the front of the list also marks a purgable block as
+    // the most recently used.
+
+    std::lock_guard<std::mutex> lock(zone_mutex);
+
+    Z_RemoveBlock(block);
+    Z_StatsChangeTag(block->site, block->tag, tag, block->size);
+    block->tag = tag;
+    Z_InsertBlock(block);
+}
+
+void Z_ChangeUser(void *ptr, void **user)
+{
+    memblock_t*	block;
+
+    block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
+
+    if (block->id != ZONEID)
+    {
+        I_Error("Z_ChangeUser: Tried to change user for invalid block!");
+    }
+
+    if (block->arena >= 0)
+    {
+        I_Error("Z_ChangeUser: Tried to give an owner to a level block!");
+    }
+
+    std::lock_guard<std::mutex> lock(zone_mutex);
+
+    block->user = user;
+    *user = ptr;
+}
+
+
+//
+// Z_FreeMemory
+//
+int Z_FreeMemory (void)
+{
+    std::lock_guard<std::mutex> lock(zone_mutex);
+
+    return static_cast<int>(cache_bytes);
+}
+
+unsigned int Z_ZoneSize(void)
+{
+    return static_cast<unsigned int>(cache_budget);
+}
+
+}
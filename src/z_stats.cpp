@@ -0,0 +1,402 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Zone memory statistics.  Every zone allocator reports its
+//     allocations, frees and tag changes here, broken down by tag and
+//     by the source line that made the allocation.
+//
+
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include "z_stats.h"
+#include "z_zone.h"
+
+namespace theta
+{
+
+// How much of each new tic goes into the smoothed rates.
+#define RATE_WEIGHT 0.125f
+
+typedef struct
+{
+    zonestat_t stat;
+
+    // Totals as of the last tic, for working out the rates.
+    unsigned int last_allocs;
+    size_t last_alloc_bytes;
+} counter_t;
+
+typedef struct
+{
+    const char *file;
+    int line;
+    counter_t total;
+
+    // Live blocks and bytes under each tag, so that a whole tag can be
+    // dropped without visiting every block.
+    int blocks[PU_NUM_TAGS];
+    size_t bytes[PU_NUM_TAGS];
+} site_t;
+
+struct SiteKey
+{
+    const char *file;
+    int line;
+
+    bool operator==(const SiteKey &other) const
+    {
+        return this->file == other.file && this->line == other.line;
+    }
+};
+
+struct SiteKeyHash
+{
+    size_t operator()(const SiteKey &key) const
+    {
+        return std::hash<const char *>()(key.file) ^
+               (static_cast<size_t>(key.line) * 2654435761u);
+    }
+};
+
+static const char *tag_names[PU_NUM_TAGS] =
+{
+    "none", "static", "sound", "music", "free",
+    "level", "levspec", "purgelevel", "cache",
+};
+
+static counter_t tags[PU_NUM_TAGS];
+static std::vector<site_t> sites;
+
+// __FILE__ is usually, but not always, the same pointer for every
+// allocation in a file, so pointers are only a shortcut to the site.
+static std::unordered_map<SiteKey, int, SiteKeyHash> site_lookup;
+
+static unsigned int tics;
+
+// Allocators may be called from any thread.
+static std::mutex stats_mutex;
+
+static int Z_FindSite(const char *file, int line)
+{
+    SiteKey key = { file, line };
+    auto it = site_lookup.find(key);
+
+    if (it != site_lookup.end())
+    {
+        return it->second;
+    }
+
+    int index = -1;
+
+    for (size_t i = 0; i < sites.size(); ++i)
+    {
+        if (sites[i].line == line && !strcmp(sites[i].file, file))
+        {
+            index = static_cast<int>(i);
+            break;
+        }
+    }
+
+    if (index < 0)
+    {
+        site_t site;
+
+        memset(&site, 0, sizeof(site));
+        site.file = file;
+        site.line = line;
+
+        index = static_cast<int>(sites.size());
+        sites.push_back(site);
+    }
+
+    site_lookup[key] = index;
+
+    return index;
+}
+
+static void Z_CountAlloc(counter_t *counter, size_t size)
+{
+    counter->stat.blocks++;
+    counter->stat.bytes += size;
+    counter->stat.allocs++;
+    counter->stat.alloc_bytes += size;
+
+    if (counter->stat.bytes > counter->stat.peak)
+    {
+        counter->stat.peak = counter->stat.bytes;
+    }
+}
+
+static void Z_CountFree(counter_t *counter, int blocks, size_t size)
+{
+    counter->stat.blocks -= blocks;
+    counter->stat.bytes -= size;
+}
+
+static void Z_UpdateRate(counter_t *counter)
+{
+    zonestat_t *stat = &counter->stat;
+    float allocs = static_cast<float>(stat->allocs - counter->last_allocs);
+    float bytes = static_cast<float>(stat->alloc_bytes - counter->last_alloc_bytes);
+
+    stat->alloc_rate += (allocs - stat->alloc_rate) * RATE_WEIGHT;
+    stat->byte_rate += (bytes - stat->byte_rate) * RATE_WEIGHT;
+
+    counter->last_allocs = stat->allocs;
+    counter->last_alloc_bytes = stat->alloc_bytes;
+}
+
+//
+// Z_StatsAlloc
+// Count a new block, returning the index of its allocation site.
+//
+int Z_StatsAlloc(int tag, size_t size, const char *file, int line)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    int index = Z_FindSite(file, line);
+    site_t *site = &sites[index];
+
+    Z_CountAlloc(&tags[tag], size);
+    Z_CountAlloc(&site->total, size);
+    site->blocks[tag]++;
+    site->bytes[tag] += size;
+
+    return index;
+}
+
+//
+// Z_StatsFree
+//
+void Z_StatsFree(int site, int tag, size_t size)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    Z_CountFree(&tags[tag], 1, size);
+    Z_CountFree(&sites[site].total, 1, size);
+    sites[site].blocks[tag]--;
+    sites[site].bytes[tag] -= size;
+}
+
+//
+// Z_StatsChangeTag
+//
+void Z_StatsChangeTag(int site, int oldtag, int newtag, size_t size)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    Z_CountFree(&tags[oldtag], 1, size);
+    sites[site].blocks[oldtag]--;
+    sites[site].bytes[oldtag] -= size;
+
+    tags[newtag].stat.blocks++;
+    tags[newtag].stat.bytes += size;
+    tags[newtag].stat.peak = std::max(tags[newtag].stat.peak,
+                                      tags[newtag].stat.bytes);
+    sites[site].blocks[newtag]++;
+    sites[site].bytes[newtag] += size;
+}
+
+//
+// Z_StatsFreeTag
+// Every block with the given tag has been freed in one go.
+//
+void Z_StatsFreeTag(int tag)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    for (site_t &site : sites)
+    {
+        Z_CountFree(&site.total, site.blocks[tag], site.bytes[tag]);
+        site.blocks[tag] = 0;
+        site.bytes[tag] = 0;
+    }
+
+    tags[tag].stat.blocks = 0;
+    tags[tag].stat.bytes = 0;
+}
+
+//
+// Z_StatsTic
+// Called once per game tic to update the allocation rates.
+//
+void Z_StatsTic(void)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    for (counter_t &tag : tags)
+    {
+        Z_UpdateRate(&tag);
+    }
+
+    for (site_t &site : sites)
+    {
+        Z_UpdateRate(&site.total);
+    }
+
+    ++tics;
+}
+
+void Z_StatsResetPeaks(void)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    for (counter_t &tag : tags)
+    {
+        tag.stat.peak = tag.stat.bytes;
+    }
+
+    for (site_t &site : sites)
+    {
+        site.total.stat.peak = site.total.stat.bytes;
+    }
+}
+
+const char *Z_TagName(int tag)
+{
+    if (tag < 0 || tag >= PU_NUM_TAGS)
+    {
+        return "unknown";
+    }
+
+    return tag_names[tag];
+}
+
+zonestat_t Z_TagStats(int tag)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    return tags[tag].stat;
+}
+
+//
+// Z_SiteStats
+// Get every allocation site seen so far, most live bytes first.
+//
+std::vector<zonesite_t> Z_SiteStats(void)
+{
+    std::vector<zonesite_t> result;
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+
+        result.reserve(sites.size());
+
+        for (const site_t &site : sites)
+        {
+            zonesite_t entry = { site.file, site.line, site.total.stat };
+            result.push_back(entry);
+        }
+    }
+
+    std::sort(result.begin(), result.end(),
+              [](const zonesite_t &a, const zonesite_t &b) {
+        if (a.stat.bytes != b.stat.bytes)
+        {
+            return a.stat.bytes > b.stat.bytes;
+        }
+        return a.stat.allocs > b.stat.allocs;
+    });
+
+    return result;
+}
+
+static void Z_WriteJSONString(FILE *f, const char *str)
+{
+    fputc('"', f);
+
+    for (; *str != '\0'; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            fputc('\\', f);
+        }
+        fputc(*str, f);
+    }
+
+    fputc('"', f);
+}
+
+static void Z_WriteJSONStat(FILE *f, const zonestat_t *stat)
+{
+    fprintf(f, "\"blocks\": %d, \"bytes\": %zu, \"peak\": %zu, "
+               "\"allocs\": %u, \"alloc_bytes\": %zu, "
+               "\"alloc_rate\": %.2f, \"byte_rate\": %.2f",
+            stat->blocks, stat->bytes, stat->peak, stat->allocs,
+            stat->alloc_bytes, stat->alloc_rate, stat->byte_rate);
+}
+
+//
+// Z_WriteStatsJSON
+// Dump all of the statistics as a JSON object.
+//
+void Z_WriteStatsJSON(FILE *f)
+{
+    std::vector<zonesite_t> allsites = Z_SiteStats();
+    zonestat_t alltags[PU_NUM_TAGS];
+    unsigned int alltics;
+    bool first;
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+
+        for (int i = 0; i < PU_NUM_TAGS; ++i)
+        {
+            alltags[i] = tags[i].stat;
+        }
+        alltics = tics;
+    }
+
+    fprintf(f, "{\n  \"tics\": %u,\n  \"tags\": [", alltics);
+
+    first = true;
+
+    for (int i = PU_STATIC; i < PU_NUM_TAGS; ++i)
+    {
+        if (i == PU_FREE)
+        {
+            continue;
+        }
+
+        fprintf(f, "%s\n    { \"tag\": ", first ? "" : ",");
+        Z_WriteJSONString(f, tag_names[i]);
+        fprintf(f, ", ");
+        Z_WriteJSONStat(f, &alltags[i]);
+        fprintf(f, " }");
+        first = false;
+    }
+
+    fprintf(f, "\n  ],\n  \"sites\": [");
+
+    first = true;
+
+    for (const zonesite_t &site : allsites)
+    {
+        fprintf(f, "%s\n    { \"file\": ", first ? "" : ",");
+        Z_WriteJSONString(f, site.file);
+        fprintf(f, ", \"line\": %d, ", site.line);
+        Z_WriteJSONStat(f, &site.stat);
+        fprintf(f, " }");
+        first = false;
+    }
+
+    fprintf(f, "\n  ]\n}\n");
+}
+
+}
@@ -0,0 +1,67 @@
+//
+// Copyright(C) 2017 Alex Mayfield
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Zone memory statistics.  Every zone allocator reports its
+//     allocations, frees and tag changes here, broken down by tag and
+//     by the source line that made the allocation.
+//
+
+#ifndef __Z_STATS__
+#define __Z_STATS__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <vector>
+
+namespace theta
+{
+
+typedef struct
+{
+    int blocks;             // live blocks
+    size_t bytes;           // live bytes
+    size_t peak;            // most live bytes seen at once
+    unsigned int allocs;    // allocations made so far
+    size_t alloc_bytes;     // bytes allocated so far
+    float alloc_rate;       // allocations per tic, smoothed
+    float byte_rate;        // bytes allocated per tic, smoothed
+} zonestat_t;
+
+typedef struct
+{
+    const char *file;
+    int line;
+    zonestat_t stat;
+} zonesite_t;
+
+// Called by the allocators.  Z_StatsAlloc returns the site index that
+// gets handed back to the others.
+
+int     Z_StatsAlloc (int tag, size_t size, const char *file, int line);
+void    Z_StatsFree (int site, int tag, size_t size);
+void    Z_StatsChangeTag (int site, int oldtag, int newtag, size_t size);
+void    Z_StatsFreeTag (int tag);
+
+void    Z_StatsTic (void);
+void    Z_StatsResetPeaks (void);
+
+const char *Z_TagName (int tag);
+zonestat_t Z_TagStats (int tag);
+std::vector<zonesite_t> Z_SiteStats (void);
+void    Z_WriteStatsJSON (FILE *f);
+
+}
+
+#endif
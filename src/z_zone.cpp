@@ -18,10 +18,13 @@
 
 #include <string.h>
 
+#include <mutex>
+
 #include "doomtype.h"
 #include "i_system.h"
 #include "m_argv.h"
 
+#include "z_stats.h"
 #include "z_zone.h"
 
 
@@ -45,6 +48,7 @@ namespace theta
 typedef struct memblock_s
 {
     int			size;	// including the header and possibly tiny fragments
+    int			site;	// where it was allocated, for z_stats
     void**		user;
     int			tag;	// PU_FREE if this is free
     int			id;	// should be ZONEID
@@ -71,6 +75,11 @@ static memzone_t *mainzone;
 static boolean zero_on_free;
 static boolean scan_on_free;
 
+// Held by every entry point, since blocks may be allocated and freed
+// from any thread.  Recursive because Z_Malloc and Z_FreeTags free
+// blocks through Z_Free.
+static std::recursive_mutex zone_mutex;
+
 
 //
 // Z_ClearZone
@@ -180,6 +189,7 @@ static void ScanForBlock(void *start, void *end)
 //
 void Z_Free (void* ptr)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*		block;
     memblock_t*		other;
 
@@ -194,6 +204,8 @@ void Z_Free (void* ptr)
 	    *block->user = 0;
     }
 
+    Z_StatsFree(block->site, block->tag, block->size - sizeof(memblock_t));
+
     // mark as free
     block->tag = PU_FREE;
     block->user = NULL;
@@ -249,11 +261,14 @@ void Z_Free (void* ptr)
 
 
 void*
-Z_Malloc
+Z_Malloc2
 ( int		size,
   int		tag,
-  void*		user )
+  void*		user,
+  const char*	file,
+  int		line )
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     int		extra;
     memblock_t*	start;
     memblock_t* rover;
@@ -340,6 +355,7 @@ Z_Malloc
 
     base->user = static_cast<void**>(user);
     base->tag = tag;
+    base->site = Z_StatsAlloc(tag, base->size - sizeof(memblock_t), file, line);
 
     result  = (void *) ((byte *)base + sizeof(memblock_t));
 
@@ -366,6 +382,7 @@ Z_FreeTags
 ( int		lowtag,
   int		hightag )
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*	block;
     memblock_t*	next;
 	
@@ -396,6 +413,7 @@ Z_DumpHeap
 ( int		lowtag,
   int		hightag )
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*	block;
 	
     printf ("zone size: %i  location: %p\n",
@@ -433,6 +451,7 @@ Z_DumpHeap
 //
 void Z_FileDumpHeap (FILE* f)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*	block;
 	
     fprintf (f,"zone size: %i  location: %p\n",mainzone->size,mainzone);
@@ -466,6 +485,7 @@ void Z_FileDumpHeap (FILE* f)
 //
 void Z_CheckHeap (void)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*	block;
 	
     for (block = mainzone->blocklist.next ; ; block = block->next)
@@ -495,6 +515,7 @@ void Z_CheckHeap (void)
 //
 void Z_ChangeTag2(void *ptr, int tag, const char *file, int line)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*	block;
 	
     block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
@@ -507,11 +528,14 @@ void Z_ChangeTag2(void *ptr, int tag, const char *file, int line)
         I_Error("%s:%i: Z_ChangeTag: an owner is required "
                 "for purgable blocks", file, line);
 
+    Z_StatsChangeTag(block->site, block->tag, tag,
+                     block->size - sizeof(memblock_t));
     block->tag = tag;
 }
 
 void Z_ChangeUser(void *ptr, void **user)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*	block;
 
     block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
@@ -532,6 +556,7 @@ void Z_ChangeUser(void *ptr, void **user)
 //
 int Z_FreeMemory (void)
 {
+    std::lock_guard<std::recursive_mutex> lock(zone_mutex);
     memblock_t*		block;
     int			free;
 	